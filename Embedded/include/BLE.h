@@ -2,30 +2,194 @@
 #define BLE_H
 
 #include "NimBLEDevice.h"
-#include <vector>
+#include <atomic>
+#include "SpscRing.h"
+#include "BadgeAdvertisement.h"
+#include "PeerTable.h"
+#include "Outbox.h"
 
-class BLE : public NimBLEScanCallbacks {
+// Optional always-on neighbor discovery at a low duty cycle while assigned.
+// Radio-on share is roughly SCAN_WINDOW / SCAN_INTERVAL; trade it against pairing latency.
+#ifndef BLE_BACKGROUND_MODE
+#define BLE_BACKGROUND_MODE 0
+#endif
+#ifndef BLE_BACKGROUND_SCAN_WINDOW_MS
+#define BLE_BACKGROUND_SCAN_WINDOW_MS 30
+#endif
+#ifndef BLE_BACKGROUND_SCAN_INTERVAL_MS
+#define BLE_BACKGROUND_SCAN_INTERVAL_MS 300
+#endif
+#ifndef BLE_BACKGROUND_ADV_INTERVAL_MS
+#define BLE_BACKGROUND_ADV_INTERVAL_MS 250
+#endif
+
+// Calibrated RSSI measured 1 m from this badge, carried in the advertisement.
+// Partners are accepted up to BLE_MAX_PARTNER_DISTANCE_CM under the log-distance model.
+#ifndef BLE_TX_POWER_1M
+#define BLE_TX_POWER_1M -59
+#endif
+#ifndef BLE_PATH_LOSS_EXPONENT
+#define BLE_PATH_LOSS_EXPONENT 2.0f
+#endif
+#ifndef BLE_MAX_PARTNER_DISTANCE_CM
+#define BLE_MAX_PARTNER_DISTANCE_CM 150
+#endif
+
+// Controller-level duplicate filtering while in background mode. The filter cache is
+// reset every epoch so each neighbor still contributes about one RSSI sample per epoch.
+#ifndef BLE_CONTROLLER_DEDUP
+#define BLE_CONTROLLER_DEDUP 1
+#endif
+#ifndef BLE_DEDUP_EPOCH_MS
+#define BLE_DEDUP_EPOCH_MS 1000
+#endif
+
+#ifndef BLE_CLAIM_TASK_STACK
+#define BLE_CLAIM_TASK_STACK 4096
+#endif
+
+// Scan callback counters, written on the NimBLE host task
+struct ScanStats {
+    uint32_t callbacks;
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t dropped;
+    uint32_t callbackUs;
+};
+
+// One accepted advertisement, handed from the NimBLE host task to the main loop
+struct ScanRecord {
+    uint32_t ticketId;
+    int8_t rssi;
+    int8_t txPower;
+    uint32_t timestamp;
+    uint8_t sketchSeq;
+    int8_t sketch[MOTION_SKETCH_LENGTH];
+    uint8_t address[6];
+    uint8_t addressType;
+};
+
+// Badge-to-badge GATT exchange used when MQTT is unavailable
+#define BADGE_SERVICE_UUID "6e2a0001-5c1b-4e8e-9a43-ec0000000001"
+#define BADGE_CLAIM_UUID   "6e2a0002-5c1b-4e8e-9a43-ec0000000001"
+
+// Progress of the claim handed to the partner, written by the claim task
+enum ClaimExchangeState : uint8_t {
+    CLAIM_IDLE,
+    CLAIM_SENDING,
+    CLAIM_DELIVERED,
+    CLAIM_FAILED
+};
+
+class BLE : public NimBLEScanCallbacks, public NimBLECharacteristicCallbacks {
 private:
-    std::vector<std::vector<String>> _incomingPackets;
-    String _ticketId;
-    String _eventId;
+    static const size_t _SCAN_QUEUE_SIZE = 64;
+    SpscRing<ScanRecord, _SCAN_QUEUE_SIZE> _incomingPackets;
+    PeerTable _peers;
+    std::atomic<uint32_t> _ticketId{0};     // onWrite reads it on the NimBLE host task
+    uint16_t _eventId = 0;
+    uint32_t _identifier;
+    uint8_t _sketchSeq = 0;
+    int8_t _sketch[MOTION_SKETCH_LENGTH] = {0};
     String _detectedTicket;
-    String _identifier;
-    static const int _RSSI_THRESHOLD = -65;
+    BadgeAdvertisement _expectedHeader;
+    float _maxPathLoss;
+    bool inRange(const PeerStats* peer);
+
+    // Foreground collection runs the radio flat out; background uses the duty cycle above
+    static const uint16_t _FOREGROUND_SCAN_MS = 100;
+    static const uint16_t _FOREGROUND_ADV_INTERVAL_MS = 30;
+    bool _background = false;
+    bool _advertising = false;
+    bool _scanning = false;
+    uint16_t _backgroundScanWindowMs = BLE_BACKGROUND_SCAN_WINDOW_MS;
+    uint16_t _backgroundScanIntervalMs = BLE_BACKGROUND_SCAN_INTERVAL_MS;
+    uint16_t _backgroundAdvIntervalMs = BLE_BACKGROUND_ADV_INTERVAL_MS;
+
+    // The host stack is brought up once; the advertisement is rebuilt only when its contents change
+    bool _initialized = false;
+    NimBLEAdvertisementData _advData;
+    void _buildAdvertisement();
+
+    // Handshake-to-radio latency instrumentation, in microseconds. onResult reads the
+    // handshake time on the NimBLE host task.
+    std::atomic<unsigned long> _handshakeUs{0};
+    unsigned long _advLatencyUs = 0;
+    std::atomic<unsigned long> _firstResultLatencyUs{0};
+    void _markAdvOnAir();
+
+    // Claims written to us by peers, handed from the NimBLE host task to the main loop
+    SpscRing<HandshakeClaim, 8> _receivedClaims;
+    static const uint32_t _CONNECT_TIMEOUT_MS = 800;
+
+    // The connect, discovery and write for our own claim run on their own task so loop() never
+    // waits on the partner. The main loop fills the request before notifying the task and
+    // leaves it alone until the state leaves CLAIM_SENDING.
+    std::atomic<ClaimExchangeState> _claimState{CLAIM_IDLE};
+    TaskHandle_t _claimTask = nullptr;
+    uint8_t _claimAddress[6];
+    uint8_t _claimAddressType = 0;
+    HandshakeClaim _claimOut;
+    bool _resumeScanAfterClaim = false;
+    static void _claimTaskLoop(void* arg);
+    bool _sendClaim();
+
+    std::atomic<uint32_t> _callbacks{0};
+    std::atomic<uint32_t> _accepted{0};
+    std::atomic<uint32_t> _callbackUs{0};
+    unsigned long _dedupEpochStart = 0;
 
 public:
     BLE();
 
+    void begin();
+
     void setTicketId(String ticketID);
     void setEventId(String eventID);
     void advertise();
     void scan();
     void onResult(const NimBLEAdvertisedDevice* advertisedDevice) override;
+    void onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) override;
+
+    /**
+     * @brief Hand our claim to the partner over a short GATT connection without blocking
+     *
+     * Scanning pauses while the connection is up and resumes from pollClaimExchange().
+     * @return false if an exchange is already in flight or the claim task could not start
+     */
+    bool startClaimExchange(const PeerStats& partner, const HandshakeClaim& claim);
+
+    /**
+     * @brief Finish an exchange the claim task completed; call every loop()
+     *
+     * @return CLAIM_DELIVERED or CLAIM_FAILED once per exchange, else CLAIM_IDLE or CLAIM_SENDING
+     */
+    ClaimExchangeState pollClaimExchange();
+    bool receivedClaim(HandshakeClaim& claim);
     String getDetectedTicket();
     void stopAdvertising();
     void stopScanning();
-    std::vector<std::vector<String>> getIncomingPackets();
+    const ScanRecord* peekPacket();
+    void popPacket();
+    void collectPackets();
+    const PeerStats* bestPeer(uint16_t minSamples, uint32_t maxAge = UINT32_MAX);
+    const PeerStats* dominantPeer(uint16_t minSamples, int margin, uint32_t maxAge, int* leadOut = nullptr);
+    const PeerStats* soleCandidate(uint16_t minSamples, uint32_t maxAge);
+    bool hasCandidates(uint32_t maxAge);
+    float distanceTo(const PeerStats* peer);
+    void setMotionSketch(const int8_t* sketch);
+    int motionMatch(const PeerStats* peer, const int8_t* history, uint32_t maxAge);
+    void clearPeers();
+    void expirePeers(uint32_t maxAge);
+    void setBackgroundDutyCycle(uint16_t scanWindowMs, uint16_t scanIntervalMs, uint16_t advIntervalMs);
+    void setBackground(bool background);
+    bool isBackground();
     void setTicket(String ticket);
+    void refreshDuplicateFilter();
+    ScanStats getScanStats();
+    void markHandshake();
+    unsigned long getAdvLatency();
+    unsigned long getFirstResultLatency();
     String getRSSI(const NimBLEAdvertisedDevice* device);
 };
 
@@ -0,0 +1,123 @@
+#ifndef BADGE_ADVERTISEMENT_H
+#define BADGE_ADVERTISEMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MotionSignature.h"
+
+/**
+ * @brief Fixed-layout manufacturer-specific AD structure broadcast by every badge.
+ *
+ * The structure is the first (and only) AD element in the advertisement, so a
+ * receiver can reject foreign packets with a single memcmp at offset 0 before
+ * touching anything else. Multi-byte fields are little-endian.
+ */
+struct __attribute__((packed)) BadgeAdvertisement {
+    uint8_t length;         // AD length, excluding this byte
+    uint8_t type;           // 0xFF, manufacturer specific data
+    uint16_t companyId;
+    uint8_t version;
+    uint32_t identifier;    // hash of BLE_IDENTIFIER
+    uint16_t eventId;       // numeric part of "E_xx"
+    uint32_t ticketId;      // numeric part of "T_xxxxxx"
+    int8_t txPower;         // calibrated RSSI at 1 m, for the receiver's distance estimate
+    uint8_t sketchSeq;      // bumped on every new handshake sketch, 0 = none yet
+    int8_t sketch[MOTION_SKETCH_LENGTH];
+};
+
+static const uint8_t BADGE_AD_TYPE = 0xFF;
+static const uint16_t BADGE_COMPANY_ID = 0xFFFF;   // Bluetooth SIG id reserved for testing
+static const uint8_t BADGE_ADV_VERSION = 3;
+
+// Bytes compared with memcmp to accept a packet: everything up to and including the event id
+static const size_t BADGE_ADV_MATCH_LENGTH = offsetof(BadgeAdvertisement, ticketId);
+
+/**
+ * @brief FNV-1a hash of the alphanumeric BLE identifier, used as the binary identifier
+ */
+inline uint32_t badgeIdentifierHash(const char* identifier) {
+    uint32_t hash = 2166136261u;
+    for (; *identifier; identifier++) {
+        hash ^= (uint8_t)*identifier;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Parse the numeric part of an id such as "E_01" or "T_000123"
+ */
+inline uint32_t parseBadgeNumber(const char* id) {
+    const char* underscore = strrchr(id, '_');
+    return (uint32_t)strtoul(underscore ? underscore + 1 : id, nullptr, 10);
+}
+
+/**
+ * @brief Format a numeric ticket id back into the "T_xxxxxx" form used on MQTT
+ */
+inline void formatTicketId(uint32_t ticketId, char* out, size_t outSize) {
+    snprintf(out, outSize, "T_%06lu", (unsigned long)ticketId);
+}
+
+/**
+ * @brief Whether a ticket id survives parseBadgeNumber and formatTicketId unchanged
+ *
+ * Badges advertise, and backends confirm, the numeric form only. Any other spelling would
+ * come back as a different ticket, or as 0, which PeerTable treats as an empty slot.
+ *
+ * @param id Not necessarily NUL-terminated, e.g. an MQTT payload
+ */
+inline bool isTicketId(const char* id, size_t length) {
+    char copy[16];
+    char canonical[16];
+    if (length == 0 || length >= sizeof(copy)) {
+        return false;
+    }
+    memcpy(copy, id, length);
+    copy[length] = '\0';
+    uint32_t ticketId = parseBadgeNumber(copy);
+    formatTicketId(ticketId, canonical, sizeof(canonical));
+    return ticketId != 0 && strcmp(copy, canonical) == 0;
+}
+
+/**
+ * @brief Parse an event id of the form "E_xx" into the 16 bits the advertisement carries
+ *
+ * @return false, leaving eventId alone, unless id is "E_" and 1 to 5 digits no larger than 65535
+ */
+inline bool parseEventId(const char* id, uint16_t& eventId) {
+    if (strncmp(id, "E_", 2) != 0) {
+        return false;
+    }
+    size_t digits = strspn(id + 2, "0123456789");
+    if (digits == 0 || digits > 5 || id[2 + digits] != '\0') {
+        return false;
+    }
+    unsigned long number = strtoul(id + 2, nullptr, 10);
+    if (number > UINT16_MAX) {
+        return false;
+    }
+    eventId = (uint16_t)number;
+    return true;
+}
+
+/**
+ * @brief Fill in the advertisement for this badge
+ */
+inline void buildBadgeAdvertisement(BadgeAdvertisement& adv, uint32_t identifier, uint16_t eventId, uint32_t ticketId, int8_t txPower = 0) {
+    adv.length = sizeof(BadgeAdvertisement) - 1;
+    adv.type = BADGE_AD_TYPE;
+    adv.companyId = BADGE_COMPANY_ID;
+    adv.version = BADGE_ADV_VERSION;
+    adv.identifier = identifier;
+    adv.eventId = eventId;
+    adv.ticketId = ticketId;
+    adv.txPower = txPower;
+    adv.sketchSeq = 0;
+    memset(adv.sketch, 0, sizeof(adv.sketch));
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef BADGE_MESSAGE_H
+#define BADGE_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fixed-schema binary form of the badge's MQTT payloads, the compact
+ * alternative to JSON once the backend has negotiated it.
+ *
+ * Every message starts with BADGE_MESSAGE_VERSION and a type byte. The version
+ * byte is never '{' or '[', so a backend can tell binary from JSON on the same
+ * topic. Integers are little-endian; text is a length byte followed by up to
+ * 255 bytes, no terminator. Ticket ids travel as the number after "T_".
+ *
+ *   availability  text eventId, text deviceId, u8 available
+ *   receipt       u8 count, count x (text command, text status)
+ *   profile swap  text eventId, u32 ticket, u32 partner, u8 flags
+ *                 [u32 timestamp, u32 nonce if flags & BADGE_SWAP_HAS_CLAIM]
+ *   telemetry     u8 count, count x (u8 id, u32 value)
+ *   link health   u8 count, count x (u8 id, u32 value),
+ *                 u8 histograms, histograms x (u8 id, u8 buckets, buckets x u16 count)
+ */
+static const uint8_t BADGE_MESSAGE_VERSION = 0xB1;
+static const uint8_t BADGE_MESSAGE_MAX_RECEIPTS = 8;
+static const uint8_t BADGE_MESSAGE_MAX_COUNTERS = 32;
+static const uint8_t BADGE_MESSAGE_MAX_HISTOGRAMS = 4;
+static const uint8_t BADGE_MESSAGE_MAX_BUCKETS = 8;
+static const uint8_t BADGE_SWAP_HAS_CLAIM = 0x01;
+
+enum BadgeMessageType : uint8_t {
+    BADGE_MSG_AVAILABILITY = 1,
+    BADGE_MSG_RECEIPT = 2,
+    BADGE_MSG_PROFILE_SWAP = 3,
+    BADGE_MSG_TELEMETRY = 4,
+    BADGE_MSG_LINK_HEALTH = 5
+};
+
+// Text decoded in place: points into the received buffer and is not NUL-terminated
+struct BadgeText {
+    const char* data;
+    uint8_t length;
+};
+
+struct BadgeReceipt {
+    BadgeText command;
+    BadgeText status;
+};
+
+struct BadgeCounter {
+    uint8_t id;
+    uint32_t value;
+};
+
+struct BadgeHistogram {
+    uint8_t id;
+    uint8_t buckets;
+    uint16_t counts[BADGE_MESSAGE_MAX_BUCKETS];
+};
+
+struct BadgeMessage {
+    BadgeMessageType type;
+    BadgeText eventId;
+    BadgeText deviceId;
+    bool available;
+    uint32_t ticketId;
+    uint32_t partnerTicketId;
+    uint8_t flags;
+    uint32_t timestamp;
+    uint32_t nonce;
+    uint8_t count;          // receipts or counters used
+    BadgeReceipt receipts[BADGE_MESSAGE_MAX_RECEIPTS];
+    BadgeCounter counters[BADGE_MESSAGE_MAX_COUNTERS];
+    uint8_t histogramCount;
+    BadgeHistogram histograms[BADGE_MESSAGE_MAX_HISTOGRAMS];
+};
+
+// Encoders write into a caller-owned buffer and return the encoded length, or 0 if it did not fit
+
+size_t encodeAvailability(uint8_t* out, size_t capacity, const char* eventId, const char* deviceId, bool available);
+size_t encodeReceipt(uint8_t* out, size_t capacity, const char* command, const char* status);
+size_t encodeProfileSwap(uint8_t* out, size_t capacity, const char* eventId, uint32_t ticketId, uint32_t partnerTicketId);
+size_t encodeProfileSwapClaim(uint8_t* out, size_t capacity, const char* eventId, uint32_t ticketId, uint32_t partnerTicketId,
+                              uint32_t timestamp, uint32_t nonce);
+size_t encodeTelemetry(uint8_t* out, size_t capacity, const BadgeCounter* counters, uint8_t count);
+size_t encodeLinkHealth(uint8_t* out, size_t capacity, const BadgeCounter* counters, uint8_t count,
+                        const BadgeHistogram* histograms, uint8_t histogramCount);
+
+/**
+ * @brief Append the receipts of one encoded receipt message to another, for batching
+ *
+ * @return The new batch length, or 0 if either message is invalid or the result does not fit
+ */
+size_t mergeReceipts(uint8_t* batch, size_t batchLength, size_t capacity, const uint8_t* receipt, size_t receiptLength);
+
+/**
+ * @brief Validate and decode one message. Safe on arbitrary input; never reads past length.
+ *
+ * @return false on any truncation, unknown type or version, oversized count, or trailing bytes
+ */
+bool decodeBadgeMessage(const uint8_t* data, size_t length, BadgeMessage& out);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef BADGE_PUBLISHER_H
+#define BADGE_PUBLISHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Mqtt5Client.h"
+#include "PublishQueue.h"
+#include "TopicRouter.h"
+
+// Stack buffers for outgoing topics and JSON payloads; publishes never touch the heap
+#ifndef MQTT_TOPIC_SIZE
+#define MQTT_TOPIC_SIZE 128
+#endif
+#ifndef MQTT_PAYLOAD_SIZE
+#define MQTT_PAYLOAD_SIZE 256
+#endif
+
+// Outbound drain rate and how many queued receipts may share one publish. Binary receipts carry a
+// count and are always batched; JSON receipts only once the backend turns on device/<id>/receipt_batch
+#ifndef MQTT_DRAIN_BURST
+#define MQTT_DRAIN_BURST 2
+#endif
+#ifndef MQTT_DRAIN_INTERVAL_MS
+#define MQTT_DRAIN_INTERVAL_MS 100
+#endif
+#ifndef MQTT_RECEIPT_BATCH
+#define MQTT_RECEIPT_BATCH 4
+#endif
+
+// Start in the compact BadgeMessage encoding instead of JSON; the backend can switch either way at runtime
+#ifndef MQTT_BINARY_PAYLOADS
+#define MQTT_BINARY_PAYLOADS 0
+#endif
+
+/**
+ * @brief The badge's queued publishes: encodes them as JSON or BadgeMessage, keeps them across
+ *        disconnects, and drains them into an Mqtt5Client at a paced rate with receipt batching.
+ *
+ * No Arduino dependencies, so tools/fleet_load.cpp runs the firmware's exact payloads, batching
+ * and pacing for every virtual badge. Main loop only.
+ */
+class BadgePublisher {
+private:
+    PublishQueue _queue;
+    bool _binary = MQTT_BINARY_PAYLOADS;
+    bool _batchJsonReceipts = false;    // a JSON array on the receipt topic, negotiated like the encoding
+    uint8_t _receiptBatch = MQTT_RECEIPT_BATCH;
+    uint16_t _burst = MQTT_DRAIN_BURST;
+    uint16_t _intervalMs = MQTT_DRAIN_INTERVAL_MS;
+
+public:
+    /**
+     * @brief Queue event/<eventId>/available_devices/<deviceId>
+     *
+     * @return false if the queue is full
+     */
+    bool availability(const char* eventId, const char* deviceId);
+
+    /**
+     * @brief Queue a receipt on device/<deviceId>/receipt; consecutive receipts may share a publish
+     */
+    bool receipt(const char* command, const char* status);
+
+    /**
+     * @brief Queue our handshake claim on event/<eventId>/profile_swap
+     */
+    bool profileSwap(const char* eventId, const char* ticketId, const char* partnerTicketId);
+
+    /**
+     * @brief Apply device/<id>/encoding or device/<id>/receipt_batch and queue the receipt that
+     *        answers it; other routes are ignored
+     *
+     * @return false if the answer could not be queued
+     */
+    bool negotiate(TopicRoute route, const uint8_t* payload, size_t length);
+
+    /**
+     * @brief Hand up to maxPublishes MQTT messages to the client, stopping early when it has no room
+     *
+     * @param deviceId The id in the device/ and available_devices/ topics
+     * @return Messages dropped because their topic did not fit MQTT_TOPIC_SIZE
+     */
+    uint16_t drain(Mqtt5Client& client, const TopicRouter& router, const char* deviceId, uint16_t maxPublishes, uint8_t qos);
+
+    /**
+     * @brief Publishes per drain() and the pause between drains, and the receipt batch size
+     */
+    void setDrainRate(uint16_t publishesPerInterval, uint16_t intervalMs, uint8_t receiptBatch = MQTT_RECEIPT_BATCH);
+    uint16_t burst() const;
+    uint16_t intervalMs() const;
+
+    // Already queued messages keep the encoding they were built with
+    void setBinary(bool binary);
+    bool binary() const;
+    void setJsonReceiptBatching(bool batch);
+    bool jsonReceiptBatching() const;
+
+    uint16_t size() const;
+    PublishStats stats() const;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SpscRing.h"
+
+// Inbound commands waiting for loop(); a power of two
+#ifndef COMMAND_QUEUE_SIZE
+#define COMMAND_QUEUE_SIZE 8
+#endif
+#ifndef COMMAND_TEXT_SIZE
+#define COMMAND_TEXT_SIZE 24
+#endif
+
+// Inbound MQTT commands the main loop acts on
+enum CommandType : uint8_t {
+    COMMAND_ASSIGNMENT,     // text is the assigned ticket
+    COMMAND_REASSIGNMENT,   // text is the new ticket
+    COMMAND_RESET_NFC,
+    COMMAND_PROFILE_SWAP,   // text is the confirmation payload, the partner's ticket
+    COMMAND_REBOOT,
+    COMMAND_TYPE_COUNT
+};
+
+struct InboundCommand {
+    CommandType type;
+    uint32_t arrivedUs;             // when the message was routed, for command-to-action latency
+    char text[COMMAND_TEXT_SIZE];   // NUL-terminated, truncated to fit
+};
+
+// Time from arrival to handled() for one command type
+struct CommandLatency {
+    uint32_t handled;
+    uint32_t lastUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+};
+
+/**
+ * @brief Bounded FIFO of typed inbound commands between the MQTT callback and loop().
+ *
+ * Every message is its own entry, so two swap confirmations in one loop pass give two
+ * buzzes and nothing has to be reset by the consumer. When the ring is full new commands
+ * are dropped and counted.
+ */
+class CommandQueue {
+private:
+    SpscRing<InboundCommand, COMMAND_QUEUE_SIZE> _ring;
+    CommandLatency _latency[COMMAND_TYPE_COUNT] = {};
+
+public:
+    /**
+     * @brief Producer side: copy a command and its payload text
+     *
+     * @return false if the queue is full and the command was dropped
+     */
+    bool push(CommandType type, const char* text, size_t length, uint32_t nowUs);
+
+    /**
+     * @brief Consumer side: take the oldest command
+     */
+    bool pop(InboundCommand& command);
+
+    /**
+     * @brief Record that the consumer finished acting on a command
+     *
+     * @return Microseconds from arrival to now
+     */
+    uint32_t handled(const InboundCommand& command, uint32_t nowUs);
+
+    CommandLatency latency(CommandType type) const;
+    size_t size() const;
+    size_t dropped() const;
+};
+
+const char* commandName(CommandType type);
+
+#endif
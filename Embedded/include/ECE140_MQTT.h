@@ -4,7 +4,75 @@
 #include <WiFi.h>
 #include <Arduino.h>
 #include <WiFiClientSecure.h>
-#include <PubSubClient.h>
+#include <atomic>
+#include "Mqtt5Client.h"
+#include "WiFiTransport.h"
+#include "JsonWriter.h"
+#include "TopicRouter.h"
+#include "BadgePublisher.h"
+#include "BadgeMessage.h"
+#include "CommandQueue.h"
+#include "LinkHealth.h"
+
+// Reconnect backoff: the wait doubles per failed attempt up to the cap, with jitter
+#ifndef MQTT_BACKOFF_MIN_MS
+#define MQTT_BACKOFF_MIN_MS 1000
+#endif
+#ifndef MQTT_BACKOFF_MAX_MS
+#define MQTT_BACKOFF_MAX_MS 60000
+#endif
+
+// Persistent session (clean start off) with QoS 1 subscriptions, so commands and swap
+// confirmations sent while the badge is offline are delivered when it reconnects.
+// The broker drops the session once the badge has been gone for MQTT_SESSION_EXPIRY_S.
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION 1
+#endif
+#ifndef MQTT_SESSION_EXPIRY_S
+#define MQTT_SESSION_EXPIRY_S 3600
+#endif
+#ifndef MQTT_SUBSCRIBE_QOS
+#define MQTT_SUBSCRIBE_QOS (MQTT_PERSISTENT_SESSION ? 1 : 0)
+#endif
+// Queued publishes wait for PUBACK, within the broker's Receive Maximum, and are resent after a reconnect
+#ifndef MQTT_PUBLISH_QOS
+#define MQTT_PUBLISH_QOS 1
+#endif
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S 15
+#endif
+// Upper bound on flush() waiting for the socket to take everything queued
+#ifndef MQTT_FLUSH_TIMEOUT_MS
+#define MQTT_FLUSH_TIMEOUT_MS 500
+#endif
+
+// Link health report on device/<clientId>/health every MQTT_HEALTH_INTERVAL_MS (0 turns it off),
+// with an extra PINGREQ every MQTT_HEALTH_PROBE_MS to sample round-trip time (0 leaves only keepalive pings)
+#ifndef MQTT_HEALTH_INTERVAL_MS
+#define MQTT_HEALTH_INTERVAL_MS 60000
+#endif
+#ifndef MQTT_HEALTH_PROBE_MS
+#define MQTT_HEALTH_PROBE_MS 10000
+#endif
+// Worst-case JSON report, every counter and command type at its maximum, is 830 bytes; one that
+// does not fit is never sent, and its interval never ends
+#ifndef MQTT_HEALTH_PAYLOAD_SIZE
+#define MQTT_HEALTH_PAYLOAD_SIZE 896
+#endif
+
+#ifndef MQTT_CONNECT_TASK_STACK
+#define MQTT_CONNECT_TASK_STACK 8192
+#endif
+
+// Connection state, shared between loop() and the connect task
+enum MqttLinkState : uint8_t {
+    MQTT_LINK_IDLE,                 // connectToBroker() not called yet
+    MQTT_LINK_WAITING,              // backing off before the next attempt
+    MQTT_LINK_CONNECTING,           // connect task owns the client
+    MQTT_LINK_CONNECT_FAILED,       // connect task finished, loop() schedules the retry
+    MQTT_LINK_CONNECT_SUCCEEDED,    // connect task finished, loop() resubscribes
+    MQTT_LINK_CONNECTED
+};
 
 class ECE140_MQTT {
 private:
@@ -14,10 +82,47 @@ private:
     String _eventId;
     String _ticketId;
     WiFiClientSecure _wifiClient;
-    PubSubClient* _mqttClient;
-    bool _ticketReset = false;
-    bool _nfcReset = false;
-    bool _profileSwap = false;
+    WiFiTransport _transport{_wifiClient};
+    Mqtt5Client _client;
+    TopicRouter _router;
+    CommandQueue _commands;
+
+    // The blocking TLS connect and CONNACK wait run on their own task so loop() never stalls while the broker is down
+    std::atomic<MqttLinkState> _state{MQTT_LINK_IDLE};
+    TaskHandle_t _connectTask = nullptr;
+    unsigned long _nextAttemptMs = 0;
+    uint8_t _backoffStep = 0;
+    uint32_t _reconnectAttempts = 0;
+    bool _disconnected = false;
+    unsigned long _disconnectedSinceMs = 0;
+    unsigned long _disconnectedMs = 0;
+    unsigned long _lastConnectMs = 0;
+
+    // Link metrics; the connect task only sets _connectFailure, loop() records it
+    LinkHealth _health;
+    LinkFailure _connectFailure = LINK_FAILURE_TLS;
+    unsigned long _lastHealthMs = 0;
+    unsigned long _lastProbeMs = 0;
+
+    // Subscriptions requested so far, replayed after every reconnect
+    bool _wantDevice = false;
+    bool _wantEvent = false;
+    bool _wantProfileSwap = false;
+    String _swapTicket;             // ticket whose profile_swap topic we are subscribed to
+    bool _swapTopicStale = false;
+
+    // Outgoing messages wait here until the connection can take them
+    BadgePublisher _outbound;
+    unsigned long _lastDrainMs = 0;
+
+    bool _queued(bool queued);
+    void _drain(uint16_t maxPublishes);
+    bool _connect();
+    static void _connectTaskLoop(void* arg);
+    void _startConnect();
+    void _scheduleReconnect();
+    void _onConnected();
+    void _publishHealth();
 
 public:
     ECE140_MQTT();
@@ -25,21 +130,64 @@ public:
     bool connectToBroker(String clientID, String eventID);
     bool subscribeDevice();
     bool subscribeEvent();
-    bool publishReceipt(String command, String status);
+    bool publishReceipt(const char* command, const char* status);
     bool publishAvailability();
-    bool publishHandshake(String deviceID);
+    bool publishHandshake(const String& deviceID);
+    bool publishHandshakeClaim(const char* ticketID, const char* ticketIDToSwap, uint32_t timestamp, uint32_t nonce);
+
+    /**
+     * @brief Publish one IMU capture chunk (see ImuCapture.h) to event/<eventId>/capture/<clientId>
+     *
+     * Not queued: the caller keeps the chunk and retries when this returns false.
+     */
+    bool publishCapture(const uint8_t* chunk, size_t length);
+    bool isConnected();
+    void flush();
+    void setDrainRate(uint16_t publishesPerInterval, uint16_t intervalMs, uint8_t receiptBatch = MQTT_RECEIPT_BATCH);
+    PublishStats getPublishStats();
+    Mqtt5Stats getClientStats();
+
+    /**
+     * @brief Choose BadgeMessage (binary) or JSON payloads for messages published from now on
+     *
+     * Normally set by the backend through device/<id>/encoding.
+     */
+    void setBinaryPayloads(bool binary);
+    bool binaryPayloads();
+
+    /**
+     * @brief Let queued JSON receipts share one publish as a JSON array
+     *
+     * Off by default, since a receipt used to be a single object. Normally set by the backend
+     * through device/<id>/receipt_batch.
+     */
+    void setJsonReceiptBatching(bool batch);
+    unsigned long getLastConnectTime();
+    uint32_t getReconnectAttempts();
+    unsigned long getDisconnectedTime();
+    const LinkHealth& getLinkHealth();
     void setCallback(void (*callback)(char*, uint8_t*, unsigned int));
     void loop();
     void handleMessage(char* topic,  uint8_t* payload, unsigned int length);
     bool isAssigned();
-    bool ticketReset();
-    bool nfcReset();
-    void resetNfcFlag();
-    void resetTicketFlag();
     bool subscribeProfileSwap();
-    bool profileSwap();
-    void resetProfileSwapFlag();
     String getTicketID();
+
+    /**
+     * @brief Take the oldest inbound command (assignment, reassignment, NFC reset, profile swap, reboot)
+     *
+     * @return false if none is waiting
+     */
+    bool nextCommand(InboundCommand& command);
+
+    /**
+     * @brief Report that loop() has acted on a command, recording its arrival-to-action latency
+     *
+     * @return The latency in microseconds
+     */
+    uint32_t commandHandled(const InboundCommand& command);
+    CommandLatency getCommandLatency(CommandType type);
+    size_t getDroppedCommands();
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,15 @@
 
 #include <Arduino.h>
 #include <Adafruit_BNO055.h>
+#include "MotionSignature.h"
+
+// Field capture of IMU windows (see ImuCapture.h); compiled out unless enabled
+#ifndef IMU_CAPTURE
+#define IMU_CAPTURE 0
+#endif
+#if IMU_CAPTURE
+#include "ImuCapture.h"
+#endif
 #include "tensorflow/lite/micro/micro_interpreter.h"
 #include "tensorflow/lite/schema/schema_generated.h"
 #include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
@@ -19,6 +28,21 @@ private:
     int _current_index;              
     int _samples_collected;         
     unsigned long _last_sample_time; 
+
+    // Resampling onto the fixed 10 ms grid the models were trained on
+    static const unsigned long _GRID_INTERVAL_US = _SAMPLE_INTERVAL * 1000UL;
+    float _prev_sample[_NUM_FEATURES];
+    unsigned long _prev_sample_us;
+    unsigned long _next_grid_us;
+    bool _has_prev_sample;
+    unsigned long _synthesized_samples;
+
+    // 100 ms accel-magnitude blocks for the motion fingerprint
+    float _motion_history[MOTION_HISTORY_LENGTH];
+    int _motion_index;
+    float _motion_block_sum;
+    int _motion_block_count;
+    void motionBlocks(float* out, int count);
     unsigned long  _last_process_time;
     static const unsigned long _PROCESS_INTERVAL = 1250; 
 
@@ -30,6 +54,14 @@ private:
     TfLiteTensor* _output_tensor =  nullptr;
 
     bool _inference = false;
+
+#if IMU_CAPTURE
+    // Optional field capture, fed every grid sample
+    ImuCapture* _capture = nullptr;
+#endif
+
+    void pushSample(const float sample[_NUM_FEATURES]);
+    void resample(const float sample[_NUM_FEATURES], unsigned long sample_us);
 public:
     Handshake();
     ~Handshake();
@@ -37,6 +69,12 @@ public:
     std::vector<std::vector<float>> processData();
     void init();
     void clearBuffer();
+    unsigned long getSynthesizedSamples();
+    void motionSketch(int8_t sketch[MOTION_SKETCH_LENGTH]);
+    void motionHistory(int8_t history[MOTION_HISTORY_LENGTH]);
+#if IMU_CAPTURE
+    void setCapture(ImuCapture* capture);
+#endif
 };
 #endif
 
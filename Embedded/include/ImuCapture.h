@@ -0,0 +1,133 @@
+#ifndef IMU_CAPTURE_H
+#define IMU_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Field capture of IMU windows around detections, for growing the training set.
+// Off by default; set -D IMU_CAPTURE=1 in platformio.ini.
+#ifndef IMU_CAPTURE
+#define IMU_CAPTURE 0
+#endif
+// 200 + 100 samples at 100 Hz, the same 300-sample length as the hand-collected CSVs
+#ifndef IMU_CAPTURE_PRE_SAMPLES
+#define IMU_CAPTURE_PRE_SAMPLES 200
+#endif
+#ifndef IMU_CAPTURE_POST_SAMPLES
+#define IMU_CAPTURE_POST_SAMPLES 100
+#endif
+#ifndef IMU_CAPTURE_CHUNK_SAMPLES
+#define IMU_CAPTURE_CHUNK_SAMPLES 50
+#endif
+// A handshake prediction at or above this score, but below the detection threshold, is a near miss
+#ifndef IMU_CAPTURE_NEAR_MISS
+#define IMU_CAPTURE_NEAR_MISS 0.6f
+#endif
+#ifndef IMU_CAPTURE_MIN_INTERVAL_MS
+#define IMU_CAPTURE_MIN_INTERVAL_MS 10000
+#endif
+#ifndef IMU_CAPTURE_SEND_INTERVAL_MS
+#define IMU_CAPTURE_SEND_INTERVAL_MS 250
+#endif
+
+static const uint8_t IMU_CAPTURE_VERSION = 0xC1;
+static const uint8_t IMU_CAPTURE_CHANNELS = 6;
+static const size_t IMU_CAPTURE_SAMPLES = IMU_CAPTURE_PRE_SAMPLES + IMU_CAPTURE_POST_SAMPLES;
+static const size_t IMU_CAPTURE_HEADER_SIZE = 18;
+// Worst case chunk: every channel's deltas need 17 bits
+static const size_t IMU_CAPTURE_CHUNK_SIZE =
+    IMU_CAPTURE_HEADER_SIZE + IMU_CAPTURE_CHANNELS * (3 + (17 * (IMU_CAPTURE_CHUNK_SAMPLES - 1) + 7) / 8);
+
+// Sensor LSBs of the BNO055: linear acceleration in 0.01 m/s^2, angular rate in 1/16 dps
+static const float IMU_CAPTURE_ACCEL_SCALE = 100.0f;
+static const float IMU_CAPTURE_GYRO_SCALE = 16.0f;
+
+enum CaptureTrigger : uint8_t {
+    CAPTURE_POSITIVE = 1,       // handshake detected
+    CAPTURE_NEAR_MISS = 2       // handshake predicted below the detection threshold
+};
+
+struct CaptureStats {
+    uint32_t captured;
+    uint32_t skipped;           // triggers ignored: capture still pending, rate limit or too few samples
+    uint32_t chunksSent;
+};
+
+/**
+ * @brief Pre/post-trigger recorder for the 100 Hz IMU stream, encoded into compact MQTT chunks.
+ *
+ * record() is called for every grid sample and only stores six int16 values, so
+ * the sampler's cadence is unaffected. A trigger freezes the pre-trigger ring and
+ * keeps recording until the post-trigger samples are in. The finished capture is
+ * then sent in chunks, one per call from the main loop.
+ *
+ * Chunk layout (little-endian):
+ *   u8 version, u32 sequence, u16 capture id, u8 chunk index, u8 chunk count,
+ *   u8 trigger, u8 predicted class, u8 score (percent), u16 trigger sample,
+ *   u16 first sample, u8 sample count, u8 channels, then per channel:
+ *   i16 first value, u8 bit width, (count - 1) zigzag deltas bit-packed LSB first.
+ *
+ * The sequence number counts every chunk the badge has sent, so a receiver can
+ * tell lost chunks from lost captures.
+ */
+class ImuCapture {
+private:
+    int16_t _ring[IMU_CAPTURE_PRE_SAMPLES][IMU_CAPTURE_CHANNELS];
+    uint16_t _ringIndex = 0;
+    uint16_t _ringCount = 0;
+
+    int16_t _capture[IMU_CAPTURE_SAMPLES][IMU_CAPTURE_CHANNELS];
+    uint16_t _captured = 0;         // samples in _capture, pre-trigger included
+    bool _recording = false;        // collecting post-trigger samples
+    bool _ready = false;            // complete and waiting to be sent
+    uint8_t _nextChunk = 0;
+
+    uint16_t _captureId = 0;
+    uint32_t _sequence = 0;
+    CaptureTrigger _trigger = CAPTURE_POSITIVE;
+    uint8_t _predictedClass = 0;
+    uint8_t _score = 0;
+    uint16_t _triggerSample = 0;
+    uint32_t _lastTriggerMs = 0;
+    bool _triggered = false;
+    CaptureStats _stats = {};
+
+public:
+    /**
+     * @brief Store one resampled reading: three linear acceleration then three gyro values
+     */
+    void record(const float sample[IMU_CAPTURE_CHANNELS]);
+
+    /**
+     * @brief Start a capture around the current sample
+     *
+     * @return false if ignored: a capture is pending, the last one was too recent, or the ring is not full yet
+     */
+    bool trigger(CaptureTrigger trigger, uint8_t predictedClass, float score, uint32_t nowMs);
+
+    /**
+     * @brief True while a finished capture has chunks left to send
+     */
+    bool ready() const;
+
+    /**
+     * @brief Encode the next unsent chunk without consuming it
+     *
+     * @return The chunk length, or 0 if nothing is ready or it does not fit
+     */
+    size_t peekChunk(uint8_t* out, size_t capacity) const;
+
+    /**
+     * @brief Consume the chunk returned by peekChunk() once it was published
+     */
+    void chunkSent();
+
+    /**
+     * @brief Drop the buffered and pending samples, e.g. when the IMU window restarts
+     */
+    void clear();
+
+    CaptureStats stats() const;
+};
+
+#endif
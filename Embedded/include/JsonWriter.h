@@ -0,0 +1,173 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <initializer_list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Flat JSON object writer over a caller-owned buffer. Never allocates.
+ *
+ * Keys are string literals, so their length is a template parameter and each
+ * key is a single fixed-size copy; only values are scanned at runtime. String
+ * values are escaped. If the buffer is too small the writer stops and finish() returns
+ * nullptr instead of a truncated document.
+ *
+ *     char payload[128];
+ *     JsonWriter json(payload, sizeof(payload));
+ *     json.field("command", command).field("status", status);
+ *     const char* text = json.finish();
+ */
+class JsonWriter {
+private:
+    char* _buffer;
+    size_t _capacity;
+    size_t _length = 0;
+    bool _overflow = false;
+    bool _finished = false;
+
+    void _put(char c) {
+        if (_length + 1 >= _capacity) {
+            _overflow = true;
+            return;
+        }
+        _buffer[_length++] = c;
+    }
+
+    void _put(const char* text, size_t length) {
+        if (_length + length >= _capacity) {
+            _overflow = true;
+            return;
+        }
+        memcpy(_buffer + _length, text, length);
+        _length += length;
+    }
+
+    // ', "key": ' or '{"key": ' for the first field
+    template <size_t N>
+    void _key(const char (&key)[N]) {
+        _put(_length == 1 ? "\"" : ", \"", _length == 1 ? 1 : 3);
+        _put(key, N - 1);
+        _put("\": ", 3);
+    }
+
+    void _number(uint32_t value) {
+        char digits[10];
+        size_t count = 0;
+        do {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        while (count > 0) {
+            _put(digits[--count]);
+        }
+    }
+
+    void _escaped(const char* value) {
+        static const char HEX_DIGITS[] = "0123456789abcdef";
+        _put('"');
+        for (const char* c = value; *c != '\0' && !_overflow; c++) {
+            switch (*c) {
+                case '"':  _put("\\\"", 2); break;
+                case '\\': _put("\\\\", 2); break;
+                case '\n': _put("\\n", 2); break;
+                case '\r': _put("\\r", 2); break;
+                case '\t': _put("\\t", 2); break;
+                default:
+                    if ((uint8_t)*c < 0x20) {
+                        char escape[6] = {'\\', 'u', '0', '0', HEX_DIGITS[(*c >> 4) & 0xF], HEX_DIGITS[*c & 0xF]};
+                        _put(escape, sizeof(escape));
+                    } else {
+                        _put(*c);
+                    }
+            }
+        }
+        _put('"');
+    }
+
+public:
+    JsonWriter(char* buffer, size_t capacity) : _buffer(buffer), _capacity(capacity) {
+        _put('{');
+    }
+
+    template <size_t N>
+    JsonWriter& field(const char (&key)[N], const char* value) {
+        _key(key);
+        _escaped(value ? value : "");
+        return *this;
+    }
+
+    template <size_t N>
+    JsonWriter& field(const char (&key)[N], uint32_t value) {
+        _key(key);
+        _number(value);
+        return *this;
+    }
+
+    /**
+     * @brief A compact array of counts, e.g. histogram buckets: "key": [0,3,1]
+     */
+    template <size_t N, typename Count>
+    JsonWriter& field(const char (&key)[N], const Count* values, size_t count) {
+        _key(key);
+        _put('[');
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) {
+                _put(',');
+            }
+            _number(values[i]);
+        }
+        _put(']');
+        return *this;
+    }
+
+    template <size_t N>
+    JsonWriter& field(const char (&key)[N], bool value) {
+        _key(key);
+        _put(value ? "true" : "false", value ? 4 : 5);
+        return *this;
+    }
+
+    /**
+     * @brief Close the object and NUL-terminate
+     *
+     * @return The document, or nullptr if it did not fit
+     */
+    const char* finish() {
+        if (!_finished) {
+            _put('}');
+            _finished = true;
+        }
+        if (_overflow) {
+            return nullptr;
+        }
+        _buffer[_length] = '\0';
+        return _buffer;
+    }
+
+    size_t length() const {
+        return _length;
+    }
+};
+
+/**
+ * @brief Join topic segments into a caller-owned buffer without allocating
+ *
+ * @return The topic, or nullptr if it did not fit
+ */
+inline const char* joinTopic(char* buffer, size_t capacity, std::initializer_list<const char*> segments) {
+    size_t length = 0;
+    for (const char* segment : segments) {
+        size_t segmentLength = strlen(segment);
+        if (length + segmentLength >= capacity) {
+            return nullptr;
+        }
+        memcpy(buffer + length, segment, segmentLength);
+        length += segmentLength;
+    }
+    buffer[length] = '\0';
+    return buffer;
+}
+
+#endif
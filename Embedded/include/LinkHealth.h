@@ -0,0 +1,127 @@
+#ifndef LINK_HEALTH_H
+#define LINK_HEALTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BadgeMessage.h"
+#include "CommandQueue.h"
+#include "Mqtt5Client.h"
+
+static const uint8_t LINK_BUCKETS = 8;
+
+// Bucket upper bounds in ms; the last bucket takes everything above the last bound.
+// Fixed so that reports from every badge and firmware version can be summed.
+static const uint32_t LINK_RTT_BOUNDS_MS[LINK_BUCKETS - 1] = {20, 50, 100, 200, 500, 1000, 2000};
+static const uint32_t LINK_CONNECT_BOUNDS_MS[LINK_BUCKETS - 1] = {250, 500, 1000, 2000, 4000, 8000, 15000};
+static const uint32_t LINK_OUTAGE_BOUNDS_MS[LINK_BUCKETS - 1] = {1000, 2000, 5000, 15000, 30000, 60000, 300000};
+
+enum LinkHistogramId : uint8_t {
+    LINK_RTT,                       // PINGREQ to PINGRESP through the broker
+    LINK_CONNECT,                   // TLS handshake plus CONNACK, successful attempts only
+    LINK_OUTAGE,                    // connection lost to connection back, i.e. reconnect duration
+    LINK_HISTOGRAM_COUNT
+};
+
+// Ids of the counters in the binary report; the JSON report uses the names in LinkHealth.cpp
+enum LinkCounterId : uint8_t {
+    LINK_SECONDS,                   // length of the interval the report covers
+    LINK_RTT_MAX_MS,
+    LINK_LOST_WIFI,                 // connection lost while WiFi was down
+    LINK_LOST_KEEPALIVE,            // WiFi up but the broker stopped answering: keepalive misses
+    LINK_LOST_NETWORK,              // socket or TLS session closed under us
+    LINK_LOST_BROKER,               // broker sent DISCONNECT or the session broke protocol
+    LINK_FAILED_WIFI,               // connect attempts made while WiFi was down
+    LINK_FAILED_TLS,                // TCP or TLS handshake failed
+    LINK_FAILED_BROKER,             // TLS up, but CONNACK refused or never came
+    LINK_PUBLISH_FAILURES,          // outbound queue full, or an outbox claim or this report refused
+    LINK_BYTES_IN,
+    LINK_BYTES_OUT,
+    LINK_PUBLISH_REJECTED,          // PUBACK with a failure reason: the broker refused a queued message
+    LINK_COUNTER_COUNT
+};
+
+// Command-to-action latency per CommandType, as binary counters LINK_COMMAND_COUNTERS + type * 3 + field;
+// kept clear of the ids above so that list can grow
+static const uint8_t LINK_COMMAND_COUNTERS = 32;
+enum LinkCommandField : uint8_t {
+    LINK_COMMAND_HANDLED,
+    LINK_COMMAND_MAX_US,
+    LINK_COMMAND_MEAN_US,
+    LINK_COMMAND_FIELD_COUNT
+};
+
+enum LinkFailure : uint8_t {
+    LINK_FAILURE_WIFI,
+    LINK_FAILURE_TLS,
+    LINK_FAILURE_BROKER
+};
+
+/**
+ * @brief Fixed-bucket histograms and counters describing the MQTT link, reported periodically.
+ *
+ * Everything is a counter increment or a walk over seven bounds, so it stays on in production.
+ * Counts cover the interval since the last reset(); histogram buckets saturate at 65535.
+ * Main loop only.
+ */
+class LinkHealth {
+private:
+    uint16_t _histograms[LINK_HISTOGRAM_COUNT][LINK_BUCKETS] = {};
+    uint32_t _counters[LINK_COUNTER_COUNT] = {};
+    CommandLatency _commands[COMMAND_TYPE_COUNT] = {};
+    uint32_t _startMs = 0;
+    uint32_t _pingsSeen = 0;
+    uint32_t _bytesInMark = 0;
+    uint32_t _bytesOutMark = 0;
+    uint32_t _rejectedMark = 0;
+
+    void _record(LinkHistogramId id, const uint32_t* bounds, uint32_t valueMs);
+    void _snapshot(uint32_t nowMs, const Mqtt5Stats& stats, uint32_t* counters) const;
+
+public:
+    /**
+     * @brief Pick up a ping answered since the last call; cheap enough for every loop()
+     */
+    void sample(const Mqtt5Stats& stats);
+    void connected(uint32_t connectMs);
+    void reconnected(uint32_t outageMs);
+    void connectFailed(LinkFailure failure);
+
+    /**
+     * @param reason Mqtt5Client::reason() after poll() failed
+     * @param wifiUp Whether WiFi was still associated at that moment
+     */
+    void connectionLost(uint8_t reason, bool wifiUp);
+    void publishFailed();
+
+    /**
+     * @param elapsedUs What CommandQueue::handled() returned for it
+     */
+    void commandHandled(CommandType type, uint32_t elapsedUs);
+
+    uint16_t bucket(LinkHistogramId id, uint8_t index) const;
+    uint32_t counter(LinkCounterId id) const;
+    CommandLatency command(CommandType type) const;
+
+    /**
+     * @brief Encode the report as a BadgeMessage link health message
+     *
+     * @return The length, or 0 if it did not fit
+     */
+    size_t encodeBinary(uint8_t* out, size_t capacity, uint32_t nowMs, const Mqtt5Stats& stats) const;
+
+    /**
+     * @brief Write the report as one flat JSON object with the histograms as arrays, and each
+     *        command type seen as "command_<type>": [handled, max_us, mean_us]; zero counters,
+     *        empty histograms and unseen command types are left out
+     *
+     * @return The length, or 0 if it did not fit
+     */
+    size_t encodeJson(char* out, size_t capacity, uint32_t nowMs, const Mqtt5Stats& stats) const;
+
+    /**
+     * @brief Start a new interval, after its report was handed to the client
+     */
+    void reset(uint32_t nowMs, const Mqtt5Stats& stats);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef MOTION_SIGNATURE_H
+#define MOTION_SIGNATURE_H
+
+#include <stdint.h>
+
+/**
+ * Compact accel-magnitude fingerprint of a detected handshake.
+ *
+ * The IMU stream is reduced to one mean linear-acceleration magnitude per
+ * 100 ms block. A badge advertises its last MOTION_SKETCH_LENGTH blocks when it
+ * detects a handshake; peers slide that sketch across their own last
+ * MOTION_HISTORY_LENGTH blocks and use the best Pearson correlation to confirm
+ * who they were shaking hands with.
+ */
+static const int MOTION_BLOCK_SAMPLES = 10;
+static const int MOTION_SKETCH_LENGTH = 12;
+static const int MOTION_HISTORY_LENGTH = 30;
+
+/**
+ * @brief Remove the mean and scale into int8 so the sketch fits in an advertisement
+ */
+void quantizeMotion(const float* magnitudes, int count, int8_t* out);
+
+/**
+ * @brief Best correlation of sketch against every alignment inside history
+ *
+ * @return Pearson correlation x100, in [-100, 100]; 0 if either signal is flat
+ */
+int motionCorrelation(const int8_t* sketch, int sketchLength, const int8_t* history, int historyLength);
+
+#endif
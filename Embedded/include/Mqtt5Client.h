@@ -0,0 +1,252 @@
+#ifndef MQTT5_CLIENT_H
+#define MQTT5_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest packet we accept; advertised to the broker as Maximum Packet Size so it never sends more
+#ifndef MQTT5_RX_BUFFER
+#define MQTT5_RX_BUFFER 1024
+#endif
+// Outgoing packets waiting for the socket
+#ifndef MQTT5_TX_BUFFER
+#define MQTT5_TX_BUFFER 1536
+#endif
+// Bytes handed to the transport per poll(), so one call never writes a whole backlog
+#ifndef MQTT5_WRITE_SLICE
+#define MQTT5_WRITE_SLICE 512
+#endif
+// Inbound packets handled per poll(); the rest stay in the socket
+#ifndef MQTT5_POLL_PACKETS
+#define MQTT5_POLL_PACKETS 4
+#endif
+#ifndef MQTT5_TOPIC_SIZE
+#define MQTT5_TOPIC_SIZE 128
+#endif
+// Outbound topic aliases we assign (capped by the broker's Topic Alias Maximum)
+#ifndef MQTT5_TOPIC_ALIASES
+#define MQTT5_TOPIC_ALIASES 4
+#endif
+// Topic aliases the broker may assign to messages it sends us
+#ifndef MQTT5_INBOUND_ALIASES
+#define MQTT5_INBOUND_ALIASES 4
+#endif
+// Unacknowledged QoS 1 publishes, kept for resending after a reconnect (capped by the broker's Receive Maximum)
+#ifndef MQTT5_MAX_INFLIGHT
+#define MQTT5_MAX_INFLIGHT 4
+#endif
+#ifndef MQTT5_INFLIGHT_PAYLOAD
+#define MQTT5_INFLIGHT_PAYLOAD 256
+#endif
+#ifndef MQTT5_CONNACK_TIMEOUT_MS
+#define MQTT5_CONNACK_TIMEOUT_MS 10000
+#endif
+// QoS 1 messages the broker may have in flight to us, our Receive Maximum
+#ifndef MQTT5_RECEIVE_MAXIMUM
+#define MQTT5_RECEIVE_MAXIMUM 8
+#endif
+
+/**
+ * @brief Byte stream under the MQTT client: TLS on the badge, a plain socket on the host.
+ *
+ * Both calls must return promptly: the bytes moved, 0 if nothing can move right now,
+ * or -1 once the connection is gone.
+ */
+class MqttTransport {
+public:
+    virtual ~MqttTransport() {}
+    virtual int read(uint8_t* buffer, size_t length) = 0;
+    virtual int write(const uint8_t* data, size_t length) = 0;
+    virtual void close() = 0;
+};
+
+enum Mqtt5State : uint8_t {
+    MQTT5_DISCONNECTED,
+    MQTT5_CONNECTING,       // CONNECT sent, waiting for CONNACK
+    MQTT5_CONNECTED
+};
+
+// MQTT 5 reason codes, plus local ones above 0xF0 for failures detected on this side
+enum Mqtt5Reason : uint8_t {
+    MQTT5_SUCCESS = 0x00,
+    MQTT5_UNSPECIFIED_ERROR = 0x80,
+    MQTT5_MALFORMED_PACKET = 0x81,
+    MQTT5_PROTOCOL_ERROR = 0x82,
+    MQTT5_PACKET_TOO_LARGE = 0x95,
+    MQTT5_TOPIC_ALIAS_INVALID = 0x94,
+    MQTT5_LOCAL_TRANSPORT_CLOSED = 0xF0,
+    MQTT5_LOCAL_KEEPALIVE_TIMEOUT = 0xF1,
+    MQTT5_LOCAL_CONNECT_TIMEOUT = 0xF2,
+    MQTT5_LOCAL_BUFFER_FULL = 0xF3
+};
+
+struct Mqtt5ConnectOptions {
+    const char* clientId;
+    const char* username;           // nullptr for none
+    const char* password;           // nullptr for none
+    uint16_t keepAliveS;
+    uint32_t sessionExpiryS;        // 0 ends the session on disconnect
+    bool cleanStart;
+};
+
+struct Mqtt5Stats {
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    uint32_t publishesOut;
+    uint32_t publishesIn;
+    uint32_t aliasedPublishes;      // sent with an empty topic thanks to an alias
+    uint32_t aliasBytesSaved;
+    uint32_t resent;                // QoS 1 publishes resent after a reconnect
+    uint32_t subscribeAcks;         // SUBACKs received, one per subscribe()
+    uint32_t subscribeFailures;     // SUBACK reason codes >= 0x80
+    uint32_t publishesRejected;     // PUBACK reason codes >= 0x80: the broker took the slot back but dropped the message
+    uint32_t pings;
+    uint32_t lastPingRttMs;
+};
+
+/**
+ * @brief Non-blocking MQTT 5 client over any MqttTransport, with fixed buffers only.
+ *
+ * publish(), subscribe() and unsubscribe() only encode into the transmit buffer;
+ * poll() moves bytes both ways, dispatches inbound messages to the callback,
+ * acknowledges them and keeps the connection alive. Nothing waits on the network.
+ *
+ * MQTT 5 features used:
+ * - Topic aliases: the first publish to a topic carries the topic plus an alias,
+ *   later ones only the two-byte alias.
+ * - Receive Maximum both ways: we cap the broker's unacknowledged QoS 1 messages to
+ *   us, and keep our own QoS 1 publishes within the broker's limit.
+ * - Session expiry, so a persistent session outlives the connection by a bounded time.
+ * - No Local on subscriptions, so our own publishes under a subscribed filter are not echoed.
+ */
+class Mqtt5Client {
+public:
+    typedef void (*MessageCallback)(char* topic, uint8_t* payload, unsigned int length);
+
+private:
+    struct Inflight {
+        uint16_t packetId;          // 0 marks a free slot
+        bool sent;                  // on the wire in this connection, waiting for PUBACK
+        uint8_t topicLength;
+        uint16_t payloadLength;
+        char topic[MQTT5_TOPIC_SIZE];
+        uint8_t payload[MQTT5_INFLIGHT_PAYLOAD];
+    };
+
+    MqttTransport* _transport = nullptr;
+    MessageCallback _callback = nullptr;
+    Mqtt5State _state = MQTT5_DISCONNECTED;
+    uint8_t _reason = MQTT5_SUCCESS;
+    bool _sessionPresent = false;
+
+    uint8_t _rx[MQTT5_RX_BUFFER];
+    size_t _rxLength = 0;
+    uint8_t _tx[MQTT5_TX_BUFFER];
+    size_t _txLength = 0;
+    size_t _txSent = 0;
+    char _topic[MQTT5_TOPIC_SIZE];
+
+    // Limits from CONNACK
+    uint16_t _keepAliveS = 0;
+    uint16_t _serverReceiveMaximum = 65535;
+    uint16_t _serverAliasMaximum = 0;
+    uint32_t _serverMaximumPacket = 0;
+    uint8_t _serverMaximumQos = 2;
+
+    char _aliases[MQTT5_TOPIC_ALIASES][MQTT5_TOPIC_SIZE];
+    uint8_t _aliasCount = 0;
+    char _inboundAliases[MQTT5_INBOUND_ALIASES][MQTT5_TOPIC_SIZE];
+
+    Inflight _inflight[MQTT5_MAX_INFLIGHT] = {};
+    uint16_t _inflightCount = 0;
+    uint16_t _inflightSent = 0;
+    uint16_t _nextPacketId = 1;
+
+    uint32_t _nowMs = 0;
+    uint32_t _connectStartMs = 0;
+    uint32_t _lastTxMs = 0;
+    uint32_t _pingSentMs = 0;
+    bool _pingOutstanding = false;
+    Mqtt5Stats _stats = {};
+
+    bool _reserve(size_t length);
+    bool _sendPublish(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                      uint8_t qos, bool retain, bool dup, uint16_t packetId);
+    bool _sendPubAck(uint16_t packetId);
+    bool _sendPing();
+    uint16_t _allocatePacketId();
+    bool _flush();
+    bool _read();
+    bool _handlePacket(uint8_t header, const uint8_t* body, size_t length);
+    bool _handleConnAck(const uint8_t* body, size_t length);
+    bool _handlePublish(uint8_t header, const uint8_t* body, size_t length);
+    uint16_t _window() const;
+    void _resendInflight();
+    void _fail(uint8_t reason);
+
+public:
+    void setTransport(MqttTransport* transport);
+    void setCallback(MessageCallback callback);
+
+    /**
+     * @brief Start an MQTT session on an already open transport by queueing CONNECT
+     *
+     * Call poll() until state() leaves MQTT5_CONNECTING. The poll() that reads CONNACK returns
+     * before dispatching anything queued behind it, so the caller can finish setting up first.
+     */
+    bool begin(const Mqtt5ConnectOptions& options, uint32_t nowMs);
+
+    /**
+     * @brief Service the connection: write pending bytes, read and dispatch, keep alive
+     *
+     * @return false once the connection is gone; reason() says why
+     */
+    bool poll(uint32_t nowMs);
+
+    /**
+     * @brief Queue a PUBLISH. QoS 1 also occupies an in-flight slot until its PUBACK.
+     *
+     * @return false if not connected, the in-flight window or transmit buffer is full, or the
+     *         packet exceeds the broker's maximum; the caller keeps the message and retries
+     */
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0, bool retain = false);
+
+    /**
+     * @brief True if a QoS qos publish of length bytes would be accepted right now
+     */
+    bool canPublish(size_t length, uint8_t qos) const;
+    bool subscribe(const char* filter, uint8_t qos);
+    bool unsubscribe(const char* filter);
+
+    /**
+     * @brief Send a PINGREQ now rather than when the keepalive is due, to measure round-trip time
+     *
+     * The answer shows up in stats().pings and lastPingRttMs; like a keepalive ping, no answer
+     * within the keepalive period drops the connection.
+     *
+     * @return false if not connected, a ping is already outstanding or the buffer is full
+     */
+    bool ping(uint32_t nowMs);
+
+    /**
+     * @brief Queue DISCONNECT, write what fits and close the transport
+     */
+    void disconnect();
+
+    Mqtt5State state() const;
+    bool connected() const;
+    uint8_t reason() const;
+    bool sessionPresent() const;
+    size_t pendingBytes() const;
+
+    /**
+     * @brief Received bytes not handled yet. An event loop that waits for the socket to become
+     *        readable must poll() again while this is non-zero: these bytes are already out of it.
+     */
+    size_t bufferedBytes() const;
+    uint16_t inflight() const;
+    uint16_t keepAlive() const;
+    Mqtt5Stats stats() const;
+};
+
+#endif
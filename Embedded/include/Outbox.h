@@ -0,0 +1,43 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// A detected handshake waiting to be reported as a profile swap
+struct HandshakeClaim {
+    uint32_t ticketId;
+    uint32_t partnerTicketId;
+    uint32_t timestamp;     // seconds since epoch when the clock is set, else since boot
+    uint32_t nonce;
+};
+
+/**
+ * @brief Flash-backed ring of handshake claims that survives reboots and lost connectivity.
+ *
+ * Each slot is its own NVS key so a push rewrites one small blob, not the whole ring.
+ * When full, the oldest claim is overwritten.
+ */
+class Outbox {
+private:
+    static const uint8_t _CAPACITY = 32;
+    Preferences _prefs;
+    uint16_t _head = 0;     // oldest claim
+    uint16_t _count = 0;
+    uint32_t _dropped = 0;
+    bool _open = false;
+
+    void saveIndex();
+
+public:
+    Outbox();
+
+    void begin();
+    bool push(const HandshakeClaim& claim);
+    bool peek(uint16_t index, HandshakeClaim& claim);
+    void pop(uint16_t count);
+    uint16_t size();
+    uint32_t dropped();
+};
+
+#endif
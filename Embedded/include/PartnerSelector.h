@@ -0,0 +1,101 @@
+#ifndef PARTNER_SELECTOR_H
+#define PARTNER_SELECTOR_H
+
+#include "BLE.h"
+
+// Why a collection window closed
+enum WindowOutcome : uint8_t {
+    WINDOW_DECIDED,     // one peer matched our motion or dominated on RSSI
+    WINDOW_NOBODY,      // nobody within the partner distance
+    WINDOW_CAPPED       // still ambiguous at the cap; fell back to the closest peer
+};
+
+struct SelectionWindow {
+    unsigned long elapsedMs;
+    int margin;         // dB the leader was ahead of the runner-up
+    int correlation;    // motion match x100, 0 without one
+    WindowOutcome outcome;
+};
+
+/**
+ * @brief Picks the handshake partner from BLE neighbours: instantly from the background
+ *        table when it can, otherwise through an adaptive full-duty collection window.
+ *
+ * Shared by main.cpp and the crowd simulator, so the simulator measures the shipped logic.
+ * Main loop only.
+ */
+class PartnerSelector {
+public:
+    static const unsigned long COLLECTION_TIME = 500;
+    static const uint16_t MIN_PEER_SAMPLES = 2;
+    static const uint32_t NEIGHBOR_MAX_AGE = 2000;
+
+    // Adaptive collection window: end as soon as one peer dominates, extend up to the cap when ambiguous
+    static const unsigned long COLLECTION_MIN_TIME = 150;
+    static const unsigned long COLLECTION_MAX_TIME = 1500;
+    static const int DECISION_MARGIN_DB = 6;
+    static const uint16_t DECISION_MIN_SAMPLES = 3;
+    static const int MIN_MOTION_CORRELATION = 75;
+    static const uint32_t MOTION_MAX_AGE = 1000;     // a partner's sketch is at most this old
+
+    // Keep advertising this long after a window opens even if it closes earlier, so a partner
+    // whose detection lags ours still collects enough samples of us
+    static const unsigned long ADVERTISE_MIN_TIME = 500;
+
+private:
+    BLE& _ble;
+    bool _collecting = false;
+    bool _lingering = false;
+    bool _restoreBackground = false;
+    unsigned long _collectionStart = 0;
+    SelectionWindow _lastWindow = {};
+
+    unsigned long _windowsClosed = 0;
+    unsigned long _windowTimeTotal = 0;
+    unsigned long _windowsDecided = 0;
+    long _decisionMarginTotal = 0;
+
+    const PeerStats* _resolve(const int8_t* history, uint32_t maxAge, int* margin, int* correlation);
+    void _closeWindow(unsigned long elapsed, int margin, int correlation, WindowOutcome outcome);
+    void _restoreRadio();
+
+public:
+    explicit PartnerSelector(BLE& ble);
+
+    /**
+     * @brief Keep the background neighbor table fed and aged, and end the advertising that
+     *        outlives a closed window; call every loop() while assigned
+     */
+    void maintain();
+
+    /**
+     * @brief A handshake was detected
+     *
+     * @param history Our recent motion blocks (Handshake::motionHistory)
+     * @return The partner if the background table already decides it, else nullptr and a
+     *         collection window is open
+     */
+    const PeerStats* start(const int8_t* history);
+
+    /**
+     * @brief Feed the open window; call every loop() while collecting()
+     *
+     * @param partner Set when the window closes, nullptr if nobody qualified
+     * @return true once the window has closed; the radio is back to its previous duty by
+     *         ADVERTISE_MIN_TIME after start(), through maintain()
+     */
+    bool poll(const int8_t* history, const PeerStats** partner);
+
+    bool collecting() const;
+    const SelectionWindow& lastWindow() const;
+    unsigned long windowsClosed() const;
+    unsigned long averageWindowMs() const;
+
+    /**
+     * @brief Average lead of the chosen peer over windows that decided; windows that found
+     *        nobody or ran into the cap have no margin and are left out
+     */
+    long averageMarginDb() const;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MotionSignature.h"
+
+/**
+ * @brief RSSI statistics for one peer badge, keyed by its numeric ticket id.
+ *
+ * Besides the raw statistics, each peer runs a scalar Kalman filter over its
+ * RSSI. The filtered value and the peer's advertised 1 m TX power give a path
+ * loss, and from that a log-distance estimate that partner selection ranks on.
+ */
+struct PeerStats {
+    static const uint8_t RECENT_SIZE = 5;
+    static constexpr float PROCESS_NOISE = 0.5f;        // dB^2 of drift per sample
+    static constexpr float MEASUREMENT_NOISE = 36.0f;   // dB^2, ~6 dB body shadowing
+
+    uint32_t ticketId;      // 0 marks an empty slot
+    uint16_t count;
+    int8_t maxRssi;
+    int32_t rssiSum;
+    float ema;
+    uint32_t lastSeen;
+    int8_t recent[RECENT_SIZE];
+    uint8_t recentIndex;
+    uint8_t sketchSeq;      // 0 until the peer advertises a handshake sketch
+    uint32_t sketchSeen;
+    int8_t sketch[MOTION_SKETCH_LENGTH];
+    uint8_t address[6];     // BLE address of the latest packet, for a direct GATT exchange
+    uint8_t addressType;
+    float filteredRssi;
+    float variance;
+    int8_t txPower;         // advertised RSSI at 1 m
+
+    float mean() const;
+    int8_t median() const;
+    float pathLoss() const;
+    float distance(float exponent) const;
+};
+
+/**
+ * @brief Small open-addressing hash table of per-peer RSSI statistics.
+ *
+ * Fixed capacity with linear probing, so recording a sample never allocates.
+ * When the table is full a closer newcomer replaces the peer with the highest
+ * filtered path loss, so in a dense room the table holds the nearest peers.
+ */
+class PeerTable {
+public:
+    static const size_t CAPACITY = 32;
+
+private:
+    static constexpr float _EMA_ALPHA = 0.3f;
+
+    PeerStats _slots[CAPACITY];
+    size_t _size;
+    size_t _evictions = 0;
+
+    static size_t _hash(uint32_t ticketId);
+    PeerStats* _find(uint32_t ticketId);
+    PeerStats* _slotFor(uint32_t ticketId, float pathLoss);
+    void _remove(size_t index);
+
+public:
+    PeerTable();
+
+    /**
+     * @brief Add one RSSI sample for a peer
+     *
+     * @param txPower The peer's advertised RSSI at 1 m
+     * @return false if the table is full of peers closer than this one
+     */
+    bool record(uint32_t ticketId, int8_t rssi, int8_t txPower, uint32_t timestamp);
+
+    /**
+     * @brief Remember where a peer can be reached; only for peers already recorded
+     */
+    void recordAddress(uint32_t ticketId, const uint8_t address[6], uint8_t addressType);
+
+    /**
+     * @brief Store the latest motion sketch advertised by a peer already recorded
+     */
+    void recordSketch(uint32_t ticketId, uint8_t sketchSeq, const int8_t* sketch, uint32_t timestamp);
+
+    const PeerStats* find(uint32_t ticketId) const;
+
+    /**
+     * @brief Peer with the lowest filtered path loss, i.e. the closest one
+     *
+     * @param minSamples Peers with fewer samples are not considered
+     * @param now Current time, only used with maxAge
+     * @param maxAge Peers not heard from within this many ms are not considered
+     * @return nullptr if no peer qualifies
+     */
+    const PeerStats* best(uint16_t minSamples, uint32_t now = 0, uint32_t maxAge = UINT32_MAX) const;
+
+    /**
+     * @brief How far the closest peer's path loss is ahead of the runner-up
+     *
+     * @param now Current time
+     * @param maxAge Peers not heard from within this many ms are not considered
+     * @param ceiling Runner-up path loss used when there is no closer runner-up (e.g. the distance threshold)
+     * @param leader Set to the closest peer, or nullptr if no peer qualifies
+     * @return Margin in dB between min(runner-up, ceiling) and the leader
+     */
+    int lead(uint32_t now, uint32_t maxAge, float ceiling, const PeerStats** leader) const;
+
+    /**
+     * @brief Number of peers heard within maxAge ms whose filtered path loss is at most maxPathLoss
+     */
+    size_t within(uint32_t now, uint32_t maxAge, float maxPathLoss) const;
+
+    /**
+     * @brief Drop peers not heard from within maxAge ms
+     *
+     * @return Number of peers removed
+     */
+    size_t expire(uint32_t now, uint32_t maxAge);
+
+    /**
+     * @brief Slot by index for iteration, nullptr if the slot is empty
+     */
+    const PeerStats* at(size_t index) const;
+
+    size_t size() const;
+
+    /**
+     * @brief Peers dropped so far to make room for a closer one
+     */
+    size_t evictions() const;
+    void clear();
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MQTT_QUEUE_SIZE
+#define MQTT_QUEUE_SIZE 16
+#endif
+#ifndef MQTT_QUEUED_PAYLOAD_SIZE
+#define MQTT_QUEUED_PAYLOAD_SIZE 160
+#endif
+
+// What a queued payload is; the topic is rebuilt from the current prefixes when it is sent
+enum PublishKind : uint8_t {
+    PUBLISH_AVAILABILITY,
+    PUBLISH_RECEIPT,
+    PUBLISH_PROFILE_SWAP
+};
+
+struct QueuedPublish {
+    PublishKind kind;
+    bool binary;                // BadgeMessage encoding rather than JSON text
+    uint16_t length;
+    char payload[MQTT_QUEUED_PAYLOAD_SIZE];
+};
+
+struct PublishStats {
+    uint32_t queued;
+    uint32_t dropped;           // queue full, payload too long, or discarded as unsendable
+    uint32_t drained;           // messages handed to the broker
+    uint32_t batches;           // MQTT publishes carrying those messages
+    uint16_t largestBatch;
+};
+
+/**
+ * @brief Bounded FIFO of outgoing MQTT payloads, kept across disconnects.
+ *
+ * Main loop only. New messages are refused when the queue is full so the
+ * oldest (e.g. the connect receipt) are not lost to a later burst.
+ */
+class PublishQueue {
+private:
+    QueuedPublish _items[MQTT_QUEUE_SIZE];
+    uint16_t _head = 0;
+    uint16_t _count = 0;
+    PublishStats _stats = {};
+
+public:
+    bool push(PublishKind kind, const char* payload);
+    bool push(PublishKind kind, const uint8_t* payload, size_t length);
+    const QueuedPublish* at(uint16_t index) const;
+
+    /**
+     * @brief Remove messages delivered in one MQTT publish
+     */
+    void pop(uint16_t count);
+
+    /**
+     * @brief Remove messages that can never be sent; counted as dropped, not drained
+     */
+    void discard(uint16_t count);
+    uint16_t size() const;
+    PublishStats stats() const;
+};
+
+#endif
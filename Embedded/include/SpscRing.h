@@ -0,0 +1,84 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * @brief Fixed-capacity lock-free ring for exactly one producer and one consumer.
+ *
+ * The producer calls push() from one task (e.g. the NimBLE host task) while the
+ * consumer calls front()/pop() from another (e.g. the Arduino loop). Capacity
+ * must be a power of two; one slot is never left unused.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    T _slots[Capacity];
+    std::atomic<size_t> _head{0};   // next slot to read, written by the consumer
+    std::atomic<size_t> _tail{0};   // next slot to write, written by the producer
+    std::atomic<size_t> _dropped{0};
+
+public:
+    /**
+     * @brief Producer side. Copies the item into the ring.
+     *
+     * @return false if the ring is full and the item was dropped
+     */
+    bool push(const T& item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) >= Capacity) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _slots[tail & (Capacity - 1)] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer side. Returns the oldest item in place, or nullptr if empty.
+     *
+     * The pointer stays valid until the matching pop().
+     */
+    const T* front() const {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &_slots[head & (Capacity - 1)];
+    }
+
+    /**
+     * @brief Consumer side. Releases the item returned by front().
+     */
+    void pop() {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head != _tail.load(std::memory_order_acquire)) {
+            _head.store(head + 1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Consumer side. Discards everything currently queued.
+     */
+    void clear() {
+        _head.store(_tail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+    size_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
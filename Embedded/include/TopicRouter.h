@@ -0,0 +1,59 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Inbound topics this badge acts on
+enum TopicRoute : uint8_t {
+    ROUTE_NONE,
+    ROUTE_ASSIGNMENT,       // device/<id>/assignment
+    ROUTE_REASSIGNMENT,     // device/<id>/reassignment
+    ROUTE_RESET_NFC,        // device/<id>/resetNFC
+    ROUTE_ENCODING,         // device/<id>/encoding, payload "binary" or "json"
+    ROUTE_RECEIPT_BATCH,    // device/<id>/receipt_batch, payload "on" or "off"
+    ROUTE_DEVICE_REBOOT,    // device/<id>/reboot
+    ROUTE_EVENT_REBOOT,     // event/<id>/reboot
+    ROUTE_PROFILE_SWAP      // event/<id>/profile_swap/<ticket>, tail is the ticket
+};
+
+/**
+ * @brief Maps inbound MQTT topics to routes without building any strings.
+ *
+ * The device and event prefixes are formatted once in begin(). A topic is
+ * matched by comparing its prefix, then switching on the suffix length (and
+ * first letter where two share a length) and comparing the single candidate.
+ */
+class TopicRouter {
+public:
+    static const size_t PREFIX_SIZE = 64;
+
+private:
+    char _devicePrefix[PREFIX_SIZE] = {0};
+    char _eventPrefix[PREFIX_SIZE] = {0};
+    size_t _devicePrefixLength = 0;
+    size_t _eventPrefixLength = 0;
+
+    TopicRoute _routeDevice(const char* suffix, size_t length) const;
+    TopicRoute _routeEvent(const char* suffix, size_t length, const char** tail, size_t* tailLength) const;
+
+public:
+    /**
+     * @brief Precompute "device/<clientId>/" and "event/<eventId>/"
+     *
+     * @return false if either prefix does not fit
+     */
+    bool begin(const char* clientId, const char* eventId);
+
+    /**
+     * @brief Route a NUL-terminated topic
+     *
+     * @param tail Set to the text after the matched suffix (profile swap ticket), if any
+     */
+    TopicRoute route(const char* topic, const char** tail, size_t* tailLength) const;
+
+    const char* devicePrefix() const;
+    const char* eventPrefix() const;
+};
+
+#endif
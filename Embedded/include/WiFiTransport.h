@@ -0,0 +1,24 @@
+#ifndef WIFI_TRANSPORT_H
+#define WIFI_TRANSPORT_H
+
+#include <WiFiClientSecure.h>
+#include "Mqtt5Client.h"
+
+/**
+ * @brief Mqtt5Client transport over an Arduino WiFiClient (WiFiClientSecure for the broker's TLS port).
+ *
+ * Reads only what available() reports, so they never wait. A TLS write still blocks until
+ * mbedTLS has handed the record to lwIP; Mqtt5Client keeps that bounded with MQTT5_WRITE_SLICE.
+ */
+class WiFiTransport : public MqttTransport {
+private:
+    WiFiClient& _client;
+
+public:
+    explicit WiFiTransport(WiFiClient& client);
+    int read(uint8_t* buffer, size_t length) override;
+    int write(const uint8_t* data, size_t length) override;
+    void close() override;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "SimRadio.h"
+#include <algorithm>
+#include <math.h>
+
+namespace SimClock {
+    uint64_t nowUs = 0;
+}
+
+bool SimSerial::enabled = false;
+SimSerial Serial;
+
+SimRadio& SimRadio::instance() {
+    static SimRadio radio;
+    return radio;
+}
+
+void SimRadio::reset(size_t count, const SimRadioConfig& config, uint32_t seed) {
+    _config = config;
+    _badges.clear();
+    _badges.resize(count);
+    _rates.assign(count, 0.0f);
+    _onAir.clear();
+    _events = decltype(_events)();
+    _selected = 0;
+    _advRate = 0.0f;
+    _rng.seed(seed);
+    _delivered = 0;
+    SimClock::nowUs = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t address[6] = {(uint8_t)i, (uint8_t)(i >> 8), 0x5A, 0x1B, 0xC6, 0xE5};
+        _badges[i].address = NimBLEAddress(address, 0);
+        _badges[i].scan.badge = i;
+        _badges[i].advertising.badge = i;
+    }
+}
+
+void SimRadio::place(size_t badge, float x, float y) {
+    _badges[badge].x = x;
+    _badges[badge].y = y;
+}
+
+void SimRadio::select(size_t badge) {
+    _selected = badge;
+}
+
+SimBadgeRadio& SimRadio::current() {
+    return _badges[_selected];
+}
+
+size_t SimRadio::size() const {
+    return _badges.size();
+}
+
+uint64_t SimRadio::delivered() const {
+    return _delivered;
+}
+
+void SimRadio::_schedule(size_t badge, uint64_t afterUs) {
+    const NimBLEAdvertising& adv = _badges[badge].advertising;
+    uint64_t delayUs = (uint64_t)(_uniform(_rng) * _config.advDelayMaxUs);
+    _events.push({afterUs + delayUs, badge, adv.generation});
+}
+
+void SimRadio::advertisingStarted(size_t badge) {
+    _rates[badge] = 1.0f / (_badges[badge].advertising.intervalUnits * 625.0f);
+    _advRate += _rates[badge];
+    _onAir.push_back(badge);
+    _schedule(badge, SimClock::nowUs);
+}
+
+void SimRadio::advertisingStopped(size_t badge) {
+    _advRate -= _rates[badge];
+    _rates[badge] = 0.0f;
+    if (_advRate < 0.0f) {
+        _advRate = 0.0f;
+    }
+    _onAir.erase(std::find(_onAir.begin(), _onAir.end(), badge));
+}
+
+void SimRadio::advance(uint64_t untilUs) {
+    while (!_events.empty() && _events.top().timeUs <= untilUs) {
+        Event event = _events.top();
+        _events.pop();
+
+        NimBLEAdvertising& adv = _badges[event.badge].advertising;
+        if (!adv.advertising || adv.generation != event.generation) {
+            continue;
+        }
+        SimClock::nowUs = event.timeUs;
+        _transmit(event.badge, event.timeUs);
+        adv.lastEventUs = event.timeUs;
+        _schedule(event.badge, event.timeUs + adv.intervalUnits * 625ull);
+    }
+    SimClock::nowUs = untilUs;
+}
+
+float SimRadio::_meanRssi(const SimBadgeRadio& from, const SimBadgeRadio& to) const {
+    float dx = from.x - to.x;
+    float dy = from.y - to.y;
+    float distance = sqrtf(dx * dx + dy * dy);
+    if (distance < 0.1f) {
+        distance = 0.1f;
+    }
+    return _config.rssiAt1m - 10.0f * _config.pathLossExponent * log10f(distance);
+}
+
+// Pure ALOHA with capture: any advertiser starting within one airtime either side overlaps,
+// and the packet survives only if it is captureDb stronger than every overlapping one
+bool SimRadio::_collides(size_t sender, const SimBadgeRadio& to, float rssi, float expected) {
+    if (expected <= 0.0f || _onAir.size() < 2) {
+        return false;
+    }
+    std::poisson_distribution<int> overlaps(expected);
+    for (int i = overlaps(_rng); i > 0; i--) {
+        size_t other = _onAir[(size_t)(_uniform(_rng) * _onAir.size()) % _onAir.size()];
+        if (other == sender) {
+            continue;
+        }
+        float interference = _meanRssi(_badges[other], to) + _config.shadowingDb * _fading(_rng);
+        if (rssi - interference < _config.captureDb) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SimRadio::_transmit(size_t sender, uint64_t timeUs) {
+    const SimBadgeRadio& from = _badges[sender];
+    float otherRate = _advRate - _rates[sender];
+    float expectedOverlaps = 2.0f * _config.airtimeUs * (otherRate > 0.0f ? otherRate : 0.0f);
+
+    NimBLEAdvertisedDevice device;
+    device.payload = from.advertising.payload;
+    device.address = from.address;
+
+    for (size_t receiver = 0; receiver < _badges.size(); receiver++) {
+        SimBadgeRadio& to = _badges[receiver];
+        NimBLEScan& scan = to.scan;
+        if (receiver == sender || !scan.scanning || scan.callbacks == nullptr) {
+            continue;
+        }
+
+        // The receiver listens for windowMs out of every intervalMs
+        uint64_t phaseUs = (timeUs - scan.startUs) % (scan.intervalMs * 1000ull);
+        if (phaseUs >= scan.windowMs * 1000ull) {
+            continue;
+        }
+        // Half duplex: a badge cannot hear while its own advertising event is on air (three channels)
+        if (to.advertising.advertising && timeUs - to.advertising.lastEventUs < 3ull * _config.airtimeUs) {
+            continue;
+        }
+
+        float rssi = _meanRssi(from, to) + _config.shadowingDb * _fading(_rng);
+        if (rssi < _config.sensitivityDbm || _uniform(_rng) < _config.packetLoss ||
+            _collides(sender, to, rssi, expectedOverlaps)) {
+            continue;
+        }
+
+        if (scan.duplicateFilter && !scan.seen.insert(sender).second) {
+            continue;
+        }
+
+        device.rssi = (int)lroundf(rssi);
+        select(receiver);
+        scan.callbacks->onResult(&device);
+        _delivered++;
+    }
+}
+
+// NimBLE stubs routed to the selected badge
+
+bool NimBLEScan::start(uint32_t, bool) {
+    scanning = true;
+    startUs = SimClock::nowUs;
+    seen.clear();
+    return true;
+}
+
+bool NimBLEAdvertising::start() {
+    if (advertising) {
+        return true;
+    }
+    advertising = true;
+    generation++;
+    SimRadio::instance().advertisingStarted(badge);
+    return true;
+}
+
+bool NimBLEAdvertising::stop() {
+    if (!advertising) {
+        return true;
+    }
+    advertising = false;
+    generation++;
+    SimRadio::instance().advertisingStopped(badge);
+    return true;
+}
+
+bool NimBLEDevice::init(const char*) {
+    return true;
+}
+
+NimBLEScan* NimBLEDevice::getScan() {
+    return &SimRadio::instance().current().scan;
+}
+
+NimBLEAdvertising* NimBLEDevice::getAdvertising() {
+    return &SimRadio::instance().current().advertising;
+}
+
+NimBLEServer* NimBLEDevice::createServer() {
+    return &SimRadio::instance().current().server;
+}
@@ -0,0 +1,83 @@
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+#include <queue>
+#include <random>
+#include <vector>
+#include "NimBLEDevice.h"
+
+struct SimRadioConfig {
+    float rssiAt1m = -59.0f;        // true RSSI 1 m from a badge
+    float pathLossExponent = 2.0f;
+    float shadowingDb = 4.0f;       // per-packet Gaussian fading
+    float packetLoss = 0.05f;       // independent loss before collisions
+    float sensitivityDbm = -95.0f;
+    uint32_t airtimeUs = 376;       // 31-byte legacy advertisement on one channel
+    float captureDb = 6.0f;         // a packet this much stronger than the interferer still decodes
+    uint32_t advDelayMaxUs = 10000; // random advDelay added to every advertising interval
+};
+
+// Radio state owned by one simulated badge
+struct SimBadgeRadio {
+    NimBLEScan scan;
+    NimBLEAdvertising advertising;
+    NimBLEServer server;
+    NimBLEAddress address;
+    float x = 0.0f;
+    float y = 0.0f;
+};
+
+/**
+ * @brief Shared 2D radio channel for many simulated badges.
+ *
+ * Advertising events are kept in time order. Each event reaches every other
+ * badge that is scanning and inside its scan window, unless the log-distance
+ * RSSI falls below sensitivity, the packet is lost, an overlapping advertiser
+ * is received within the capture margin, or the receiver is transmitting itself. Survivors are delivered
+ * through the receiver's onResult with the virtual clock set to the event time.
+ */
+class SimRadio {
+private:
+    struct Event {
+        uint64_t timeUs;
+        size_t badge;
+        uint32_t generation;
+        bool operator>(const Event& other) const { return timeUs > other.timeUs; }
+    };
+
+    SimRadioConfig _config;
+    std::vector<SimBadgeRadio> _badges;
+    std::vector<float> _rates;      // advertising events per microsecond while each badge is on air
+    std::vector<size_t> _onAir;     // badges currently advertising
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _events;
+    size_t _selected = 0;
+    float _advRate = 0.0f;          // sum of _rates
+    std::mt19937 _rng;
+    std::normal_distribution<float> _fading{0.0f, 1.0f};
+    std::uniform_real_distribution<float> _uniform{0.0f, 1.0f};
+    uint64_t _delivered = 0;
+
+    void _schedule(size_t badge, uint64_t afterUs);
+    void _transmit(size_t badge, uint64_t timeUs);
+    float _meanRssi(const SimBadgeRadio& from, const SimBadgeRadio& to) const;
+    bool _collides(size_t sender, const SimBadgeRadio& to, float rssi, float expected);
+
+public:
+    static SimRadio& instance();
+
+    void reset(size_t count, const SimRadioConfig& config, uint32_t seed);
+    void place(size_t badge, float x, float y);
+    void select(size_t badge);
+    SimBadgeRadio& current();
+    size_t size() const;
+
+    // Called by the NimBLE stubs
+    void advertisingStarted(size_t badge);
+    void advertisingStopped(size_t badge);
+
+    // Run every advertising event up to untilUs, then leave the clock there
+    void advance(uint64_t untilUs);
+    uint64_t delivered() const;
+};
+
+#endif
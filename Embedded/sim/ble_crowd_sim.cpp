@@ -0,0 +1,649 @@
+/*
+ * Crowd pairing benchmark for BLE.cpp on the host.
+ *
+ * Runs the real BLE, PeerTable and PartnerSelector code for every badge against
+ * SimRadio, and reports how often each badge picks its true handshake partner as
+ * the crowd grows.
+ *
+ * Build and run from Embedded/:
+ *   pio run -e native_sim && .pio/build/native_sim/program
+ * or without PlatformIO:
+ *   g++ -std=gnu++17 -O2 -Isim/stubs -Isim -Iinclude -DBLE_IDENTIFIER='"SIM"' \
+ *       src/BLE.cpp src/PeerTable.cpp src/PartnerSelector.cpp src/MotionSignature.cpp sim/SimRadio.cpp sim/ble_crowd_sim.cpp \
+ *       -o ble_crowd_sim
+ *
+ * Options:
+ *   --background        keep the low-duty neighbor table warm (BLE_BACKGROUND_MODE=1)
+ *   --sizes 2,10,100    crowd sizes to run (default 2,4,8,16,32,64,128,256,500)
+ *   --trials N          runs per crowd size (default 3)
+ *   --spread MS         window in which every pair shakes hands (default 5000)
+ *   --density M2        floor area per badge in square metres (default 2)
+ *   --loss P            independent packet loss probability (default 0.05)
+ *   --shadowing DB      per-packet fading standard deviation (default 4)
+ *   --exponent N        true path loss exponent of the room (default 2.0)
+ *   --capture DB        capture margin over an overlapping advertiser (default 6)
+ *   --motion DIR        advertise and match motion sketches replayed from recordings in DIR
+ *   --seed S
+ *   --check PERCENT     exit with status 1 if any crowd size pairs fewer badges than this
+ *   --motion-check      instead of pairing, score the --motion recordings against each other
+ *                       at PartnerSelector's motion threshold
+ *   --motion-other DIR  with --motion-check, also score non-handshake recordings from DIR
+ *   --replay RATE       instead of pairing, feed one badge's scan callback RATE adv/s of a
+ *                       conference mix for 10 s and report what the callback costs
+ *   --badges PERCENT    with --replay, share of the mix from badges (default 2)
+ *   --verbose           print the firmware's Serial output
+ *
+ * Regression check for dense rooms, which must keep the partner in the full PeerTable:
+ *   program --background --sizes 128 --check 90
+ *
+ * Without --motion no badge advertises a motion sketch, so partners are resolved on
+ * RSSI alone. With --motion DIR every pair replays one recording from DIR (CSV files
+ * with lin_acc_x, lin_acc_y, lin_acc_z columns at 10 ms, e.g. TensorFlow/Data/handshake)
+ * through the firmware's 100 ms blocks, with pair-specific variation so pairs that
+ * share a recording still differ. One badge sees the pair's motion as is, its partner
+ * a rescaled, noisy view up to one block late.
+ *
+ * --motion-check is the validation behind MIN_MOTION_CORRELATION. For each recording it
+ * correlates the badge's own history with a partner's sketch, as BLE::motionMatch does,
+ * 20 times with fresh noise. The sketch comes from the partner view of the same
+ * recording, of another handshake recording, and with --motion-other of each non-handshake
+ * recording. --check then requires that share of same-handshake views to match.
+ *
+ * --replay bypasses the radio model and calls BLE::onResult directly, timed on the host
+ * clock, while a main loop drains the scan queue every 10 ms as PartnerSelector does. The
+ * mix is 2% badges (--badges), one in four of them from another event, and otherwise
+ * foreign packets: phone and tag manufacturer data, iBeacons, service data, and some with a
+ * badge-sized length byte.
+ * The host is much faster than the badge; the ratio between filtered and accepted packets
+ * and the queue drops are what carry over.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include "BLE.h"
+#include "PartnerSelector.h"
+#include "SimRadio.h"
+
+static const uint64_t LOOP_PERIOD_US = 10000;
+static const float PARTNER_DISTANCE_M = 0.5f;
+static const float MIN_PAIR_SPACING_M = 1.2f;
+static const uint64_t DETECTION_JITTER_US = 150000;
+
+struct SimOptions {
+    bool background = false;
+    std::vector<size_t> sizes = {2, 4, 8, 16, 32, 64, 128, 256, 500};
+    int trials = 3;
+    uint64_t spreadUs = 5000000;
+    float density = 2.0f;
+    SimRadioConfig radio;
+    std::vector<std::vector<float>> recordings;     // motion blocks per --motion recording
+    uint32_t seed = 1;
+    float checkPercent = 0.0f;
+    std::vector<std::vector<float>> others;        // --motion-other recordings
+    bool motionCheck = false;
+    uint32_t replayRate = 0;
+    float badgePercent = 2.0f;
+};
+
+// One badge running the BLE half of main.cpp's loop
+struct SimBadge {
+    size_t index;
+    uint32_t ticketId;
+    uint32_t partnerTicketId;
+    BLE ble;
+    PartnerSelector selector{ble};
+    int8_t history[MOTION_HISTORY_LENGTH] = {0};
+    int8_t sketch[MOTION_SKETCH_LENGTH] = {0};
+    bool hasSketch = false;
+
+    uint64_t handshakeUs = UINT64_MAX;
+    bool handshakeSeen = false;
+
+    bool decided = false;
+    uint32_t chosen = 0;
+    uint64_t decidedUs = 0;
+    unsigned long firstResultUs = 0;
+
+    void assign(bool background) {
+        char ticket[16];
+        formatTicketId(ticketId, ticket, sizeof(ticket));
+        ble.begin();
+        ble.setTicketId(ticket);
+        ble.setEventId("E_01");
+        if (background) {
+            ble.setBackground(true);
+            ble.advertise();
+            ble.scan();
+        }
+    }
+
+    void decide(const PeerStats* partner) {
+        decided = true;
+        chosen = partner ? partner->ticketId : 0;
+        decidedUs = SimClock::nowUs;
+        firstResultUs = ble.getFirstResultLatency();
+    }
+
+    void loop() {
+        selector.maintain();
+
+        if (!handshakeSeen && SimClock::nowUs >= handshakeUs) {
+            handshakeSeen = true;
+            ble.markHandshake();
+            if (hasSketch) {
+                ble.setMotionSketch(sketch);
+            }
+            const PeerStats* partner = selector.start(history);
+            if (partner != nullptr) {
+                decide(partner);
+            }
+        }
+
+        const PeerStats* partner = nullptr;
+        if (selector.collecting() && selector.poll(history, &partner)) {
+            decide(partner);
+        }
+    }
+};
+
+struct SimResult {
+    size_t badges = 0;
+    size_t success = 0;
+    size_t wrong = 0;
+    size_t none = 0;
+    std::vector<float> pairMs;
+    std::vector<float> firstResultMs;
+    uint64_t callbacks = 0;
+    uint64_t dropped = 0;
+    double badgeSeconds = 0.0;
+};
+
+static float motionSpread(const std::vector<float>& blocks) {
+    float mean = 0.0f;
+    float spread = 0.0f;
+    for (float block : blocks) {
+        mean += block;
+    }
+    mean /= blocks.size();
+    for (float block : blocks) {
+        spread += (block - mean) * (block - mean);
+    }
+    return sqrtf(spread / blocks.size());
+}
+
+// One pair's handshake: its recording with variation of its own, so two pairs that
+// replay the same recording do not shake hands identically
+static std::vector<float> pairMotion(const std::vector<float>& recording, std::mt19937& rng) {
+    std::normal_distribution<float> noise(0.0f, 0.3f * motionSpread(recording));
+    std::vector<float> motion = recording;
+    for (float& block : motion) {
+        block += noise(rng);
+    }
+    return motion;
+}
+
+// The firmware's sketch and history for a badge that lived through this handshake. The
+// partner's view is rescaled, noisy and up to one block late, like a second IMU on the
+// other hand of the same handshake.
+static void motionView(const std::vector<float>& recording, std::mt19937& rng, bool partnerView, int8_t* history, int8_t* sketch) {
+    float blocks[MOTION_HISTORY_LENGTH];
+    std::uniform_real_distribution<float> scale(0.8f, 1.2f);
+    std::normal_distribution<float> noise(0.0f, 0.15f * motionSpread(recording));
+    size_t lag = partnerView ? rng() % 2 : 0;
+    float gain = partnerView ? scale(rng) : 1.0f;
+    for (int i = 0; i < MOTION_HISTORY_LENGTH; i++) {
+        size_t source = i >= (int)lag ? i - lag : 0;
+        blocks[i] = recording[source] * gain + (partnerView ? noise(rng) : 0.0f);
+    }
+
+    quantizeMotion(blocks, MOTION_HISTORY_LENGTH, history);
+    quantizeMotion(blocks + MOTION_HISTORY_LENGTH - MOTION_SKETCH_LENGTH, MOTION_SKETCH_LENGTH, sketch);
+}
+
+static void assignMotion(SimBadge& badge, const std::vector<float>& recording, std::mt19937& rng, bool partnerView) {
+    motionView(recording, rng, partnerView, badge.history, badge.sketch);
+    badge.hasSketch = true;
+}
+
+// Mean linear-acceleration magnitude per 100 ms block, as Handshake computes it
+static bool loadRecording(const std::string& path, std::vector<float>& blocks) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char line[512];
+    float sum = 0.0f;
+    int samples = 0;
+    blocks.clear();
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        float x, y, z;
+        if (sscanf(line, "%f,%f,%f", &x, &y, &z) != 3) {
+            continue;
+        }
+        sum += sqrtf(x * x + y * y + z * z);
+        if (++samples == MOTION_BLOCK_SAMPLES) {
+            blocks.push_back(sum / MOTION_BLOCK_SAMPLES);
+            sum = 0.0f;
+            samples = 0;
+        }
+    }
+    fclose(file);
+
+    // Keep the last MOTION_HISTORY_LENGTH blocks, the ones leading up to detection
+    if (blocks.size() < (size_t)MOTION_HISTORY_LENGTH) {
+        return false;
+    }
+    blocks.erase(blocks.begin(), blocks.end() - MOTION_HISTORY_LENGTH);
+    return true;
+}
+
+static size_t loadRecordings(const char* directory, std::vector<std::vector<float>>& recordings) {
+    DIR* dir = opendir(directory);
+    if (dir == nullptr) {
+        return 0;
+    }
+    std::vector<std::string> paths;
+    for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+            paths.push_back(std::string(directory) + "/" + name);
+        }
+    }
+    closedir(dir);
+
+    // Directory order is not stable across file systems
+    std::sort(paths.begin(), paths.end());
+    for (const std::string& path : paths) {
+        std::vector<float> blocks;
+        if (loadRecording(path, blocks)) {
+            recordings.push_back(blocks);
+        }
+    }
+    return recordings.size();
+}
+
+static void runTrial(size_t count, const SimOptions& options, uint32_t seed, SimResult& result) {
+    SimRadio& radio = SimRadio::instance();
+    radio.reset(count, options.radio, seed);
+
+    std::mt19937 rng(seed ^ 0x9E3779B9u);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float side = sqrtf(count * options.density);
+    uint64_t warmupUs = options.background ? 2000000 : 0;
+
+    std::vector<std::unique_ptr<SimBadge>> badges;
+    for (size_t i = 0; i < count; i++) {
+        SimBadge* badge = new SimBadge();
+        badge->index = i;
+        badge->ticketId = 100001 + (uint32_t)i;
+        badge->partnerTicketId = 100001 + (uint32_t)(i ^ 1);
+        badges.emplace_back(badge);
+    }
+
+    // Pairs stand PARTNER_DISTANCE_M apart at random spots, keeping some personal space
+    // from other pairs when the floor allows it; each pair shakes hands once
+    uint64_t lastHandshakeUs = 0;
+    std::vector<std::pair<float, float>> centers;
+    for (size_t i = 0; i + 1 < count; i += 2) {
+        float x = 0.0f;
+        float y = 0.0f;
+        for (int attempt = 0; attempt < 100; attempt++) {
+            x = unit(rng) * side;
+            y = unit(rng) * side;
+            bool spaced = true;
+            for (const std::pair<float, float>& center : centers) {
+                float dx = center.first - x;
+                float dy = center.second - y;
+                if (dx * dx + dy * dy < MIN_PAIR_SPACING_M * MIN_PAIR_SPACING_M) {
+                    spaced = false;
+                    break;
+                }
+            }
+            if (spaced) {
+                break;
+            }
+        }
+        centers.push_back(std::make_pair(x, y));
+        float angle = unit(rng) * 6.2831853f;
+        radio.place(i, x, y);
+        radio.place(i + 1, x + PARTNER_DISTANCE_M * cosf(angle), y + PARTNER_DISTANCE_M * sinf(angle));
+
+        uint64_t shakeUs = warmupUs + (uint64_t)(unit(rng) * options.spreadUs);
+        badges[i]->handshakeUs = shakeUs + (uint64_t)(unit(rng) * DETECTION_JITTER_US);
+        badges[i + 1]->handshakeUs = shakeUs + (uint64_t)(unit(rng) * DETECTION_JITTER_US);
+        lastHandshakeUs = std::max(lastHandshakeUs, std::max(badges[i]->handshakeUs, badges[i + 1]->handshakeUs));
+    }
+
+    // A separate generator, so runs without --motion see the same radio as before
+    if (!options.recordings.empty()) {
+        std::mt19937 motionRng(seed ^ 0x85EBCA6Bu);
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            std::vector<float> motion = pairMotion(options.recordings[motionRng() % options.recordings.size()], motionRng);
+            assignMotion(*badges[i], motion, motionRng, false);
+            assignMotion(*badges[i + 1], motion, motionRng, true);
+        }
+    }
+
+    // Badges get their tickets at staggered times so background advertising is not phase-locked
+    std::vector<uint64_t> assignUs(count);
+    for (size_t i = 0; i < count; i++) {
+        assignUs[i] = options.background ? (uint64_t)(unit(rng) * 1000000) : 0;
+    }
+    std::vector<bool> assigned(count, false);
+
+    uint64_t endUs = lastHandshakeUs + (PartnerSelector::COLLECTION_MAX_TIME + 500) * 1000ull;
+    for (uint64_t now = 0; now <= endUs; now += LOOP_PERIOD_US) {
+        radio.advance(now);
+        for (size_t i = 0; i < count; i++) {
+            radio.select(i);
+            if (!assigned[i]) {
+                if (now >= assignUs[i]) {
+                    badges[i]->assign(options.background);
+                    assigned[i] = true;
+                }
+                continue;
+            }
+            badges[i]->loop();
+        }
+    }
+
+    result.badges += count;
+    for (size_t i = 0; i < count; i++) {
+        const SimBadge& badge = *badges[i];
+        if (!badge.decided || badge.chosen == 0) {
+            result.none++;
+        } else if (badge.chosen == badge.partnerTicketId) {
+            result.success++;
+            result.pairMs.push_back((badge.decidedUs - badge.handshakeUs) / 1000.0f);
+            if (badge.firstResultUs != 0) {
+                result.firstResultMs.push_back(badge.firstResultUs / 1000.0f);
+            }
+        } else {
+            result.wrong++;
+        }
+
+        ScanStats stats = badges[i]->ble.getScanStats();
+        result.callbacks += stats.callbacks;
+        result.dropped += stats.dropped;
+    }
+    result.badgeSeconds += count * (endUs / 1e6);
+}
+
+// Share of sketches from `sketches` that match a history from `histories` at the firmware's threshold
+static float motionMatchRate(const std::vector<std::vector<float>>& histories, const std::vector<std::vector<float>>& sketches,
+                             bool sameRecording, std::mt19937& rng) {
+    static const int DRAWS = 20;
+    size_t matched = 0;
+    size_t scored = 0;
+    for (size_t i = 0; i < histories.size(); i++) {
+        for (int draw = 0; draw < DRAWS; draw++) {
+            size_t j = i;
+            if (!sameRecording) {
+                // Another recording; with one list, never the same one
+                j = rng() % sketches.size();
+                if (&histories == &sketches && sketches.size() > 1) {
+                    while (j == i) {
+                        j = rng() % sketches.size();
+                    }
+                }
+            }
+            int8_t history[MOTION_HISTORY_LENGTH];
+            int8_t sketch[MOTION_SKETCH_LENGTH];
+            int8_t unused[MOTION_HISTORY_LENGTH];
+            motionView(histories[i], rng, false, history, unused);
+            motionView(sketches[j], rng, true, unused, sketch);
+            if (motionCorrelation(sketch, MOTION_SKETCH_LENGTH, history, MOTION_HISTORY_LENGTH) >= PartnerSelector::MIN_MOTION_CORRELATION) {
+                matched++;
+            }
+            scored++;
+        }
+    }
+    return scored ? 100.0f * matched / scored : 0.0f;
+}
+
+static int runMotionCheck(const SimOptions& options) {
+    std::mt19937 rng(options.seed);
+    float same = motionMatchRate(options.recordings, options.recordings, true, rng);
+    float different = motionMatchRate(options.recordings, options.recordings, false, rng);
+    printf("Motion: %zu recording(s), sketches matched at r >= %d%%\n\n", options.recordings.size(), PartnerSelector::MIN_MOTION_CORRELATION);
+    printf("partner view of the same handshake  %5.1f%% match\n", same);
+    printf("another handshake                   %5.1f%% match\n", different);
+    if (!options.others.empty()) {
+        float other = motionMatchRate(options.recordings, options.others, false, rng);
+        printf("non-handshake motion (%3zu)          %5.1f%% match\n", options.others.size(), other);
+    }
+
+    if (options.checkPercent > 0.0f) {
+        bool passed = same >= options.checkPercent;
+        printf("\n%s: required %.1f%% of same-handshake views to match\n", passed ? "PASS" : "FAIL", options.checkPercent);
+        return passed ? 0 : 1;
+    }
+    return 0;
+}
+
+// A foreign advertisement: one AD structure of the given type and length, random body
+static std::vector<uint8_t> foreignPacket(std::mt19937& rng, uint8_t length, uint8_t type, const uint8_t* prefix, size_t prefixLength) {
+    std::vector<uint8_t> packet(length + 1);
+    packet[0] = length;
+    packet[1] = type;
+    for (size_t i = 2; i < packet.size(); i++) {
+        packet[i] = i - 2 < prefixLength ? prefix[i - 2] : (uint8_t)rng();
+    }
+    return packet;
+}
+
+static std::vector<uint8_t> badgePacket(uint16_t eventId, uint32_t ticketId) {
+    BadgeAdvertisement adv;
+    buildBadgeAdvertisement(adv, badgeIdentifierHash(BLE_IDENTIFIER), eventId, ticketId, -59);
+    const uint8_t* bytes = (const uint8_t*)&adv;
+    return std::vector<uint8_t>(bytes, bytes + sizeof(adv));
+}
+
+static int runReplay(const SimOptions& options) {
+    static const uint32_t SECONDS = 10;
+    static const uint64_t DRAIN_PERIOD_US = 10000;
+    static const size_t POOL = 4096;
+
+    SimRadio& radio = SimRadio::instance();
+    radio.reset(1, options.radio, options.seed);
+    radio.select(0);
+    BLE ble;
+    char ticket[16];
+    formatTicketId(100001, ticket, sizeof(ticket));
+    ble.begin();
+    ble.setTicketId(ticket);
+    ble.setEventId("E_01");
+
+    // Precomputed so the timed loop only runs the callback
+    std::mt19937 rng(options.seed);
+    const uint8_t apple[] = {0x4C, 0x00};
+    const uint8_t iBeacon[] = {0x4C, 0x00, 0x02, 0x15};
+    const uint8_t fastPair[] = {0x2C, 0xFE};
+    std::vector<NimBLEAdvertisedDevice> pool(POOL);
+    size_t badges = 0;
+    size_t otherEvent = 0;
+    for (size_t i = 0; i < POOL; i++) {
+        NimBLEAdvertisedDevice& device = pool[i];
+        // Badges spread evenly at exactly the requested share; the foreign kinds keep fixed proportions of the rest
+        uint32_t kind = rng() % 94;
+        if ((size_t)((i + 1) * options.badgePercent / 100.0f) > (size_t)(i * options.badgePercent / 100.0f)) {
+            bool ours = (badges + otherEvent) % 4 != 3;
+            device.payload = badgePacket(ours ? 1 : 2, 100002 + rng() % 200);
+            badges += ours;
+            otherEvent += !ours;
+        } else if (kind < 34) {
+            device.payload = foreignPacket(rng, 8 + rng() % 20, 0xFF, apple, sizeof(apple));
+        } else if (kind < 54) {
+            device.payload = foreignPacket(rng, 26, 0xFF, iBeacon, sizeof(iBeacon));
+        } else if (kind < 74) {
+            device.payload = foreignPacket(rng, 6 + rng() % 10, 0x16, fastPair, sizeof(fastPair));
+        } else if (kind < 84) {
+            device.payload = foreignPacket(rng, 2 + rng() % 28, 0xFF, nullptr, 0);
+        } else {
+            // Same length byte as a badge, so only the memcmp rejects it
+            device.payload = foreignPacket(rng, sizeof(BadgeAdvertisement) - 1, 0xFF, nullptr, 0);
+        }
+        device.rssi = -40 - (int)(rng() % 55);
+    }
+
+    uint64_t total = (uint64_t)options.replayRate * SECONDS;
+    uint64_t callbackNs = 0;
+    uint64_t sent = 0;
+    for (uint64_t sliceUs = 0; sent < total; sliceUs += DRAIN_PERIOD_US) {
+        uint64_t due = std::min(total, (sliceUs + DRAIN_PERIOD_US) * options.replayRate / 1000000);
+        SimClock::nowUs = sliceUs;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (; sent < due; sent++) {
+            ble.onResult(&pool[sent % POOL]);
+        }
+        callbackNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        ble.collectPackets();
+    }
+
+    ScanStats stats = ble.getScanStats();
+    double perCallbackNs = stats.callbacks ? (double)callbackNs / stats.callbacks : 0.0;
+    printf("Replay: %u adv/s for %u s, %.1f%% of the mix from badges of this event, %.1f%% from another event\n\n",
+           options.replayRate, SECONDS, 100.0 * badges / POOL, 100.0 * otherEvent / POOL);
+    printf("callbacks %u, accepted %u, rejected %u, dropped %u\n", stats.callbacks, stats.accepted,
+           stats.callbacks - stats.accepted, stats.dropped);
+    printf("%.0f ns per callback on this host, %.3f%% of one core at %u adv/s\n", perCallbackNs,
+           perCallbackNs * options.replayRate / 1e7, options.replayRate);
+    return stats.dropped == 0 ? 0 : 1;
+}
+
+static float percentile(std::vector<float>& values, float fraction) {
+    if (values.empty()) {
+        return 0.0f;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5f);
+    return values[index];
+}
+
+static std::vector<size_t> parseSizes(const char* text) {
+    std::vector<size_t> sizes;
+    while (*text) {
+        size_t size = strtoul(text, (char**)&text, 10);
+        // Badges come in handshake pairs
+        if (size >= 2) {
+            sizes.push_back(size & ~(size_t)1);
+        }
+        if (*text == ',') {
+            text++;
+        } else if (*text) {
+            break;
+        }
+    }
+    return sizes;
+}
+
+int main(int argc, char** argv) {
+    SimOptions options;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if (strcmp(arg, "--background") == 0) {
+            options.background = true;
+        } else if (strcmp(arg, "--verbose") == 0) {
+            SimSerial::enabled = true;
+        } else if (strcmp(arg, "--sizes") == 0) {
+            options.sizes = parseSizes(value);
+            i++;
+        } else if (strcmp(arg, "--trials") == 0) {
+            options.trials = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--spread") == 0) {
+            options.spreadUs = strtoull(value, nullptr, 10) * 1000;
+            i++;
+        } else if (strcmp(arg, "--density") == 0) {
+            options.density = atof(value);
+            i++;
+        } else if (strcmp(arg, "--loss") == 0) {
+            options.radio.packetLoss = atof(value);
+            i++;
+        } else if (strcmp(arg, "--shadowing") == 0) {
+            options.radio.shadowingDb = atof(value);
+            i++;
+        } else if (strcmp(arg, "--exponent") == 0) {
+            options.radio.pathLossExponent = atof(value);
+            i++;
+        } else if (strcmp(arg, "--capture") == 0) {
+            options.radio.captureDb = atof(value);
+            i++;
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.seed = strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--motion") == 0) {
+            if (loadRecordings(value, options.recordings) == 0) {
+                fprintf(stderr, "No usable recordings in %s\n", value);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(arg, "--check") == 0) {
+            options.checkPercent = atof(value);
+            i++;
+        } else if (strcmp(arg, "--motion-check") == 0) {
+            options.motionCheck = true;
+        } else if (strcmp(arg, "--motion-other") == 0) {
+            if (loadRecordings(value, options.others) == 0) {
+                fprintf(stderr, "No usable recordings in %s\n", value);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(arg, "--replay") == 0) {
+            options.replayRate = strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--badges") == 0) {
+            options.badgePercent = atof(value);
+            i++;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+    }
+
+    if (options.replayRate > 0) {
+        return runReplay(options);
+    }
+    if (options.motionCheck) {
+        if (options.recordings.empty()) {
+            fprintf(stderr, "--motion-check needs --motion DIR\n");
+            return 1;
+        }
+        return runMotionCheck(options);
+    }
+
+    printf("%s mode, %d trial(s) per size, handshakes spread over %llu ms, %.1f m2 per badge\n",
+           options.background ? "Background" : "Foreground", options.trials, (unsigned long long)(options.spreadUs / 1000), options.density);
+    printf("Radio: n=%.1f, shadowing %.1f dB, loss %.0f%%, partners %.1f m apart, accept <= %d cm\n\n",
+           options.radio.pathLossExponent, options.radio.shadowingDb, options.radio.packetLoss * 100.0f, PARTNER_DISTANCE_M, BLE_MAX_PARTNER_DISTANCE_CM);
+    if (!options.recordings.empty()) {
+        printf("Motion: %zu recording(s), sketches matched at r >= %d%%\n\n", options.recordings.size(), PartnerSelector::MIN_MOTION_CORRELATION);
+    }
+    printf("%7s %8s %8s %8s %9s %9s %9s %12s %9s\n", "badges", "success", "wrong", "none", "p50 ms", "p90 ms", "rx p50", "callbacks/s", "dropped");
+
+    bool passed = true;
+    for (size_t size : options.sizes) {
+        SimResult result;
+        for (int trial = 0; trial < options.trials; trial++) {
+            runTrial(size, options, options.seed * 7919u + (uint32_t)size * 31u + trial, result);
+        }
+        float total = result.badges ? (float)result.badges : 1.0f;
+        printf("%7zu %7.1f%% %7.1f%% %7.1f%% %9.0f %9.0f %9.1f %12.1f %9llu\n", size,
+               100.0f * result.success / total, 100.0f * result.wrong / total, 100.0f * result.none / total,
+               percentile(result.pairMs, 0.5f), percentile(result.pairMs, 0.9f), percentile(result.firstResultMs, 0.5f),
+               result.callbacks / (result.badgeSeconds > 0.0 ? result.badgeSeconds : 1.0), (unsigned long long)result.dropped);
+        if (100.0f * result.success / total < options.checkPercent) {
+            passed = false;
+        }
+    }
+
+    if (options.checkPercent > 0.0f) {
+        printf("\n%s: required %.1f%% success at every size\n", passed ? "PASS" : "FAIL", options.checkPercent);
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Minimal Arduino surface for building BLE.cpp on the host. Time comes from the
+// simulator's virtual clock, not the wall clock.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace SimClock {
+    extern uint64_t nowUs;
+}
+
+inline unsigned long millis() { return (unsigned long)(SimClock::nowUs / 1000); }
+inline unsigned long micros() { return (unsigned long)SimClock::nowUs; }
+inline void delay(unsigned long) {}
+inline uint32_t esp_random() { return (uint32_t)rand(); }
+
+// No tasks in the simulator: GATT claim exchanges are not simulated, so the claim task never starts
+typedef void* TaskHandle_t;
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define portMAX_DELAY 0xFFFFFFFFu
+inline int xTaskCreate(void (*)(void*), const char*, uint32_t, void*, unsigned, TaskHandle_t*) { return pdFAIL; }
+inline uint32_t ulTaskNotifyTake(int, uint32_t) { return 0; }
+inline void xTaskNotifyGive(TaskHandle_t) {}
+
+class String {
+private:
+    std::string _value;
+
+public:
+    String() {}
+    String(const char* value) : _value(value ? value : "") {}
+    String(const std::string& value) : _value(value) {}
+    String(int value) : _value(std::to_string(value)) {}
+    String(unsigned int value) : _value(std::to_string(value)) {}
+    String(long value) : _value(std::to_string(value)) {}
+    String(unsigned long value) : _value(std::to_string(value)) {}
+    String(float value) : _value(std::to_string(value)) {}
+
+    const char* c_str() const { return _value.c_str(); }
+    unsigned int length() const { return _value.length(); }
+    bool isEmpty() const { return _value.empty(); }
+    long toInt() const { return atol(_value.c_str()); }
+
+    String& operator+=(const String& other) { _value += other._value; return *this; }
+    bool operator==(const String& other) const { return _value == other._value; }
+    bool operator!=(const String& other) const { return _value != other._value; }
+    friend String operator+(String lhs, const String& rhs) { lhs += rhs; return lhs; }
+};
+
+class SimSerial {
+public:
+    static bool enabled;
+    void println(const String& line) { if (enabled) puts(line.c_str()); }
+    void print(const String& text) { if (enabled) fputs(text.c_str(), stdout); }
+};
+
+extern SimSerial Serial;
+
+#endif
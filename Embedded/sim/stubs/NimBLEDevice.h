@@ -0,0 +1,168 @@
+#ifndef SIM_NIMBLE_DEVICE_H
+#define SIM_NIMBLE_DEVICE_H
+
+// The subset of the NimBLE-Arduino 2.x API that BLE.cpp uses, backed by SimRadio.
+// Every badge owns one set of these objects; NimBLEDevice returns the set of the
+// badge SimRadio has currently selected, so many BLE instances share one process.
+
+#include <set>
+#include <vector>
+#include "Arduino.h"
+
+class NimBLEAdvertisedDevice;
+class NimBLECharacteristic;
+
+class NimBLEAddress {
+private:
+    uint8_t _value[6] = {0};
+    uint8_t _type = 0;
+
+public:
+    NimBLEAddress() {}
+    NimBLEAddress(const uint8_t* value, uint8_t type) : _type(type) { memcpy(_value, value, sizeof(_value)); }
+
+    const uint8_t* getVal() const { return _value; }
+    uint8_t getType() const { return _type; }
+};
+
+class NimBLEAdvertisedDevice {
+public:
+    std::vector<uint8_t> payload;
+    int rssi = 0;
+    NimBLEAddress address;
+
+    const std::vector<uint8_t>& getPayload() const { return payload; }
+    int getRSSI() const { return rssi; }
+    const NimBLEAddress& getAddress() const { return address; }
+};
+
+class NimBLEScanCallbacks {
+public:
+    virtual ~NimBLEScanCallbacks() {}
+    virtual void onResult(const NimBLEAdvertisedDevice* /*advertisedDevice*/) {}
+};
+
+class NimBLEScan {
+public:
+    size_t badge = 0;
+    NimBLEScanCallbacks* callbacks = nullptr;
+    uint16_t intervalMs = 100;
+    uint16_t windowMs = 100;
+    bool duplicateFilter = false;
+    bool scanning = false;
+    uint64_t startUs = 0;
+    std::set<size_t> seen;      // advertisers already reported since start, for the duplicate filter
+
+    void setScanCallbacks(NimBLEScanCallbacks* scanCallbacks) { callbacks = scanCallbacks; }
+    void setActiveScan(bool) {}
+    void setMaxResults(uint8_t) {}
+    void setInterval(uint16_t ms) { intervalMs = ms; }
+    void setWindow(uint16_t ms) { windowMs = ms; }
+    void setDuplicateFilter(bool enabled) { duplicateFilter = enabled; }
+    bool isScanning() { return scanning; }
+    bool start(uint32_t duration, bool isContinue);
+    bool stop() { scanning = false; return true; }
+};
+
+class NimBLEAdvertisementData {
+public:
+    std::vector<uint8_t> payload;
+
+    bool addData(const uint8_t* data, size_t length) {
+        payload.insert(payload.end(), data, data + length);
+        return payload.size() <= 31;
+    }
+};
+
+class NimBLEAdvertising {
+public:
+    size_t badge = 0;
+    std::vector<uint8_t> payload;
+    uint16_t intervalUnits = 48;    // 0.625 ms units
+    bool advertising = false;
+    uint32_t generation = 0;        // bumped on every start/stop so stale radio events are ignored
+    uint64_t lastEventUs = 0;
+
+    bool setAdvertisementData(const NimBLEAdvertisementData& data) { payload = data.payload; return true; }
+    void setMinInterval(uint16_t units) { intervalUnits = units; }
+    void setMaxInterval(uint16_t units) { intervalUnits = units; }
+    bool isAdvertising() { return advertising; }
+    bool start();
+    bool stop();
+};
+
+namespace NIMBLE_PROPERTY {
+    static const uint32_t WRITE = 0x0008;
+}
+
+class NimBLEConnInfo {};
+
+class NimBLEAttValue {
+public:
+    std::vector<uint8_t> value;
+
+    size_t size() const { return value.size(); }
+    const uint8_t* data() const { return value.data(); }
+};
+
+class NimBLECharacteristicCallbacks {
+public:
+    virtual ~NimBLECharacteristicCallbacks() {}
+    virtual void onWrite(NimBLECharacteristic* /*characteristic*/, NimBLEConnInfo& /*connInfo*/) {}
+};
+
+class NimBLECharacteristic {
+public:
+    NimBLECharacteristicCallbacks* callbacks = nullptr;
+    NimBLEAttValue value;
+
+    void setCallbacks(NimBLECharacteristicCallbacks* characteristicCallbacks) { callbacks = characteristicCallbacks; }
+    NimBLEAttValue getValue() { return value; }
+};
+
+class NimBLEService {
+public:
+    NimBLECharacteristic claim;
+
+    NimBLECharacteristic* createCharacteristic(const char*, uint32_t) { return &claim; }
+    bool start() { return true; }
+};
+
+class NimBLEServer {
+public:
+    NimBLEService service;
+
+    NimBLEService* createService(const char*) { return &service; }
+    void advertiseOnDisconnect(bool) {}
+};
+
+// GATT connections are not simulated: every connect attempt fails as if the peer were out of reach
+class NimBLERemoteCharacteristic {
+public:
+    bool writeValue(const uint8_t*, size_t, bool) { return false; }
+};
+
+class NimBLERemoteService {
+public:
+    NimBLERemoteCharacteristic* getCharacteristic(const char*) { return nullptr; }
+};
+
+class NimBLEClient {
+public:
+    void setConnectTimeout(uint32_t) {}
+    bool connect(const NimBLEAddress&, bool) { return false; }
+    NimBLERemoteService* getService(const char*) { return nullptr; }
+    bool disconnect() { return true; }
+};
+
+class NimBLEDevice {
+public:
+    static bool init(const char* name);
+    static NimBLEScan* getScan();
+    static NimBLEAdvertising* getAdvertising();
+    static NimBLEServer* createServer();
+    static NimBLEClient* createClient() { return new NimBLEClient(); }
+    static bool deleteClient(NimBLEClient* client) { delete client; return true; }
+};
+
+#endif
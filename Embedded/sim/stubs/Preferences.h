@@ -0,0 +1,42 @@
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+// In-memory stand-in for the ESP32 NVS Preferences API
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+class Preferences {
+private:
+    std::map<std::string, std::vector<uint8_t>> _values;
+
+public:
+    bool begin(const char*, bool) { return true; }
+
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        const uint8_t* bytes = (const uint8_t*)value;
+        _values[key].assign(bytes, bytes + length);
+        return length;
+    }
+
+    size_t getBytes(const char* key, void* value, size_t length) {
+        auto it = _values.find(key);
+        if (it == _values.end() || it->second.size() > length) {
+            return 0;
+        }
+        memcpy(value, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t putUShort(const char* key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+
+    uint16_t getUShort(const char* key, uint16_t defaultValue) {
+        uint16_t value = defaultValue;
+        getBytes(key, &value, sizeof(value));
+        return value;
+    }
+};
+
+#endif
@@ -1,21 +1,74 @@
 #include "BLE.h"
 
 BLE::BLE() {
-    _identifier = BLE_IDENTIFIER;
+    _identifier = badgeIdentifierHash(BLE_IDENTIFIER);
+    _maxPathLoss = 10.0f * BLE_PATH_LOSS_EXPONENT * log10f(BLE_MAX_PARTNER_DISTANCE_CM / 100.0f);
+    buildBadgeAdvertisement(_expectedHeader, _identifier, _eventId, 0);
 }
 
-void BLE::advertise(){
+// Initialize the NimBLE host stack and scan callbacks once for the life of the device
+void BLE::begin() {
+    if (_initialized) {
+        return;
+    }
     NimBLEDevice::init("");
-    NimBLEAdvertisementData advData;
+
+    NimBLEScan* scan = NimBLEDevice::getScan();
+    scan->setScanCallbacks(this);
+    scan->setActiveScan(false);
+    // Deliver results through onResult only; never keep the whole crowd in NimBLE's result list
+    scan->setMaxResults(0);
+
+    // Peers write their handshake claim here when MQTT is down on their side
+    NimBLEServer* server = NimBLEDevice::createServer();
+    NimBLEService* service = server->createService(BADGE_SERVICE_UUID);
+    NimBLECharacteristic* claim = service->createCharacteristic(BADGE_CLAIM_UUID, NIMBLE_PROPERTY::WRITE);
+    claim->setCallbacks(this);
+    service->start();
+    server->advertiseOnDisconnect(false);
+
+    _initialized = true;
+    _buildAdvertisement();
+}
+
+void BLE::_buildAdvertisement() {
+    BadgeAdvertisement badge;
+    buildBadgeAdvertisement(badge, _identifier, _eventId, _ticketId, BLE_TX_POWER_1M);
+    badge.sketchSeq = _sketchSeq;
+    memcpy(badge.sketch, _sketch, sizeof(badge.sketch));
+
+    _advData = NimBLEAdvertisementData();
+    _advData.addData((const uint8_t*)&badge, sizeof(badge));
+
+    if (_initialized && NimBLEDevice::getAdvertising()->setAdvertisementData(_advData) && _advertising) {
+        // Already advertising in background mode: the new sketch is on air from here
+        _markAdvOnAir();
+    }
+}
+
+// First advertisement on air since the handshake, main loop only
+void BLE::_markAdvOnAir() {
+    unsigned long handshakeUs = _handshakeUs.load();
+    if (handshakeUs != 0 && _advLatencyUs == 0) {
+        _advLatencyUs = micros() - handshakeUs;
+    }
+}
+
+void BLE::advertise(){
     NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
 
-    String stringData = _identifier + _eventId + _ticketId;
-    advData.setName("EZ");
-    advData.addData((uint8_t *)stringData.c_str(), stringData.length()); 
-    adv->setAdvertisementData(advData);
+    // Advertising intervals are in 0.625 ms units
+    uint16_t intervalMs = _background ? _backgroundAdvIntervalMs : _FOREGROUND_ADV_INTERVAL_MS;
+    adv->setMinInterval(intervalMs * 8 / 5);
+    adv->setMaxInterval(intervalMs * 8 / 5);
 
+    if (adv->isAdvertising()) {
+        adv->stop();
+    }
     bool started = adv->start();
+    _advertising = started;
     if (started) {
+        _markAdvOnAir();
        // Serial.println("Advertising started successfully");
     } else {
         //Serial.println("Failed to start advertising");
@@ -23,10 +76,22 @@ void BLE::advertise(){
 }
 
 void BLE::scan() {
+    if (_claimState == CLAIM_SENDING) {
+        _resumeScanAfterClaim = true;
+        return;
+    }
     NimBLEScan* scan = NimBLEDevice::getScan();
-    scan -> setScanCallbacks(this);
+    scan->setInterval(_background ? _backgroundScanIntervalMs : _FOREGROUND_SCAN_MS);
+    scan->setWindow(_background ? _backgroundScanWindowMs : _FOREGROUND_SCAN_MS);
+    // Foreground windows need every packet for RSSI statistics, so only filter in the background
+    scan->setDuplicateFilter(BLE_CONTROLLER_DEDUP && _background);
 
-    if(scan->start(0, false)){
+    if (scan->isScanning()) {
+        scan->stop();
+    }
+    _scanning = scan->start(0, false);
+    _dedupEpochStart = millis();
+    if(_scanning){
        // Serial.println("Scanning started successfully");
     } else {
         //Serial.println("Failed to start scanning");
@@ -34,33 +99,37 @@ void BLE::scan() {
 }
 
 void BLE::onResult(const NimBLEAdvertisedDevice* device) {
-    if (String(device->getName().c_str()) == "EZ") {
-        std::vector<uint8_t> payload = device->getPayload();
-        std::string payloadStr(payload.begin(), payload.end()); 
-        String payloadArdStr = String(payloadStr.substr(2, 21).c_str());
-
-        // Serial.println(device->getRSSI() > _RSSI_THRESHOLD);
-
-        if(payloadArdStr.substring(2,8) == _identifier && payloadArdStr.substring(8,12) == _eventId && device->getRSSI() > _RSSI_THRESHOLD) {
-            //Serial.println("Detected RSSI: " + String(device->getRSSI()) + " Threshold: " + String(_RSSI_THRESHOLD));
-            //Serial.println("Valid advertisement detected from: " + String(device->getName().c_str()));
-            String detectedTicket = payloadArdStr.substring(12,21);
-            String rssi = String(device->getRSSI());
-            bool found = false;
-            for (const auto& packet : _incomingPackets) {
-                if (packet[0] == detectedTicket) {  
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {  
-                std::vector<String> newPacket = {detectedTicket, rssi};
-                _incomingPackets.push_back(newPacket); 
-                // Serial.println("Detected ticket: " + detectedTicket + " RSSI: " + rssi);
-            } 
-        }
+    unsigned long startUs = micros();
+    _callbacks.fetch_add(1, std::memory_order_relaxed);
+
+    // Reject foreign packets on a fixed-offset compare before anything is copied.
+    // The length and AD type bytes go first so most phones and beacons fail on one byte.
+    const std::vector<uint8_t>& payload = device->getPayload();
+    if (payload.size() < sizeof(BadgeAdvertisement) ||
+        payload[0] != _expectedHeader.length ||
+        memcmp(payload.data(), &_expectedHeader, BADGE_ADV_MATCH_LENGTH) != 0) {
+        _callbackUs.fetch_add(micros() - startUs, std::memory_order_relaxed);
+        return;
+    }
+    _accepted.fetch_add(1, std::memory_order_relaxed);
+
+    ScanRecord record;
+    memcpy(&record.ticketId, payload.data() + offsetof(BadgeAdvertisement, ticketId), sizeof(record.ticketId));
+    record.rssi = (int8_t)device->getRSSI();
+    record.txPower = (int8_t)payload[offsetof(BadgeAdvertisement, txPower)];
+    record.timestamp = millis();
+    record.sketchSeq = payload[offsetof(BadgeAdvertisement, sketchSeq)];
+    memcpy(record.sketch, payload.data() + offsetof(BadgeAdvertisement, sketch), sizeof(record.sketch));
+    memcpy(record.address, device->getAddress().getVal(), sizeof(record.address));
+    record.addressType = device->getAddress().getType();
+    _incomingPackets.push(record);
+
+    unsigned long handshakeUs = _handshakeUs.load();
+    unsigned long unset = 0;
+    if (handshakeUs != 0) {
+        _firstResultLatencyUs.compare_exchange_strong(unset, micros() - handshakeUs);
     }
+    _callbackUs.fetch_add(micros() - startUs, std::memory_order_relaxed);
 }
 
 String BLE::getDetectedTicket() {
@@ -68,30 +137,262 @@ String BLE::getDetectedTicket() {
 }
 
 void BLE::setTicketId(String ticketID){
-    _ticketId = ticketID;
+    _ticketId = parseBadgeNumber(ticketID.c_str());
+    _buildAdvertisement();
 }
 
 void BLE::setEventId(String eventID){
-    _eventId = eventID;
+    // Checked at boot; an unusable id keeps the last one rather than advertising a truncated number
+    parseEventId(eventID.c_str(), _eventId);
+    buildBadgeAdvertisement(_expectedHeader, _identifier, _eventId, 0);
+    _buildAdvertisement();
 }
 
 void BLE::stopAdvertising() {
     NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
     adv->stop();
+    _advertising = false;
     // Serial.println("Advertising stopped");
 }
 
 void BLE::stopScanning() {
     NimBLEScan* scan = NimBLEDevice::getScan();
     scan->stop();
+    _scanning = false;
+    _resumeScanAfterClaim = false;
     _incomingPackets.clear();
     // Serial.println("Scanning stopped");
 }
 
-std::vector<std::vector<String>> BLE::getIncomingPackets() {
-    return _incomingPackets;
+const ScanRecord* BLE::peekPacket() {
+    return _incomingPackets.front();
+}
+
+void BLE::popPacket() {
+    _incomingPackets.pop();
+}
+
+// Drain the scan queue into the per-peer statistics. Main loop only.
+void BLE::collectPackets() {
+    for (const ScanRecord* packet = _incomingPackets.front(); packet != nullptr; packet = _incomingPackets.front()) {
+        _peers.record(packet->ticketId, packet->rssi, packet->txPower, packet->timestamp);
+        _peers.recordSketch(packet->ticketId, packet->sketchSeq, packet->sketch, packet->timestamp);
+        _peers.recordAddress(packet->ticketId, packet->address, packet->addressType);
+        _incomingPackets.pop();
+    }
+}
+
+bool BLE::inRange(const PeerStats* peer) {
+    return peer != nullptr && peer->pathLoss() <= _maxPathLoss;
+}
+
+float BLE::distanceTo(const PeerStats* peer) {
+    return peer->distance(BLE_PATH_LOSS_EXPONENT);
+}
+
+// Closest peer by Kalman-filtered path loss, if it is within the partner distance
+const PeerStats* BLE::bestPeer(uint16_t minSamples, uint32_t maxAge) {
+    const PeerStats* peer = _peers.best(minSamples, millis(), maxAge);
+    return inRange(peer) ? peer : nullptr;
+}
+
+// Closest peer only if it is in range and beats every other peer by margin dB of path loss
+const PeerStats* BLE::dominantPeer(uint16_t minSamples, int margin, uint32_t maxAge, int* leadOut) {
+    const PeerStats* leader = nullptr;
+    int lead = _peers.lead(millis(), maxAge, _maxPathLoss, &leader);
+    if (leadOut != nullptr) {
+        *leadOut = lead;
+    }
+
+    if (!inRange(leader) || leader->count < minSamples || lead < margin) {
+        return nullptr;
+    }
+    return leader;
+}
+
+// The only peer within the partner distance heard within maxAge ms, once it has minSamples readings.
+// With nobody to confuse it with, waiting for a margin or more samples only delays the decision.
+const PeerStats* BLE::soleCandidate(uint16_t minSamples, uint32_t maxAge) {
+    uint32_t now = millis();
+    if (_peers.within(now, maxAge, _maxPathLoss) != 1) {
+        return nullptr;
+    }
+    const PeerStats* peer = _peers.best(minSamples, now, maxAge);
+    return inRange(peer) ? peer : nullptr;
+}
+
+// Whether any peer within the partner distance has been heard within maxAge ms
+bool BLE::hasCandidates(uint32_t maxAge) {
+    return bestPeer(1, maxAge) != nullptr;
+}
+
+// Advertise the fingerprint of the handshake just detected
+void BLE::setMotionSketch(const int8_t* sketch) {
+    memcpy(_sketch, sketch, sizeof(_sketch));
+    _sketchSeq = _sketchSeq == UINT8_MAX ? 1 : _sketchSeq + 1;
+    _buildAdvertisement();
+}
+
+// How well the sketch an in-range peer advertised within maxAge ms matches our own recent motion,
+// x100; 0 without one
+int BLE::motionMatch(const PeerStats* peer, const int8_t* history, uint32_t maxAge) {
+    if (!inRange(peer) || peer->sketchSeq == 0 || millis() - peer->sketchSeen > maxAge) {
+        return 0;
+    }
+    return motionCorrelation(peer->sketch, MOTION_SKETCH_LENGTH, history, MOTION_HISTORY_LENGTH);
+}
+
+void BLE::clearPeers() {
+    _peers.clear();
+}
+
+void BLE::expirePeers(uint32_t maxAge) {
+    _peers.expire(millis(), maxAge);
+}
+
+void BLE::setBackgroundDutyCycle(uint16_t scanWindowMs, uint16_t scanIntervalMs, uint16_t advIntervalMs) {
+    _backgroundScanWindowMs = scanWindowMs < scanIntervalMs ? scanWindowMs : scanIntervalMs;
+    _backgroundScanIntervalMs = scanIntervalMs;
+    _backgroundAdvIntervalMs = advIntervalMs;
+}
+
+// Switch between background and foreground duty, restarting whatever is running
+void BLE::setBackground(bool background) {
+    if (_background == background) {
+        return;
+    }
+    _background = background;
+    if (_advertising) {
+        advertise();
+    }
+    if (_scanning) {
+        scan();
+    }
+}
+
+bool BLE::isBackground() {
+    return _background;
 }
 
 void BLE::setTicket(String ticket) {
     _detectedTicket = ticket;
+}
+
+// A peer wrote its claim to us; only keep it if we are the partner it names
+void BLE::onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& /*connInfo*/) {
+    NimBLEAttValue value = characteristic->getValue();
+    if (value.size() != sizeof(HandshakeClaim)) {
+        return;
+    }
+    HandshakeClaim claim;
+    memcpy(&claim, value.data(), sizeof(claim));
+    if (claim.partnerTicketId == _ticketId) {
+        _receivedClaims.push(claim);
+    }
+}
+
+bool BLE::startClaimExchange(const PeerStats& partner, const HandshakeClaim& claim) {
+    if (_claimState != CLAIM_IDLE) {
+        return false;
+    }
+    if (_claimTask == nullptr &&
+        xTaskCreate(_claimTaskLoop, "ble_claim", BLE_CLAIM_TASK_STACK, this, 1, &_claimTask) != pdPASS) {
+        _claimTask = nullptr;
+        Serial.println("[BLE] Failed to start claim task");
+        return false;
+    }
+
+    memcpy(_claimAddress, partner.address, sizeof(_claimAddress));
+    _claimAddressType = partner.addressType;
+    _claimOut = claim;
+    // The controller can't connect while it scans; scan() holds off until the exchange is done
+    _resumeScanAfterClaim = _scanning;
+    if (_scanning) {
+        NimBLEDevice::getScan()->stop();
+    }
+    _claimState = CLAIM_SENDING;
+    xTaskNotifyGive(_claimTask);
+    return true;
+}
+
+void BLE::_claimTaskLoop(void* arg) {
+    BLE* ble = (BLE*)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ble->_claimState = ble->_sendClaim() ? CLAIM_DELIVERED : CLAIM_FAILED;
+    }
+}
+
+// Short GATT connection to the partner to hand over our claim; runs on the claim task
+bool BLE::_sendClaim() {
+    NimBLEClient* client = NimBLEDevice::createClient();
+    client->setConnectTimeout(_CONNECT_TIMEOUT_MS);
+
+    bool written = false;
+    if (client->connect(NimBLEAddress(_claimAddress, _claimAddressType), false)) {
+        NimBLERemoteService* service = client->getService(BADGE_SERVICE_UUID);
+        NimBLERemoteCharacteristic* characteristic = service ? service->getCharacteristic(BADGE_CLAIM_UUID) : nullptr;
+        if (characteristic != nullptr) {
+            written = characteristic->writeValue((const uint8_t*)&_claimOut, sizeof(_claimOut), true);
+        }
+        client->disconnect();
+    }
+    NimBLEDevice::deleteClient(client);
+    return written;
+}
+
+ClaimExchangeState BLE::pollClaimExchange() {
+    ClaimExchangeState state = _claimState;
+    if (state != CLAIM_DELIVERED && state != CLAIM_FAILED) {
+        return state;
+    }
+    _claimState = CLAIM_IDLE;
+    if (_resumeScanAfterClaim) {
+        _resumeScanAfterClaim = false;
+        scan();
+    }
+    Serial.println(state == CLAIM_DELIVERED ? "[BLE] Handshake claim delivered over GATT" : "[BLE] GATT claim exchange failed");
+    return state;
+}
+
+bool BLE::receivedClaim(HandshakeClaim& claim) {
+    const HandshakeClaim* front = _receivedClaims.front();
+    if (front == nullptr) {
+        return false;
+    }
+    claim = *front;
+    _receivedClaims.pop();
+    return true;
+}
+
+// Restart the background scan once per epoch so the controller's duplicate cache is cleared
+void BLE::refreshDuplicateFilter() {
+    if (BLE_CONTROLLER_DEDUP && _background && _scanning && millis() - _dedupEpochStart >= BLE_DEDUP_EPOCH_MS) {
+        scan();
+    }
+}
+
+ScanStats BLE::getScanStats() {
+    ScanStats stats;
+    stats.callbacks = _callbacks.load(std::memory_order_relaxed);
+    stats.accepted = _accepted.load(std::memory_order_relaxed);
+    stats.rejected = stats.callbacks - stats.accepted;
+    stats.dropped = _incomingPackets.dropped();
+    stats.callbackUs = _callbackUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Start timing from handshake detection to the first advertisement and scan result
+void BLE::markHandshake() {
+    _advLatencyUs = 0;
+    _firstResultLatencyUs.store(0);
+    _handshakeUs.store(micros());
+}
+
+unsigned long BLE::getAdvLatency() {
+    return _advLatencyUs;
+}
+
+unsigned long BLE::getFirstResultLatency() {
+    return _firstResultLatencyUs.load();
 }
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "BadgeMessage.h"
+#include <string.h>
+
+namespace {
+
+// Bounds-checked cursors; the first failure sticks and everything after it is a no-op
+struct Writer {
+    uint8_t* out;
+    size_t capacity;
+    size_t length;
+    bool ok;
+
+    Writer(uint8_t* buffer, size_t size) : out(buffer), capacity(size), length(0), ok(buffer != nullptr) {}
+
+    void bytes(const void* data, size_t count) {
+        if (!ok || count > capacity - length) {
+            ok = false;
+            return;
+        }
+        // A null text has nothing to copy, and memcpy may not be passed null even for zero bytes
+        if (count == 0) {
+            return;
+        }
+        memcpy(out + length, data, count);
+        length += count;
+    }
+
+    void u8(uint8_t value) {
+        bytes(&value, 1);
+    }
+
+    void u16(uint16_t value) {
+        uint8_t le[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+        bytes(le, sizeof(le));
+    }
+
+    void u32(uint32_t value) {
+        uint8_t le[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+        bytes(le, sizeof(le));
+    }
+
+    void text(const char* value) {
+        size_t count = value ? strlen(value) : 0;
+        if (count > UINT8_MAX) {
+            ok = false;
+            return;
+        }
+        u8((uint8_t)count);
+        bytes(value, count);
+    }
+
+    size_t finish() {
+        return ok ? length : 0;
+    }
+};
+
+struct Reader {
+    const uint8_t* in;
+    size_t length;
+    size_t position;
+    bool ok;
+
+    Reader(const uint8_t* data, size_t size) : in(data), length(size), position(0), ok(data != nullptr) {}
+
+    const uint8_t* take(size_t count) {
+        if (!ok || count > length - position) {
+            ok = false;
+            return nullptr;
+        }
+        const uint8_t* start = in + position;
+        position += count;
+        return start;
+    }
+
+    uint8_t u8() {
+        const uint8_t* p = take(1);
+        return p ? p[0] : 0;
+    }
+
+    uint16_t u16() {
+        const uint8_t* p = take(2);
+        return p ? (uint16_t)(p[0] | p[1] << 8) : 0;
+    }
+
+    uint32_t u32() {
+        const uint8_t* p = take(4);
+        return p ? (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24 : 0;
+    }
+
+    BadgeText text() {
+        BadgeText value = {nullptr, 0};
+        uint8_t count = u8();
+        const uint8_t* p = take(count);
+        if (p != nullptr) {
+            value.data = (const char*)p;
+            value.length = count;
+        }
+        return value;
+    }
+};
+
+void header(Writer& writer, BadgeMessageType type) {
+    writer.u8(BADGE_MESSAGE_VERSION);
+    writer.u8(type);
+}
+
+void counterList(Writer& writer, const BadgeCounter* counters, uint8_t count) {
+    writer.u8(count);
+    for (uint8_t i = 0; i < count; i++) {
+        writer.u8(counters[i].id);
+        writer.u32(counters[i].value);
+    }
+}
+
+bool readCounters(Reader& reader, BadgeMessage& out) {
+    out.count = reader.u8();
+    if (out.count > BADGE_MESSAGE_MAX_COUNTERS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < out.count; i++) {
+        out.counters[i].id = reader.u8();
+        out.counters[i].value = reader.u32();
+    }
+    return true;
+}
+
+}
+
+size_t encodeAvailability(uint8_t* out, size_t capacity, const char* eventId, const char* deviceId, bool available) {
+    Writer writer(out, capacity);
+    header(writer, BADGE_MSG_AVAILABILITY);
+    writer.text(eventId);
+    writer.text(deviceId);
+    writer.u8(available ? 1 : 0);
+    return writer.finish();
+}
+
+size_t encodeReceipt(uint8_t* out, size_t capacity, const char* command, const char* status) {
+    Writer writer(out, capacity);
+    header(writer, BADGE_MSG_RECEIPT);
+    writer.u8(1);
+    writer.text(command);
+    writer.text(status);
+    return writer.finish();
+}
+
+size_t encodeProfileSwap(uint8_t* out, size_t capacity, const char* eventId, uint32_t ticketId, uint32_t partnerTicketId) {
+    Writer writer(out, capacity);
+    header(writer, BADGE_MSG_PROFILE_SWAP);
+    writer.text(eventId);
+    writer.u32(ticketId);
+    writer.u32(partnerTicketId);
+    writer.u8(0);
+    return writer.finish();
+}
+
+size_t encodeProfileSwapClaim(uint8_t* out, size_t capacity, const char* eventId, uint32_t ticketId, uint32_t partnerTicketId,
+                              uint32_t timestamp, uint32_t nonce) {
+    Writer writer(out, capacity);
+    header(writer, BADGE_MSG_PROFILE_SWAP);
+    writer.text(eventId);
+    writer.u32(ticketId);
+    writer.u32(partnerTicketId);
+    writer.u8(BADGE_SWAP_HAS_CLAIM);
+    writer.u32(timestamp);
+    writer.u32(nonce);
+    return writer.finish();
+}
+
+size_t encodeTelemetry(uint8_t* out, size_t capacity, const BadgeCounter* counters, uint8_t count) {
+    if (count > BADGE_MESSAGE_MAX_COUNTERS) {
+        return 0;
+    }
+    Writer writer(out, capacity);
+    header(writer, BADGE_MSG_TELEMETRY);
+    counterList(writer, counters, count);
+    return writer.finish();
+}
+
+size_t encodeLinkHealth(uint8_t* out, size_t capacity, const BadgeCounter* counters, uint8_t count,
+                        const BadgeHistogram* histograms, uint8_t histogramCount) {
+    if (count > BADGE_MESSAGE_MAX_COUNTERS || histogramCount > BADGE_MESSAGE_MAX_HISTOGRAMS) {
+        return 0;
+    }
+    Writer writer(out, capacity);
+    header(writer, BADGE_MSG_LINK_HEALTH);
+    counterList(writer, counters, count);
+    writer.u8(histogramCount);
+    for (uint8_t i = 0; i < histogramCount; i++) {
+        if (histograms[i].buckets > BADGE_MESSAGE_MAX_BUCKETS) {
+            return 0;
+        }
+        writer.u8(histograms[i].id);
+        writer.u8(histograms[i].buckets);
+        for (uint8_t b = 0; b < histograms[i].buckets; b++) {
+            writer.u16(histograms[i].counts[b]);
+        }
+    }
+    return writer.finish();
+}
+
+// Receipt layout: version, type, count, then the receipts back to back
+size_t mergeReceipts(uint8_t* batch, size_t batchLength, size_t capacity, const uint8_t* receipt, size_t receiptLength) {
+    static const size_t PREFIX = 3;
+    if (batchLength < PREFIX || receiptLength < PREFIX ||
+        batch[0] != BADGE_MESSAGE_VERSION || batch[1] != BADGE_MSG_RECEIPT ||
+        receipt[0] != BADGE_MESSAGE_VERSION || receipt[1] != BADGE_MSG_RECEIPT ||
+        batch[2] + receipt[2] > BADGE_MESSAGE_MAX_RECEIPTS ||
+        receiptLength - PREFIX > capacity - batchLength) {
+        return 0;
+    }
+    memcpy(batch + batchLength, receipt + PREFIX, receiptLength - PREFIX);
+    batch[2] += receipt[2];
+    return batchLength + receiptLength - PREFIX;
+}
+
+bool decodeBadgeMessage(const uint8_t* data, size_t length, BadgeMessage& out) {
+    memset(&out, 0, sizeof(out));
+    Reader reader(data, length);
+    if (reader.u8() != BADGE_MESSAGE_VERSION) {
+        return false;
+    }
+    out.type = (BadgeMessageType)reader.u8();
+
+    switch (out.type) {
+        case BADGE_MSG_AVAILABILITY:
+            out.eventId = reader.text();
+            out.deviceId = reader.text();
+            out.available = reader.u8() != 0;
+            break;
+        case BADGE_MSG_RECEIPT:
+            out.count = reader.u8();
+            if (out.count == 0 || out.count > BADGE_MESSAGE_MAX_RECEIPTS) {
+                return false;
+            }
+            for (uint8_t i = 0; i < out.count; i++) {
+                out.receipts[i].command = reader.text();
+                out.receipts[i].status = reader.text();
+            }
+            break;
+        case BADGE_MSG_PROFILE_SWAP:
+            out.eventId = reader.text();
+            out.ticketId = reader.u32();
+            out.partnerTicketId = reader.u32();
+            out.flags = reader.u8();
+            if (out.flags & ~BADGE_SWAP_HAS_CLAIM) {
+                return false;
+            }
+            if (out.flags & BADGE_SWAP_HAS_CLAIM) {
+                out.timestamp = reader.u32();
+                out.nonce = reader.u32();
+            }
+            break;
+        case BADGE_MSG_TELEMETRY:
+            if (!readCounters(reader, out)) {
+                return false;
+            }
+            break;
+        case BADGE_MSG_LINK_HEALTH:
+            if (!readCounters(reader, out)) {
+                return false;
+            }
+            out.histogramCount = reader.u8();
+            if (out.histogramCount > BADGE_MESSAGE_MAX_HISTOGRAMS) {
+                return false;
+            }
+            for (uint8_t i = 0; i < out.histogramCount; i++) {
+                BadgeHistogram& histogram = out.histograms[i];
+                histogram.id = reader.u8();
+                histogram.buckets = reader.u8();
+                if (histogram.buckets > BADGE_MESSAGE_MAX_BUCKETS) {
+                    return false;
+                }
+                for (uint8_t b = 0; b < histogram.buckets; b++) {
+                    histogram.counts[b] = reader.u16();
+                }
+            }
+            break;
+        default:
+            return false;
+    }
+    return reader.ok && reader.position == length;
+}
@@ -0,0 +1,192 @@
+#include "BadgePublisher.h"
+#include "BadgeAdvertisement.h"
+#include "BadgeMessage.h"
+#include "JsonWriter.h"
+#include <string.h>
+
+bool BadgePublisher::availability(const char* eventId, const char* deviceId) {
+    if (_binary) {
+        uint8_t message[MQTT_QUEUED_PAYLOAD_SIZE];
+        size_t length = encodeAvailability(message, sizeof(message), eventId, deviceId, true);
+        return _queue.push(PUBLISH_AVAILABILITY, message, length);
+    }
+    char payload[MQTT_QUEUED_PAYLOAD_SIZE];
+    JsonWriter json(payload, sizeof(payload));
+    json.field("event_id", eventId)
+        .field("device_id", deviceId)
+        .field("is_available", true)
+        .field("encodings", "json,binary")
+        .field("receipt_batch", (uint32_t)_receiptBatch);
+    return _queue.push(PUBLISH_AVAILABILITY, json.finish());
+}
+
+bool BadgePublisher::receipt(const char* command, const char* status) {
+    if (_binary) {
+        uint8_t message[MQTT_QUEUED_PAYLOAD_SIZE];
+        size_t length = encodeReceipt(message, sizeof(message), command, status);
+        return _queue.push(PUBLISH_RECEIPT, message, length);
+    }
+    char payload[MQTT_QUEUED_PAYLOAD_SIZE];
+    JsonWriter json(payload, sizeof(payload));
+    json.field("command", command)
+        .field("status", status);
+    return _queue.push(PUBLISH_RECEIPT, json.finish());
+}
+
+bool BadgePublisher::profileSwap(const char* eventId, const char* ticketId, const char* partnerTicketId) {
+    if (_binary) {
+        uint8_t message[MQTT_QUEUED_PAYLOAD_SIZE];
+        size_t length = encodeProfileSwap(message, sizeof(message), eventId, parseBadgeNumber(ticketId),
+                                          parseBadgeNumber(partnerTicketId));
+        return _queue.push(PUBLISH_PROFILE_SWAP, message, length);
+    }
+    char payload[MQTT_QUEUED_PAYLOAD_SIZE];
+    JsonWriter json(payload, sizeof(payload));
+    json.field("event_id", eventId)
+        .field("ticket_id", ticketId)
+        .field("ticket_id_to_swap", partnerTicketId);
+    return _queue.push(PUBLISH_PROFILE_SWAP, json.finish());
+}
+
+bool BadgePublisher::negotiate(TopicRoute route, const uint8_t* payload, size_t length) {
+    switch (route) {
+        case ROUTE_ENCODING:
+            if (length == 6 && memcmp(payload, "binary", 6) == 0) {
+                _binary = true;
+            } else if (length == 4 && memcmp(payload, "json", 4) == 0) {
+                _binary = false;
+            } else {
+                return receipt("encoding", "unsupported");
+            }
+            return receipt("encoding", _binary ? "binary" : "json");
+        case ROUTE_RECEIPT_BATCH:
+            if (length == 2 && memcmp(payload, "on", 2) == 0) {
+                _batchJsonReceipts = true;
+            } else if (length == 3 && memcmp(payload, "off", 3) == 0) {
+                _batchJsonReceipts = false;
+            } else {
+                return receipt("receipt_batch", "unsupported");
+            }
+            return receipt("receipt_batch", _batchJsonReceipts ? "on" : "off");
+        default:
+            return true;
+    }
+}
+
+// Consecutive receipts in the same encoding are coalesced, into one multi-receipt BadgeMessage or,
+// once negotiated, a JSON array, so a burst costs a single TLS record.
+// Stops when the client's in-flight window or buffer is full and retries later; once the client has
+// taken a message it owns delivery, including the resend after a reconnect.
+uint16_t BadgePublisher::drain(Mqtt5Client& client, const TopicRouter& router, const char* deviceId, uint16_t maxPublishes,
+                               uint8_t qos) {
+    char fullTopic[MQTT_TOPIC_SIZE];
+    char batch[MQTT_PAYLOAD_SIZE];
+    uint16_t unaddressable = 0;
+
+    for (uint16_t sent = 0; sent < maxPublishes && _queue.size() > 0; sent++) {
+        const QueuedPublish* first = _queue.at(0);
+        const char* payload = first->payload;
+        size_t length = first->length;
+        uint16_t count = 1;
+
+        if (first->kind == PUBLISH_RECEIPT && _receiptBatch > 1 && (first->binary || _batchJsonReceipts)) {
+            size_t used = 0;
+            count = 0;
+            for (const QueuedPublish* next = first;
+                 next != nullptr && next->kind == PUBLISH_RECEIPT && next->binary == first->binary && count < _receiptBatch;
+                 next = _queue.at(count)) {
+                if (!first->binary) {
+                    if (used + next->length + 2 > sizeof(batch)) {
+                        break;
+                    }
+                    batch[used++] = count > 0 ? ',' : '[';
+                    memcpy(batch + used, next->payload, next->length);
+                    used += next->length;
+                } else if (count == 0) {
+                    memcpy(batch, next->payload, next->length);
+                    used = next->length;
+                } else {
+                    size_t merged = mergeReceipts((uint8_t*)batch, used, sizeof(batch), (const uint8_t*)next->payload, next->length);
+                    if (merged == 0) {
+                        break;
+                    }
+                    used = merged;
+                }
+                count++;
+            }
+            if (!first->binary) {
+                batch[used++] = ']';
+            }
+
+            if (count > 1) {
+                payload = batch;
+                length = used;
+            } else {
+                count = 1;
+            }
+        }
+
+        const char* topic = nullptr;
+        switch (first->kind) {
+            case PUBLISH_AVAILABILITY:
+                topic = joinTopic(fullTopic, sizeof(fullTopic), {router.eventPrefix(), "available_devices/", deviceId});
+                break;
+            case PUBLISH_RECEIPT:
+                topic = joinTopic(fullTopic, sizeof(fullTopic), {router.devicePrefix(), "receipt"});
+                break;
+            case PUBLISH_PROFILE_SWAP:
+                topic = joinTopic(fullTopic, sizeof(fullTopic), {router.eventPrefix(), "profile_swap"});
+                break;
+        }
+
+        if (topic == nullptr) {
+            // Can't be addressed now or later; the caller counts them rather than retry forever
+            unaddressable += count;
+            _queue.discard(count);
+            continue;
+        }
+        if (!client.publish(topic, (const uint8_t*)payload, length, qos)) {
+            break;
+        }
+        _queue.pop(count);
+    }
+    return unaddressable;
+}
+
+void BadgePublisher::setDrainRate(uint16_t publishesPerInterval, uint16_t intervalMs, uint8_t receiptBatch) {
+    _burst = publishesPerInterval ? publishesPerInterval : 1;
+    _intervalMs = intervalMs;
+    _receiptBatch = receiptBatch ? receiptBatch : 1;
+}
+
+uint16_t BadgePublisher::burst() const {
+    return _burst;
+}
+
+uint16_t BadgePublisher::intervalMs() const {
+    return _intervalMs;
+}
+
+void BadgePublisher::setBinary(bool binary) {
+    _binary = binary;
+}
+
+bool BadgePublisher::binary() const {
+    return _binary;
+}
+
+void BadgePublisher::setJsonReceiptBatching(bool batch) {
+    _batchJsonReceipts = batch;
+}
+
+bool BadgePublisher::jsonReceiptBatching() const {
+    return _batchJsonReceipts;
+}
+
+uint16_t BadgePublisher::size() const {
+    return _queue.size();
+}
+
+PublishStats BadgePublisher::stats() const {
+    return _queue.stats();
+}
@@ -0,0 +1,69 @@
+#include "CommandQueue.h"
+#include <string.h>
+
+bool CommandQueue::push(CommandType type, const char* text, size_t length, uint32_t nowUs) {
+    InboundCommand command;
+    command.type = type;
+    command.arrivedUs = nowUs;
+    if (length >= sizeof(command.text)) {
+        length = sizeof(command.text) - 1;
+    }
+    if (length > 0) {
+        memcpy(command.text, text, length);
+    }
+    command.text[length] = '\0';
+    return _ring.push(command);
+}
+
+bool CommandQueue::pop(InboundCommand& command) {
+    const InboundCommand* front = _ring.front();
+    if (front == nullptr) {
+        return false;
+    }
+    command = *front;
+    _ring.pop();
+    return true;
+}
+
+uint32_t CommandQueue::handled(const InboundCommand& command, uint32_t nowUs) {
+    uint32_t elapsedUs = nowUs - command.arrivedUs;
+    if (command.type < COMMAND_TYPE_COUNT) {
+        CommandLatency& latency = _latency[command.type];
+        latency.handled++;
+        latency.lastUs = elapsedUs;
+        latency.totalUs += elapsedUs;
+        if (elapsedUs > latency.maxUs) {
+            latency.maxUs = elapsedUs;
+        }
+    }
+    return elapsedUs;
+}
+
+CommandLatency CommandQueue::latency(CommandType type) const {
+    return type < COMMAND_TYPE_COUNT ? _latency[type] : CommandLatency{};
+}
+
+size_t CommandQueue::size() const {
+    return _ring.size();
+}
+
+size_t CommandQueue::dropped() const {
+    return _ring.dropped();
+}
+
+const char* commandName(CommandType type) {
+    switch (type) {
+        case COMMAND_ASSIGNMENT:
+            return "assignment";
+        case COMMAND_REASSIGNMENT:
+            return "reassignment";
+        case COMMAND_RESET_NFC:
+            return "nfc reset";
+        case COMMAND_PROFILE_SWAP:
+            return "profile swap";
+        case COMMAND_REBOOT:
+            return "reboot";
+        default:
+            return "unknown";
+    }
+}
@@ -1,5 +1,6 @@
 #include "ECE140_MQTT.h"
 #include "Certificates.h"
+#include "BadgeAdvertisement.h"
 
 
 ECE140_MQTT::ECE140_MQTT(){
@@ -7,79 +8,294 @@ ECE140_MQTT::ECE140_MQTT(){
     _password = MQTT_PASSWORD;
 
     _wifiClient.setCACert(CA_CERT); 
-    _mqttClient = new PubSubClient(_wifiClient);
-    _mqttClient->setServer(MQTT_SERVER, atoi(MQTT_PORT));
-    _mqttClient->setBufferSize(1024);
+    _client.setTransport(&_transport);
     Serial.println("[ECE140_MQTT] Initialized");
 }
 
+// First connect from setup(). Blocks; if it fails, loop() keeps retrying in the background.
 bool ECE140_MQTT::connectToBroker(String clientID, String eventID) {
+    if (_state == MQTT_LINK_CONNECTING) {
+        return false;
+    }
     _clientId = clientID;
     _eventId = eventID;
-    
+    if (!_router.begin(_clientId.c_str(), _eventId.c_str())) {
+        Serial.println("[MQTT] Client or event ID too long for topic prefixes");
+    }
+    _health.reset(millis(), _client.stats());
+    _lastHealthMs = millis();
+
+    if (_connect()) {
+        _onConnected();
+        return true;
+    }
+    _health.connectFailed(_connectFailure);
+    _scheduleReconnect();
+    return false;
+}
+
+// Blocking TLS + MQTT connect. Called by setup() or the connect task, never both at once.
+bool ECE140_MQTT::_connect() {
     Serial.println("[MQTT] Connecting to HiveMQ broker...");
-    
-    if (_mqttClient->connect(_clientId.c_str(), _username.c_str(), _password.c_str())) {
-        Serial.println("[MQTT] Connected successfully!");
+    unsigned long startMs = millis();
+
+    if (!_wifiClient.connect(MQTT_SERVER, atoi(MQTT_PORT))) {
+        _lastConnectMs = millis() - startMs;
+        _connectFailure = WiFi.status() == WL_CONNECTED ? LINK_FAILURE_TLS : LINK_FAILURE_WIFI;
+        Serial.println("[MQTT] TLS connection failed");
+        return false;
+    }
+
+    // With a persistent session the broker keeps our subscriptions and QoS 1 messages while we are away
+    Mqtt5ConnectOptions options = {_clientId.c_str(), _username.c_str(), _password.c_str(), MQTT_KEEPALIVE_S,
+                                   MQTT_PERSISTENT_SESSION ? MQTT_SESSION_EXPIRY_S : 0, !MQTT_PERSISTENT_SESSION};
+    if (_client.begin(options, millis())) {
+        while (_client.state() == MQTT5_CONNECTING && _client.poll(millis())) {
+            delay(5);
+        }
+    }
+    _lastConnectMs = millis() - startMs;
+
+    if (_client.connected()) {
+        Serial.println("[MQTT] Connected successfully in " + String(_lastConnectMs) + " ms" +
+                       (_client.sessionPresent() ? ", session resumed" : ""));
         return true;
     } else {
-        Serial.print("[MQTT] Connection failed with state: ");
-        Serial.println(_mqttClient->state());
+        _connectFailure = LINK_FAILURE_BROKER;
+        Serial.println("[MQTT] Connection failed with reason 0x" + String(_client.reason(), HEX));
+        _wifiClient.stop();
         return false;
     }
 }
 
+void ECE140_MQTT::_connectTaskLoop(void* arg) {
+    ECE140_MQTT* mqtt = (ECE140_MQTT*)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        mqtt->_state = mqtt->_connect() ? MQTT_LINK_CONNECT_SUCCEEDED : MQTT_LINK_CONNECT_FAILED;
+    }
+}
+
+// Hand the client to the connect task; loop() stays off it until the task reports back
+void ECE140_MQTT::_startConnect() {
+    if (_connectTask == nullptr &&
+        xTaskCreate(_connectTaskLoop, "mqtt_connect", MQTT_CONNECT_TASK_STACK, this, 1, &_connectTask) != pdPASS) {
+        _connectTask = nullptr;
+        Serial.println("[MQTT] Failed to start connect task");
+        _scheduleReconnect();
+        return;
+    }
+    _reconnectAttempts++;
+    _state = MQTT_LINK_CONNECTING;
+    xTaskNotifyGive(_connectTask);
+}
+
+// Exponential backoff with equal jitter so a fleet that lost the broker together does not retry in lockstep
+void ECE140_MQTT::_scheduleReconnect() {
+    if (!_disconnected) {
+        _disconnected = true;
+        _disconnectedSinceMs = millis();
+    }
+
+    uint32_t ceiling = MQTT_BACKOFF_MAX_MS;
+    if (_backoffStep < 16 && ((uint32_t)MQTT_BACKOFF_MIN_MS << _backoffStep) < ceiling) {
+        ceiling = (uint32_t)MQTT_BACKOFF_MIN_MS << _backoffStep;
+        _backoffStep++;
+    }
+    uint32_t delayMs = ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+    _nextAttemptMs = millis() + delayMs;
+    _state = MQTT_LINK_WAITING;
+    Serial.println("[MQTT] Retrying in " + String(delayMs) + " ms");
+}
+
+void ECE140_MQTT::_onConnected() {
+    _state = MQTT_LINK_CONNECTED;
+    _backoffStep = 0;
+    _health.connected(_lastConnectMs);
+    if (_disconnected) {
+        unsigned long outage = millis() - _disconnectedSinceMs;
+        _disconnectedMs += outage;
+        _disconnected = false;
+        _health.reconnected(outage);
+        Serial.println("[MQTT] Reconnected after " + String(outage) + " ms, " + String(_reconnectAttempts) + " reconnect attempt(s) so far, " +
+                       String(_outbound.size()) + " message(s) queued");
+    }
+
+    // A resumed session still holds our subscriptions, including the swap topic in _swapTicket.
+    // Otherwise the broker forgot them (clean start or expiry), so replay every one.
+    if (_client.sessionPresent()) {
+        if (_wantProfileSwap && _swapTicket != _ticketId) {
+            subscribeProfileSwap();
+        }
+        return;
+    }
+    _swapTicket = "";
+    if (_wantDevice) {
+        subscribeDevice();
+    }
+    if (_wantEvent) {
+        subscribeEvent();
+    }
+    if (_wantProfileSwap) {
+        subscribeProfileSwap();
+    }
+}
+
+// Publishes below are queued and sent from loop(), so they survive a dropped connection.
+// Each is encoded as JSON or BadgeMessage depending on what the backend negotiated.
+
 bool ECE140_MQTT::publishAvailability() {
-    String fullTopic = "event/" + _eventId + "/available_devices/" + _clientId;
+    return _queued(_outbound.availability(_eventId.c_str(), _clientId.c_str()));
+}
 
-    String payload = "{\"event_id\": \"" + String(_eventId) + 
-                    "\", \"device_id\": \"" + String(_clientId) + 
-                    "\", \"is_available\": true}";
-    
-    if (_mqttClient->publish(fullTopic.c_str(), payload.c_str())) {
-        Serial.println("[MQTT] Availability published successfully");
-        return true;
-    } else {
-        Serial.println("[MQTT] Failed to publish availability");
-        return false;
+bool ECE140_MQTT::publishReceipt(const char* command, const char* status) {
+    return _queued(_outbound.receipt(command, status));
+}
+
+bool ECE140_MQTT::publishHandshake(const String& ticketID) {
+    return _queued(_outbound.profileSwap(_eventId.c_str(), _ticketId.c_str(), ticketID.c_str()));
+}
+
+bool ECE140_MQTT::_queued(bool queued) {
+    if (!queued) {
+        _health.publishFailed();
+        Serial.println("[MQTT] Outbound queue full, message dropped");
     }
+    return queued;
 }
 
-bool ECE140_MQTT::publishReceipt(String command, String status) {
-    String fullTopic = "device/" + _clientId + "/receipt";
+// Send up to maxPublishes MQTT messages from the queue (see BadgePublisher::drain)
+void ECE140_MQTT::_drain(uint16_t maxPublishes) {
+    uint16_t dropped = _outbound.drain(_client, _router, _clientId.c_str(), maxPublishes, MQTT_PUBLISH_QOS);
+    if (dropped > 0) {
+        for (uint16_t i = 0; i < dropped; i++) {
+            _health.publishFailed();
+        }
+        Serial.println("[MQTT] Topic too long, " + String((unsigned int)dropped) + " message(s) dropped");
+    }
+}
 
-    String payload = "{\"command\": \"" + String(command) +
-                    "\", \"status\": \"" + String(status) + "\"}";
-    
-    if (_mqttClient->publish(fullTopic.c_str(), payload.c_str())) {
-        Serial.println("[MQTT] Receipt published successfully");
-        return true;
-    } else {
-        Serial.println("[MQTT] Failed to publish receipt");
-        return false;
+// Send everything queued right away, e.g. the receipt before a reboot. Waits at most
+// MQTT_FLUSH_TIMEOUT_MS for the socket; QoS 1 acknowledgements are not waited for.
+void ECE140_MQTT::flush() {
+    unsigned long startMs = millis();
+    while (isConnected() && millis() - startMs < MQTT_FLUSH_TIMEOUT_MS) {
+        _drain(MQTT_QUEUE_SIZE);
+        if (_outbound.size() == 0 && _client.pendingBytes() == 0) {
+            return;
+        }
+        if (!_client.poll(millis())) {
+            return;
+        }
+        delay(1);
     }
 }
 
-bool ECE140_MQTT::publishHandshake(String ticketID) {
-    String fullTopic = "event/" + _eventId + "/profile_swap";
+void ECE140_MQTT::setDrainRate(uint16_t publishesPerInterval, uint16_t intervalMs, uint8_t receiptBatch) {
+    _outbound.setDrainRate(publishesPerInterval, intervalMs, receiptBatch);
+}
 
-    String payload = "{\"event_id\": \"" + String(_eventId) +
-                    "\", \"ticket_id\": \"" + String(_ticketId) +
-                    "\", \"ticket_id_to_swap\": \"" + String(ticketID) + "\"}";
-    
-    if (_mqttClient->publish(fullTopic.c_str(), payload.c_str())) {
-        Serial.println("[MQTT] Profile swap published successfully");
+PublishStats ECE140_MQTT::getPublishStats() {
+    return _outbound.stats();
+}
+
+Mqtt5Stats ECE140_MQTT::getClientStats() {
+    return _client.stats();
+}
+
+// Already queued messages keep the encoding they were built with
+void ECE140_MQTT::setBinaryPayloads(bool binary) {
+    if (binary != _outbound.binary()) {
+        Serial.println(binary ? "[MQTT] Switched to binary payloads" : "[MQTT] Switched to JSON payloads");
+    }
+    _outbound.setBinary(binary);
+}
+
+bool ECE140_MQTT::binaryPayloads() {
+    return _outbound.binary();
+}
+
+void ECE140_MQTT::setJsonReceiptBatching(bool batch) {
+    _outbound.setJsonReceiptBatching(batch);
+}
+
+// Replay of a handshake queued while offline; timestamp and nonce let the backend dedupe both badges' copies
+bool ECE140_MQTT::publishHandshakeClaim(const char* ticketID, const char* ticketIDToSwap, uint32_t timestamp, uint32_t nonce) {
+    if (!isConnected()) {
+        return false;
+    }
+    char fullTopic[MQTT_TOPIC_SIZE];
+    char payload[MQTT_PAYLOAD_SIZE];
+    size_t length = 0;
+    if (_outbound.binary()) {
+        length = encodeProfileSwapClaim((uint8_t*)payload, sizeof(payload), _eventId.c_str(),
+                                        parseBadgeNumber(ticketID), parseBadgeNumber(ticketIDToSwap), timestamp, nonce);
+    } else {
+        JsonWriter json(payload, sizeof(payload));
+        json.field("event_id", _eventId.c_str())
+            .field("ticket_id", ticketID)
+            .field("ticket_id_to_swap", ticketIDToSwap)
+            .field("timestamp", timestamp)
+            .field("nonce", nonce);
+        length = json.finish() ? json.length() : 0;
+    }
+
+    if (length > 0 && joinTopic(fullTopic, sizeof(fullTopic), {_router.eventPrefix(), "profile_swap"}) &&
+        _client.publish(fullTopic, (const uint8_t*)payload, length, MQTT_PUBLISH_QOS)) {
+        Serial.println("[MQTT] Queued profile swap published successfully");
         return true;
     } else {
-        Serial.println("[MQTT] Failed to publish profile swap");
+        _health.publishFailed();
+        Serial.println("[MQTT] Failed to publish queued profile swap");
+        return false;
+    }
+}
+
+// QoS 0: a lost chunk costs one capture, not a stalled in-flight window
+bool ECE140_MQTT::publishCapture(const uint8_t* chunk, size_t length) {
+    if (!isConnected()) {
+        return false;
+    }
+    char fullTopic[MQTT_TOPIC_SIZE];
+    if (!joinTopic(fullTopic, sizeof(fullTopic), {_router.eventPrefix(), "capture/", _clientId.c_str()})) {
         return false;
     }
+    return _client.publish(fullTopic, chunk, length);
+}
+
+// One compact report per interval, in the negotiated encoding. The interval restarts only once
+// the client has taken the report, so nothing is lost if it has to wait for the next attempt.
+void ECE140_MQTT::_publishHealth() {
+    _lastHealthMs = millis();
+    char fullTopic[MQTT_TOPIC_SIZE];
+    char payload[MQTT_HEALTH_PAYLOAD_SIZE];
+    Mqtt5Stats stats = _client.stats();
+    size_t length = _outbound.binary() ? _health.encodeBinary((uint8_t*)payload, sizeof(payload), millis(), stats)
+                            : _health.encodeJson(payload, sizeof(payload), millis(), stats);
+    if (length == 0 || !joinTopic(fullTopic, sizeof(fullTopic), {_router.devicePrefix(), "health"})) {
+        return;
+    }
+    // A JSON report from a very troubled interval can outgrow the client's in-flight slot; send
+    // that one at QoS 0 rather than not at all
+    uint8_t qos = length <= MQTT5_INFLIGHT_PAYLOAD ? MQTT_PUBLISH_QOS : 0;
+    if (!_client.publish(fullTopic, (const uint8_t*)payload, length, qos)) {
+        _health.publishFailed();
+        return;
+    }
+    _health.reset(millis(), stats);
 }
 
 bool ECE140_MQTT::subscribeDevice() {
-    String fullTopic = "device/" + _clientId + "/#";
+    _wantDevice = true;
+    if (!isConnected()) {
+        return false;
+    }
+    char fullTopic[MQTT_TOPIC_SIZE];
+    if (!joinTopic(fullTopic, sizeof(fullTopic), {_router.devicePrefix(), "#"})) {
+        return false;
+    }
     
-    if (_mqttClient->subscribe(fullTopic.c_str())) {
+    if (_client.subscribe(fullTopic, MQTT_SUBSCRIBE_QOS)) {
         Serial.println("[MQTT] Subscribed successfully to assignment");
         return true;
     } else {
@@ -88,10 +304,18 @@ bool ECE140_MQTT::subscribeDevice() {
     }
 }
 
+// Only the event-wide command we act on; availability and other badges' swaps are not delivered
 bool ECE140_MQTT::subscribeEvent() {
-    String fullTopic = "event/" + _eventId + "/#";
+    _wantEvent = true;
+    if (!isConnected()) {
+        return false;
+    }
+    char fullTopic[MQTT_TOPIC_SIZE];
+    if (!joinTopic(fullTopic, sizeof(fullTopic), {_router.eventPrefix(), "reboot"})) {
+        return false;
+    }
     
-    if (_mqttClient->subscribe(fullTopic.c_str())) {
+    if (_client.subscribe(fullTopic, MQTT_SUBSCRIBE_QOS)) {
         Serial.println("[MQTT] Subscribed successfully to event notifications");
         return true;
     } else {
@@ -100,10 +324,35 @@ bool ECE140_MQTT::subscribeEvent() {
     }
 }
 
+// Swap confirmations for our ticket only. Before assignment this just records the intent;
+// loop() moves the subscription whenever the ticket is (re)assigned, and keeps retrying while
+// the client can't take the (UN)SUBSCRIBE, e.g. with its send buffer full.
 bool ECE140_MQTT::subscribeProfileSwap() {
-    String fullTopic = "event/" + _eventId + "/profile_swap/#";  
+    _wantProfileSwap = true;
+    if (_ticketId.isEmpty()) {
+        _swapTopicStale = false;
+        return false;
+    }
+    if (!isConnected()) {
+        return false;
+    }
+    char fullTopic[MQTT_TOPIC_SIZE];
+    if (!_swapTicket.isEmpty() && _swapTicket != _ticketId &&
+        joinTopic(fullTopic, sizeof(fullTopic), {_router.eventPrefix(), "profile_swap/", _swapTicket.c_str()})) {
+        if (!_client.unsubscribe(fullTopic)) {
+            Serial.println("[MQTT] Failed to unsubscribe from the previous profile swap topic");
+            return false;
+        }
+        _swapTicket = "";
+    }
+    if (!joinTopic(fullTopic, sizeof(fullTopic), {_router.eventPrefix(), "profile_swap/", _ticketId.c_str()})) {
+        _swapTopicStale = false;
+        return false;
+    }
     
-    if (_mqttClient->subscribe(fullTopic.c_str())) {
+    if (_client.subscribe(fullTopic, MQTT_SUBSCRIBE_QOS)) {
+        _swapTicket = _ticketId;
+        _swapTopicStale = false;
         Serial.println("[MQTT] Subscribed successfully to profile swap");
         return true;
     } else {
@@ -112,58 +361,130 @@ bool ECE140_MQTT::subscribeProfileSwap() {
     }
 }
 
+// Route on the precomputed prefixes; the payload is read in place and only copied when it is stored.
+// Commands for loop() are queued with their arrival time rather than acted on here.
 void ECE140_MQTT::handleMessage(char* topic, uint8_t* payload, unsigned int length) {
-    String topicStr = String(topic);
-    String message = "";
-    for (unsigned int i = 0; i < length; i++) {
-        message += (char)payload[i];
-    }
-
-    // Serial.println("=== MQTT DEBUG ===");
-    // Serial.println("Topic: " + topicStr);
-    // Serial.println("Payload: " + message);
-    // Serial.println(topicStr.substring(0, 23));
-    // Serial.println("event/" + _eventId + "/profile_swap" == topicStr.substring(0, 23));
-    // Serial.println(topicStr.substring(23));
-    // Serial.println(topicStr.substring(23) == _ticketId);
-    // Serial.println("==================");
-    
-    if (topicStr == "device/" + _clientId + "/assignment") {
-        _ticketId = message;
-    } else if(topicStr == "device/" + _clientId + "/reboot"){
-        publishReceipt("reboot", "acknowledged");
-        delay(100);
-        ESP.restart();
-    } else if(topicStr == "device/" + _clientId + "/reassignment"){
-         _ticketId = message;
-         _ticketReset = true;
-    } else if(topicStr == "device/" + _clientId + "/resetNFC"){
-         _nfcReset = true;
-    } else if (topicStr == "event/" + _eventId + "/reboot") {
-        publishReceipt("reboot", "acknowledged");
-        delay(100);
-        ESP.restart();
-    } else if (topicStr.substring(0, 23) == "event/" + _eventId + "/profile_swap") {
-        if(topicStr.substring(24) == _ticketId){
-            _profileSwap = true;
+    const char* tail = nullptr;
+    size_t tailLength = 0;
+    CommandType command = COMMAND_TYPE_COUNT;
+
+    TopicRoute route = _router.route(topic, &tail, &tailLength);
+    switch (route) {
+        case ROUTE_ASSIGNMENT:
+        case ROUTE_REASSIGNMENT: {
+            // Refused before it replaces the current ticket or its swap subscription
+            const char* receipt = route == ROUTE_ASSIGNMENT ? "assign device" : "ticket_reassignment";
+            if (!isTicketId((const char*)payload, length)) {
+                Serial.println("[MQTT] Ticket " + String((const char*)payload, length) + " is not a nonzero T_xxxxxx id, refused");
+                publishReceipt(receipt, "invalid ticket");
+                break;
+            }
+            _ticketId = String((const char*)payload, length);
+            _swapTopicStale = _ticketId != _swapTicket;
+            command = route == ROUTE_ASSIGNMENT ? COMMAND_ASSIGNMENT : COMMAND_REASSIGNMENT;
+            break;
         }
-    } 
+        case ROUTE_RESET_NFC:
+            command = COMMAND_RESET_NFC;
+            break;
+        case ROUTE_ENCODING:
+        case ROUTE_RECEIPT_BATCH: {
+            bool binary = _outbound.binary();
+            _queued(_outbound.negotiate(route, payload, length));
+            if (_outbound.binary() != binary) {
+                Serial.println(binary ? "[MQTT] Switched to JSON payloads" : "[MQTT] Switched to binary payloads");
+            }
+            break;
+        }
+        case ROUTE_DEVICE_REBOOT:
+        case ROUTE_EVENT_REBOOT:
+            // Restarted from loop() after this returns and the message is acknowledged, or a queued QoS 1 reboot would repeat forever
+            command = COMMAND_REBOOT;
+            break;
+        case ROUTE_PROFILE_SWAP:
+            if (tailLength == _ticketId.length() && memcmp(tail, _ticketId.c_str(), tailLength) == 0) {
+                command = COMMAND_PROFILE_SWAP;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (command != COMMAND_TYPE_COUNT && !_commands.push(command, (const char*)payload, length, micros())) {
+        Serial.println("[MQTT] Command queue full, " + String(commandName(command)) + " dropped");
+    }
 }
 
 void ECE140_MQTT::setCallback(void (*callback)(char*, uint8_t*, unsigned int)) {
-    _mqttClient->setCallback(callback);
+    _client.setCallback(callback);
 }
 
+// Never blocks: services the socket while connected, otherwise advances the reconnect state machine
 void ECE140_MQTT::loop() {
-    _mqttClient->loop();
-    
-    // Reconnect if connection is lost
-    if (!_mqttClient->connected()) {
-        Serial.println("[MQTT] Connection lost. Attempting to reconnect...");
-        connectToBroker(_clientId, _eventId);
+    switch (_state.load()) {
+        case MQTT_LINK_CONNECTED:
+            if (!_client.poll(millis())) {
+                _health.connectionLost(_client.reason(), WiFi.status() == WL_CONNECTED);
+                Serial.println("[MQTT] Connection lost (reason 0x" + String(_client.reason(), HEX) + ")");
+                _scheduleReconnect();
+                break;
+            }
+            _health.sample(_client.stats());
+            if (_swapTopicStale && _wantProfileSwap && millis() - _lastDrainMs >= _outbound.intervalMs()) {
+                // Not from handleMessage: the client's buffer still holds the message being handled there.
+                // Paced like the drain, since a full send buffer keeps refusing it for a while.
+                _lastDrainMs = millis();
+                subscribeProfileSwap();
+            } else if (_outbound.size() > 0 && millis() - _lastDrainMs >= _outbound.intervalMs()) {
+                _lastDrainMs = millis();
+                _drain(_outbound.burst());
+            } else if (MQTT_HEALTH_INTERVAL_MS > 0 && millis() - _lastHealthMs >= MQTT_HEALTH_INTERVAL_MS) {
+                _publishHealth();
+            } else if (MQTT_HEALTH_PROBE_MS > 0 && millis() - _lastProbeMs >= MQTT_HEALTH_PROBE_MS) {
+                _lastProbeMs = millis();
+                _client.ping(millis());
+            }
+            break;
+        case MQTT_LINK_WAITING:
+            if ((long)(millis() - _nextAttemptMs) >= 0) {
+                _startConnect();
+            }
+            break;
+        case MQTT_LINK_CONNECT_SUCCEEDED:
+            _onConnected();
+            break;
+        case MQTT_LINK_CONNECT_FAILED:
+            _health.connectFailed(_connectFailure);
+            _scheduleReconnect();
+            break;
+        default:
+            break;
     }
 }
 
+bool ECE140_MQTT::isConnected() {
+    return _state == MQTT_LINK_CONNECTED;
+}
+
+// Duration of the last TLS + MQTT connect attempt
+unsigned long ECE140_MQTT::getLastConnectTime() {
+    return _lastConnectMs;
+}
+
+uint32_t ECE140_MQTT::getReconnectAttempts() {
+    return _reconnectAttempts;
+}
+
+// Counts since the last health report
+const LinkHealth& ECE140_MQTT::getLinkHealth() {
+    return _health;
+}
+
+// Total time without a broker connection since the first failure, including the current outage
+unsigned long ECE140_MQTT::getDisconnectedTime() {
+    return _disconnectedMs + (_disconnected ? millis() - _disconnectedSinceMs : 0);
+}
+
 bool ECE140_MQTT::isAssigned() {
     return !_ticketId.isEmpty();
 }
@@ -172,26 +493,20 @@ String ECE140_MQTT::getTicketID() {
     return _ticketId;
 }
 
-bool ECE140_MQTT::ticketReset() {
-    return _ticketReset;
+bool ECE140_MQTT::nextCommand(InboundCommand& command) {
+    return _commands.pop(command);
 }
 
-bool ECE140_MQTT::nfcReset() {
-    return _nfcReset;
+uint32_t ECE140_MQTT::commandHandled(const InboundCommand& command) {
+    uint32_t elapsedUs = _commands.handled(command, micros());
+    _health.commandHandled(command.type, elapsedUs);
+    return elapsedUs;
 }
 
-void ECE140_MQTT::resetNfcFlag(){
-    _nfcReset = !_nfcReset;
+CommandLatency ECE140_MQTT::getCommandLatency(CommandType type) {
+    return _commands.latency(type);
 }
 
-void ECE140_MQTT::resetTicketFlag(){
-    _ticketReset = !_ticketReset;
+size_t ECE140_MQTT::getDroppedCommands() {
+    return _commands.dropped();
 }
-
-bool ECE140_MQTT::profileSwap(){
-   return _profileSwap;
-}
-
-void ECE140_MQTT::resetProfileSwapFlag(){
-   _profileSwap = !_profileSwap;
-}
\ No newline at end of file
@@ -5,6 +5,14 @@ Handshake::Handshake() : _bno(55, 0x28, &Wire) {
     _current_index = 0;              
     _samples_collected = 0;         
     _last_sample_time = 0; 
+    _prev_sample_us = 0;
+    _next_grid_us = 0;
+    _has_prev_sample = false;
+    _synthesized_samples = 0;
+    _motion_index = 0;
+    _motion_block_sum = 0.0f;
+    _motion_block_count = 0;
+    memset(_motion_history, 0, sizeof(_motion_history));
     _tensor_arena = nullptr;
     _model = nullptr;
     _interpreter = nullptr;
@@ -56,42 +64,85 @@ void Handshake::init() {
 
 
  void Handshake::collectData(){
-    imu::Vector<3> accel = _bno.getVector(Adafruit_BNO055::VECTOR_LINEARACCEL);
-    imu::Vector<3> gyro = _bno.getVector(Adafruit_BNO055::VECTOR_GYROSCOPE);
-
     if (millis() - _last_sample_time >= _SAMPLE_INTERVAL) {
         _last_sample_time = millis(); 
+        unsigned long sample_us = micros();
 
-        _data_buffer[_current_index][0] = accel.x();
-        _data_buffer[_current_index][1] = accel.y();
-        _data_buffer[_current_index][2] = accel.z();
-        _data_buffer[_current_index][3] = gyro.x();
-        _data_buffer[_current_index][4] = gyro.y();
-        _data_buffer[_current_index][5]= gyro.z();
-        
-        // Serial.print(_data_buffer[_current_index][0], 4);
-        // Serial.print(", ");
-        // Serial.print(_data_buffer[_current_index][1], 4);
-        // Serial.print(", ");
-        // Serial.print(_data_buffer[_current_index][2], 4);
-        // Serial.print(", ");
-        // Serial.print(_data_buffer[_current_index][3], 4);
-        // Serial.print(", ");
-        // Serial.print(_data_buffer[_current_index][4], 4);
-        // Serial.print(", ");
-        // Serial.print(_data_buffer[_current_index][5], 4);
-        // Serial.print(", ");
-
-        _current_index = (_current_index + 1 ) % _WINDOW_SIZE;
-
-        if (_samples_collected < _WINDOW_SIZE) {
-            _samples_collected++;
-        } else if (_samples_collected == _WINDOW_SIZE) {
-             _inference = true; 
-        }
+        imu::Vector<3> accel = _bno.getVector(Adafruit_BNO055::VECTOR_LINEARACCEL);
+        imu::Vector<3> gyro = _bno.getVector(Adafruit_BNO055::VECTOR_GYROSCOPE);
+
+        float sample[_NUM_FEATURES] = {
+            (float)accel.x(), (float)accel.y(), (float)accel.z(),
+            (float)gyro.x(), (float)gyro.y(), (float)gyro.z()
+        };
+        resample(sample, sample_us);
     }
  }
 
+// Linearly interpolate between the previous and current reading onto every
+// 10 ms grid point that falls between them. A late reading fills the gap with
+// synthesized samples instead of compressing time in the window.
+void Handshake::resample(const float sample[_NUM_FEATURES], unsigned long sample_us) {
+    if (!_has_prev_sample || (long)(sample_us - _next_grid_us) >= (long)(_WINDOW_SIZE * _GRID_INTERVAL_US)) {
+        // First reading, or a gap longer than a whole window: restart the grid here
+        pushSample(sample);
+        memcpy(_prev_sample, sample, sizeof(_prev_sample));
+        _prev_sample_us = sample_us;
+        _next_grid_us = sample_us + _GRID_INTERVAL_US;
+        _has_prev_sample = true;
+        return;
+    }
+
+    float span = (float)(sample_us - _prev_sample_us);
+    int emitted = 0;
+
+    while ((long)(sample_us - _next_grid_us) >= 0) {
+        float alpha = span > 0 ? (float)(_next_grid_us - _prev_sample_us) / span : 1.0f;
+        float interpolated[_NUM_FEATURES];
+        for (int f = 0; f < _NUM_FEATURES; f++) {
+            interpolated[f] = _prev_sample[f] + alpha * (sample[f] - _prev_sample[f]);
+        }
+        pushSample(interpolated);
+
+        if (emitted > 0) {
+            _synthesized_samples++;
+        }
+        emitted++;
+        _next_grid_us += _GRID_INTERVAL_US;
+    }
+
+    memcpy(_prev_sample, sample, sizeof(_prev_sample));
+    _prev_sample_us = sample_us;
+}
+
+void Handshake::pushSample(const float sample[_NUM_FEATURES]) {
+    for (int f = 0; f < _NUM_FEATURES; f++) {
+        _data_buffer[_current_index][f] = sample[f];
+    }
+
+    _current_index = (_current_index + 1 ) % _WINDOW_SIZE;
+
+#if IMU_CAPTURE
+    if (_capture != nullptr) {
+        _capture->record(sample);
+    }
+#endif
+
+    _motion_block_sum += sqrtf(sample[0] * sample[0] + sample[1] * sample[1] + sample[2] * sample[2]);
+    if (++_motion_block_count == MOTION_BLOCK_SAMPLES) {
+        _motion_history[_motion_index] = _motion_block_sum / MOTION_BLOCK_SAMPLES;
+        _motion_index = (_motion_index + 1) % MOTION_HISTORY_LENGTH;
+        _motion_block_sum = 0.0f;
+        _motion_block_count = 0;
+    }
+
+    if (_samples_collected < _WINDOW_SIZE) {
+        _samples_collected++;
+    } else if (_samples_collected == _WINDOW_SIZE) {
+         _inference = true; 
+    }
+}
+
 std::vector<std::vector<float>> Handshake::processData() {
     std::vector<std::vector<float>> output;
 
@@ -139,7 +190,13 @@ void Handshake::clearBuffer(){
     _current_index = 0;              
     _samples_collected = 0;         
     _last_sample_time = 0; 
+    _has_prev_sample = false;
     _inference = false;
+#if IMU_CAPTURE
+    if (_capture != nullptr) {
+        _capture->clear();
+    }
+#endif
     
     for (int i = 0; i < _WINDOW_SIZE; i++) {
         for (int j = 0; j < _NUM_FEATURES; j++) {
@@ -148,6 +205,36 @@ void Handshake::clearBuffer(){
     }
 }
 
+unsigned long Handshake::getSynthesizedSamples() {
+    return _synthesized_samples;
+}
+
+// Most recent count motion blocks, oldest first
+void Handshake::motionBlocks(float* out, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = _motion_history[(_motion_index + MOTION_HISTORY_LENGTH - count + i) % MOTION_HISTORY_LENGTH];
+    }
+}
+
+#if IMU_CAPTURE
+// Capture sees exactly the resampled 10 ms grid the model is fed
+void Handshake::setCapture(ImuCapture* capture) {
+    _capture = capture;
+}
+#endif
+
+void Handshake::motionSketch(int8_t sketch[MOTION_SKETCH_LENGTH]) {
+    float blocks[MOTION_SKETCH_LENGTH];
+    motionBlocks(blocks, MOTION_SKETCH_LENGTH);
+    quantizeMotion(blocks, MOTION_SKETCH_LENGTH, sketch);
+}
+
+void Handshake::motionHistory(int8_t history[MOTION_HISTORY_LENGTH]) {
+    float blocks[MOTION_HISTORY_LENGTH];
+    motionBlocks(blocks, MOTION_HISTORY_LENGTH);
+    quantizeMotion(blocks, MOTION_HISTORY_LENGTH, history);
+}
+
 // if(!predictions.empty()){
 //     String predicted_class_str;
 //     switch ((int)predictions[0][0]) {
@@ -0,0 +1,162 @@
+#include "ImuCapture.h"
+#include <math.h>
+#include <string.h>
+
+static const uint8_t CHUNK_COUNT = (IMU_CAPTURE_SAMPLES + IMU_CAPTURE_CHUNK_SAMPLES - 1) / IMU_CAPTURE_CHUNK_SAMPLES;
+static_assert(IMU_CAPTURE_CHUNK_SAMPLES >= 2 && IMU_CAPTURE_CHUNK_SAMPLES <= 255, "Chunk sample count must fit a byte");
+static_assert(IMU_CAPTURE_SAMPLES / IMU_CAPTURE_CHUNK_SAMPLES < 255, "Too many chunks per capture");
+
+static int16_t quantize(float value, float scale) {
+    float scaled = roundf(value * scale);
+    if (scaled > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (scaled < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)scaled;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static uint8_t bitWidth(uint32_t value) {
+    uint8_t bits = 0;
+    while (value != 0) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+static uint8_t* putU16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    return out + 2;
+}
+
+void ImuCapture::record(const float sample[IMU_CAPTURE_CHANNELS]) {
+    int16_t* slot = _ring[_ringIndex];
+    for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+        slot[c] = quantize(sample[c], c < 3 ? IMU_CAPTURE_ACCEL_SCALE : IMU_CAPTURE_GYRO_SCALE);
+    }
+    _ringIndex = (_ringIndex + 1) % IMU_CAPTURE_PRE_SAMPLES;
+    if (_ringCount < IMU_CAPTURE_PRE_SAMPLES) {
+        _ringCount++;
+    }
+
+    if (_recording) {
+        memcpy(_capture[_captured++], slot, sizeof(_capture[0]));
+        if (_captured == IMU_CAPTURE_SAMPLES) {
+            _recording = false;
+            _ready = true;
+            _nextChunk = 0;
+            _stats.captured++;
+        }
+    }
+}
+
+bool ImuCapture::trigger(CaptureTrigger trigger, uint8_t predictedClass, float score, uint32_t nowMs) {
+    if (_recording || _ready || _ringCount < IMU_CAPTURE_PRE_SAMPLES ||
+        (_triggered && nowMs - _lastTriggerMs < IMU_CAPTURE_MIN_INTERVAL_MS)) {
+        _stats.skipped++;
+        return false;
+    }
+
+    // Unroll the ring oldest first; the most recent sample is the trigger point
+    uint16_t oldest = _ringIndex;
+    uint16_t firstRun = IMU_CAPTURE_PRE_SAMPLES - oldest;
+    memcpy(_capture[0], _ring[oldest], firstRun * sizeof(_capture[0]));
+    memcpy(_capture[firstRun], _ring[0], oldest * sizeof(_capture[0]));
+    _captured = IMU_CAPTURE_PRE_SAMPLES;
+    _recording = true;
+
+    _captureId++;
+    _trigger = trigger;
+    _predictedClass = predictedClass;
+    _score = (uint8_t)(score <= 0.0f ? 0 : score >= 1.0f ? 100 : lroundf(score * 100.0f));
+    _triggerSample = IMU_CAPTURE_PRE_SAMPLES - 1;
+    _lastTriggerMs = nowMs;
+    _triggered = true;
+    return true;
+}
+
+bool ImuCapture::ready() const {
+    return _ready;
+}
+
+size_t ImuCapture::peekChunk(uint8_t* out, size_t capacity) const {
+    if (!_ready || capacity < IMU_CAPTURE_CHUNK_SIZE) {
+        return 0;
+    }
+    uint16_t first = _nextChunk * IMU_CAPTURE_CHUNK_SAMPLES;
+    uint16_t count = IMU_CAPTURE_SAMPLES - first < IMU_CAPTURE_CHUNK_SAMPLES ? IMU_CAPTURE_SAMPLES - first : IMU_CAPTURE_CHUNK_SAMPLES;
+
+    uint8_t* p = out;
+    uint32_t sequence = _sequence;
+    *p++ = IMU_CAPTURE_VERSION;
+    p = putU16(p, (uint16_t)sequence);
+    p = putU16(p, (uint16_t)(sequence >> 16));
+    p = putU16(p, _captureId);
+    *p++ = _nextChunk;
+    *p++ = CHUNK_COUNT;
+    *p++ = _trigger;
+    *p++ = _predictedClass;
+    *p++ = _score;
+    p = putU16(p, _triggerSample);
+    p = putU16(p, first);
+    *p++ = (uint8_t)count;
+    *p++ = IMU_CAPTURE_CHANNELS;
+
+    // Per channel: delta against the previous sample, zigzag, then pack at the widest delta's width
+    for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+        uint8_t bits = 0;
+        for (uint16_t i = 1; i < count; i++) {
+            uint8_t width = bitWidth(zigzag((int32_t)_capture[first + i][c] - _capture[first + i - 1][c]));
+            if (width > bits) {
+                bits = width;
+            }
+        }
+        p = putU16(p, (uint16_t)_capture[first][c]);
+        *p++ = bits;
+
+        uint64_t accumulator = 0;
+        uint8_t pending = 0;
+        for (uint16_t i = 1; i < count && bits > 0; i++) {
+            accumulator |= (uint64_t)zigzag((int32_t)_capture[first + i][c] - _capture[first + i - 1][c]) << pending;
+            pending += bits;
+            while (pending >= 8) {
+                *p++ = (uint8_t)accumulator;
+                accumulator >>= 8;
+                pending -= 8;
+            }
+        }
+        if (pending > 0) {
+            *p++ = (uint8_t)accumulator;
+        }
+    }
+    return p - out;
+}
+
+void ImuCapture::chunkSent() {
+    if (!_ready) {
+        return;
+    }
+    _sequence++;
+    _stats.chunksSent++;
+    if (++_nextChunk == CHUNK_COUNT) {
+        _ready = false;
+    }
+}
+
+void ImuCapture::clear() {
+    _ringIndex = 0;
+    _ringCount = 0;
+    _recording = false;
+    _captured = 0;
+}
+
+CaptureStats ImuCapture::stats() const {
+    return _stats;
+}
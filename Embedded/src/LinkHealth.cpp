@@ -0,0 +1,240 @@
+#include "LinkHealth.h"
+#include "JsonWriter.h"
+
+namespace {
+
+// Like the binary form, the JSON report leaves out what is zero; a missing key reads as 0
+template <size_t N>
+void counterField(JsonWriter& json, const char (&key)[N], uint32_t value) {
+    if (value != 0) {
+        json.field(key, value);
+    }
+}
+
+template <size_t N>
+void histogramField(JsonWriter& json, const char (&key)[N], const uint16_t* counts) {
+    for (uint8_t i = 0; i < LINK_BUCKETS; i++) {
+        if (counts[i] != 0) {
+            json.field(key, counts, LINK_BUCKETS);
+            return;
+        }
+    }
+}
+
+// A literal key per type, as JsonWriter wants
+void commandField(JsonWriter& json, CommandType type, const uint32_t* values) {
+    switch (type) {
+        case COMMAND_ASSIGNMENT:
+            json.field("command_assignment", values, LINK_COMMAND_FIELD_COUNT);
+            break;
+        case COMMAND_REASSIGNMENT:
+            json.field("command_reassignment", values, LINK_COMMAND_FIELD_COUNT);
+            break;
+        case COMMAND_RESET_NFC:
+            json.field("command_reset_nfc", values, LINK_COMMAND_FIELD_COUNT);
+            break;
+        case COMMAND_PROFILE_SWAP:
+            json.field("command_profile_swap", values, LINK_COMMAND_FIELD_COUNT);
+            break;
+        case COMMAND_REBOOT:
+            json.field("command_reboot", values, LINK_COMMAND_FIELD_COUNT);
+            break;
+        default:
+            break;
+    }
+}
+
+void commandValues(const CommandLatency& latency, uint32_t* values) {
+    values[LINK_COMMAND_HANDLED] = latency.handled;
+    values[LINK_COMMAND_MAX_US] = latency.maxUs;
+    values[LINK_COMMAND_MEAN_US] = latency.handled ? (uint32_t)(latency.totalUs / latency.handled) : 0;
+}
+
+}  // namespace
+
+void LinkHealth::_record(LinkHistogramId id, const uint32_t* bounds, uint32_t valueMs) {
+    uint8_t index = 0;
+    while (index < LINK_BUCKETS - 1 && valueMs > bounds[index]) {
+        index++;
+    }
+    if (_histograms[id][index] != UINT16_MAX) {
+        _histograms[id][index]++;
+    }
+}
+
+void LinkHealth::sample(const Mqtt5Stats& stats) {
+    if (stats.pings == _pingsSeen) {
+        return;
+    }
+    // At most one ping is outstanding, so only the latest answer can be new
+    _pingsSeen = stats.pings;
+    _record(LINK_RTT, LINK_RTT_BOUNDS_MS, stats.lastPingRttMs);
+    if (stats.lastPingRttMs > _counters[LINK_RTT_MAX_MS]) {
+        _counters[LINK_RTT_MAX_MS] = stats.lastPingRttMs;
+    }
+}
+
+void LinkHealth::connected(uint32_t connectMs) {
+    _record(LINK_CONNECT, LINK_CONNECT_BOUNDS_MS, connectMs);
+}
+
+void LinkHealth::reconnected(uint32_t outageMs) {
+    _record(LINK_OUTAGE, LINK_OUTAGE_BOUNDS_MS, outageMs);
+}
+
+void LinkHealth::connectFailed(LinkFailure failure) {
+    switch (failure) {
+        case LINK_FAILURE_WIFI:
+            _counters[LINK_FAILED_WIFI]++;
+            break;
+        case LINK_FAILURE_TLS:
+            _counters[LINK_FAILED_TLS]++;
+            break;
+        case LINK_FAILURE_BROKER:
+            _counters[LINK_FAILED_BROKER]++;
+            break;
+    }
+}
+
+void LinkHealth::connectionLost(uint8_t reason, bool wifiUp) {
+    if (!wifiUp) {
+        _counters[LINK_LOST_WIFI]++;
+    } else if (reason == MQTT5_LOCAL_KEEPALIVE_TIMEOUT) {
+        _counters[LINK_LOST_KEEPALIVE]++;
+    } else if (reason == MQTT5_LOCAL_TRANSPORT_CLOSED) {
+        _counters[LINK_LOST_NETWORK]++;
+    } else {
+        _counters[LINK_LOST_BROKER]++;
+    }
+}
+
+void LinkHealth::publishFailed() {
+    _counters[LINK_PUBLISH_FAILURES]++;
+}
+
+void LinkHealth::commandHandled(CommandType type, uint32_t elapsedUs) {
+    if (type >= COMMAND_TYPE_COUNT) {
+        return;
+    }
+    CommandLatency& latency = _commands[type];
+    latency.handled++;
+    latency.lastUs = elapsedUs;
+    latency.totalUs += elapsedUs;
+    if (elapsedUs > latency.maxUs) {
+        latency.maxUs = elapsedUs;
+    }
+}
+
+uint16_t LinkHealth::bucket(LinkHistogramId id, uint8_t index) const {
+    return id < LINK_HISTOGRAM_COUNT && index < LINK_BUCKETS ? _histograms[id][index] : 0;
+}
+
+uint32_t LinkHealth::counter(LinkCounterId id) const {
+    return id < LINK_COUNTER_COUNT ? _counters[id] : 0;
+}
+
+CommandLatency LinkHealth::command(CommandType type) const {
+    return type < COMMAND_TYPE_COUNT ? _commands[type] : CommandLatency{};
+}
+
+// Counters as reported: the interval length and byte deltas are filled in at report time
+void LinkHealth::_snapshot(uint32_t nowMs, const Mqtt5Stats& stats, uint32_t* counters) const {
+    for (uint8_t i = 0; i < LINK_COUNTER_COUNT; i++) {
+        counters[i] = _counters[i];
+    }
+    counters[LINK_SECONDS] = (nowMs - _startMs) / 1000;
+    counters[LINK_BYTES_IN] = stats.bytesIn - _bytesInMark;
+    counters[LINK_BYTES_OUT] = stats.bytesOut - _bytesOutMark;
+    counters[LINK_PUBLISH_REJECTED] = stats.publishesRejected - _rejectedMark;
+}
+
+size_t LinkHealth::encodeBinary(uint8_t* out, size_t capacity, uint32_t nowMs, const Mqtt5Stats& stats) const {
+    uint32_t values[LINK_COUNTER_COUNT];
+    _snapshot(nowMs, stats, values);
+
+    // Zero counters and empty histograms are left out; a missing id reads as 0
+    BadgeCounter counters[LINK_COUNTER_COUNT + COMMAND_TYPE_COUNT * LINK_COMMAND_FIELD_COUNT];
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < LINK_COUNTER_COUNT; i++) {
+        if (values[i] != 0 || i == LINK_SECONDS) {
+            counters[count++] = BadgeCounter{i, values[i]};
+        }
+    }
+    for (uint8_t type = 0; type < COMMAND_TYPE_COUNT; type++) {
+        if (_commands[type].handled == 0) {
+            continue;
+        }
+        uint32_t latency[LINK_COMMAND_FIELD_COUNT];
+        commandValues(_commands[type], latency);
+        for (uint8_t field = 0; field < LINK_COMMAND_FIELD_COUNT; field++) {
+            counters[count++] = BadgeCounter{(uint8_t)(LINK_COMMAND_COUNTERS + type * LINK_COMMAND_FIELD_COUNT + field),
+                                             latency[field]};
+        }
+    }
+    BadgeHistogram histograms[LINK_HISTOGRAM_COUNT];
+    uint8_t histogramCount = 0;
+    for (uint8_t i = 0; i < LINK_HISTOGRAM_COUNT; i++) {
+        BadgeHistogram& histogram = histograms[histogramCount];
+        histogram.id = i;
+        histogram.buckets = LINK_BUCKETS;
+        uint32_t total = 0;
+        for (uint8_t b = 0; b < LINK_BUCKETS; b++) {
+            histogram.counts[b] = _histograms[i][b];
+            total += _histograms[i][b];
+        }
+        if (total > 0) {
+            histogramCount++;
+        }
+    }
+    return encodeLinkHealth(out, capacity, counters, count, histograms, histogramCount);
+}
+
+size_t LinkHealth::encodeJson(char* out, size_t capacity, uint32_t nowMs, const Mqtt5Stats& stats) const {
+    uint32_t values[LINK_COUNTER_COUNT];
+    _snapshot(nowMs, stats, values);
+
+    JsonWriter json(out, capacity);
+    json.field("seconds", values[LINK_SECONDS]);
+    histogramField(json, "rtt_ms", _histograms[LINK_RTT]);
+    counterField(json, "rtt_max_ms", values[LINK_RTT_MAX_MS]);
+    histogramField(json, "connect_ms", _histograms[LINK_CONNECT]);
+    histogramField(json, "outage_ms", _histograms[LINK_OUTAGE]);
+    counterField(json, "lost_wifi", values[LINK_LOST_WIFI]);
+    counterField(json, "lost_keepalive", values[LINK_LOST_KEEPALIVE]);
+    counterField(json, "lost_network", values[LINK_LOST_NETWORK]);
+    counterField(json, "lost_broker", values[LINK_LOST_BROKER]);
+    counterField(json, "failed_wifi", values[LINK_FAILED_WIFI]);
+    counterField(json, "failed_tls", values[LINK_FAILED_TLS]);
+    counterField(json, "failed_broker", values[LINK_FAILED_BROKER]);
+    counterField(json, "publish_failures", values[LINK_PUBLISH_FAILURES]);
+    counterField(json, "publish_rejected", values[LINK_PUBLISH_REJECTED]);
+    counterField(json, "bytes_in", values[LINK_BYTES_IN]);
+    counterField(json, "bytes_out", values[LINK_BYTES_OUT]);
+    for (uint8_t type = 0; type < COMMAND_TYPE_COUNT; type++) {
+        if (_commands[type].handled != 0) {
+            uint32_t latency[LINK_COMMAND_FIELD_COUNT];
+            commandValues(_commands[type], latency);
+            commandField(json, (CommandType)type, latency);
+        }
+    }
+    return json.finish() ? json.length() : 0;
+}
+
+void LinkHealth::reset(uint32_t nowMs, const Mqtt5Stats& stats) {
+    for (uint8_t i = 0; i < LINK_HISTOGRAM_COUNT; i++) {
+        for (uint8_t b = 0; b < LINK_BUCKETS; b++) {
+            _histograms[i][b] = 0;
+        }
+    }
+    for (uint8_t i = 0; i < LINK_COUNTER_COUNT; i++) {
+        _counters[i] = 0;
+    }
+    for (uint8_t i = 0; i < COMMAND_TYPE_COUNT; i++) {
+        _commands[i] = CommandLatency{};
+    }
+    _startMs = nowMs;
+    _pingsSeen = stats.pings;
+    _bytesInMark = stats.bytesIn;
+    _bytesOutMark = stats.bytesOut;
+    _rejectedMark = stats.publishesRejected;
+}
@@ -0,0 +1,63 @@
+#include "MotionSignature.h"
+#include <math.h>
+
+void quantizeMotion(const float* magnitudes, int count, int8_t* out) {
+    float mean = 0.0f;
+    for (int i = 0; i < count; i++) {
+        mean += magnitudes[i];
+    }
+    mean = count ? mean / count : 0.0f;
+
+    float peak = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float deviation = fabsf(magnitudes[i] - mean);
+        if (deviation > peak) {
+            peak = deviation;
+        }
+    }
+
+    float scale = peak > 0.0f ? 127.0f / peak : 0.0f;
+    for (int i = 0; i < count; i++) {
+        out[i] = (int8_t)lroundf((magnitudes[i] - mean) * scale);
+    }
+}
+
+int motionCorrelation(const int8_t* sketch, int sketchLength, const int8_t* history, int historyLength) {
+    int32_t sumA = 0;
+    int32_t sumAA = 0;
+    for (int i = 0; i < sketchLength; i++) {
+        sumA += sketch[i];
+        sumAA += sketch[i] * sketch[i];
+    }
+    float varA = (float)sumAA - (float)sumA * sumA / sketchLength;
+    if (varA <= 0.0f || historyLength < sketchLength) {
+        return 0;
+    }
+
+    // Integer sums per alignment, one square root per alignment
+    int best = 0;
+    bool found = false;
+    for (int offset = 0; offset + sketchLength <= historyLength; offset++) {
+        int32_t sumB = 0;
+        int32_t sumBB = 0;
+        int32_t sumAB = 0;
+        for (int i = 0; i < sketchLength; i++) {
+            int32_t b = history[offset + i];
+            sumB += b;
+            sumBB += b * b;
+            sumAB += sketch[i] * b;
+        }
+
+        float varB = (float)sumBB - (float)sumB * sumB / sketchLength;
+        if (varB <= 0.0f) {
+            continue;
+        }
+        float covariance = (float)sumAB - (float)sumA * sumB / sketchLength;
+        int r = (int)lroundf(100.0f * covariance / sqrtf(varA * varB));
+        if (!found || r > best) {
+            best = r;
+            found = true;
+        }
+    }
+    return best;
+}
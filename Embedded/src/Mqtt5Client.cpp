@@ -0,0 +1,842 @@
+#include "Mqtt5Client.h"
+#include <string.h>
+
+namespace {
+
+enum PacketType : uint8_t {
+    CONNECT = 1,
+    CONNACK = 2,
+    PUBLISH = 3,
+    PUBACK = 4,
+    SUBSCRIBE = 8,
+    SUBACK = 9,
+    UNSUBSCRIBE = 10,
+    UNSUBACK = 11,
+    PINGREQ = 12,
+    PINGRESP = 13,
+    DISCONNECT = 14
+};
+
+enum PropertyId : uint8_t {
+    PROP_SESSION_EXPIRY = 0x11,
+    PROP_SERVER_KEEP_ALIVE = 0x13,
+    PROP_RECEIVE_MAXIMUM = 0x21,
+    PROP_TOPIC_ALIAS_MAXIMUM = 0x22,
+    PROP_TOPIC_ALIAS = 0x23,
+    PROP_MAXIMUM_QOS = 0x24,
+    PROP_MAXIMUM_PACKET_SIZE = 0x27
+};
+
+// Subscription option: do not send our own publishes back to us
+const uint8_t SUBSCRIBE_NO_LOCAL = 0x04;
+
+size_t varintSize(uint32_t value) {
+    return value < 128 ? 1 : value < 16384 ? 2 : value < 2097152 ? 3 : 4;
+}
+
+uint8_t* putVarint(uint8_t* p, uint32_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        *p++ = value ? byte | 0x80 : byte;
+    } while (value);
+    return p;
+}
+
+uint8_t* putU16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+    return p + 2;
+}
+
+uint8_t* putU32(uint8_t* p, uint32_t value) {
+    p = putU16(p, (uint16_t)(value >> 16));
+    return putU16(p, (uint16_t)value);
+}
+
+uint8_t* putString(uint8_t* p, const char* text, size_t length) {
+    p = putU16(p, (uint16_t)length);
+    memcpy(p, text, length);
+    return p + length;
+}
+
+uint16_t getU16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// 1 on success, 0 if more bytes are needed, -1 if malformed
+int getVarint(const uint8_t* p, size_t length, uint32_t* value, size_t* used) {
+    *value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        if (i == length) {
+            return 0;
+        }
+        *value |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+        if ((p[i] & 0x80) == 0) {
+            *used = i + 1;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+// One property from a property list. Numeric values land in value; strings and binary data in data/length.
+struct Property {
+    uint8_t id;
+    uint32_t value;
+    const uint8_t* data;
+    uint16_t length;
+};
+
+// Bytes consumed, or 0 if the property is malformed or unknown
+size_t readProperty(const uint8_t* p, size_t length, Property& out) {
+    if (length < 1) {
+        return 0;
+    }
+    out.id = p[0];
+    out.value = 0;
+    out.data = nullptr;
+    out.length = 0;
+    p++;
+    length--;
+
+    switch (out.id) {
+        // Byte
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            if (length < 1) {
+                return 0;
+            }
+            out.value = p[0];
+            return 2;
+        // Two byte integer
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            if (length < 2) {
+                return 0;
+            }
+            out.value = getU16(p);
+            return 3;
+        // Four byte integer
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            if (length < 4) {
+                return 0;
+            }
+            out.value = (uint32_t)getU16(p) << 16 | getU16(p + 2);
+            return 5;
+        // Variable byte integer
+        case 0x0B: {
+            size_t used = 0;
+            return getVarint(p, length, &out.value, &used) == 1 ? 1 + used : 0;
+        }
+        // UTF-8 string or binary data
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            if (length < 2 || length < 2u + getU16(p)) {
+                return 0;
+            }
+            out.length = getU16(p);
+            out.data = p + 2;
+            return 3 + out.length;
+        // String pair
+        case 0x26: {
+            if (length < 2 || length < 2u + getU16(p)) {
+                return 0;
+            }
+            size_t first = 2 + getU16(p);
+            if (length < first + 2 || length < first + 2 + getU16(p + first)) {
+                return 0;
+            }
+            return 1 + first + 2 + getU16(p + first);
+        }
+        default:
+            return 0;
+    }
+}
+
+// Walk a property list: "length varint, properties". Returns the bytes consumed, or 0 if malformed.
+template <typename Visitor>
+size_t readProperties(const uint8_t* p, size_t length, Visitor visit) {
+    uint32_t propertiesLength = 0;
+    size_t used = 0;
+    if (getVarint(p, length, &propertiesLength, &used) != 1 || propertiesLength > length - used) {
+        return 0;
+    }
+    const uint8_t* property = p + used;
+    size_t remaining = propertiesLength;
+    while (remaining > 0) {
+        Property prop;
+        size_t consumed = readProperty(property, remaining, prop);
+        if (consumed == 0) {
+            return 0;
+        }
+        visit(prop);
+        property += consumed;
+        remaining -= consumed;
+    }
+    return used + propertiesLength;
+}
+
+}
+
+void Mqtt5Client::setTransport(MqttTransport* transport) {
+    _transport = transport;
+}
+
+void Mqtt5Client::setCallback(MessageCallback callback) {
+    _callback = callback;
+}
+
+bool Mqtt5Client::begin(const Mqtt5ConnectOptions& options, uint32_t nowMs) {
+    if (_transport == nullptr || options.clientId == nullptr) {
+        return false;
+    }
+    _nowMs = nowMs;
+    _rxLength = 0;
+    _txLength = 0;
+    _txSent = 0;
+    _reason = MQTT5_SUCCESS;
+    _sessionPresent = false;
+    _keepAliveS = options.keepAliveS;
+    _serverReceiveMaximum = 65535;
+    _serverAliasMaximum = 0;
+    _serverMaximumPacket = 0;
+    _serverMaximumQos = 2;
+    _aliasCount = 0;
+    memset(_inboundAliases, 0, sizeof(_inboundAliases));
+    _pingOutstanding = false;
+
+    // Anything unacknowledged from the last connection goes out again after CONNACK
+    for (uint16_t i = 0; i < MQTT5_MAX_INFLIGHT; i++) {
+        _inflight[i].sent = false;
+    }
+    _inflightSent = 0;
+
+    size_t clientIdLength = strlen(options.clientId);
+    size_t usernameLength = options.username ? strlen(options.username) : 0;
+    size_t passwordLength = options.password ? strlen(options.password) : 0;
+
+    size_t propertiesLength = 3 + 5 + (options.sessionExpiryS ? 5 : 0) + (MQTT5_INBOUND_ALIASES ? 3 : 0);
+    size_t remaining = 10 + varintSize(propertiesLength) + propertiesLength + 2 + clientIdLength +
+                       (options.username ? 2 + usernameLength : 0) + (options.password ? 2 + passwordLength : 0);
+    size_t total = 1 + varintSize(remaining) + remaining;
+    if (!_reserve(total)) {
+        return false;
+    }
+
+    uint8_t flags = options.cleanStart ? 0x02 : 0x00;
+    if (options.username) {
+        flags |= 0x80;
+    }
+    if (options.password) {
+        flags |= 0x40;
+    }
+
+    uint8_t* p = _tx + _txLength;
+    *p++ = CONNECT << 4;
+    p = putVarint(p, remaining);
+    p = putString(p, "MQTT", 4);
+    *p++ = 5;
+    *p++ = flags;
+    p = putU16(p, options.keepAliveS);
+
+    p = putVarint(p, propertiesLength);
+    if (options.sessionExpiryS) {
+        *p++ = PROP_SESSION_EXPIRY;
+        p = putU32(p, options.sessionExpiryS);
+    }
+    *p++ = PROP_RECEIVE_MAXIMUM;
+    p = putU16(p, MQTT5_RECEIVE_MAXIMUM);
+    *p++ = PROP_MAXIMUM_PACKET_SIZE;
+    p = putU32(p, MQTT5_RX_BUFFER);
+    if (MQTT5_INBOUND_ALIASES) {
+        *p++ = PROP_TOPIC_ALIAS_MAXIMUM;
+        p = putU16(p, MQTT5_INBOUND_ALIASES);
+    }
+
+    p = putString(p, options.clientId, clientIdLength);
+    if (options.username) {
+        p = putString(p, options.username, usernameLength);
+    }
+    if (options.password) {
+        p = putString(p, options.password, passwordLength);
+    }
+    _txLength += total;
+
+    _state = MQTT5_CONNECTING;
+    _connectStartMs = nowMs;
+    _lastTxMs = nowMs;
+    return true;
+}
+
+bool Mqtt5Client::poll(uint32_t nowMs) {
+    if (_state == MQTT5_DISCONNECTED) {
+        return false;
+    }
+    _nowMs = nowMs;
+
+    if (!_flush()) {
+        _fail(MQTT5_LOCAL_TRANSPORT_CLOSED);
+        return false;
+    }
+    if (!_read()) {
+        return false;
+    }
+
+    if (_state == MQTT5_CONNECTING) {
+        if (nowMs - _connectStartMs > MQTT5_CONNACK_TIMEOUT_MS) {
+            _fail(MQTT5_LOCAL_CONNECT_TIMEOUT);
+            return false;
+        }
+    } else if (_state == MQTT5_CONNECTED) {
+        if (_inflightSent < _inflightCount) {
+            _resendInflight();
+        }
+        // Ping when we have been quiet for a keepalive period; no answer within another period means the link is dead
+        uint32_t intervalMs = (uint32_t)_keepAliveS * 1000;
+        if (intervalMs > 0) {
+            if (_pingOutstanding && nowMs - _pingSentMs > intervalMs) {
+                _fail(MQTT5_LOCAL_KEEPALIVE_TIMEOUT);
+                return false;
+            }
+            if (!_pingOutstanding && nowMs - _lastTxMs >= intervalMs && _sendPing()) {
+                _pingOutstanding = true;
+                _pingSentMs = nowMs;
+            }
+        }
+    }
+
+    // Acknowledgements queued while reading go out in the same call
+    if (!_flush()) {
+        _fail(MQTT5_LOCAL_TRANSPORT_CLOSED);
+        return false;
+    }
+    return true;
+}
+
+// Make room for length more bytes, compacting the unsent tail to the front if needed
+bool Mqtt5Client::_reserve(size_t length) {
+    if (_txLength + length <= MQTT5_TX_BUFFER) {
+        return true;
+    }
+    if (_txSent > 0) {
+        memmove(_tx, _tx + _txSent, _txLength - _txSent);
+        _txLength -= _txSent;
+        _txSent = 0;
+    }
+    return _txLength + length <= MQTT5_TX_BUFFER;
+}
+
+bool Mqtt5Client::_flush() {
+    size_t pending = _txLength - _txSent;
+    if (pending == 0) {
+        return true;
+    }
+    int written = _transport->write(_tx + _txSent, pending < MQTT5_WRITE_SLICE ? pending : MQTT5_WRITE_SLICE);
+    if (written < 0) {
+        return false;
+    }
+    if (written > 0) {
+        _txSent += written;
+        _stats.bytesOut += written;
+        _lastTxMs = _nowMs;
+    }
+    if (_txSent == _txLength) {
+        _txSent = 0;
+        _txLength = 0;
+    }
+    return true;
+}
+
+// Parse up to MQTT5_POLL_PACKETS complete packets, reading more from the transport as needed
+bool Mqtt5Client::_read() {
+    uint16_t handled = 0;
+    while (handled < MQTT5_POLL_PACKETS && _state != MQTT5_DISCONNECTED) {
+        if (_rxLength >= 2) {
+            uint32_t remaining = 0;
+            size_t used = 0;
+            int status = getVarint(_rx + 1, _rxLength - 1, &remaining, &used);
+            if (status < 0) {
+                _fail(MQTT5_MALFORMED_PACKET);
+                return false;
+            }
+            if (status > 0) {
+                size_t total = 1 + used + remaining;
+                if (total > MQTT5_RX_BUFFER) {
+                    _fail(MQTT5_PACKET_TOO_LARGE);
+                    return false;
+                }
+                if (_rxLength >= total) {
+                    // An inbound QoS 1 publish needs room for its PUBACK; leave it until the socket drains
+                    if (_rx[0] >> 4 == PUBLISH && (_rx[0] & 0x06) != 0 && !_reserve(4)) {
+                        break;
+                    }
+                    uint8_t type = _rx[0] >> 4;
+                    // The callback may have torn the connection down, taking the buffer with it
+                    if (!_handlePacket(_rx[0], _rx + 1 + used, remaining) || _state == MQTT5_DISCONNECTED) {
+                        return false;
+                    }
+                    memmove(_rx, _rx + total, _rxLength - total);
+                    _rxLength -= total;
+                    handled++;
+                    // Return on CONNACK so whoever drives the connect sees it before any message is dispatched
+                    if (type == CONNACK) {
+                        break;
+                    }
+                    continue;
+                }
+            }
+        }
+
+        int received = _transport->read(_rx + _rxLength, MQTT5_RX_BUFFER - _rxLength);
+        if (received < 0) {
+            _fail(MQTT5_LOCAL_TRANSPORT_CLOSED);
+            return false;
+        }
+        if (received == 0) {
+            break;
+        }
+        _rxLength += received;
+        _stats.bytesIn += received;
+    }
+    return _state != MQTT5_DISCONNECTED;
+}
+
+bool Mqtt5Client::_handlePacket(uint8_t header, const uint8_t* body, size_t length) {
+    uint8_t type = header >> 4;
+    if (_state == MQTT5_CONNECTING && type != CONNACK) {
+        _fail(MQTT5_PROTOCOL_ERROR);
+        return false;
+    }
+
+    switch (type) {
+        case CONNACK:
+            return _handleConnAck(body, length);
+        case PUBLISH:
+            return _handlePublish(header, body, length);
+        case PUBACK: {
+            if (length < 2) {
+                _fail(MQTT5_MALFORMED_PACKET);
+                return false;
+            }
+            uint16_t packetId = getU16(body);
+            // A PUBACK without a reason code means success
+            if (length > 2 && body[2] >= 0x80) {
+                _stats.publishesRejected++;
+            }
+            for (uint16_t i = 0; i < MQTT5_MAX_INFLIGHT; i++) {
+                if (_inflight[i].packetId == packetId) {
+                    if (_inflight[i].sent) {
+                        _inflightSent--;
+                    }
+                    _inflight[i].packetId = 0;
+                    _inflightCount--;
+                    break;
+                }
+            }
+            return true;
+        }
+        case SUBACK: {
+            size_t properties = length >= 2 ? readProperties(body + 2, length - 2, [](const Property&) {}) : 0;
+            if (properties == 0) {
+                _fail(MQTT5_MALFORMED_PACKET);
+                return false;
+            }
+            _stats.subscribeAcks++;
+            for (size_t i = 2 + properties; i < length; i++) {
+                if (body[i] >= 0x80) {
+                    _stats.subscribeFailures++;
+                }
+            }
+            return true;
+        }
+        case UNSUBACK:
+            return true;
+        case PINGRESP:
+            if (_pingOutstanding) {
+                _pingOutstanding = false;
+                _stats.pings++;
+                _stats.lastPingRttMs = _nowMs - _pingSentMs;
+            }
+            return true;
+        case DISCONNECT:
+            _fail(length > 0 ? body[0] : (uint8_t)MQTT5_SUCCESS);
+            return false;
+        default:
+            // QoS 2 and AUTH are never negotiated
+            _fail(MQTT5_PROTOCOL_ERROR);
+            return false;
+    }
+}
+
+bool Mqtt5Client::_handleConnAck(const uint8_t* body, size_t length) {
+    if (length < 3) {
+        _fail(MQTT5_MALFORMED_PACKET);
+        return false;
+    }
+    if (body[1] >= 0x80) {
+        _fail(body[1]);
+        return false;
+    }
+    _sessionPresent = body[0] & 0x01;
+
+    size_t properties = readProperties(body + 2, length - 2, [this](const Property& prop) {
+        switch (prop.id) {
+            case PROP_RECEIVE_MAXIMUM:     _serverReceiveMaximum = prop.value ? prop.value : 1; break;
+            case PROP_TOPIC_ALIAS_MAXIMUM: _serverAliasMaximum = prop.value; break;
+            case PROP_MAXIMUM_PACKET_SIZE: _serverMaximumPacket = prop.value; break;
+            case PROP_MAXIMUM_QOS:         _serverMaximumQos = prop.value; break;
+            case PROP_SERVER_KEEP_ALIVE:   _keepAliveS = prop.value; break;
+            default: break;
+        }
+    });
+    if (properties == 0) {
+        _fail(MQTT5_MALFORMED_PACKET);
+        return false;
+    }
+
+    _state = MQTT5_CONNECTED;
+    _resendInflight();
+    return true;
+}
+
+bool Mqtt5Client::_handlePublish(uint8_t header, const uint8_t* body, size_t length) {
+    uint8_t qos = (header >> 1) & 0x03;
+    if (qos > 1) {
+        _fail(MQTT5_PROTOCOL_ERROR);
+        return false;
+    }
+    if (length < 2 || length < 2u + getU16(body)) {
+        _fail(MQTT5_MALFORMED_PACKET);
+        return false;
+    }
+    size_t topicLength = getU16(body);
+    const uint8_t* topic = body + 2;
+    size_t offset = 2 + topicLength;
+
+    uint16_t packetId = 0;
+    if (qos > 0) {
+        if (length < offset + 2) {
+            _fail(MQTT5_MALFORMED_PACKET);
+            return false;
+        }
+        packetId = getU16(body + offset);
+        offset += 2;
+    }
+
+    uint32_t alias = 0;
+    size_t properties = readProperties(body + offset, length - offset, [&alias](const Property& prop) {
+        if (prop.id == PROP_TOPIC_ALIAS) {
+            alias = prop.value;
+        }
+    });
+    if (properties == 0) {
+        _fail(MQTT5_MALFORMED_PACKET);
+        return false;
+    }
+    offset += properties;
+
+    // Resolve the topic: learn a new alias, look one up, or take the topic as sent
+    if (alias > MQTT5_INBOUND_ALIASES || (alias == 0 && topicLength == 0)) {
+        _fail(alias ? MQTT5_TOPIC_ALIAS_INVALID : MQTT5_PROTOCOL_ERROR);
+        return false;
+    }
+    bool deliver = true;
+    if (topicLength > 0) {
+        if (topicLength < MQTT5_TOPIC_SIZE) {
+            memcpy(_topic, topic, topicLength);
+            _topic[topicLength] = '\0';
+            if (alias) {
+                memcpy(_inboundAliases[alias - 1], _topic, topicLength + 1);
+            }
+        } else {
+            deliver = false;
+        }
+    } else {
+        if (_inboundAliases[alias - 1][0] == '\0') {
+            _fail(MQTT5_TOPIC_ALIAS_INVALID);
+            return false;
+        }
+        memcpy(_topic, _inboundAliases[alias - 1], MQTT5_TOPIC_SIZE);
+    }
+
+    _stats.publishesIn++;
+    if (deliver && _callback != nullptr) {
+        _callback(_topic, (uint8_t*)body + offset, (unsigned int)(length - offset));
+    }
+    // Acknowledged after the callback so a command is not lost if we reset while handling it
+    return qos == 0 || _sendPubAck(packetId);
+}
+
+bool Mqtt5Client::_sendPubAck(uint16_t packetId) {
+    if (!_reserve(4)) {
+        _fail(MQTT5_LOCAL_BUFFER_FULL);
+        return false;
+    }
+    uint8_t* p = _tx + _txLength;
+    *p++ = PUBACK << 4;
+    *p++ = 2;
+    putU16(p, packetId);
+    _txLength += 4;
+    return true;
+}
+
+bool Mqtt5Client::_sendPing() {
+    if (!_reserve(2)) {
+        return false;
+    }
+    _tx[_txLength++] = PINGREQ << 4;
+    _tx[_txLength++] = 0;
+    return true;
+}
+
+bool Mqtt5Client::_sendPublish(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                               uint8_t qos, bool retain, bool dup, uint16_t packetId) {
+    // Reuse this topic's alias, or claim a free one while the broker allows more
+    uint16_t alias = 0;
+    bool knownAlias = false;
+    for (uint8_t i = 0; i < _aliasCount; i++) {
+        if (strncmp(_aliases[i], topic, MQTT5_TOPIC_SIZE) == 0) {
+            alias = i + 1;
+            knownAlias = true;
+            break;
+        }
+    }
+    uint16_t aliasLimit = _serverAliasMaximum < MQTT5_TOPIC_ALIASES ? _serverAliasMaximum : MQTT5_TOPIC_ALIASES;
+    if (!knownAlias && _aliasCount < aliasLimit && topicLength < MQTT5_TOPIC_SIZE) {
+        alias = _aliasCount + 1;
+    }
+
+    size_t sentTopicLength = knownAlias ? 0 : topicLength;
+    size_t propertiesLength = alias ? 3 : 0;
+    size_t remaining = 2 + sentTopicLength + (qos ? 2 : 0) + varintSize(propertiesLength) + propertiesLength + length;
+    size_t total = 1 + varintSize(remaining) + remaining;
+    if ((_serverMaximumPacket != 0 && total > _serverMaximumPacket) || !_reserve(total)) {
+        return false;
+    }
+
+    uint8_t* p = _tx + _txLength;
+    *p++ = PUBLISH << 4 | (dup ? 0x08 : 0) | qos << 1 | (retain ? 0x01 : 0);
+    p = putVarint(p, remaining);
+    p = putString(p, topic, sentTopicLength);
+    if (qos) {
+        p = putU16(p, packetId);
+    }
+    p = putVarint(p, propertiesLength);
+    if (alias) {
+        *p++ = PROP_TOPIC_ALIAS;
+        p = putU16(p, alias);
+    }
+    memcpy(p, payload, length);
+    _txLength += total;
+
+    // The alias only counts as known to the broker once the packet carrying it is queued
+    if (alias && !knownAlias) {
+        memcpy(_aliases[_aliasCount++], topic, topicLength + 1);
+    }
+    if (knownAlias) {
+        _stats.aliasedPublishes++;
+        _stats.aliasBytesSaved += topicLength > 3 ? topicLength - 3 : 0;
+    }
+    _stats.publishesOut++;
+    return true;
+}
+
+uint16_t Mqtt5Client::_window() const {
+    return _serverReceiveMaximum < MQTT5_MAX_INFLIGHT ? _serverReceiveMaximum : MQTT5_MAX_INFLIGHT;
+}
+
+// Send stored QoS 1 publishes not yet on the wire in this connection, within the broker's window
+void Mqtt5Client::_resendInflight() {
+    for (uint16_t i = 0; i < MQTT5_MAX_INFLIGHT && _inflightSent < _window(); i++) {
+        Inflight& item = _inflight[i];
+        if (item.packetId == 0 || item.sent) {
+            continue;
+        }
+        if (!_sendPublish(item.topic, item.topicLength, item.payload, item.payloadLength, 1, false, _sessionPresent, item.packetId)) {
+            return;
+        }
+        item.sent = true;
+        _inflightSent++;
+        _stats.resent++;
+    }
+}
+
+uint16_t Mqtt5Client::_allocatePacketId() {
+    for (;;) {
+        uint16_t packetId = _nextPacketId++;
+        if (packetId == 0) {
+            continue;
+        }
+        bool used = false;
+        for (uint16_t i = 0; i < MQTT5_MAX_INFLIGHT; i++) {
+            used |= _inflight[i].packetId == packetId;
+        }
+        if (!used) {
+            return packetId;
+        }
+    }
+}
+
+bool Mqtt5Client::canPublish(size_t length, uint8_t qos) const {
+    if (_state != MQTT5_CONNECTED) {
+        return false;
+    }
+    if (qos > 0 && _serverMaximumQos > 0 && (_inflightCount >= _window() || length > MQTT5_INFLIGHT_PAYLOAD)) {
+        return false;
+    }
+    // Worst case framing: fixed header, topic, packet id and alias property
+    return (_txLength - _txSent) + length + MQTT5_TOPIC_SIZE + 12 <= MQTT5_TX_BUFFER;
+}
+
+bool Mqtt5Client::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+    if (_state != MQTT5_CONNECTED || topic == nullptr || topic[0] == '\0') {
+        return false;
+    }
+    if (qos > _serverMaximumQos) {
+        qos = _serverMaximumQos;
+    }
+    if (qos > 1) {
+        qos = 1;
+    }
+    size_t topicLength = strlen(topic);
+
+    if (qos == 0) {
+        return _sendPublish(topic, topicLength, payload, length, 0, retain, false, 0);
+    }
+
+    // QoS 1 keeps a copy until PUBACK so it can be resent after a reconnect
+    if (_inflightCount >= _window() || topicLength >= MQTT5_TOPIC_SIZE || length > MQTT5_INFLIGHT_PAYLOAD) {
+        return false;
+    }
+    Inflight* slot = nullptr;
+    for (uint16_t i = 0; i < MQTT5_MAX_INFLIGHT && slot == nullptr; i++) {
+        if (_inflight[i].packetId == 0) {
+            slot = &_inflight[i];
+        }
+    }
+    uint16_t packetId = _allocatePacketId();
+    if (slot == nullptr || !_sendPublish(topic, topicLength, payload, length, 1, retain, false, packetId)) {
+        return false;
+    }
+    slot->packetId = packetId;
+    slot->sent = true;
+    slot->topicLength = (uint8_t)topicLength;
+    slot->payloadLength = (uint16_t)length;
+    memcpy(slot->topic, topic, topicLength + 1);
+    memcpy(slot->payload, payload, length);
+    _inflightCount++;
+    _inflightSent++;
+    return true;
+}
+
+bool Mqtt5Client::subscribe(const char* filter, uint8_t qos) {
+    if (_state != MQTT5_CONNECTED || filter == nullptr) {
+        return false;
+    }
+    size_t filterLength = strlen(filter);
+    size_t remaining = 2 + 1 + 2 + filterLength + 1;
+    size_t total = 1 + varintSize(remaining) + remaining;
+    if (!_reserve(total)) {
+        return false;
+    }
+    uint8_t* p = _tx + _txLength;
+    *p++ = SUBSCRIBE << 4 | 0x02;
+    p = putVarint(p, remaining);
+    p = putU16(p, _allocatePacketId());
+    *p++ = 0;
+    p = putString(p, filter, filterLength);
+    *p++ = (qos > 1 ? 1 : qos) | SUBSCRIBE_NO_LOCAL;
+    _txLength += total;
+    return true;
+}
+
+bool Mqtt5Client::unsubscribe(const char* filter) {
+    if (_state != MQTT5_CONNECTED || filter == nullptr) {
+        return false;
+    }
+    size_t filterLength = strlen(filter);
+    size_t remaining = 2 + 1 + 2 + filterLength;
+    size_t total = 1 + varintSize(remaining) + remaining;
+    if (!_reserve(total)) {
+        return false;
+    }
+    uint8_t* p = _tx + _txLength;
+    *p++ = UNSUBSCRIBE << 4 | 0x02;
+    p = putVarint(p, remaining);
+    p = putU16(p, _allocatePacketId());
+    *p++ = 0;
+    putString(p, filter, filterLength);
+    _txLength += total;
+    return true;
+}
+
+bool Mqtt5Client::ping(uint32_t nowMs) {
+    if (_state != MQTT5_CONNECTED || _pingOutstanding || !_sendPing()) {
+        return false;
+    }
+    _pingOutstanding = true;
+    _pingSentMs = nowMs;
+    return true;
+}
+
+void Mqtt5Client::disconnect() {
+    if (_state == MQTT5_DISCONNECTED) {
+        return;
+    }
+    if (_state == MQTT5_CONNECTED && _reserve(2)) {
+        _tx[_txLength++] = DISCONNECT << 4;
+        _tx[_txLength++] = 0;
+    }
+    // Bounded: stop as soon as the transport stops taking bytes
+    size_t before;
+    do {
+        before = _txLength - _txSent;
+    } while (before > 0 && _flush() && _txLength - _txSent < before);
+    _fail(MQTT5_SUCCESS);
+}
+
+void Mqtt5Client::_fail(uint8_t reason) {
+    _reason = reason;
+    _state = MQTT5_DISCONNECTED;
+    _rxLength = 0;
+    _txLength = 0;
+    _txSent = 0;
+    _pingOutstanding = false;
+    if (_transport != nullptr) {
+        _transport->close();
+    }
+}
+
+Mqtt5State Mqtt5Client::state() const {
+    return _state;
+}
+
+bool Mqtt5Client::connected() const {
+    return _state == MQTT5_CONNECTED;
+}
+
+uint8_t Mqtt5Client::reason() const {
+    return _reason;
+}
+
+bool Mqtt5Client::sessionPresent() const {
+    return _sessionPresent;
+}
+
+size_t Mqtt5Client::pendingBytes() const {
+    return _txLength - _txSent;
+}
+
+size_t Mqtt5Client::bufferedBytes() const {
+    return _rxLength;
+}
+
+uint16_t Mqtt5Client::inflight() const {
+    return _inflightCount;
+}
+
+uint16_t Mqtt5Client::keepAlive() const {
+    return _keepAliveS;
+}
+
+Mqtt5Stats Mqtt5Client::stats() const {
+    return _stats;
+}
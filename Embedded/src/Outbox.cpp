@@ -0,0 +1,77 @@
+#include "Outbox.h"
+
+Outbox::Outbox() {
+}
+
+void Outbox::begin() {
+    if (_open) {
+        return;
+    }
+    _open = _prefs.begin("outbox", false);
+    if (!_open) {
+        Serial.println("[Outbox] Failed to open NVS namespace");
+        return;
+    }
+    _head = _prefs.getUShort("head", 0) % _CAPACITY;
+    _count = _prefs.getUShort("count", 0);
+    if (_count > _CAPACITY) {
+        _count = 0;
+    }
+    Serial.println("[Outbox] " + String(_count) + " queued handshake(s) restored");
+}
+
+void Outbox::saveIndex() {
+    _prefs.putUShort("head", _head);
+    _prefs.putUShort("count", _count);
+}
+
+bool Outbox::push(const HandshakeClaim& claim) {
+    if (!_open) {
+        return false;
+    }
+
+    // When full the slot after the last claim is the oldest one's; the indices only move once
+    // the new claim is in flash, so a failed write leaves the ring as it was
+    char key[4];
+    snprintf(key, sizeof(key), "%u", (unsigned)((_head + _count) % _CAPACITY));
+    if (_prefs.putBytes(key, &claim, sizeof(claim)) != sizeof(claim)) {
+        return false;
+    }
+    if (_count == _CAPACITY) {
+        _head = (_head + 1) % _CAPACITY;
+        _dropped++;
+    } else {
+        _count++;
+    }
+    saveIndex();
+    return true;
+}
+
+bool Outbox::peek(uint16_t index, HandshakeClaim& claim) {
+    if (!_open || index >= _count) {
+        return false;
+    }
+    char key[4];
+    snprintf(key, sizeof(key), "%u", (unsigned)((_head + index) % _CAPACITY));
+    return _prefs.getBytes(key, &claim, sizeof(claim)) == sizeof(claim);
+}
+
+void Outbox::pop(uint16_t count) {
+    if (count > _count) {
+        count = _count;
+    }
+    if (count == 0) {
+        return;
+    }
+    _head = (_head + count) % _CAPACITY;
+    _count -= count;
+    saveIndex();
+}
+
+uint16_t Outbox::size() {
+    return _count;
+}
+
+uint32_t Outbox::dropped() {
+    return _dropped;
+}
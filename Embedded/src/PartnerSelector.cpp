@@ -0,0 +1,142 @@
+#include "PartnerSelector.h"
+
+PartnerSelector::PartnerSelector(BLE& ble) : _ble(ble) {}
+
+void PartnerSelector::maintain() {
+    if (_lingering && millis() - _collectionStart >= ADVERTISE_MIN_TIME) {
+        _lingering = false;
+        _restoreRadio();
+    }
+    if (_lingering) {
+        // A background window keeps scanning at full duty; don't let the queue back up
+        _ble.collectPackets();
+    } else if (_ble.isBackground()) {
+        _ble.collectPackets();
+        _ble.expirePeers(NEIGHBOR_MAX_AGE);
+        _ble.refreshDuplicateFilter();
+    }
+}
+
+// Inside a window: the closest peer once its handshake motion matches ours, else a clear RSSI
+// winner, else the only peer in range. The 2 s background table only answers with a clear RSSI
+// winner; the sketches and lone peers it holds often predate our handshake.
+// A stranger's handshake correlates with ours too often for motion to pick a peer on its own,
+// so it only confirms the RSSI leader early.
+const PeerStats* PartnerSelector::_resolve(const int8_t* history, uint32_t maxAge, int* margin, int* correlation) {
+    const PeerStats* dominant = _ble.dominantPeer(DECISION_MIN_SAMPLES, DECISION_MARGIN_DB, maxAge, margin);
+    if (maxAge >= NEIGHBOR_MAX_AGE) {
+        return dominant;
+    }
+
+    const PeerStats* leader = _ble.bestPeer(MIN_PEER_SAMPLES, maxAge);
+    int match = _ble.motionMatch(leader, history, MOTION_MAX_AGE);
+    if (match >= MIN_MOTION_CORRELATION) {
+        *correlation = match;
+        return leader;
+    }
+    return dominant != nullptr ? dominant : _ble.soleCandidate(MIN_PEER_SAMPLES, maxAge);
+}
+
+const PeerStats* PartnerSelector::start(const int8_t* history) {
+    int margin = 0;
+    int correlation = 0;
+    const PeerStats* partner = _ble.isBackground() ? _resolve(history, NEIGHBOR_MAX_AGE, &margin, &correlation) : nullptr;
+    if (partner != nullptr) {
+        return partner;
+    }
+
+    // A window opened while the last one still advertises takes the radio over as it is
+    if (_lingering) {
+        _lingering = false;
+    } else {
+        _restoreBackground = _ble.isBackground();
+    }
+    if (_restoreBackground) {
+        // Nothing close enough yet: run a full-duty window, then drop back to background
+        _ble.setBackground(false);
+    } else {
+        _ble.clearPeers();
+        _ble.advertise();
+        _ble.scan();
+    }
+    _collecting = true;
+    _collectionStart = millis();
+    return nullptr;
+}
+
+// Gather RSSI statistics and close the window once the decision is clear
+bool PartnerSelector::poll(const int8_t* history, const PeerStats** partner) {
+    if (!_collecting) {
+        return false;
+    }
+    _ble.collectPackets();
+
+    unsigned long elapsed = millis() - _collectionStart;
+    int margin = 0;
+    int correlation = 0;
+    const PeerStats* candidate = _resolve(history, elapsed, &margin, &correlation);
+
+    bool decided = candidate != nullptr && elapsed >= COLLECTION_MIN_TIME;
+    bool nobody = elapsed >= COLLECTION_TIME && !_ble.hasCandidates(elapsed);
+    bool capped = elapsed >= COLLECTION_MAX_TIME;
+    if (!decided && !nobody && !capped) {
+        return false;
+    }
+
+    if (candidate == nullptr && capped) {
+        candidate = _ble.bestPeer(MIN_PEER_SAMPLES, elapsed);
+    }
+    *partner = candidate;
+    _closeWindow(elapsed, margin, correlation, decided ? WINDOW_DECIDED : nobody ? WINDOW_NOBODY : WINDOW_CAPPED);
+    return true;
+}
+
+void PartnerSelector::_closeWindow(unsigned long elapsed, int margin, int correlation, WindowOutcome outcome) {
+    _lastWindow = SelectionWindow{elapsed, margin, correlation, outcome};
+    _windowsClosed++;
+    _windowTimeTotal += elapsed;
+    if (outcome == WINDOW_DECIDED) {
+        _windowsDecided++;
+        _decisionMarginTotal += margin;
+    }
+    _collecting = false;
+
+    if (elapsed < ADVERTISE_MIN_TIME) {
+        // Our decision is made, but the partner may still be collecting
+        _lingering = true;
+        if (!_restoreBackground) {
+            _ble.stopScanning();
+        }
+        return;
+    }
+    _restoreRadio();
+}
+
+void PartnerSelector::_restoreRadio() {
+    if (_restoreBackground) {
+        _ble.setBackground(true);
+    } else {
+        _ble.stopScanning();
+        _ble.stopAdvertising();
+    }
+}
+
+bool PartnerSelector::collecting() const {
+    return _collecting;
+}
+
+const SelectionWindow& PartnerSelector::lastWindow() const {
+    return _lastWindow;
+}
+
+unsigned long PartnerSelector::windowsClosed() const {
+    return _windowsClosed;
+}
+
+unsigned long PartnerSelector::averageWindowMs() const {
+    return _windowsClosed ? _windowTimeTotal / _windowsClosed : 0;
+}
+
+long PartnerSelector::averageMarginDb() const {
+    return _windowsDecided ? _decisionMarginTotal / (long)_windowsDecided : 0;
+}
@@ -0,0 +1,263 @@
+#include "PeerTable.h"
+#include <math.h>
+#include <string.h>
+
+float PeerStats::mean() const {
+    return count ? (float)rssiSum / count : 0.0f;
+}
+
+int8_t PeerStats::median() const {
+    uint8_t n = count < RECENT_SIZE ? count : RECENT_SIZE;
+    int8_t sorted[RECENT_SIZE];
+    memcpy(sorted, recent, n);
+
+    // Insertion sort, at most five elements
+    for (uint8_t i = 1; i < n; i++) {
+        int8_t value = sorted[i];
+        int8_t j = i - 1;
+        while (j >= 0 && sorted[j] > value) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = value;
+    }
+    return n ? sorted[n / 2] : -128;
+}
+
+float PeerStats::pathLoss() const {
+    return txPower - filteredRssi;
+}
+
+// Log-distance path loss model: d = 10 ^ ((txPower - rssi) / (10 n)), in metres
+float PeerStats::distance(float exponent) const {
+    return powf(10.0f, pathLoss() / (10.0f * exponent));
+}
+
+PeerTable::PeerTable() {
+    clear();
+}
+
+size_t PeerTable::_hash(uint32_t ticketId) {
+    return (ticketId * 2654435761u) & (CAPACITY - 1);
+}
+
+PeerStats* PeerTable::_find(uint32_t ticketId) {
+    return const_cast<PeerStats*>(find(ticketId));
+}
+
+// Existing slot for the peer, or a new one. A full table makes room by dropping the peer
+// heard weakest, but only for a newcomer that is closer than it; in a crowd that keeps the
+// nearest peers, which are the only ones partner selection looks at.
+PeerStats* PeerTable::_slotFor(uint32_t ticketId, float pathLoss) {
+    PeerStats* existing = _find(ticketId);
+    if (existing != nullptr) {
+        return existing;
+    }
+
+    if (_size >= CAPACITY - 1) {
+        size_t weakest = CAPACITY;
+        for (size_t i = 0; i < CAPACITY; i++) {
+            if (_slots[i].ticketId != 0 && (weakest == CAPACITY || _slots[i].pathLoss() > _slots[weakest].pathLoss())) {
+                weakest = i;
+            }
+        }
+        if (weakest == CAPACITY || _slots[weakest].pathLoss() <= pathLoss) {
+            return nullptr;
+        }
+        _remove(weakest);
+        _evictions++;
+    }
+
+    size_t index = _hash(ticketId);
+    while (_slots[index].ticketId != 0) {
+        index = (index + 1) & (CAPACITY - 1);
+    }
+    PeerStats& peer = _slots[index];
+    memset(&peer, 0, sizeof(peer));
+    peer.ticketId = ticketId;
+    _size++;
+    return &peer;
+}
+
+// Backward-shift deletion: later entries of the probe run move into the hole so lookups
+// still stop at the first empty slot
+void PeerTable::_remove(size_t index) {
+    size_t hole = index;
+    for (size_t i = (hole + 1) & (CAPACITY - 1); _slots[i].ticketId != 0; i = (i + 1) & (CAPACITY - 1)) {
+        size_t home = _hash(_slots[i].ticketId);
+        if (((i - home) & (CAPACITY - 1)) >= ((i - hole) & (CAPACITY - 1))) {
+            _slots[hole] = _slots[i];
+            hole = i;
+        }
+    }
+    memset(&_slots[hole], 0, sizeof(_slots[hole]));
+    _size--;
+}
+
+bool PeerTable::record(uint32_t ticketId, int8_t rssi, int8_t txPower, uint32_t timestamp) {
+    if (ticketId == 0) {
+        return false;
+    }
+
+    PeerStats* peer = _slotFor(ticketId, txPower - rssi);
+    if (peer == nullptr) {
+        return false;
+    }
+
+    if (peer->count == 0) {
+        peer->maxRssi = rssi;
+        peer->ema = rssi;
+        peer->filteredRssi = rssi;
+        peer->variance = PeerStats::MEASUREMENT_NOISE;
+    } else {
+        peer->variance += PeerStats::PROCESS_NOISE;
+        float gain = peer->variance / (peer->variance + PeerStats::MEASUREMENT_NOISE);
+        peer->filteredRssi += gain * (rssi - peer->filteredRssi);
+        peer->variance *= 1.0f - gain;
+    }
+    peer->txPower = txPower;
+    if (rssi > peer->maxRssi) {
+        peer->maxRssi = rssi;
+    }
+    if (peer->count < UINT16_MAX) {
+        peer->count++;
+        peer->rssiSum += rssi;
+    }
+    peer->ema += _EMA_ALPHA * (rssi - peer->ema);
+    peer->lastSeen = timestamp;
+    peer->recent[peer->recentIndex] = rssi;
+    peer->recentIndex = (peer->recentIndex + 1) % PeerStats::RECENT_SIZE;
+    return true;
+}
+
+void PeerTable::recordAddress(uint32_t ticketId, const uint8_t address[6], uint8_t addressType) {
+    PeerStats* peer = _find(ticketId);
+    if (peer == nullptr) {
+        return;
+    }
+    memcpy(peer->address, address, sizeof(peer->address));
+    peer->addressType = addressType;
+}
+
+void PeerTable::recordSketch(uint32_t ticketId, uint8_t sketchSeq, const int8_t* sketch, uint32_t timestamp) {
+    PeerStats* peer = _find(ticketId);
+    if (peer == nullptr || sketchSeq == 0 || peer->sketchSeq == sketchSeq) {
+        return;
+    }
+    peer->sketchSeq = sketchSeq;
+    peer->sketchSeen = timestamp;
+    memcpy(peer->sketch, sketch, sizeof(peer->sketch));
+}
+
+const PeerStats* PeerTable::find(uint32_t ticketId) const {
+    size_t index = _hash(ticketId);
+    for (size_t probe = 0; probe < CAPACITY; probe++, index = (index + 1) & (CAPACITY - 1)) {
+        const PeerStats& peer = _slots[index];
+        if (peer.ticketId == ticketId) {
+            return &peer;
+        }
+        if (peer.ticketId == 0) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+const PeerStats* PeerTable::best(uint16_t minSamples, uint32_t now, uint32_t maxAge) const {
+    const PeerStats* closest = nullptr;
+
+    for (size_t i = 0; i < CAPACITY; i++) {
+        const PeerStats& peer = _slots[i];
+        if (peer.ticketId == 0 || peer.count < minSamples) {
+            continue;
+        }
+        if (maxAge != UINT32_MAX && now - peer.lastSeen > maxAge) {
+            continue;
+        }
+        if (closest == nullptr || peer.pathLoss() < closest->pathLoss()) {
+            closest = &peer;
+        }
+    }
+    return closest;
+}
+
+int PeerTable::lead(uint32_t now, uint32_t maxAge, float ceiling, const PeerStats** leader) const {
+    const PeerStats* first = nullptr;
+    float firstLoss = 0.0f;
+    float secondLoss = ceiling;
+
+    for (size_t i = 0; i < CAPACITY; i++) {
+        const PeerStats& peer = _slots[i];
+        if (peer.ticketId == 0 || now - peer.lastSeen > maxAge) {
+            continue;
+        }
+        float loss = peer.pathLoss();
+        if (first == nullptr || loss < firstLoss) {
+            if (first != nullptr && firstLoss < secondLoss) {
+                secondLoss = firstLoss;
+            }
+            first = &peer;
+            firstLoss = loss;
+        } else if (loss < secondLoss) {
+            secondLoss = loss;
+        }
+    }
+
+    *leader = first;
+    return first ? (int)lroundf(secondLoss - firstLoss) : 0;
+}
+
+size_t PeerTable::within(uint32_t now, uint32_t maxAge, float maxPathLoss) const {
+    size_t count = 0;
+    for (size_t i = 0; i < CAPACITY; i++) {
+        const PeerStats& peer = _slots[i];
+        if (peer.ticketId != 0 && now - peer.lastSeen <= maxAge && peer.pathLoss() <= maxPathLoss) {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t PeerTable::expire(uint32_t now, uint32_t maxAge) {
+    PeerStats survivors[CAPACITY];
+    size_t kept = 0;
+
+    for (size_t i = 0; i < CAPACITY; i++) {
+        if (_slots[i].ticketId != 0 && now - _slots[i].lastSeen <= maxAge) {
+            survivors[kept++] = _slots[i];
+        }
+    }
+
+    size_t removed = _size - kept;
+    if (removed == 0) {
+        return 0;
+    }
+
+    // Rehash the survivors so linear probing chains stay intact
+    clear();
+    for (size_t i = 0; i < kept; i++) {
+        PeerStats* peer = _slotFor(survivors[i].ticketId, survivors[i].pathLoss());
+        *peer = survivors[i];
+    }
+    return removed;
+}
+
+const PeerStats* PeerTable::at(size_t index) const {
+    if (index >= CAPACITY || _slots[index].ticketId == 0) {
+        return nullptr;
+    }
+    return &_slots[index];
+}
+
+size_t PeerTable::size() const {
+    return _size;
+}
+
+size_t PeerTable::evictions() const {
+    return _evictions;
+}
+
+void PeerTable::clear() {
+    memset(_slots, 0, sizeof(_slots));
+    _size = 0;
+}
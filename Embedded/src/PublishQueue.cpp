@@ -0,0 +1,81 @@
+#include "PublishQueue.h"
+#include <string.h>
+
+static bool fits(const void* payload, size_t length) {
+    return payload != nullptr && length < MQTT_QUEUED_PAYLOAD_SIZE;
+}
+
+bool PublishQueue::push(PublishKind kind, const char* payload) {
+    size_t length = payload ? strlen(payload) : 0;
+    if (!fits(payload, length) || _count == MQTT_QUEUE_SIZE) {
+        _stats.dropped++;
+        return false;
+    }
+
+    QueuedPublish& item = _items[(_head + _count) % MQTT_QUEUE_SIZE];
+    item.kind = kind;
+    item.binary = false;
+    item.length = (uint16_t)length;
+    memcpy(item.payload, payload, length + 1);
+    _count++;
+    _stats.queued++;
+    return true;
+}
+
+// Binary payloads may contain NULs, so the length is explicit and nothing is terminated
+bool PublishQueue::push(PublishKind kind, const uint8_t* payload, size_t length) {
+    if (!fits(payload, length) || length == 0 || _count == MQTT_QUEUE_SIZE) {
+        _stats.dropped++;
+        return false;
+    }
+
+    QueuedPublish& item = _items[(_head + _count) % MQTT_QUEUE_SIZE];
+    item.kind = kind;
+    item.binary = true;
+    item.length = (uint16_t)length;
+    memcpy(item.payload, payload, length);
+    _count++;
+    _stats.queued++;
+    return true;
+}
+
+const QueuedPublish* PublishQueue::at(uint16_t index) const {
+    if (index >= _count) {
+        return nullptr;
+    }
+    return &_items[(_head + index) % MQTT_QUEUE_SIZE];
+}
+
+void PublishQueue::pop(uint16_t count) {
+    if (count > _count) {
+        count = _count;
+    }
+    if (count == 0) {
+        return;
+    }
+    _head = (_head + count) % MQTT_QUEUE_SIZE;
+    _count -= count;
+
+    _stats.drained += count;
+    _stats.batches++;
+    if (count > _stats.largestBatch) {
+        _stats.largestBatch = count;
+    }
+}
+
+void PublishQueue::discard(uint16_t count) {
+    if (count > _count) {
+        count = _count;
+    }
+    _head = (_head + count) % MQTT_QUEUE_SIZE;
+    _count -= count;
+    _stats.dropped += count;
+}
+
+uint16_t PublishQueue::size() const {
+    return _count;
+}
+
+PublishStats PublishQueue::stats() const {
+    return _stats;
+}
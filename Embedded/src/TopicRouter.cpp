@@ -0,0 +1,75 @@
+#include "TopicRouter.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool suffixIs(const char* suffix, const char* expected, size_t length) {
+    return memcmp(suffix, expected, length) == 0;
+}
+
+bool TopicRouter::begin(const char* clientId, const char* eventId) {
+    int device = snprintf(_devicePrefix, sizeof(_devicePrefix), "device/%s/", clientId);
+    int event = snprintf(_eventPrefix, sizeof(_eventPrefix), "event/%s/", eventId);
+    if (device < 0 || device >= (int)sizeof(_devicePrefix) || event < 0 || event >= (int)sizeof(_eventPrefix)) {
+        _devicePrefixLength = 0;
+        _eventPrefixLength = 0;
+        return false;
+    }
+    _devicePrefixLength = device;
+    _eventPrefixLength = event;
+    return true;
+}
+
+TopicRoute TopicRouter::route(const char* topic, const char** tail, size_t* tailLength) const {
+    *tail = nullptr;
+    *tailLength = 0;
+    size_t length = strlen(topic);
+
+    if (_devicePrefixLength != 0 && length > _devicePrefixLength &&
+        memcmp(topic, _devicePrefix, _devicePrefixLength) == 0) {
+        return _routeDevice(topic + _devicePrefixLength, length - _devicePrefixLength);
+    }
+    if (_eventPrefixLength != 0 && length > _eventPrefixLength &&
+        memcmp(topic, _eventPrefix, _eventPrefixLength) == 0) {
+        return _routeEvent(topic + _eventPrefixLength, length - _eventPrefixLength, tail, tailLength);
+    }
+    return ROUTE_NONE;
+}
+
+// Device suffixes are told apart by length, and by first letter for the two of length 8, so one compare decides
+TopicRoute TopicRouter::_routeDevice(const char* suffix, size_t length) const {
+    switch (length) {
+        case 6:  return suffixIs(suffix, "reboot", 6) ? ROUTE_DEVICE_REBOOT : ROUTE_NONE;
+        case 8:
+            if (suffix[0] == 'e') {
+                return suffixIs(suffix, "encoding", 8) ? ROUTE_ENCODING : ROUTE_NONE;
+            }
+            return suffixIs(suffix, "resetNFC", 8) ? ROUTE_RESET_NFC : ROUTE_NONE;
+        case 10: return suffixIs(suffix, "assignment", 10) ? ROUTE_ASSIGNMENT : ROUTE_NONE;
+        case 12: return suffixIs(suffix, "reassignment", 12) ? ROUTE_REASSIGNMENT : ROUTE_NONE;
+        case 13: return suffixIs(suffix, "receipt_batch", 13) ? ROUTE_RECEIPT_BATCH : ROUTE_NONE;
+        default: return ROUTE_NONE;
+    }
+}
+
+// Availability announcements and the bare profile_swap topic fall through to ROUTE_NONE
+TopicRoute TopicRouter::_routeEvent(const char* suffix, size_t length, const char** tail, size_t* tailLength) const {
+    static const size_t SWAP_LENGTH = sizeof("profile_swap/") - 1;
+
+    if (length == 6) {
+        return suffixIs(suffix, "reboot", 6) ? ROUTE_EVENT_REBOOT : ROUTE_NONE;
+    }
+    if (length > SWAP_LENGTH && suffix[0] == 'p' && suffixIs(suffix, "profile_swap/", SWAP_LENGTH)) {
+        *tail = suffix + SWAP_LENGTH;
+        *tailLength = length - SWAP_LENGTH;
+        return ROUTE_PROFILE_SWAP;
+    }
+    return ROUTE_NONE;
+}
+
+const char* TopicRouter::devicePrefix() const {
+    return _devicePrefix;
+}
+
+const char* TopicRouter::eventPrefix() const {
+    return _eventPrefix;
+}
@@ -0,0 +1,25 @@
+#include "WiFiTransport.h"
+
+WiFiTransport::WiFiTransport(WiFiClient& client) : _client(client) {}
+
+int WiFiTransport::read(uint8_t* buffer, size_t length) {
+    int available = _client.available();
+    if (available <= 0) {
+        return _client.connected() ? 0 : -1;
+    }
+    int received = _client.read(buffer, (size_t)available < length ? (size_t)available : length);
+    return received < 0 ? 0 : received;
+}
+
+// A short or zero write on a live connection is retried by the next poll()
+int WiFiTransport::write(const uint8_t* data, size_t length) {
+    size_t written = _client.write(data, length);
+    if (written == 0 && !_client.connected()) {
+        return -1;
+    }
+    return (int)written;
+}
+
+void WiFiTransport::close() {
+    _client.stop();
+}
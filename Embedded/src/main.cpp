@@ -2,10 +2,18 @@
 #include "ECE140_MQTT.h"
 #include "BLE.h"
 #include "Handshake.h"
+#include "Outbox.h"
+#include "PartnerSelector.h"
 #include <Adafruit_BNO055.h>
 #include <SparkFun_ST25DV64KC_Arduino_Library.h>
 #include <algorithm>
 
+// Per-window BLE statistics and per-command latency on Serial. Building those lines
+// allocates Strings on every window and command, so they are off by default.
+#ifndef BADGE_DEBUG_LOG
+#define BADGE_DEBUG_LOG 0
+#endif
+
 // MQTT Credentials
 const char* broker = MQTT_SERVER;
 const char* broker_username = MQTT_USERNAME;
@@ -28,6 +36,8 @@ SFE_ST25DV64KC_NDEF tag;
 ECE140_WIFI wifi;
 ECE140_MQTT mqtt;
 BLE ble;
+PartnerSelector selector(ble);
+Outbox outbox;
 
 // Device specific variables
 String ticketId;
@@ -36,18 +46,23 @@ String macAddress;
 
 // State variables
 bool assigned = false;
+bool eventValid = false;
 bool tagWritten = false;
 bool handshakeDetected = false;
 bool deviceFound = false;
-bool BLEstarted = false;
 bool profileExchanged = false;
 
 // BLE
 String foundId;
 String prevId;
 std::vector<String> detectedTickets;
-unsigned long collectionStart = 0;
-static const unsigned long COLLECTION_TIME = 1000; 
+PeerStats lastPartner;
+bool lastPartnerKnown = false;
+
+// Offline handshake outbox, drained to MQTT in batches once connectivity returns
+static const uint8_t OUTBOX_BATCH = 4;
+static const unsigned long OUTBOX_DRAIN_INTERVAL = 1000;
+unsigned long lastOutboxDrain = 0;
 
 // Buzzer
 const int pwmBitResolution = 8;
@@ -60,6 +75,13 @@ unsigned long buzzDuration = 0;
 Handshake handshake;
 unsigned long timeDetected = 0;
 
+#if IMU_CAPTURE
+// Field capture of IMU windows around detections
+ImuCapture capture;
+uint8_t captureChunk[IMU_CAPTURE_CHUNK_SIZE];
+unsigned long lastCaptureSend = 0;
+#endif
+
 // Haptic feedback
 void setupFeedback(){
     ledcAttach(MOTOR_PIN, pwmFrequency, pwmBitResolution);
@@ -77,6 +99,149 @@ void deactivateFeedback() {
     }
 }
 
+// Hand the chosen partner's ticket to the profile exchange logic below
+void selectPartner(const PeerStats* partner) {
+    if (partner != nullptr) {
+        char ticket[16];
+        formatTicketId(partner->ticketId, ticket, sizeof(ticket));
+        ble.setTicket(ticket);
+        lastPartner = *partner;
+        lastPartnerKnown = true;
+        // Serial.println("Closest peer: " + String(ticket) + " at " + String(ble.distanceTo(partner)) + " m");
+    }
+}
+
+// Record a handshake that could not be reported over MQTT and pass it to the partner over GATT
+void queueHandshake(String partnerTicket) {
+    HandshakeClaim claim;
+    claim.ticketId = parseBadgeNumber(ticketId.c_str());
+    claim.partnerTicketId = parseBadgeNumber(partnerTicket.c_str());
+    claim.timestamp = (uint32_t)time(nullptr);
+    claim.nonce = esp_random();
+
+    if (lastPartnerKnown && lastPartner.ticketId == claim.partnerTicketId) {
+        ble.startClaimExchange(lastPartner, claim);
+    }
+    outbox.push(claim);
+}
+
+// Publish up to OUTBOX_BATCH queued handshakes per interval while connected
+void drainOutbox() {
+    if (outbox.size() == 0 || !mqtt.isConnected() || millis() - lastOutboxDrain < OUTBOX_DRAIN_INTERVAL) {
+        return;
+    }
+    lastOutboxDrain = millis();
+
+    uint16_t published = 0;
+    HandshakeClaim claim;
+    while (published < OUTBOX_BATCH && outbox.peek(published, claim)) {
+        char ticket[16];
+        char partner[16];
+        formatTicketId(claim.ticketId, ticket, sizeof(ticket));
+        formatTicketId(claim.partnerTicketId, partner, sizeof(partner));
+        if (!mqtt.publishHandshakeClaim(ticket, partner, claim.timestamp, claim.nonce)) {
+            break;
+        }
+        published++;
+    }
+    outbox.pop(published);
+}
+
+#if IMU_CAPTURE
+// Publish one chunk of a finished capture per interval. Called right after sampling so a slow
+// publish delays at most the next reading, which the resampler interpolates back onto the grid.
+void sendCapture() {
+    if (!capture.ready() || selector.collecting() || handshakeDetected || !mqtt.isConnected() ||
+        millis() - lastCaptureSend < IMU_CAPTURE_SEND_INTERVAL_MS) {
+        return;
+    }
+    lastCaptureSend = millis();
+
+    size_t length = capture.peekChunk(captureChunk, sizeof(captureChunk));
+    if (length > 0 && mqtt.publishCapture(captureChunk, length)) {
+        capture.chunkSent();
+    }
+}
+#endif
+
+// Load the assigned ticket into the BLE advertising packet and start looking for handshakes.
+// The ticket itself was checked by the MQTT client; an unusable EVENT_ID refuses every ticket.
+bool assignTicket(const String& ticket) {
+    if (!eventValid) {
+        mqtt.publishReceipt("assign device", "invalid event id");
+        return false;
+    }
+    ticketId = ticket;
+    mqtt.publishReceipt("assign device", "success");
+    assigned = true;
+    ble.setTicketId(ticketId);
+    ble.setEventId(eventId);
+    handshake.init();
+    activateFeedback(255, 1000);
+
+    if (BLE_BACKGROUND_MODE) {
+        // Keep a warm neighbor table at low duty so a handshake resolves instantly
+        ble.setBackground(true);
+        ble.advertise();
+        ble.scan();
+    }
+    return true;
+}
+
+// Act on MQTT commands in arrival order. Every message is its own entry, so two swap
+// confirmations in one pass buzz twice, and the latency from arrival to action is logged.
+void handleCommands() {
+    InboundCommand command;
+    while (mqtt.nextCommand(command)) {
+        switch (command.type) {
+            case COMMAND_ASSIGNMENT:
+                if (!assigned) {
+                    assignTicket(command.text);
+                }
+                break;
+            case COMMAND_REASSIGNMENT:
+                tagWritten = false;
+                profileExchanged = false;
+                if (assignTicket(command.text)) {
+                    mqtt.publishReceipt("ticket_reassignment", "success");
+                }
+                break;
+            case COMMAND_RESET_NFC: {
+                uint8_t tagMemory[256];
+                memset(tagMemory, 0, 256);
+                tag.writeEEPROM(0x0, tagMemory, 256);
+                tag.writeCCFile8Byte();
+                tagWritten = false;
+                mqtt.publishReceipt("nfc_reset", "success");
+                break;
+            }
+            case COMMAND_PROFILE_SWAP:
+                activateFeedback(255, 500);
+                mqtt.publishReceipt("Haptic feedback", "success");
+                break;
+            case COMMAND_REBOOT:
+                // The broker already has our acknowledgement of this message, so it is not redelivered after the restart
+                mqtt.publishReceipt("reboot", "acknowledged");
+                mqtt.flush();
+                delay(100);
+                ESP.restart();
+                break;
+            default:
+                break;
+        }
+
+        uint32_t latencyUs = mqtt.commandHandled(command);
+#if BADGE_DEBUG_LOG
+        CommandLatency latency = mqtt.getCommandLatency(command.type);
+        Serial.println("[CMD] " + String(commandName(command.type)) + " handled " + String(latencyUs) + " us after arrival (avg " +
+                       String((uint32_t)(latency.totalUs / latency.handled)) + " us, max " + String(latency.maxUs) + " us, " +
+                       String((uint32_t)mqtt.getDroppedCommands()) + " dropped)");
+#else
+        (void)latencyUs;
+#endif
+    }
+}
+
 // //Turn on the external antenna
 void turnOnAntenna() {
     pinMode(3, OUTPUT); 
@@ -96,20 +261,27 @@ void setup() {
     wifi.connectToWiFi(WIFI_SSID, NON_ENTERPRISE_WIFI_PASSWORD);
     macAddress = WiFi.macAddress();
     eventId = EVENT_ID;
+    uint16_t eventNumber;
+    eventValid = parseEventId(eventId.c_str(), eventNumber);
+    if (!eventValid) {
+        Serial.println("EVENT_ID " + eventId + " is not E_ and a number up to 65535, ticket assignments will be refused");
+    }
 
-    // Connect to MQTT broker and initialize sub/pubs
-    if (mqtt.connectToBroker(macAddress, eventId)) {
-        mqtt.setCallback([](char* topic, uint8_t* payload, unsigned int length) {
-            mqtt.handleMessage(topic, payload, length);
-        });
+    // Connect to MQTT broker and initialize sub/pubs. Subscriptions are remembered and
+    // replayed by mqtt.loop() after every reconnect, including when this first attempt fails.
+    bool mqttConnected = mqtt.connectToBroker(macAddress, eventId);
+    mqtt.setCallback([](char* topic, uint8_t* payload, unsigned int length) {
+        mqtt.handleMessage(topic, payload, length);
+    });
+    mqtt.subscribeDevice();
+    mqtt.subscribeEvent();
+    mqtt.subscribeProfileSwap();
+    if (mqttConnected) {
         mqtt.publishAvailability();
-        mqtt.subscribeDevice();
-        mqtt.subscribeEvent();
-        mqtt.subscribeProfileSwap();
-        mqtt.publishReceipt("connect", "success");
+        mqtt.publishReceipt("connect", eventValid ? "success" : "invalid event id");
         Serial.println("Connected to MQTT broker");
     } else {
-        Serial.println("Failed to connect to MQTT broker");
+        Serial.println("Failed to connect to MQTT broker, retrying in the background");
     }
 
     // Connect to NFC tag
@@ -124,6 +296,17 @@ void setup() {
         tag.writeCCFile8Byte();
     }
 
+    // Bring up the BLE host stack once; handshakes only start/stop the radio
+    ble.begin();
+
+    // Restore handshakes queued while offline and keep wall-clock time for their timestamps
+    outbox.begin();
+    configTime(0, 0, "pool.ntp.org");
+
+#if IMU_CAPTURE
+    handshake.setCapture(&capture);
+#endif
+
     // Set up Haptic feedback
     setupFeedback();
 
@@ -133,19 +316,9 @@ void setup() {
 
 
 void loop() {
-    // Maintain MQTT connection
+    // Maintain MQTT connection, then act on any commands it delivered (assignment, swaps, resets, reboot)
     mqtt.loop();
-
-    // Get assigned ticket ID and load it into the BLE advertising packet
-    if(mqtt.isAssigned() && !assigned) {
-        ticketId = mqtt.getTicketID();
-        mqtt.publishReceipt("assign device", "success");
-        assigned = true;
-        ble.setTicketId(ticketId);
-        ble.setEventId(eventId);
-        handshake.init();
-        activateFeedback(255, 1000);
-    }
+    handleCommands();
 
     // Write ticket URL to NFC tag 
     if (assigned && !tagWritten) {
@@ -162,6 +335,9 @@ void loop() {
     // If assigned, collect data from the IMU
     if(assigned) {
         handshake.collectData();
+#if IMU_CAPTURE
+        sendCapture();
+#endif
     }
 
     // Process the IMU data and determine if a handshake is detected
@@ -171,9 +347,23 @@ void loop() {
         if(!predictions.empty() && (int)predictions[0][0] == 4 && predictions[0][1] > 0.9) {
             handshakeDetected = true;
             timeDetected = millis();
+            ble.markHandshake();
+
+            // Advertise a fingerprint of this handshake so the partner can confirm it
+            int8_t sketch[MOTION_SKETCH_LENGTH];
+            handshake.motionSketch(sketch);
+            ble.setMotionSketch(sketch);
             // Serial.println("Handshake detected!");
             mqtt.publishReceipt("handshake", "success");
+#if IMU_CAPTURE
+            capture.trigger(CAPTURE_POSITIVE, 4, predictions[0][1], millis());
+#endif
+        }
+#if IMU_CAPTURE
+        else if (!predictions.empty() && (int)predictions[0][0] == 4 && predictions[0][1] >= IMU_CAPTURE_NEAR_MISS) {
+            capture.trigger(CAPTURE_NEAR_MISS, 4, predictions[0][1], millis());
         }
+#endif
     }
 
     // Handshake detected debounce of 2 seconds
@@ -183,36 +373,37 @@ void loop() {
         }
     }
 
-    // If the IMU detects a handshake, advertise/scan over BLE to find the ticket ID of the other device
-    if(assigned && !BLEstarted && handshakeDetected) {
-        ble.advertise();
-        ble.scan();
-        BLEstarted = true;
-        collectionStart = millis();
+    // In background mode keep the rolling neighbor table fed and aged
+    if(assigned) {
+        selector.maintain();
     }
 
-    // If BLE is started, collect the strongest signal from the incoming packets
-    if(BLEstarted){
-        if(millis() - collectionStart >= COLLECTION_TIME){
-            ble.stopScanning();
-            ble.stopAdvertising();
-            BLEstarted = false;
-        }
+    // If the IMU detects a handshake, resolve the partner from the neighbor table or open a collection window
+    if(assigned && !selector.collecting() && handshakeDetected) {
+        int8_t history[MOTION_HISTORY_LENGTH];
+        handshake.motionHistory(history);
+        selectPartner(selector.start(history));
+    }
 
-        if (!ble.getIncomingPackets().empty()) {
-            std::vector<String> strongest = ble.getIncomingPackets()[0];
-        
-            for (size_t i = 1; i < ble.getIncomingPackets().size(); i++) {
-                int currentRssi = ble.getIncomingPackets()[i][1].toInt(); 
-                int strongestRssi = strongest[1].toInt();
-            
-                if (currentRssi > strongestRssi) {
-                    strongest = ble.getIncomingPackets()[i];
-                }
-            }
-            ble.setTicket(strongest[0]);
-            // Serial.println("Strongest signal: " + strongest[0] + " at " + strongest[1] + "dBm");
-        } 
+    // If a window is open, gather RSSI statistics until the decision is clear
+    if(selector.collecting()){
+        int8_t history[MOTION_HISTORY_LENGTH];
+        handshake.motionHistory(history);
+        const PeerStats* partner = nullptr;
+
+        if(selector.poll(history, &partner)){
+            selectPartner(partner);
+#if BADGE_DEBUG_LOG
+            const SelectionWindow& window = selector.lastWindow();
+            Serial.println("[BLE] Window " + String(window.elapsedMs) + " ms, margin " + String(window.margin) + " dB, motion r=" + String(window.correlation) +
+                           "%, avg window " + String(selector.averageWindowMs()) + " ms, avg margin " + String(selector.averageMarginDb()) + " dB");
+            Serial.println("[BLE] Adv on air after " + String(ble.getAdvLatency()) + " us, first scan result after " + String(ble.getFirstResultLatency()) + " us");
+
+            ScanStats stats = ble.getScanStats();
+            Serial.println("[BLE] Scan callbacks " + String(stats.callbacks) + " (accepted " + String(stats.accepted) + ", rejected " + String(stats.rejected) +
+                           ", dropped " + String(stats.dropped) + "), " + String(stats.callbackUs) + " us in callback");
+#endif
+        }
     }
 
 
@@ -224,41 +415,24 @@ void loop() {
         deviceFound = true;
 
     } else if(deviceFound && !profileExchanged && std::find(detectedTickets.begin(), detectedTickets.end(), foundId) != detectedTickets.end()) {
-        mqtt.publishHandshake(foundId);
-        mqtt.publishReceipt("profile exchange", "success");
+        if (mqtt.isConnected() && mqtt.publishHandshake(foundId)) {
+            mqtt.publishReceipt("profile exchange", "success");
+        } else {
+            queueHandshake(foundId);
+        }
         deviceFound = false;
         profileExchanged = true;
-        BLEstarted = false;
     } 
 
-    // Turn off the feedback
-    deactivateFeedback();
-
-    // Check for profile swaps and provide haptic feedback if detected
-    if(mqtt.profileSwap()){
-        activateFeedback(255, 500);
-        mqtt.publishReceipt("Haptic feedback", "success");
-        mqtt.resetProfileSwapFlag();
-    }
-
-    // Check for ticket reassignment
-    if(mqtt.ticketReset()){
-        assigned = false;
-        tagWritten = false;
-        profileExchanged = false;
-        mqtt.resetTicketFlag();
-        mqtt.publishReceipt("ticket_reassignment", "success");
+    // Keep claims peers handed us over GATT, then sync the outbox when MQTT is back
+    ble.pollClaimExchange();
+    HandshakeClaim received;
+    while (ble.receivedClaim(received)) {
+        outbox.push(received);
     }
+    drainOutbox();
 
-    // Check for NFC reset
-    if(mqtt.nfcReset()){
-        uint8_t tagMemory[256];
-        memset(tagMemory, 0, 256);
-        tag.writeEEPROM(0x0, tagMemory, 256);
-        tag.writeCCFile8Byte();
-        tagWritten = false;
-        mqtt.resetNfcFlag();
-        mqtt.publishReceipt("nfc_reset", "success");
-    }
+    // Turn off the feedback
+    deactivateFeedback();
 }
 
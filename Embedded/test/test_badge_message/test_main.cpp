@@ -0,0 +1,319 @@
+#include <unity.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "BadgeMessage.h"
+#include "JsonWriter.h"
+
+void setUp() {}
+void tearDown() {}
+
+static bool textIs(const BadgeText& text, const char* expected) {
+    return text.length == strlen(expected) && memcmp(text.data, expected, text.length) == 0;
+}
+
+static BadgeMessage decoded(const uint8_t* data, size_t length) {
+    BadgeMessage message;
+    TEST_ASSERT_TRUE(decodeBadgeMessage(data, length, message));
+    return message;
+}
+
+void test_availability_round_trip() {
+    uint8_t buffer[64];
+    size_t length = encodeAvailability(buffer, sizeof(buffer), "E_01", "AA:BB:CC:DD:EE:FF", true);
+    // version, type, two length-prefixed texts, flag
+    TEST_ASSERT_EQUAL(2 + 1 + 4 + 1 + 17 + 1, length);
+    TEST_ASSERT_EQUAL_HEX8(BADGE_MESSAGE_VERSION, buffer[0]);
+    BadgeMessage message = decoded(buffer, length);
+    TEST_ASSERT_EQUAL(BADGE_MSG_AVAILABILITY, message.type);
+    TEST_ASSERT_TRUE(textIs(message.eventId, "E_01"));
+    TEST_ASSERT_TRUE(textIs(message.deviceId, "AA:BB:CC:DD:EE:FF"));
+    TEST_ASSERT_TRUE(message.available);
+    // Text spans point into the input, not a copy
+    TEST_ASSERT_TRUE(message.deviceId.data > (const char*)buffer && message.deviceId.data < (const char*)buffer + length);
+
+    length = encodeAvailability(buffer, sizeof(buffer), nullptr, "", false);
+    message = decoded(buffer, length);
+    TEST_ASSERT_EQUAL(0, message.eventId.length);
+    TEST_ASSERT_FALSE(message.available);
+}
+
+void test_receipt_round_trip_and_merge() {
+    uint8_t batch[128];
+    uint8_t receipt[64];
+    size_t length = encodeReceipt(batch, sizeof(batch), "resetNFC", "ok");
+    TEST_ASSERT_EQUAL(2 + 1 + 1 + 8 + 1 + 2, length);
+    for (uint8_t i = 1; i < BADGE_MESSAGE_MAX_RECEIPTS; i++) {
+        size_t receiptLength = encodeReceipt(receipt, sizeof(receipt), "assignment", i % 2 ? "ok" : "stale");
+        length = mergeReceipts(batch, length, sizeof(batch), receipt, receiptLength);
+        TEST_ASSERT_NOT_EQUAL(0, length);
+    }
+    BadgeMessage message = decoded(batch, length);
+    TEST_ASSERT_EQUAL(BADGE_MSG_RECEIPT, message.type);
+    TEST_ASSERT_EQUAL(BADGE_MESSAGE_MAX_RECEIPTS, message.count);
+    TEST_ASSERT_TRUE(textIs(message.receipts[0].command, "resetNFC"));
+    TEST_ASSERT_TRUE(textIs(message.receipts[7].command, "assignment"));
+    TEST_ASSERT_TRUE(textIs(message.receipts[7].status, "ok"));
+    TEST_ASSERT_TRUE(textIs(message.receipts[6].status, "stale"));
+
+    // A ninth receipt, a batch that does not fit, and a non-receipt are all refused
+    size_t receiptLength = encodeReceipt(receipt, sizeof(receipt), "assignment", "ok");
+    TEST_ASSERT_EQUAL(0, mergeReceipts(batch, length, sizeof(batch), receipt, receiptLength));
+    size_t small = encodeReceipt(batch, sizeof(batch), "resetNFC", "ok");
+    TEST_ASSERT_EQUAL(0, mergeReceipts(batch, small, small + receiptLength - 4, receipt, receiptLength));
+    size_t other = encodeAvailability(receipt, sizeof(receipt), "E_01", "AA", true);
+    TEST_ASSERT_EQUAL(0, mergeReceipts(batch, small, sizeof(batch), receipt, other));
+}
+
+void test_profile_swap_round_trip() {
+    uint8_t buffer[64];
+    size_t length = encodeProfileSwap(buffer, sizeof(buffer), "E_01", 123, 456);
+    BadgeMessage message = decoded(buffer, length);
+    TEST_ASSERT_EQUAL(BADGE_MSG_PROFILE_SWAP, message.type);
+    TEST_ASSERT_EQUAL(123, message.ticketId);
+    TEST_ASSERT_EQUAL(456, message.partnerTicketId);
+    TEST_ASSERT_EQUAL(0, message.flags);
+
+    length = encodeProfileSwapClaim(buffer, sizeof(buffer), "E_01", 999999, 1, 0xFFFFFFFFu, 0x12345678u);
+    TEST_ASSERT_EQUAL(24, length);
+    message = decoded(buffer, length);
+    TEST_ASSERT_EQUAL(BADGE_SWAP_HAS_CLAIM, message.flags);
+    TEST_ASSERT_EQUAL(999999, message.ticketId);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFFu, message.timestamp);
+    TEST_ASSERT_EQUAL_HEX32(0x12345678u, message.nonce);
+
+    // Unknown flag bits are refused
+    buffer[length - 9] |= 0x80;
+    TEST_ASSERT_FALSE(decodeBadgeMessage(buffer, length, message));
+}
+
+void test_telemetry_and_link_health_round_trip() {
+    uint8_t buffer[512];
+    BadgeCounter counters[BADGE_MESSAGE_MAX_COUNTERS];
+    for (uint8_t i = 0; i < BADGE_MESSAGE_MAX_COUNTERS; i++) {
+        counters[i] = {i, 0xA5000000u + i};
+    }
+    size_t length = encodeTelemetry(buffer, sizeof(buffer), counters, 8);
+    TEST_ASSERT_EQUAL(43, length);
+    BadgeMessage message = decoded(buffer, length);
+    TEST_ASSERT_EQUAL(BADGE_MSG_TELEMETRY, message.type);
+    TEST_ASSERT_EQUAL(8, message.count);
+    TEST_ASSERT_EQUAL_HEX32(0xA5000007u, message.counters[7].value);
+    TEST_ASSERT_EQUAL(0, encodeTelemetry(buffer, sizeof(buffer), counters, BADGE_MESSAGE_MAX_COUNTERS + 1));
+
+    BadgeHistogram histograms[BADGE_MESSAGE_MAX_HISTOGRAMS];
+    for (uint8_t h = 0; h < BADGE_MESSAGE_MAX_HISTOGRAMS; h++) {
+        histograms[h].id = h;
+        histograms[h].buckets = BADGE_MESSAGE_MAX_BUCKETS;
+        for (uint8_t b = 0; b < BADGE_MESSAGE_MAX_BUCKETS; b++) {
+            histograms[h].counts[b] = (uint16_t)(h * 1000 + b);
+        }
+    }
+    length = encodeLinkHealth(buffer, sizeof(buffer), counters, BADGE_MESSAGE_MAX_COUNTERS, histograms, BADGE_MESSAGE_MAX_HISTOGRAMS);
+    TEST_ASSERT_NOT_EQUAL(0, length);
+    message = decoded(buffer, length);
+    TEST_ASSERT_EQUAL(BADGE_MSG_LINK_HEALTH, message.type);
+    TEST_ASSERT_EQUAL(BADGE_MESSAGE_MAX_COUNTERS, message.count);
+    TEST_ASSERT_EQUAL(BADGE_MESSAGE_MAX_HISTOGRAMS, message.histogramCount);
+    TEST_ASSERT_EQUAL(3007, message.histograms[3].counts[7]);
+
+    histograms[1].buckets = BADGE_MESSAGE_MAX_BUCKETS + 1;
+    TEST_ASSERT_EQUAL(0, encodeLinkHealth(buffer, sizeof(buffer), counters, 1, histograms, 2));
+}
+
+// Encoders never write past the capacity and never return a partial message
+void test_encoders_at_every_capacity() {
+    uint8_t full[64];
+    size_t needed = encodeProfileSwapClaim(full, sizeof(full), "E_01", 1, 2, 3, 4);
+    for (size_t capacity = 0; capacity <= needed; capacity++) {
+        uint8_t buffer[64];
+        memset(buffer, 0xEE, sizeof(buffer));
+        size_t length = encodeProfileSwapClaim(buffer, capacity, "E_01", 1, 2, 3, 4);
+        TEST_ASSERT_EQUAL(capacity < needed ? 0 : needed, length);
+        TEST_ASSERT_EQUAL_HEX8(0xEE, buffer[capacity]);
+    }
+
+    char longText[300];
+    memset(longText, 'x', sizeof(longText) - 1);
+    longText[sizeof(longText) - 1] = '\0';
+    uint8_t buffer[512];
+    TEST_ASSERT_EQUAL(0, encodeAvailability(buffer, sizeof(buffer), longText, "AA", true));
+}
+
+void test_rejects_malformed_input() {
+    uint8_t buffer[64];
+    BadgeMessage message;
+    size_t length = encodeReceipt(buffer, sizeof(buffer), "resetNFC", "ok");
+
+    TEST_ASSERT_FALSE(decodeBadgeMessage(nullptr, 0, message));
+    TEST_ASSERT_FALSE(decodeBadgeMessage((const uint8_t*)"{\"command\": 1}", 14, message));
+    // Trailing bytes
+    buffer[length] = 0;
+    TEST_ASSERT_FALSE(decodeBadgeMessage(buffer, length + 1, message));
+    // Empty and oversized receipt counts
+    buffer[2] = 0;
+    TEST_ASSERT_FALSE(decodeBadgeMessage(buffer, length, message));
+    buffer[2] = BADGE_MESSAGE_MAX_RECEIPTS + 1;
+    TEST_ASSERT_FALSE(decodeBadgeMessage(buffer, length, message));
+    // Unknown type
+    buffer[1] = 0x7F;
+    TEST_ASSERT_FALSE(decodeBadgeMessage(buffer, 2, message));
+}
+
+// Every field is fixed by the counts and lengths before it, so no strict prefix of a valid
+// message decodes
+void test_truncation_always_rejected() {
+    uint8_t buffers[5][512];
+    size_t lengths[5];
+    BadgeCounter counters[4] = {{1, 10}, {2, 20}, {3, 30}, {4, 40}};
+    BadgeHistogram histogram = {9, 3, {1, 2, 3}};
+    lengths[0] = encodeAvailability(buffers[0], 512, "E_01", "AA:BB:CC:DD:EE:FF", true);
+    lengths[1] = encodeReceipt(buffers[1], 512, "resetNFC", "ok");
+    lengths[2] = encodeProfileSwapClaim(buffers[2], 512, "E_01", 1, 2, 3, 4);
+    lengths[3] = encodeTelemetry(buffers[3], 512, counters, 4);
+    lengths[4] = encodeLinkHealth(buffers[4], 512, counters, 4, &histogram, 1);
+
+    for (int i = 0; i < 5; i++) {
+        for (size_t cut = 0; cut < lengths[i]; cut++) {
+            // Exact-size heap copy, so a sanitizer build catches any read past the end
+            uint8_t* copy = (uint8_t*)malloc(cut ? cut : 1);
+            memcpy(copy, buffers[i], cut);
+            BadgeMessage message;
+            TEST_ASSERT_FALSE(decodeBadgeMessage(copy, cut, message));
+            free(copy);
+        }
+    }
+}
+
+// Whatever the input, an accepted message stays inside the buffer and its declared bounds
+static bool withinBounds(const BadgeMessage& message, const uint8_t* data, size_t length) {
+    const char* begin = (const char*)data;
+    const char* end = begin + length;
+    auto inside = [&](const BadgeText& text) {
+        return text.length == 0 || (text.data >= begin && text.data + text.length <= end);
+    };
+    if (!inside(message.eventId) || !inside(message.deviceId)) {
+        return false;
+    }
+    if (message.type == BADGE_MSG_RECEIPT) {
+        if (message.count == 0 || message.count > BADGE_MESSAGE_MAX_RECEIPTS) {
+            return false;
+        }
+        for (uint8_t i = 0; i < message.count; i++) {
+            if (!inside(message.receipts[i].command) || !inside(message.receipts[i].status)) {
+                return false;
+            }
+        }
+    }
+    if (message.count > BADGE_MESSAGE_MAX_COUNTERS || message.histogramCount > BADGE_MESSAGE_MAX_HISTOGRAMS) {
+        return false;
+    }
+    for (uint8_t h = 0; h < message.histogramCount; h++) {
+        if (message.histograms[h].buckets > BADGE_MESSAGE_MAX_BUCKETS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_fuzz_bit_flips_and_random_input() {
+    std::mt19937 rng(44);
+    uint8_t seeds[5][512];
+    size_t lengths[5];
+    BadgeCounter counters[4] = {{1, 10}, {2, 20}, {3, 30}, {4, 40}};
+    BadgeHistogram histogram = {9, 3, {1, 2, 3}};
+    lengths[0] = encodeAvailability(seeds[0], 512, "E_01", "AA:BB:CC:DD:EE:FF", true);
+    lengths[1] = encodeReceipt(seeds[1], 512, "resetNFC", "ok");
+    lengths[1] = mergeReceipts(seeds[1], lengths[1], 512, seeds[1], lengths[1]);
+    lengths[2] = encodeProfileSwapClaim(seeds[2], 512, "E_01", 1, 2, 3, 4);
+    lengths[3] = encodeTelemetry(seeds[3], 512, counters, 4);
+    lengths[4] = encodeLinkHealth(seeds[4], 512, counters, 4, &histogram, 1);
+
+    const uint32_t rounds = 500000;
+    uint32_t accepted = 0;
+    uint32_t outOfBounds = 0;
+    std::vector<uint8_t> input;
+    for (uint32_t round = 0; round < rounds; round++) {
+        if (round % 4 == 0) {
+            // Random bytes behind a valid header
+            input.resize(2 + rng() % 64);
+            for (uint8_t& byte : input) {
+                byte = (uint8_t)rng();
+            }
+            input[0] = BADGE_MESSAGE_VERSION;
+            input[1] = (uint8_t)(1 + rng() % 5);
+        } else {
+            int seed = rng() % 5;
+            input.assign(seeds[seed], seeds[seed] + lengths[seed]);
+            for (uint32_t flips = 1 + rng() % 3; flips > 0; flips--) {
+                input[rng() % input.size()] ^= (uint8_t)(1 << (rng() % 8));
+            }
+            if (rng() % 4 == 0) {
+                input.resize(rng() % input.size());
+            }
+        }
+        uint8_t* copy = (uint8_t*)malloc(input.size() ? input.size() : 1);
+        memcpy(copy, input.data(), input.size());
+        BadgeMessage message;
+        if (decodeBadgeMessage(copy, input.size(), message)) {
+            accepted++;
+            outOfBounds += !withinBounds(message, copy, input.size());
+        }
+        free(copy);
+    }
+
+    char text[96];
+    snprintf(text, sizeof(text), "%u mutated or random inputs, %u accepted, all within bounds", (unsigned)rounds, (unsigned)accepted);
+    TEST_MESSAGE(text);
+    TEST_ASSERT_EQUAL(0, outOfBounds);
+    TEST_ASSERT_GREATER_THAN(0, accepted);
+}
+
+// The JSON forms BadgePublisher sends for the same messages
+void test_size_against_json() {
+    char json[256];
+    uint8_t binary[256];
+    JsonWriter availability(json, sizeof(json));
+    availability.field("event_id", "E_01")
+        .field("device_id", "AA:BB:CC:DD:EE:FF")
+        .field("is_available", true)
+        .field("encodings", "json,binary")
+        .field("receipt_batch", (uint32_t)8);
+    availability.finish();
+    size_t availabilityBinary = encodeAvailability(binary, sizeof(binary), "E_01", "AA:BB:CC:DD:EE:FF", true);
+
+    JsonWriter receipt(json, sizeof(json));
+    receipt.field("command", "resetNFC").field("status", "ok");
+    receipt.finish();
+    size_t receiptBinary = encodeReceipt(binary, sizeof(binary), "resetNFC", "ok");
+
+    JsonWriter swap(json, sizeof(json));
+    swap.field("event_id", "E_01").field("ticket_id", "T_000123").field("ticket_id_to_swap", "T_000456");
+    swap.finish();
+    size_t swapBinary = encodeProfileSwap(binary, sizeof(binary), "E_01", 123, 456);
+
+    char text[160];
+    snprintf(text, sizeof(text), "bytes JSON/binary: availability %u/%u, receipt %u/%u, swap %u/%u",
+             (unsigned)availability.length(), (unsigned)availabilityBinary, (unsigned)receipt.length(), (unsigned)receiptBinary,
+             (unsigned)swap.length(), (unsigned)swapBinary);
+    TEST_MESSAGE(text);
+    TEST_ASSERT_LESS_THAN(availability.length() / 3, availabilityBinary);
+    TEST_ASSERT_LESS_THAN(receipt.length(), receiptBinary);
+    TEST_ASSERT_LESS_THAN(swap.length() / 3, swapBinary);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_availability_round_trip);
+    RUN_TEST(test_receipt_round_trip_and_merge);
+    RUN_TEST(test_profile_swap_round_trip);
+    RUN_TEST(test_telemetry_and_link_health_round_trip);
+    RUN_TEST(test_encoders_at_every_capacity);
+    RUN_TEST(test_rejects_malformed_input);
+    RUN_TEST(test_truncation_always_rejected);
+    RUN_TEST(test_fuzz_bit_flips_and_random_input);
+    RUN_TEST(test_size_against_json);
+    return UNITY_END();
+}
@@ -0,0 +1,119 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "CommandQueue.h"
+
+static CommandQueue* queue = nullptr;
+
+void setUp() {
+    queue = new CommandQueue();
+}
+
+void tearDown() {
+    delete queue;
+}
+
+static bool push(CommandType type, const char* text, uint32_t nowUs = 0) {
+    return queue->push(type, text, text ? strlen(text) : 0, nowUs);
+}
+
+// A burst of swap confirmations between two loop passes comes out as one command each, in order
+void test_fifo_across_types() {
+    TEST_ASSERT_TRUE(push(COMMAND_ASSIGNMENT, "T_0001"));
+    TEST_ASSERT_TRUE(push(COMMAND_PROFILE_SWAP, "T_0002"));
+    TEST_ASSERT_TRUE(push(COMMAND_PROFILE_SWAP, "T_0003"));
+    TEST_ASSERT_TRUE(push(COMMAND_RESET_NFC, nullptr));
+    TEST_ASSERT_TRUE(push(COMMAND_PROFILE_SWAP, "T_0004"));
+    TEST_ASSERT_EQUAL(5, queue->size());
+
+    const CommandType types[] = {COMMAND_ASSIGNMENT, COMMAND_PROFILE_SWAP, COMMAND_PROFILE_SWAP, COMMAND_RESET_NFC, COMMAND_PROFILE_SWAP};
+    const char* texts[] = {"T_0001", "T_0002", "T_0003", "", "T_0004"};
+    InboundCommand command;
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(queue->pop(command));
+        TEST_ASSERT_EQUAL(types[i], command.type);
+        TEST_ASSERT_EQUAL_STRING(texts[i], command.text);
+    }
+    TEST_ASSERT_FALSE(queue->pop(command));
+    TEST_ASSERT_EQUAL(0, queue->dropped());
+}
+
+void test_text_is_truncated_and_terminated() {
+    char longText[COMMAND_TEXT_SIZE * 2];
+    memset(longText, 'x', sizeof(longText));
+    TEST_ASSERT_TRUE(queue->push(COMMAND_REASSIGNMENT, longText, sizeof(longText), 0));
+    // The payload is not NUL-terminated; only length bytes may be read
+    TEST_ASSERT_TRUE(queue->push(COMMAND_ASSIGNMENT, "T_0009garbage", 6, 0));
+
+    InboundCommand command;
+    queue->pop(command);
+    TEST_ASSERT_EQUAL(COMMAND_TEXT_SIZE - 1, strlen(command.text));
+    queue->pop(command);
+    TEST_ASSERT_EQUAL_STRING("T_0009", command.text);
+}
+
+void test_full_queue_drops_newest() {
+    char text[8];
+    for (int i = 0; i < COMMAND_QUEUE_SIZE + 3; i++) {
+        snprintf(text, sizeof(text), "T_%04d", i);
+        TEST_ASSERT_EQUAL(i < COMMAND_QUEUE_SIZE, push(COMMAND_PROFILE_SWAP, text));
+    }
+    TEST_ASSERT_EQUAL(COMMAND_QUEUE_SIZE, queue->size());
+    TEST_ASSERT_EQUAL(3, queue->dropped());
+
+    InboundCommand command;
+    queue->pop(command);
+    TEST_ASSERT_EQUAL_STRING("T_0000", command.text);
+    TEST_ASSERT_TRUE(push(COMMAND_REBOOT, nullptr));
+}
+
+void test_latency_per_type() {
+    InboundCommand command;
+    push(COMMAND_PROFILE_SWAP, "T_0002", 1000);
+    push(COMMAND_PROFILE_SWAP, "T_0003", 1500);
+    push(COMMAND_ASSIGNMENT, "T_0001", 2000);
+
+    queue->pop(command);
+    TEST_ASSERT_EQUAL(200, queue->handled(command, 1200));
+    queue->pop(command);
+    TEST_ASSERT_EQUAL(700, queue->handled(command, 2200));
+    queue->pop(command);
+    TEST_ASSERT_EQUAL(250, queue->handled(command, 2250));
+
+    CommandLatency swaps = queue->latency(COMMAND_PROFILE_SWAP);
+    TEST_ASSERT_EQUAL(2, swaps.handled);
+    TEST_ASSERT_EQUAL(700, swaps.lastUs);
+    TEST_ASSERT_EQUAL(700, swaps.maxUs);
+    TEST_ASSERT_EQUAL(900, swaps.totalUs);
+    TEST_ASSERT_EQUAL(1, queue->latency(COMMAND_ASSIGNMENT).handled);
+    TEST_ASSERT_EQUAL(0, queue->latency(COMMAND_REBOOT).handled);
+    TEST_ASSERT_EQUAL(0, queue->latency(COMMAND_TYPE_COUNT).handled);
+}
+
+// micros() wraps every 71 minutes; a command that straddles the wrap still measures correctly
+void test_latency_across_micros_wrap() {
+    InboundCommand command;
+    push(COMMAND_RESET_NFC, nullptr, 0xFFFFFF00u);
+    queue->pop(command);
+    TEST_ASSERT_EQUAL(0x100 + 50, queue->handled(command, 50));
+}
+
+void test_command_names() {
+    TEST_ASSERT_EQUAL_STRING("assignment", commandName(COMMAND_ASSIGNMENT));
+    TEST_ASSERT_EQUAL_STRING("reassignment", commandName(COMMAND_REASSIGNMENT));
+    TEST_ASSERT_EQUAL_STRING("nfc reset", commandName(COMMAND_RESET_NFC));
+    TEST_ASSERT_EQUAL_STRING("profile swap", commandName(COMMAND_PROFILE_SWAP));
+    TEST_ASSERT_EQUAL_STRING("reboot", commandName(COMMAND_REBOOT));
+    TEST_ASSERT_EQUAL_STRING("unknown", commandName(COMMAND_TYPE_COUNT));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_across_types);
+    RUN_TEST(test_text_is_truncated_and_terminated);
+    RUN_TEST(test_full_queue_drops_newest);
+    RUN_TEST(test_latency_per_type);
+    RUN_TEST(test_latency_across_micros_wrap);
+    RUN_TEST(test_command_names);
+    return UNITY_END();
+}
@@ -0,0 +1,340 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "ImuCapture.h"
+
+// The hand-collected CSVs, relative to Embedded/ where pio test runs
+#ifndef IMU_CAPTURE_DATASET
+#define IMU_CAPTURE_DATASET "../TensorFlow/Data"
+#endif
+
+typedef std::vector<std::vector<int16_t>> Samples;
+
+struct Chunk {
+    uint32_t sequence;
+    uint16_t captureId;
+    uint8_t chunkIndex;
+    uint8_t chunkCount;
+    uint8_t trigger;
+    uint8_t predictedClass;
+    uint8_t score;
+    uint16_t triggerSample;
+    uint16_t firstSample;
+    Samples samples;
+};
+
+static ImuCapture* capture = nullptr;
+
+void setUp() {
+    capture = new ImuCapture();
+}
+
+void tearDown() {
+    delete capture;
+}
+
+static int16_t quantize(float value, float scale) {
+    float scaled = roundf(value * scale);
+    return (int16_t)std::max(-32768.0f, std::min(32767.0f, scaled));
+}
+
+static uint32_t getU16(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+}
+
+// The same checks and layout as decodeChunk() in TensorFlow/captureReceiver.py
+static bool decodeChunk(const uint8_t* payload, size_t length, Chunk& out) {
+    if (length < IMU_CAPTURE_HEADER_SIZE || payload[0] != IMU_CAPTURE_VERSION) {
+        return false;
+    }
+    out.sequence = getU16(payload + 1) | getU16(payload + 3) << 16;
+    out.captureId = getU16(payload + 5);
+    out.chunkIndex = payload[7];
+    out.chunkCount = payload[8];
+    out.trigger = payload[9];
+    out.predictedClass = payload[10];
+    out.score = payload[11];
+    out.triggerSample = getU16(payload + 12);
+    out.firstSample = getU16(payload + 14);
+    uint8_t count = payload[16];
+    uint8_t channels = payload[17];
+    if (channels != IMU_CAPTURE_CHANNELS || count == 0 || out.chunkIndex >= out.chunkCount) {
+        return false;
+    }
+
+    out.samples.assign(count, std::vector<int16_t>(channels));
+    size_t offset = IMU_CAPTURE_HEADER_SIZE;
+    for (uint8_t c = 0; c < channels; c++) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        int16_t value = (int16_t)getU16(payload + offset);
+        uint8_t bits = payload[offset + 2];
+        offset += 3;
+        size_t packedLength = (bits * (count - 1) + 7) / 8;
+        if (bits > 17 || offset + packedLength > length) {
+            return false;
+        }
+        out.samples[0][c] = value;
+        size_t bit = offset * 8;
+        for (uint8_t i = 1; i < count; i++) {
+            uint32_t delta = 0;
+            for (uint8_t b = 0; b < bits; b++, bit++) {
+                delta |= (uint32_t)(payload[bit / 8] >> (bit % 8) & 1) << b;
+            }
+            value = (int16_t)(value + (int32_t)((delta >> 1) ^ -(delta & 1)));
+            out.samples[i][c] = value;
+        }
+        offset += packedLength;
+    }
+    return offset == length;
+}
+
+// Send every chunk of the pending capture and reassemble it
+static bool drainCapture(Samples& samples, std::vector<Chunk>* chunks = nullptr, size_t* bytes = nullptr) {
+    samples.clear();
+    uint8_t buffer[IMU_CAPTURE_CHUNK_SIZE];
+    while (capture->ready()) {
+        size_t length = capture->peekChunk(buffer, sizeof(buffer));
+        Chunk chunk;
+        if (length == 0 || length > IMU_CAPTURE_CHUNK_SIZE || !decodeChunk(buffer, length, chunk) ||
+            chunk.firstSample != samples.size()) {
+            return false;
+        }
+        samples.insert(samples.end(), chunk.samples.begin(), chunk.samples.end());
+        if (chunks != nullptr) {
+            chunks->push_back(chunk);
+        }
+        if (bytes != nullptr) {
+            *bytes += length;
+        }
+        capture->chunkSent();
+    }
+    return samples.size() == IMU_CAPTURE_SAMPLES;
+}
+
+static void record(const float sample[IMU_CAPTURE_CHANNELS], Samples& history) {
+    capture->record(sample);
+    std::vector<int16_t> quantized(IMU_CAPTURE_CHANNELS);
+    for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+        quantized[c] = quantize(sample[c], c < 3 ? IMU_CAPTURE_ACCEL_SCALE : IMU_CAPTURE_GYRO_SCALE);
+    }
+    history.push_back(quantized);
+}
+
+static bool matchesHistory(const Samples& samples, const Samples& history, size_t triggerIndex) {
+    size_t start = triggerIndex + 1 - IMU_CAPTURE_PRE_SAMPLES;
+    return std::equal(samples.begin(), samples.end(), history.begin() + start);
+}
+
+void test_trigger_gating() {
+    float sample[IMU_CAPTURE_CHANNELS] = {};
+    Samples history;
+    // Not enough history for the pre-trigger window yet
+    for (size_t i = 0; i < IMU_CAPTURE_PRE_SAMPLES - 1; i++) {
+        record(sample, history);
+    }
+    TEST_ASSERT_FALSE(capture->trigger(CAPTURE_POSITIVE, 1, 0.9f, 1000));
+    record(sample, history);
+    TEST_ASSERT_TRUE(capture->trigger(CAPTURE_POSITIVE, 1, 0.9f, 1000));
+    // Pending until sent, then rate limited
+    TEST_ASSERT_FALSE(capture->trigger(CAPTURE_NEAR_MISS, 1, 0.7f, 1000 + IMU_CAPTURE_MIN_INTERVAL_MS));
+    TEST_ASSERT_FALSE(capture->ready());
+    for (size_t i = 0; i < IMU_CAPTURE_POST_SAMPLES; i++) {
+        record(sample, history);
+    }
+    TEST_ASSERT_TRUE(capture->ready());
+    Samples samples;
+    TEST_ASSERT_TRUE(drainCapture(samples));
+    TEST_ASSERT_FALSE(capture->trigger(CAPTURE_NEAR_MISS, 1, 0.7f, 1000 + IMU_CAPTURE_MIN_INTERVAL_MS - 1));
+    TEST_ASSERT_TRUE(capture->trigger(CAPTURE_NEAR_MISS, 1, 0.7f, 1000 + IMU_CAPTURE_MIN_INTERVAL_MS));
+
+    CaptureStats stats = capture->stats();
+    TEST_ASSERT_EQUAL(1, stats.captured);
+    TEST_ASSERT_EQUAL(3, stats.skipped);
+    TEST_ASSERT_EQUAL((IMU_CAPTURE_SAMPLES + IMU_CAPTURE_CHUNK_SAMPLES - 1) / IMU_CAPTURE_CHUNK_SAMPLES, stats.chunksSent);
+
+    // clear() drops the pre-trigger window and the capture in progress
+    capture->clear();
+    TEST_ASSERT_FALSE(capture->ready());
+    TEST_ASSERT_FALSE(capture->trigger(CAPTURE_POSITIVE, 1, 0.9f, 1000 + 3 * IMU_CAPTURE_MIN_INTERVAL_MS));
+}
+
+void test_header_fields() {
+    float sample[IMU_CAPTURE_CHANNELS] = {1.0f, -1.0f, 0.5f, 10.0f, -10.0f, 0.0f};
+    Samples history;
+    uint8_t buffer[IMU_CAPTURE_CHUNK_SIZE];
+    for (size_t i = 0; i < IMU_CAPTURE_PRE_SAMPLES; i++) {
+        record(sample, history);
+    }
+    TEST_ASSERT_EQUAL(0, capture->peekChunk(buffer, sizeof(buffer)));
+    capture->trigger(CAPTURE_NEAR_MISS, 3, 0.666f, 0);
+    for (size_t i = 0; i < IMU_CAPTURE_POST_SAMPLES; i++) {
+        record(sample, history);
+    }
+    // Too small a buffer gets nothing rather than a partial chunk
+    TEST_ASSERT_EQUAL(0, capture->peekChunk(buffer, sizeof(buffer) - 1));
+
+    std::vector<Chunk> chunks;
+    Samples samples;
+    TEST_ASSERT_TRUE(drainCapture(samples, &chunks));
+    TEST_ASSERT_EQUAL((IMU_CAPTURE_SAMPLES + IMU_CAPTURE_CHUNK_SAMPLES - 1) / IMU_CAPTURE_CHUNK_SAMPLES, chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        TEST_ASSERT_EQUAL(i, chunks[i].sequence);
+        TEST_ASSERT_EQUAL(i, chunks[i].chunkIndex);
+        TEST_ASSERT_EQUAL(chunks.size(), chunks[i].chunkCount);
+        TEST_ASSERT_EQUAL(1, chunks[i].captureId);
+        TEST_ASSERT_EQUAL(CAPTURE_NEAR_MISS, chunks[i].trigger);
+        TEST_ASSERT_EQUAL(3, chunks[i].predictedClass);
+        TEST_ASSERT_EQUAL(67, chunks[i].score);
+        TEST_ASSERT_EQUAL(IMU_CAPTURE_PRE_SAMPLES - 1, chunks[i].triggerSample);
+    }
+    TEST_ASSERT_TRUE(matchesHistory(samples, history, IMU_CAPTURE_PRE_SAMPLES - 1));
+}
+
+// Full-scale steps need 17-bit deltas, the widest the chunk size allows for; values beyond
+// the int16 range saturate
+void test_round_trip_at_full_scale() {
+    std::mt19937 rng(45);
+    Samples history;
+    float sample[IMU_CAPTURE_CHANNELS];
+    size_t triggerIndex = 0;
+    for (size_t i = 0; i < IMU_CAPTURE_PRE_SAMPLES + 37; i++) {
+        for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+            float limit = 32768.0f / (c < 3 ? IMU_CAPTURE_ACCEL_SCALE : IMU_CAPTURE_GYRO_SCALE);
+            sample[c] = (i + c) % 2 ? limit * 1.5f : -limit * 1.5f;
+            if (rng() % 3 == 0) {
+                sample[c] = std::uniform_real_distribution<float>(-limit, limit)(rng);
+            }
+        }
+        record(sample, history);
+    }
+    triggerIndex = history.size() - 1;
+    TEST_ASSERT_TRUE(capture->trigger(CAPTURE_POSITIVE, 0, 1.0f, 0));
+    for (size_t i = 0; i < IMU_CAPTURE_POST_SAMPLES; i++) {
+        for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+            sample[c] = (float)(int32_t)(rng() % 65536 - 32768) / (c < 3 ? IMU_CAPTURE_ACCEL_SCALE : IMU_CAPTURE_GYRO_SCALE);
+        }
+        record(sample, history);
+    }
+    Samples samples;
+    TEST_ASSERT_TRUE(drainCapture(samples));
+    TEST_ASSERT_TRUE(matchesHistory(samples, history, triggerIndex));
+}
+
+static bool readCsv(const std::string& path, std::vector<std::vector<float>>& rows) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char line[512];
+    fgets(line, sizeof(line), file);
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        std::vector<float> row;
+        char* cursor = line;
+        for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+            row.push_back(strtof(cursor, &cursor));
+            cursor += *cursor == ',';
+        }
+        rows.push_back(row);
+    }
+    fclose(file);
+    return true;
+}
+
+static std::vector<std::string> datasetFiles() {
+    std::vector<std::string> files;
+    DIR* root = opendir(IMU_CAPTURE_DATASET);
+    if (root == nullptr) {
+        return files;
+    }
+    while (dirent* label = readdir(root)) {
+        if (label->d_name[0] == '.') {
+            continue;
+        }
+        std::string folder = std::string(IMU_CAPTURE_DATASET) + "/" + label->d_name;
+        DIR* directory = opendir(folder.c_str());
+        while (directory != nullptr && (label = readdir(directory)) != nullptr) {
+            size_t length = strlen(label->d_name);
+            if (length > 4 && strcmp(label->d_name + length - 4, ".csv") == 0) {
+                files.push_back(folder + "/" + label->d_name);
+            }
+        }
+        if (directory != nullptr) {
+            closedir(directory);
+        }
+    }
+    closedir(root);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Every hand-collected CSV back to back as one 100 Hz stream, triggering as often as the rate
+// limit allows and sending each chunk as soon as it is ready, as the badge would
+void test_dataset_round_trip() {
+    std::vector<std::string> files = datasetFiles();
+    if (files.empty()) {
+        TEST_IGNORE_MESSAGE("no CSVs under " IMU_CAPTURE_DATASET);
+    }
+    std::vector<std::vector<float>> rows;
+    for (const std::string& file : files) {
+        TEST_ASSERT_TRUE(readCsv(file, rows));
+    }
+
+    Samples history;
+    history.reserve(rows.size());
+    size_t triggerIndex = 0;
+    size_t captures = 0;
+    size_t chunks = 0;
+    size_t bytes = 0;
+    size_t mismatches = 0;
+    double recordNs = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        capture->record(rows[i].data());
+        recordNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        history.push_back(std::vector<int16_t>(IMU_CAPTURE_CHANNELS));
+        for (uint8_t c = 0; c < IMU_CAPTURE_CHANNELS; c++) {
+            history.back()[c] = quantize(rows[i][c], c < 3 ? IMU_CAPTURE_ACCEL_SCALE : IMU_CAPTURE_GYRO_SCALE);
+        }
+
+        if (capture->trigger(CAPTURE_POSITIVE, 0, 0.95f, (uint32_t)(i * 10))) {
+            triggerIndex = i;
+        }
+        if (capture->ready()) {
+            std::vector<Chunk> sent;
+            Samples samples;
+            mismatches += !drainCapture(samples, &sent, &bytes) || !matchesHistory(samples, history, triggerIndex);
+            captures++;
+            chunks += sent.size();
+        }
+    }
+
+    char message[192];
+    snprintf(message, sizeof(message),
+             "%u files, %u samples: %u captures in %u chunks, %.2f B/sample (raw int16 %u B), record %.0f ns/sample",
+             (unsigned)files.size(), (unsigned)rows.size(), (unsigned)captures, (unsigned)chunks,
+             (double)bytes / (captures * IMU_CAPTURE_SAMPLES), (unsigned)(IMU_CAPTURE_CHANNELS * sizeof(int16_t)),
+             recordNs / rows.size());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, mismatches);
+    TEST_ASSERT_GREATER_THAN(0, captures);
+    TEST_ASSERT_LESS_THAN(IMU_CAPTURE_CHANNELS * sizeof(int16_t), (double)bytes / (captures * IMU_CAPTURE_SAMPLES));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_trigger_gating);
+    RUN_TEST(test_header_fields);
+    RUN_TEST(test_round_trip_at_full_scale);
+    RUN_TEST(test_dataset_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,191 @@
+#include <unity.h>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "JsonWriter.h"
+
+// Every heap allocation in the process, to check the writer makes none
+static size_t allocations = 0;
+// Keeps the timed loops from being optimized away
+static volatile size_t sink = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* pointer = malloc(size ? size : 1);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_fields_in_order() {
+    char buffer[128];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.field("event_id", "E_01")
+        .field("count", (uint32_t)42)
+        .field("is_available", true)
+        .field("off", false);
+    TEST_ASSERT_EQUAL_STRING("{\"event_id\": \"E_01\", \"count\": 42, \"is_available\": true, \"off\": false}", json.finish());
+    TEST_ASSERT_EQUAL(strlen(buffer), json.length());
+}
+
+void test_empty_object_and_null_string() {
+    char buffer[16];
+    JsonWriter empty(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("{}", empty.finish());
+
+    JsonWriter json(buffer, sizeof(buffer));
+    json.field("a", (const char*)nullptr);
+    TEST_ASSERT_EQUAL_STRING("{\"a\": \"\"}", json.finish());
+}
+
+void test_numbers() {
+    char buffer[64];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.field("zero", (uint32_t)0).field("max", (uint32_t)UINT32_MAX);
+    TEST_ASSERT_EQUAL_STRING("{\"zero\": 0, \"max\": 4294967295}", json.finish());
+}
+
+void test_escaping() {
+    char buffer[128];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.field("text", "a\"b\\c\nd\re\tf\x01g");
+    TEST_ASSERT_EQUAL_STRING("{\"text\": \"a\\\"b\\\\c\\nd\\re\\tf\\u0001g\"}", json.finish());
+}
+
+void test_arrays() {
+    char buffer[96];
+    const uint16_t buckets[] = {0, 3, 65535};
+    const uint32_t latency[] = {2, 4000000000u, 0};
+    JsonWriter json(buffer, sizeof(buffer));
+    json.field("rtt_ms", buckets, 3).field("latency", latency, 3).field("none", buckets, 0);
+    TEST_ASSERT_EQUAL_STRING("{\"rtt_ms\": [0,3,65535], \"latency\": [2,4000000000,0], \"none\": []}", json.finish());
+}
+
+// A document that does not fit is never returned truncated, at any capacity
+void test_overflow_at_every_capacity() {
+    char expected[64];
+    JsonWriter full(expected, sizeof(expected));
+    full.field("command", "resetNFC").field("status", "ok");
+    TEST_ASSERT_NOT_NULL(full.finish());
+    size_t needed = full.length() + 1;
+
+    for (size_t capacity = 1; capacity <= needed; capacity++) {
+        char buffer[64];
+        memset(buffer, 'x', sizeof(buffer));
+        JsonWriter json(buffer, capacity);
+        json.field("command", "resetNFC").field("status", "ok");
+        const char* result = json.finish();
+        if (capacity < needed) {
+            TEST_ASSERT_NULL(result);
+        } else {
+            TEST_ASSERT_EQUAL_STRING(expected, result);
+        }
+        // Nothing past the capacity was touched
+        TEST_ASSERT_EQUAL('x', buffer[capacity]);
+    }
+}
+
+void test_finish_is_idempotent() {
+    char buffer[32];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.field("a", (uint32_t)1);
+    json.finish();
+    TEST_ASSERT_EQUAL_STRING("{\"a\": 1}", json.finish());
+}
+
+void test_join_topic() {
+    char topic[32];
+    TEST_ASSERT_EQUAL_STRING("device/AA:BB/receipt", joinTopic(topic, sizeof(topic), {"device/", "AA:BB", "/receipt"}));
+    TEST_ASSERT_EQUAL_STRING("", joinTopic(topic, sizeof(topic), {}));
+
+    // The terminator needs a byte of its own
+    char exact[8];
+    TEST_ASSERT_EQUAL_STRING("1234567", joinTopic(exact, sizeof(exact), {"1234", "567"}));
+    TEST_ASSERT_NULL(joinTopic(exact, sizeof(exact), {"1234", "5678"}));
+}
+
+void test_no_allocations() {
+    char topic[128];
+    char payload[256];
+    size_t before = allocations;
+    for (int i = 0; i < 1000; i++) {
+        joinTopic(topic, sizeof(topic), {"device/", "AA:BB:CC:DD:EE:FF", "/", "receipt"});
+        JsonWriter json(payload, sizeof(payload));
+        json.field("command", "resetNFC").field("status", "ok");
+        TEST_ASSERT_NOT_NULL(json.finish());
+    }
+    TEST_ASSERT_EQUAL(0, allocations - before);
+}
+
+// A receipt built by concatenation, as publishReceipt did before the writer; std::string
+// stands in for Arduino String
+static size_t concatenatedReceipt(const std::string& clientId, const std::string& command, const std::string& status) {
+    std::string topic = "device/" + clientId + "/receipt";
+    std::string payload = "{\"command\": \"" + command + "\", \"status\": \"" + status + "\"}";
+    return topic.size() + payload.size();
+}
+
+void test_receipt_cost_against_concatenation() {
+    const int rounds = 200000;
+    // Long enough that the small string buffer cannot hold them
+    std::string clientId = "AA:BB:CC:DD:EE:FF-badge";
+    std::string command = "resetNFC";
+    std::string status = "ok";
+
+    size_t before = allocations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        sink = sink + concatenatedReceipt(clientId, command, status);
+    }
+    double concatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    double concatAllocations = (double)(allocations - before) / rounds;
+
+    char topic[128];
+    char payload[256];
+    before = allocations;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        joinTopic(topic, sizeof(topic), {"device/", clientId.c_str(), "/receipt"});
+        JsonWriter json(payload, sizeof(payload));
+        json.field("command", command.c_str()).field("status", status.c_str());
+        json.finish();
+        sink = sink + json.length();
+    }
+    double writerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    char message[160];
+    snprintf(message, sizeof(message), "per receipt: concatenation %.1f allocations %.0f ns, writer %u allocations %.0f ns",
+             concatAllocations, concatNs, (unsigned)(allocations - before), writerNs);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, allocations - before);
+    TEST_ASSERT_GREATER_THAN(0, concatAllocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fields_in_order);
+    RUN_TEST(test_empty_object_and_null_string);
+    RUN_TEST(test_numbers);
+    RUN_TEST(test_escaping);
+    RUN_TEST(test_arrays);
+    RUN_TEST(test_overflow_at_every_capacity);
+    RUN_TEST(test_finish_is_idempotent);
+    RUN_TEST(test_join_topic);
+    RUN_TEST(test_no_allocations);
+    RUN_TEST(test_receipt_cost_against_concatenation);
+    return UNITY_END();
+}
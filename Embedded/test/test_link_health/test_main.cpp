@@ -0,0 +1,291 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "ECE140_MQTT.h"
+#include "LinkHealth.h"
+
+// Keeps the timed loops from being optimized away
+static volatile size_t sink = 0;
+
+static LinkHealth* health = nullptr;
+static Mqtt5Stats stats;
+
+void setUp() {
+    health = new LinkHealth();
+    stats = Mqtt5Stats{};
+}
+
+void tearDown() {
+    delete health;
+}
+
+static void ping(uint32_t rttMs) {
+    stats.pings++;
+    stats.lastPingRttMs = rttMs;
+    health->sample(stats);
+}
+
+static uint32_t counterIn(const BadgeMessage& message, uint8_t id) {
+    for (uint8_t i = 0; i < message.count; i++) {
+        if (message.counters[i].id == id) {
+            return message.counters[i].value;
+        }
+    }
+    return 0;
+}
+
+// A value equal to a bound falls in that bound's bucket; the last bucket takes everything above
+void test_bucket_bounds() {
+    const uint32_t rtts[] = {0, 20, 21, 50, 2000, 2001, 60000};
+    const uint8_t buckets[] = {0, 0, 1, 1, 6, 7, 7};
+    for (size_t i = 0; i < sizeof(rtts) / sizeof(rtts[0]); i++) {
+        ping(rtts[i]);
+    }
+    uint16_t expected[LINK_BUCKETS] = {};
+    for (uint8_t bucket : buckets) {
+        expected[bucket]++;
+    }
+    for (uint8_t b = 0; b < LINK_BUCKETS; b++) {
+        TEST_ASSERT_EQUAL(expected[b], health->bucket(LINK_RTT, b));
+    }
+    TEST_ASSERT_EQUAL(60000, health->counter(LINK_RTT_MAX_MS));
+
+    health->connected(250);
+    health->connected(15001);
+    health->reconnected(300001);
+    TEST_ASSERT_EQUAL(1, health->bucket(LINK_CONNECT, 0));
+    TEST_ASSERT_EQUAL(1, health->bucket(LINK_CONNECT, 7));
+    TEST_ASSERT_EQUAL(1, health->bucket(LINK_OUTAGE, 7));
+    TEST_ASSERT_EQUAL(0, health->bucket(LINK_HISTOGRAM_COUNT, 0));
+}
+
+// sample() runs every loop pass but records each ping answer once
+void test_sample_records_each_ping_once() {
+    ping(30);
+    for (int i = 0; i < 100; i++) {
+        health->sample(stats);
+    }
+    TEST_ASSERT_EQUAL(1, health->bucket(LINK_RTT, 1));
+}
+
+void test_buckets_saturate() {
+    for (uint32_t i = 0; i < 70000; i++) {
+        health->connected(100);
+    }
+    TEST_ASSERT_EQUAL(UINT16_MAX, health->bucket(LINK_CONNECT, 0));
+}
+
+void test_loss_and_failure_causes() {
+    health->connectionLost(MQTT5_LOCAL_TRANSPORT_CLOSED, false);
+    health->connectionLost(MQTT5_LOCAL_KEEPALIVE_TIMEOUT, true);
+    health->connectionLost(MQTT5_LOCAL_TRANSPORT_CLOSED, true);
+    health->connectionLost(0x8E, true);
+    health->connectionLost(MQTT5_PROTOCOL_ERROR, true);
+    health->connectFailed(LINK_FAILURE_WIFI);
+    health->connectFailed(LINK_FAILURE_TLS);
+    health->connectFailed(LINK_FAILURE_TLS);
+    health->connectFailed(LINK_FAILURE_BROKER);
+    health->publishFailed();
+
+    TEST_ASSERT_EQUAL(1, health->counter(LINK_LOST_WIFI));
+    TEST_ASSERT_EQUAL(1, health->counter(LINK_LOST_KEEPALIVE));
+    TEST_ASSERT_EQUAL(1, health->counter(LINK_LOST_NETWORK));
+    TEST_ASSERT_EQUAL(2, health->counter(LINK_LOST_BROKER));
+    TEST_ASSERT_EQUAL(1, health->counter(LINK_FAILED_WIFI));
+    TEST_ASSERT_EQUAL(2, health->counter(LINK_FAILED_TLS));
+    TEST_ASSERT_EQUAL(1, health->counter(LINK_FAILED_BROKER));
+    TEST_ASSERT_EQUAL(1, health->counter(LINK_PUBLISH_FAILURES));
+}
+
+void test_command_latency() {
+    health->commandHandled(COMMAND_PROFILE_SWAP, 100);
+    health->commandHandled(COMMAND_PROFILE_SWAP, 300);
+    health->commandHandled(COMMAND_TYPE_COUNT, 300);
+    CommandLatency swaps = health->command(COMMAND_PROFILE_SWAP);
+    TEST_ASSERT_EQUAL(2, swaps.handled);
+    TEST_ASSERT_EQUAL(300, swaps.maxUs);
+    TEST_ASSERT_EQUAL(400, swaps.totalUs);
+    TEST_ASSERT_EQUAL(0, health->command(COMMAND_TYPE_COUNT).handled);
+}
+
+// Only what happened is reported, with byte counts relative to the start of the interval
+void test_json_report() {
+    stats.bytesIn = 5000;
+    stats.bytesOut = 7000;
+    health->reset(1000, stats);
+    ping(30);
+    health->connectionLost(MQTT5_LOCAL_KEEPALIVE_TIMEOUT, true);
+    health->commandHandled(COMMAND_ASSIGNMENT, 120);
+    health->commandHandled(COMMAND_ASSIGNMENT, 80);
+    stats.bytesIn = 5100;
+    stats.bytesOut = 7250;
+    stats.publishesRejected = 2;
+
+    char json[MQTT_HEALTH_PAYLOAD_SIZE];
+    size_t length = health->encodeJson(json, sizeof(json), 61000, stats);
+    TEST_ASSERT_EQUAL_STRING("{\"seconds\": 60, \"rtt_ms\": [0,1,0,0,0,0,0,0], \"rtt_max_ms\": 30, \"lost_keepalive\": 1, "
+                             "\"publish_rejected\": 2, \"bytes_in\": 100, \"bytes_out\": 250, \"command_assignment\": [2,120,100]}",
+                             json);
+    TEST_ASSERT_EQUAL(strlen(json), length);
+    TEST_ASSERT_EQUAL(0, health->encodeJson(json, length, 61000, stats));
+}
+
+void test_binary_report_round_trip() {
+    health->reset(0, stats);
+    ping(700);
+    health->connected(3000);
+    health->connectFailed(LINK_FAILURE_TLS);
+    health->commandHandled(COMMAND_REBOOT, 50);
+    stats.bytesOut = 42;
+
+    uint8_t buffer[MQTT_HEALTH_PAYLOAD_SIZE];
+    size_t length = health->encodeBinary(buffer, sizeof(buffer), 30500, stats);
+    BadgeMessage message;
+    TEST_ASSERT_TRUE(decodeBadgeMessage(buffer, length, message));
+    TEST_ASSERT_EQUAL(BADGE_MSG_LINK_HEALTH, message.type);
+    TEST_ASSERT_EQUAL(30, counterIn(message, LINK_SECONDS));
+    TEST_ASSERT_EQUAL(700, counterIn(message, LINK_RTT_MAX_MS));
+    TEST_ASSERT_EQUAL(1, counterIn(message, LINK_FAILED_TLS));
+    TEST_ASSERT_EQUAL(42, counterIn(message, LINK_BYTES_OUT));
+    uint8_t reboot = LINK_COMMAND_COUNTERS + COMMAND_REBOOT * LINK_COMMAND_FIELD_COUNT;
+    TEST_ASSERT_EQUAL(1, counterIn(message, reboot + LINK_COMMAND_HANDLED));
+    TEST_ASSERT_EQUAL(50, counterIn(message, reboot + LINK_COMMAND_MEAN_US));
+    // Seconds, rtt max, failed tls, bytes out and the three reboot fields; zero counters are left out
+    TEST_ASSERT_EQUAL(7, message.count);
+
+    TEST_ASSERT_EQUAL(2, message.histogramCount);
+    TEST_ASSERT_EQUAL(LINK_RTT, message.histograms[0].id);
+    TEST_ASSERT_EQUAL(1, message.histograms[0].counts[5]);
+    TEST_ASSERT_EQUAL(LINK_CONNECT, message.histograms[1].id);
+    TEST_ASSERT_EQUAL(1, message.histograms[1].counts[4]);
+}
+
+void test_reset_starts_a_new_interval() {
+    ping(30);
+    health->connectFailed(LINK_FAILURE_WIFI);
+    health->commandHandled(COMMAND_RESET_NFC, 10);
+    stats.bytesIn = 900;
+    health->reset(5000, stats);
+    // The ping answered before the reset is not counted again
+    health->sample(stats);
+
+    TEST_ASSERT_EQUAL(0, health->bucket(LINK_RTT, 1));
+    TEST_ASSERT_EQUAL(0, health->counter(LINK_FAILED_WIFI));
+    TEST_ASSERT_EQUAL(0, health->command(COMMAND_RESET_NFC).handled);
+    char json[64];
+    health->encodeJson(json, sizeof(json), 5000, stats);
+    TEST_ASSERT_EQUAL_STRING("{\"seconds\": 0}", json);
+}
+
+// Every counter, bucket and command type at its maximum still fits the firmware's report buffer
+void test_worst_case_fits() {
+    for (uint8_t b = 0; b < LINK_BUCKETS; b++) {
+        for (uint32_t i = 0; i < 70000; i++) {
+            ping(b == 0 ? 0 : b == LINK_BUCKETS - 1 ? UINT32_MAX : LINK_RTT_BOUNDS_MS[b - 1] + 1);
+            health->connected(b == 0 ? 0 : b == LINK_BUCKETS - 1 ? UINT32_MAX : LINK_CONNECT_BOUNDS_MS[b - 1] + 1);
+            health->reconnected(b == 0 ? 0 : b == LINK_BUCKETS - 1 ? UINT32_MAX : LINK_OUTAGE_BOUNDS_MS[b - 1] + 1);
+        }
+    }
+    // Every counter present; the binary report is fixed width from here on
+    const uint8_t reasons[] = {MQTT5_LOCAL_KEEPALIVE_TIMEOUT, MQTT5_LOCAL_TRANSPORT_CLOSED, MQTT5_PROTOCOL_ERROR};
+    for (uint8_t reason : reasons) {
+        health->connectionLost(reason, true);
+    }
+    health->connectionLost(MQTT5_LOCAL_TRANSPORT_CLOSED, false);
+    health->connectFailed(LINK_FAILURE_WIFI);
+    health->connectFailed(LINK_FAILURE_TLS);
+    health->connectFailed(LINK_FAILURE_BROKER);
+    health->publishFailed();
+    for (uint8_t type = 0; type < COMMAND_TYPE_COUNT; type++) {
+        health->commandHandled((CommandType)type, UINT32_MAX);
+    }
+    stats.bytesIn = UINT32_MAX;
+    stats.bytesOut = UINT32_MAX;
+    stats.publishesRejected = UINT32_MAX;
+
+    char json[MQTT_HEALTH_PAYLOAD_SIZE];
+    uint8_t binary[MQTT_HEALTH_PAYLOAD_SIZE];
+    size_t jsonLength = health->encodeJson(json, sizeof(json), UINT32_MAX, stats);
+    size_t binaryLength = health->encodeBinary(binary, sizeof(binary), UINT32_MAX, stats);
+    TEST_ASSERT_NOT_EQUAL(0, jsonLength);
+    TEST_ASSERT_NOT_EQUAL(0, binaryLength);
+
+    // Buckets are saturated and seconds is already at its widest; counting the other counters to
+    // 2^32 - 1 would take billions of calls, so widen each to 10 digits instead
+    const char* numbers = strchr(json, ',');
+    size_t widest = jsonLength;
+    for (const char* p = numbers; *p;) {
+        size_t digits = strspn(p, "0123456789");
+        if (digits == 0) {
+            p++;
+            continue;
+        }
+        if (digits != 5 || strncmp(p, "65535", 5) != 0) {
+            widest += 10 - digits;
+        }
+        p += digits;
+    }
+    char message[128];
+    snprintf(message, sizeof(message), "worst-case report: JSON %u B, binary %u B, buffer %u B", (unsigned)widest,
+             (unsigned)binaryLength, (unsigned)MQTT_HEALTH_PAYLOAD_SIZE);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(MQTT_HEALTH_PAYLOAD_SIZE, widest);
+}
+
+void test_cost() {
+    const int rounds = 1000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        health->sample(stats);
+    }
+    double sampleNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        ping(i % 3000);
+    }
+    double pingNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    health->connected(900);
+    health->connectionLost(MQTT5_LOCAL_TRANSPORT_CLOSED, true);
+    health->commandHandled(COMMAND_PROFILE_SWAP, 140);
+    stats.bytesIn = 1200;
+    stats.bytesOut = 3400;
+    char json[MQTT_HEALTH_PAYLOAD_SIZE];
+    uint8_t binary[MQTT_HEALTH_PAYLOAD_SIZE];
+    const int reports = 100000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reports; i++) {
+        sink = sink + health->encodeBinary(binary, sizeof(binary), 60000, stats);
+    }
+    double binaryNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / reports;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reports; i++) {
+        sink = sink + health->encodeJson(json, sizeof(json), 60000, stats);
+    }
+    double jsonNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / reports;
+
+    char message[192];
+    snprintf(message, sizeof(message),
+             "sample() %.1f ns idle, %.1f ns with a new ping; typical report %u B binary in %.0f ns, %u B JSON in %.0f ns; state %u B",
+             sampleNs, pingNs, (unsigned)health->encodeBinary(binary, sizeof(binary), 60000, stats), binaryNs,
+             (unsigned)health->encodeJson(json, sizeof(json), 60000, stats), jsonNs, (unsigned)sizeof(LinkHealth));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(jsonNs, binaryNs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_bounds);
+    RUN_TEST(test_sample_records_each_ping_once);
+    RUN_TEST(test_buckets_saturate);
+    RUN_TEST(test_loss_and_failure_causes);
+    RUN_TEST(test_command_latency);
+    RUN_TEST(test_json_report);
+    RUN_TEST(test_binary_report_round_trip);
+    RUN_TEST(test_reset_starts_a_new_interval);
+    RUN_TEST(test_worst_case_fits);
+    RUN_TEST(test_cost);
+    return UNITY_END();
+}
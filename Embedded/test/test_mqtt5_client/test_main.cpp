@@ -0,0 +1,427 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "Mqtt5Client.h"
+
+// The broker side, scripted by the test: bytes queued for the client, and everything it wrote
+class ScriptedTransport : public MqttTransport {
+public:
+    std::string toClient;
+    std::string fromClient;
+    bool open = true;
+
+    int read(uint8_t* buffer, size_t length) override {
+        if (!open) {
+            return -1;
+        }
+        size_t count = toClient.size() < length ? toClient.size() : length;
+        memcpy(buffer, toClient.data(), count);
+        toClient.erase(0, count);
+        return (int)count;
+    }
+
+    int write(const uint8_t* data, size_t length) override {
+        if (!open) {
+            return -1;
+        }
+        fromClient.append((const char*)data, length);
+        return (int)length;
+    }
+
+    void close() override {
+        open = false;
+    }
+};
+
+struct Packet {
+    uint8_t type;
+    uint8_t flags;
+    std::string body;
+};
+
+struct Received {
+    std::string topic;
+    std::string payload;
+};
+
+static ScriptedTransport* transport = nullptr;
+static Mqtt5Client* client = nullptr;
+static std::vector<Received> received;
+static uint32_t nowMs = 0;
+
+static void onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    received.push_back(Received{topic, std::string((const char*)payload, length)});
+}
+
+void setUp() {
+    transport = new ScriptedTransport();
+    client = new Mqtt5Client();
+    client->setTransport(transport);
+    client->setCallback(onMessage);
+    received.clear();
+    nowMs = 1000;
+}
+
+void tearDown() {
+    delete client;
+    delete transport;
+}
+
+static std::string varint(uint32_t value) {
+    std::string out;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out += (char)(value ? byte | 0x80 : byte);
+    } while (value);
+    return out;
+}
+
+static std::string u16(uint16_t value) {
+    return std::string() + (char)(value >> 8) + (char)value;
+}
+
+static std::string packet(uint8_t header, const std::string& body) {
+    return std::string(1, (char)header) + varint(body.size()) + body;
+}
+
+static std::string connack(bool sessionPresent, const std::string& properties = "", uint8_t reason = 0) {
+    return packet(0x20, std::string(1, (char)sessionPresent) + (char)reason + varint(properties.size()) + properties);
+}
+
+static std::string property16(uint8_t id, uint16_t value) {
+    return std::string(1, (char)id) + u16(value);
+}
+
+static std::string puback(uint16_t packetId, uint8_t reason) {
+    return packet(0x40, u16(packetId) + (char)reason + varint(0));
+}
+
+static std::string publishPacket(const std::string& topic, const std::string& payload, uint8_t qos, uint16_t packetId, uint16_t alias) {
+    std::string properties = alias ? property16(0x23, alias) : "";
+    return packet(0x30 | qos << 1, u16(topic.size()) + topic + (qos ? u16(packetId) : "") + varint(properties.size()) + properties + payload);
+}
+
+// Split what the client wrote into packets and forget it
+static std::vector<Packet> sent() {
+    std::vector<Packet> packets;
+    const std::string& bytes = transport->fromClient;
+    size_t offset = 0;
+    while (offset < bytes.size()) {
+        uint32_t remaining = 0;
+        size_t used = 0;
+        uint8_t byte;
+        do {
+            byte = bytes[offset + 1 + used];
+            remaining |= (uint32_t)(byte & 0x7F) << (7 * used);
+            used++;
+        } while (byte & 0x80);
+        uint8_t header = bytes[offset];
+        packets.push_back(Packet{(uint8_t)(header >> 4), (uint8_t)(header & 0x0F), bytes.substr(offset + 1 + used, remaining)});
+        offset += 1 + used + remaining;
+    }
+    transport->fromClient.clear();
+    return packets;
+}
+
+static uint16_t getU16(const std::string& bytes, size_t offset) {
+    return (uint16_t)((uint8_t)bytes[offset] << 8 | (uint8_t)bytes[offset + 1]);
+}
+
+// A PUBLISH from the client: topic as sent, packet id, alias property, payload
+struct Publish {
+    std::string topic;
+    uint16_t packetId;
+    uint16_t alias;
+    bool dup;
+    std::string payload;
+};
+
+static Publish parsePublish(const Packet& packet) {
+    Publish out = {};
+    uint16_t topicLength = getU16(packet.body, 0);
+    out.topic = packet.body.substr(2, topicLength);
+    size_t offset = 2 + topicLength;
+    if (packet.flags & 0x06) {
+        out.packetId = getU16(packet.body, offset);
+        offset += 2;
+    }
+    uint8_t propertiesLength = packet.body[offset++];
+    if (propertiesLength == 3 && packet.body[offset] == 0x23) {
+        out.alias = getU16(packet.body, offset + 1);
+    }
+    offset += propertiesLength;
+    out.dup = packet.flags & 0x08;
+    out.payload = packet.body.substr(offset);
+    return out;
+}
+
+static bool publish(const char* topic, const char* payload, uint8_t qos) {
+    return client->publish(topic, (const uint8_t*)payload, strlen(payload), qos);
+}
+
+static void connect(bool cleanStart, const std::string& connackPacket) {
+    Mqtt5ConnectOptions options = {"badge", "user", "secret", 30, 3600, cleanStart};
+    TEST_ASSERT_TRUE(client->begin(options, nowMs));
+    transport->toClient += connackPacket;
+    client->poll(nowMs);
+}
+
+void test_connect_packet_and_session_present() {
+    connect(false, connack(true));
+    std::vector<Packet> packets = sent();
+    TEST_ASSERT_EQUAL(1, packets.size());
+    TEST_ASSERT_EQUAL(1, packets[0].type);
+    const std::string& body = packets[0].body;
+    TEST_ASSERT_EQUAL_STRING_LEN("\0\4MQTT\5", body.data(), 7);
+    // Username and password, no clean start
+    TEST_ASSERT_EQUAL_HEX8(0xC0, body[7]);
+    TEST_ASSERT_EQUAL(30, getU16(body, 8));
+    // Session expiry, Receive Maximum, Maximum Packet Size, Topic Alias Maximum
+    std::string properties = body.substr(11, (uint8_t)body[10]);
+    std::string expected = std::string("\x11\0\0\x0e\x10", 5) + property16(0x21, MQTT5_RECEIVE_MAXIMUM) +
+                           std::string("\x27\0\0", 3) + u16(MQTT5_RX_BUFFER) + property16(0x22, MQTT5_INBOUND_ALIASES);
+    TEST_ASSERT_TRUE(expected == properties);
+
+    TEST_ASSERT_TRUE(client->connected());
+    TEST_ASSERT_TRUE(client->sessionPresent());
+}
+
+void test_connack_failure_and_timeout() {
+    connect(true, connack(false, "", 0x87));
+    TEST_ASSERT_EQUAL(MQTT5_DISCONNECTED, client->state());
+    TEST_ASSERT_EQUAL_HEX8(0x87, client->reason());
+
+    Mqtt5ConnectOptions options = {"badge", nullptr, nullptr, 30, 0, true};
+    transport->open = true;
+    client->begin(options, nowMs);
+    TEST_ASSERT_TRUE(client->poll(nowMs + MQTT5_CONNACK_TIMEOUT_MS));
+    TEST_ASSERT_FALSE(client->poll(nowMs + MQTT5_CONNACK_TIMEOUT_MS + 1));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_LOCAL_CONNECT_TIMEOUT, client->reason());
+}
+
+// The first publish to a topic carries it with an alias, later ones only the alias, and no more
+// aliases than the broker allows are claimed
+void test_outbound_topic_aliases() {
+    connect(true, connack(false, property16(0x22, 2)));
+    sent();
+    const char* topics[] = {"device/AA/receipt", "device/AA/receipt", "event/E_01/profile_swap", "device/AA/health",
+                            "device/AA/health", "device/AA/receipt"};
+    for (const char* topic : topics) {
+        TEST_ASSERT_TRUE(publish(topic, "x", 0));
+    }
+    client->poll(nowMs);
+    std::vector<Packet> packets = sent();
+    TEST_ASSERT_EQUAL(6, packets.size());
+    Publish first = parsePublish(packets[0]);
+    Publish second = parsePublish(packets[1]);
+    Publish third = parsePublish(packets[2]);
+    Publish fourth = parsePublish(packets[3]);
+    Publish sixth = parsePublish(packets[5]);
+    TEST_ASSERT_EQUAL_STRING("device/AA/receipt", first.topic.c_str());
+    TEST_ASSERT_EQUAL(1, first.alias);
+    TEST_ASSERT_EQUAL_STRING("", second.topic.c_str());
+    TEST_ASSERT_EQUAL(1, second.alias);
+    TEST_ASSERT_EQUAL(2, third.alias);
+    // Past the broker's Topic Alias Maximum the topic goes out in full every time
+    TEST_ASSERT_EQUAL_STRING("device/AA/health", fourth.topic.c_str());
+    TEST_ASSERT_EQUAL(0, fourth.alias);
+    Publish fifth = parsePublish(packets[4]);
+    TEST_ASSERT_EQUAL_STRING("device/AA/health", fifth.topic.c_str());
+    TEST_ASSERT_EQUAL(1, sixth.alias);
+
+    Mqtt5Stats stats = client->stats();
+    TEST_ASSERT_EQUAL(2, stats.aliasedPublishes);
+    TEST_ASSERT_EQUAL(2 * (strlen("device/AA/receipt") - 3), stats.aliasBytesSaved);
+}
+
+void test_no_aliases_unless_offered() {
+    connect(true, connack(false));
+    sent();
+    publish("device/AA/receipt", "x", 0);
+    publish("device/AA/receipt", "x", 0);
+    client->poll(nowMs);
+    std::vector<Packet> packets = sent();
+    Publish second = parsePublish(packets[1]);
+    TEST_ASSERT_EQUAL(0, second.alias);
+    TEST_ASSERT_EQUAL_STRING("device/AA/receipt", second.topic.c_str());
+}
+
+// Our QoS 1 publishes stay within the broker's Receive Maximum; a PUBACK with a failure reason
+// frees the slot and is counted
+void test_receive_maximum_and_rejected_pubacks() {
+    connect(true, connack(false, property16(0x21, 2)));
+    sent();
+    TEST_ASSERT_TRUE(publish("device/AA/receipt", "1", 1));
+    TEST_ASSERT_TRUE(publish("device/AA/receipt", "2", 1));
+    TEST_ASSERT_FALSE(client->canPublish(1, 1));
+    TEST_ASSERT_FALSE(publish("device/AA/receipt", "3", 1));
+    TEST_ASSERT_TRUE(client->canPublish(1, 0));
+    TEST_ASSERT_EQUAL(2, client->inflight());
+    client->poll(nowMs);
+    std::vector<Packet> packets = sent();
+    TEST_ASSERT_EQUAL(2, packets.size());
+    uint16_t firstId = parsePublish(packets[0]).packetId;
+    uint16_t secondId = parsePublish(packets[1]).packetId;
+    TEST_ASSERT_NOT_EQUAL(firstId, secondId);
+
+    // 0x10 "no matching subscribers" is a success; 0x87 "not authorized" is not
+    transport->toClient += puback(firstId, 0x10) + puback(secondId, 0x87);
+    client->poll(nowMs);
+    TEST_ASSERT_EQUAL(0, client->inflight());
+    TEST_ASSERT_EQUAL(1, client->stats().publishesRejected);
+    TEST_ASSERT_TRUE(publish("device/AA/receipt", "3", 1));
+}
+
+// Unacknowledged QoS 1 publishes survive the connection. A resumed session gets them again with
+// DUP set and their original packet ids; a fresh session gets them as new messages
+void test_resend_after_reconnect() {
+    connect(false, connack(false, property16(0x22, 4)));
+    sent();
+    publish("event/E_01/profile_swap", "claim-1", 1);
+    publish("event/E_01/profile_swap", "claim-2", 1);
+    client->poll(nowMs);
+    std::vector<Packet> before = sent();
+    TEST_ASSERT_EQUAL(2, before.size());
+
+    transport->open = false;
+    TEST_ASSERT_FALSE(client->poll(nowMs));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_LOCAL_TRANSPORT_CLOSED, client->reason());
+    TEST_ASSERT_EQUAL(2, client->inflight());
+
+    transport->open = true;
+    transport->fromClient.clear();
+    connect(false, connack(true, property16(0x22, 4)));
+    client->poll(nowMs);
+    std::vector<Packet> after = sent();
+    TEST_ASSERT_EQUAL(3, after.size());
+    for (int i = 0; i < 2; i++) {
+        Publish original = parsePublish(before[i]);
+        Publish resent = parsePublish(after[i + 1]);
+        TEST_ASSERT_TRUE(resent.dup);
+        TEST_ASSERT_EQUAL(original.packetId, resent.packetId);
+        TEST_ASSERT_EQUAL_STRING(original.payload.c_str(), resent.payload.c_str());
+    }
+    // Aliases do not outlive the connection, so the first resend names the topic again
+    Publish firstResent = parsePublish(after[1]);
+    TEST_ASSERT_EQUAL_STRING("event/E_01/profile_swap", firstResent.topic.c_str());
+    TEST_ASSERT_EQUAL(2, client->stats().resent);
+
+    transport->open = false;
+    client->poll(nowMs);
+    transport->open = true;
+    transport->fromClient.clear();
+    connect(false, connack(false));
+    client->poll(nowMs);
+    after = sent();
+    TEST_ASSERT_EQUAL(3, after.size());
+    TEST_ASSERT_FALSE(parsePublish(after[1]).dup);
+}
+
+void test_inbound_aliases_and_acknowledgement() {
+    connect(true, connack(false));
+    sent();
+    transport->toClient += publishPacket("device/AA/assignment", "T_0001", 1, 7, 1);
+    transport->toClient += publishPacket("", "T_0002", 0, 0, 1);
+    client->poll(nowMs);
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("device/AA/assignment", received[1].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("T_0002", received[1].payload.c_str());
+
+    std::vector<Packet> packets = sent();
+    TEST_ASSERT_EQUAL(1, packets.size());
+    TEST_ASSERT_EQUAL(4, packets[0].type);
+    TEST_ASSERT_EQUAL(7, getU16(packets[0].body, 0));
+
+    // An alias we never learned drops the connection
+    transport->toClient += publishPacket("", "x", 0, 0, 2);
+    TEST_ASSERT_FALSE(client->poll(nowMs));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_TOPIC_ALIAS_INVALID, client->reason());
+}
+
+void test_inbound_alias_above_our_maximum() {
+    connect(true, connack(false));
+    transport->toClient += publishPacket("device/AA/reboot", "", 0, 0, MQTT5_INBOUND_ALIASES + 1);
+    TEST_ASSERT_FALSE(client->poll(nowMs));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_TOPIC_ALIAS_INVALID, client->reason());
+    TEST_ASSERT_EQUAL(0, received.size());
+}
+
+void test_subscribe_options_and_failures() {
+    connect(true, connack(false));
+    sent();
+    TEST_ASSERT_TRUE(client->subscribe("device/AA/#", 1));
+    client->poll(nowMs);
+    std::vector<Packet> packets = sent();
+    TEST_ASSERT_EQUAL(8, packets[0].type);
+    TEST_ASSERT_EQUAL(2, packets[0].flags);
+    // QoS 1 with No Local
+    TEST_ASSERT_EQUAL_HEX8(0x05, packets[0].body.back());
+
+    transport->toClient += packet(0x90, u16(1) + varint(0) + (char)0x01 + (char)0x87);
+    client->poll(nowMs);
+    TEST_ASSERT_EQUAL(1, client->stats().subscribeAcks);
+    TEST_ASSERT_EQUAL(1, client->stats().subscribeFailures);
+}
+
+void test_keepalive_ping_and_timeout() {
+    connect(true, connack(false, property16(0x13, 5)));
+    sent();
+    TEST_ASSERT_EQUAL(5, client->keepAlive());
+    client->poll(nowMs + 4999);
+    TEST_ASSERT_EQUAL(0, sent().size());
+    client->poll(nowMs + 5000);
+    std::vector<Packet> packets = sent();
+    TEST_ASSERT_EQUAL(1, packets.size());
+    TEST_ASSERT_EQUAL(12, packets[0].type);
+
+    transport->toClient += packet(0xD0, "");
+    client->poll(nowMs + 5040);
+    TEST_ASSERT_EQUAL(1, client->stats().pings);
+    TEST_ASSERT_EQUAL(40, client->stats().lastPingRttMs);
+
+    // Unanswered for a whole keepalive period: the link is dead
+    TEST_ASSERT_TRUE(client->ping(nowMs + 6000));
+    TEST_ASSERT_TRUE(client->poll(nowMs + 11000));
+    TEST_ASSERT_FALSE(client->poll(nowMs + 11001));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_LOCAL_KEEPALIVE_TIMEOUT, client->reason());
+}
+
+void test_malformed_and_oversized_input() {
+    connect(true, connack(false));
+    transport->toClient += std::string("\x30\xff\xff\xff\xff\x01", 6);
+    TEST_ASSERT_FALSE(client->poll(nowMs));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_MALFORMED_PACKET, client->reason());
+
+    transport->open = true;
+    transport->toClient.clear();
+    connect(true, connack(false));
+    transport->toClient += std::string("\x30", 1) + varint(MQTT5_RX_BUFFER);
+    TEST_ASSERT_FALSE(client->poll(nowMs));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_PACKET_TOO_LARGE, client->reason());
+
+    // Nothing but CONNACK is allowed while connecting
+    transport->open = true;
+    transport->toClient.clear();
+    Mqtt5ConnectOptions options = {"badge", nullptr, nullptr, 30, 0, true};
+    client->begin(options, nowMs);
+    transport->toClient += packet(0xD0, "");
+    TEST_ASSERT_FALSE(client->poll(nowMs));
+    TEST_ASSERT_EQUAL_HEX8(MQTT5_PROTOCOL_ERROR, client->reason());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_connect_packet_and_session_present);
+    RUN_TEST(test_connack_failure_and_timeout);
+    RUN_TEST(test_outbound_topic_aliases);
+    RUN_TEST(test_no_aliases_unless_offered);
+    RUN_TEST(test_receive_maximum_and_rejected_pubacks);
+    RUN_TEST(test_resend_after_reconnect);
+    RUN_TEST(test_inbound_aliases_and_acknowledgement);
+    RUN_TEST(test_inbound_alias_above_our_maximum);
+    RUN_TEST(test_subscribe_options_and_failures);
+    RUN_TEST(test_keepalive_ping_and_timeout);
+    RUN_TEST(test_malformed_and_oversized_input);
+    return UNITY_END();
+}
@@ -0,0 +1,306 @@
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include "BadgeAdvertisement.h"
+#include "PeerTable.h"
+
+static const int8_t TX_POWER = -59;
+
+void setUp() {}
+void tearDown() {}
+
+void test_statistics_per_peer() {
+    PeerTable table;
+    int8_t samples[] = {-70, -60, -80, -65, -75, -50};
+    for (size_t i = 0; i < sizeof(samples); i++) {
+        TEST_ASSERT_TRUE(table.record(100001, samples[i], TX_POWER, 1000 + i * 30));
+    }
+    const PeerStats* peer = table.find(100001);
+    TEST_ASSERT_NOT_NULL(peer);
+    TEST_ASSERT_EQUAL(6, peer->count);
+    TEST_ASSERT_EQUAL(-50, peer->maxRssi);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, -400.0f / 6, peer->mean());
+    // The last five readings are -60 -80 -65 -75 -50
+    TEST_ASSERT_EQUAL(-65, peer->median());
+    TEST_ASSERT_EQUAL(1150, peer->lastSeen);
+    TEST_ASSERT_NULL(table.find(100002));
+    TEST_ASSERT_FALSE(table.record(0, -60, TX_POWER, 0));
+}
+
+void test_median_of_fewer_than_five() {
+    PeerTable table;
+    table.record(7, -70, TX_POWER, 0);
+    TEST_ASSERT_EQUAL(-70, table.find(7)->median());
+    table.record(7, -60, TX_POWER, 0);
+    table.record(7, -90, TX_POWER, 0);
+    TEST_ASSERT_EQUAL(-70, table.find(7)->median());
+}
+
+// Tickets that share a home slot must stay reachable after others in their probe run are removed
+void test_probe_runs_survive_expiry() {
+    PeerTable table;
+    for (uint32_t ticket = 1; ticket <= 20; ticket++) {
+        table.record(ticket, -60, TX_POWER, ticket % 2 ? 100 : 5000);
+    }
+    TEST_ASSERT_EQUAL(20, table.size());
+    TEST_ASSERT_EQUAL(10, table.expire(5000, 1000));
+    TEST_ASSERT_EQUAL(10, table.size());
+    for (uint32_t ticket = 1; ticket <= 20; ticket++) {
+        TEST_ASSERT_EQUAL(ticket % 2 == 0, table.find(ticket) != nullptr);
+    }
+    table.clear();
+    TEST_ASSERT_EQUAL(0, table.size());
+}
+
+// One partner at arm's length and five bystanders around it, advertising every 30 ms plus
+// advDelay, with per-packet fading, a fixed orientation offset per peer and packet loss
+struct TraceConfig {
+    float fadingDb = 6.0f;
+    float orientationDb = 3.0f;
+    float loss = 0.3f;
+};
+
+enum TracePick {
+    PICK_FIRST_SEEN,    // before user-029: the strongest first packet
+    PICK_MEDIAN,        // user-029: the strongest median of the last five
+    PICK_KALMAN,        // user-036: the lowest filtered path loss, PeerTable::best()
+    PICK_COUNT
+};
+
+static const size_t TRACE_PEERS = 6;
+
+static void runTrace(std::mt19937& rng, uint32_t windowMs, const TraceConfig& config, bool correct[PICK_COUNT]) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> fading(0.0f, config.fadingDb);
+
+    float meanRssi[TRACE_PEERS];
+    for (size_t peer = 0; peer < TRACE_PEERS; peer++) {
+        float distance = peer == 0 ? 0.3f + 0.5f * unit(rng) : 1.0f + 3.0f * unit(rng);
+        float orientation = (2.0f * unit(rng) - 1.0f) * config.orientationDb;
+        meanRssi[peer] = TX_POWER - 20.0f * log10f(distance) + orientation;
+    }
+
+    PeerTable table;
+    int8_t firstSeen[TRACE_PEERS];
+    bool seen[TRACE_PEERS] = {false};
+    float nextMs[TRACE_PEERS];
+    for (size_t peer = 0; peer < TRACE_PEERS; peer++) {
+        nextMs[peer] = unit(rng) * 30.0f;
+    }
+
+    for (uint32_t now = 0; now < windowMs; now++) {
+        for (size_t peer = 0; peer < TRACE_PEERS; peer++) {
+            if (now < nextMs[peer]) {
+                continue;
+            }
+            nextMs[peer] += 30.0f + 10.0f * unit(rng);
+            if (unit(rng) < config.loss) {
+                continue;
+            }
+            float rssi = meanRssi[peer] + fading(rng);
+            int8_t sample = (int8_t)fmaxf(-127.0f, fminf(0.0f, roundf(rssi)));
+            table.record(1 + peer, sample, TX_POWER, now);
+            if (!seen[peer]) {
+                seen[peer] = true;
+                firstSeen[peer] = sample;
+            }
+        }
+    }
+
+    int firstPick = -1;
+    int medianPick = -1;
+    for (size_t peer = 0; peer < TRACE_PEERS; peer++) {
+        const PeerStats* stats = table.find(1 + peer);
+        if (seen[peer] && (firstPick < 0 || firstSeen[peer] > firstSeen[firstPick])) {
+            firstPick = peer;
+        }
+        if (stats != nullptr && stats->count >= 2 &&
+            (medianPick < 0 || stats->median() > table.find(1 + medianPick)->median())) {
+            medianPick = peer;
+        }
+    }
+    const PeerStats* closest = table.best(2);
+    correct[PICK_FIRST_SEEN] = firstPick == 0;
+    correct[PICK_MEDIAN] = medianPick == 0;
+    correct[PICK_KALMAN] = closest != nullptr && closest->ticketId == 1;
+}
+
+static void traceRates(uint32_t windowMs, float rates[PICK_COUNT]) {
+    const int trials = 4000;
+    std::mt19937 rng(29 + windowMs);
+    TraceConfig config;
+    int hits[PICK_COUNT] = {0};
+    for (int trial = 0; trial < trials; trial++) {
+        bool correct[PICK_COUNT];
+        runTrace(rng, windowMs, config, correct);
+        for (int pick = 0; pick < PICK_COUNT; pick++) {
+            hits[pick] += correct[pick];
+        }
+    }
+    for (int pick = 0; pick < PICK_COUNT; pick++) {
+        rates[pick] = (float)hits[pick] / trials;
+    }
+}
+
+// Why COLLECTION_TIME could drop to 500 ms: the median over a short window beats the first
+// packet heard over twice as long
+void test_median_at_500ms_beats_first_seen_at_1000ms() {
+    float at500[PICK_COUNT];
+    float at1000[PICK_COUNT];
+    traceRates(500, at500);
+    traceRates(1000, at1000);
+
+    char message[128];
+    snprintf(message, sizeof(message), "first-seen 1000 ms %.2f, median 500 ms %.2f", at1000[PICK_FIRST_SEEN], at500[PICK_MEDIAN]);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0.85f, at500[PICK_MEDIAN]);
+    TEST_ASSERT_GREATER_OR_EQUAL(at1000[PICK_FIRST_SEEN] + 0.10f, at500[PICK_MEDIAN]);
+}
+
+void test_kalman_converges_and_tracks() {
+    PeerTable table;
+    table.record(1, -70, TX_POWER, 0);
+    const PeerStats* peer = table.find(1);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, -70.0f, peer->filteredRssi);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, PeerStats::MEASUREMENT_NOISE, peer->variance);
+
+    // The second sample weighs about as much as the first
+    table.record(1, -50, TX_POWER, 30);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, -60.0f, peer->filteredRssi);
+
+    // Steady input converges and the variance settles well below the measurement noise
+    for (uint32_t i = 0; i < 200; i++) {
+        table.record(1, -60, TX_POWER, 60 + i * 30);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, -60.0f, peer->filteredRssi);
+    TEST_ASSERT_LESS_THAN(PeerStats::MEASUREMENT_NOISE / 4, peer->variance);
+    TEST_ASSERT_GREATER_THAN(0.0f, peer->variance);
+
+    // Then a 20 dB fade moves the estimate by a fraction of it
+    table.record(1, -80, TX_POWER, 7000);
+    TEST_ASSERT_LESS_THAN(-60.0f, peer->filteredRssi);
+    TEST_ASSERT_GREATER_THAN(-64.0f, peer->filteredRssi);
+}
+
+void test_path_loss_and_distance() {
+    PeerTable table;
+    table.record(1, -59, -59, 0);
+    table.record(2, -79, -59, 0);
+    table.record(3, -79, -65, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, table.find(1)->pathLoss());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, table.find(1)->distance(2.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, table.find(2)->distance(2.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 3.16f, table.find(2)->distance(4.0f));
+    // A peer advertising a weaker TX power is closer than its RSSI alone says
+    TEST_ASSERT_LESS_THAN(table.find(2)->pathLoss(), table.find(3)->pathLoss());
+}
+
+void test_best_lead_and_within() {
+    PeerTable table;
+    table.record(1, -62, TX_POWER, 1000);     // path loss 3 dB
+    table.record(1, -62, TX_POWER, 1030);
+    table.record(2, -70, TX_POWER, 1000);     // 11 dB
+    table.record(2, -70, TX_POWER, 1030);
+    table.record(3, -50, TX_POWER, 1000);     // -9 dB: closest, but one sample and the oldest
+
+    TEST_ASSERT_EQUAL(3, table.best(1)->ticketId);
+    TEST_ASSERT_EQUAL(1, table.best(2)->ticketId);
+    TEST_ASSERT_EQUAL(1, table.best(1, 1500, 480)->ticketId);
+    TEST_ASSERT_NULL(table.best(3));
+
+    const PeerStats* leader = nullptr;
+    TEST_ASSERT_EQUAL(12, table.lead(1500, 1000, 30.0f, &leader));
+    TEST_ASSERT_EQUAL(3, leader->ticketId);
+    TEST_ASSERT_EQUAL(8, table.lead(1500, 480, 30.0f, &leader));
+    TEST_ASSERT_EQUAL(1, leader->ticketId);
+    // The ceiling caps the runner-up, e.g. the distance threshold when the runner-up is out of range
+    TEST_ASSERT_EQUAL(2, table.lead(1500, 480, 5.0f, &leader));
+    TEST_ASSERT_EQUAL(0, table.lead(5000, 100, 30.0f, &leader));
+    TEST_ASSERT_NULL(leader);
+
+    TEST_ASSERT_EQUAL(3, table.within(1500, 1000, 11.0f));
+    TEST_ASSERT_EQUAL(2, table.within(1500, 1000, 5.0f));
+}
+
+// A full table gives a closer newcomer the slot of the farthest peer, and refuses farther ones
+void test_full_table_keeps_the_nearest() {
+    PeerTable table;
+    for (uint32_t ticket = 1; ticket < PeerTable::CAPACITY; ticket++) {
+        TEST_ASSERT_TRUE(table.record(ticket, (int8_t)(-60 - ticket), TX_POWER, 0));
+    }
+    size_t full = table.size();
+    TEST_ASSERT_FALSE(table.record(1000, -100, TX_POWER, 0));
+    TEST_ASSERT_NULL(table.find(1000));
+
+    TEST_ASSERT_TRUE(table.record(1001, -55, TX_POWER, 0));
+    TEST_ASSERT_EQUAL(full, table.size());
+    TEST_ASSERT_EQUAL(1, table.evictions());
+    TEST_ASSERT_NOT_NULL(table.find(1001));
+    TEST_ASSERT_NULL(table.find(PeerTable::CAPACITY - 1));
+    for (uint32_t ticket = 1; ticket < PeerTable::CAPACITY - 1; ticket++) {
+        TEST_ASSERT_NOT_NULL(table.find(ticket));
+    }
+}
+
+// Kalman-filtered path loss against the median of five, window by window
+void test_kalman_beats_median_of_five() {
+    const uint32_t windows[] = {150, 300, 500, 1000};
+    for (uint32_t windowMs : windows) {
+        float rates[PICK_COUNT];
+        traceRates(windowMs, rates);
+
+        char message[128];
+        snprintf(message, sizeof(message), "%4u ms: median-of-5 %.2f, Kalman %.2f", windowMs, rates[PICK_MEDIAN], rates[PICK_KALMAN]);
+        TEST_MESSAGE(message);
+
+        TEST_ASSERT_GREATER_OR_EQUAL(rates[PICK_MEDIAN] - 0.01f, rates[PICK_KALMAN]);
+        if (windowMs >= 500) {
+            TEST_ASSERT_GREATER_OR_EQUAL(0.90f, rates[PICK_KALMAN]);
+        }
+    }
+}
+
+// Ticket 0 marks an empty slot, so only ids that advertise as themselves are ever assigned
+void test_ticket_and_event_ids() {
+    PeerTable table;
+    TEST_ASSERT_FALSE(table.record(parseBadgeNumber("T_ABC"), -60, TX_POWER, 0));
+
+    const char* valid[] = {"T_000001", "T_123456", "T_1234567"};
+    for (const char* id : valid) {
+        TEST_ASSERT_TRUE_MESSAGE(isTicketId(id, strlen(id)), id);
+    }
+    const char* invalid[] = {"", "T_", "T_ABC", "T_0001", "T_000000", "T_000001 ", "T_+00001", "X_000001", "T_99999999999"};
+    for (const char* id : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(isTicketId(id, strlen(id)), id);
+    }
+    // MQTT payloads are not NUL-terminated
+    TEST_ASSERT_TRUE(isTicketId("T_000042garbage", 8));
+
+    uint16_t eventId = 7;
+    const char* badEvents[] = {"E_", "E_65536", "E_123456", "E_1x", "01", "E_-1"};
+    for (const char* id : badEvents) {
+        TEST_ASSERT_FALSE_MESSAGE(parseEventId(id, eventId), id);
+    }
+    TEST_ASSERT_EQUAL(7, eventId);
+    TEST_ASSERT_TRUE(parseEventId("E_01", eventId));
+    TEST_ASSERT_EQUAL(1, eventId);
+    TEST_ASSERT_TRUE(parseEventId("E_65535", eventId));
+    TEST_ASSERT_EQUAL(65535, eventId);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_statistics_per_peer);
+    RUN_TEST(test_median_of_fewer_than_five);
+    RUN_TEST(test_probe_runs_survive_expiry);
+    RUN_TEST(test_median_at_500ms_beats_first_seen_at_1000ms);
+    RUN_TEST(test_kalman_converges_and_tracks);
+    RUN_TEST(test_path_loss_and_distance);
+    RUN_TEST(test_best_lead_and_within);
+    RUN_TEST(test_full_table_keeps_the_nearest);
+    RUN_TEST(test_kalman_beats_median_of_five);
+    RUN_TEST(test_ticket_and_event_ids);
+    return UNITY_END();
+}
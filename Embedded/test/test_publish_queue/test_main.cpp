@@ -0,0 +1,74 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "PublishQueue.h"
+
+static PublishQueue* queue = nullptr;
+
+void setUp() {
+    queue = new PublishQueue();
+}
+
+void tearDown() {
+    delete queue;
+}
+
+void test_pop_counts_delivery() {
+    TEST_ASSERT_TRUE(queue->push(PUBLISH_RECEIPT, "{\"status\": \"success\"}"));
+    TEST_ASSERT_TRUE(queue->push(PUBLISH_RECEIPT, "{\"status\": \"success\"}"));
+    const uint8_t binary[] = {1, 0, 2};
+    TEST_ASSERT_TRUE(queue->push(PUBLISH_PROFILE_SWAP, binary, sizeof(binary)));
+    TEST_ASSERT_EQUAL(3, queue->at(2)->length);
+    TEST_ASSERT_TRUE(queue->at(2)->binary);
+    TEST_ASSERT_NULL(queue->at(3));
+
+    // Two receipts in one batch, then the claim on its own
+    queue->pop(2);
+    TEST_ASSERT_EQUAL(PUBLISH_PROFILE_SWAP, queue->at(0)->kind);
+    queue->pop(1);
+    PublishStats stats = queue->stats();
+    TEST_ASSERT_EQUAL(3, stats.queued);
+    TEST_ASSERT_EQUAL(3, stats.drained);
+    TEST_ASSERT_EQUAL(2, stats.batches);
+    TEST_ASSERT_EQUAL(2, stats.largestBatch);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+}
+
+// Messages that can never be addressed leave the queue without counting as delivered
+void test_discard_counts_as_dropped() {
+    for (int i = 0; i < 3; i++) {
+        queue->push(PUBLISH_AVAILABILITY, "{}");
+    }
+    queue->discard(2);
+    queue->discard(5);
+    TEST_ASSERT_EQUAL(0, queue->size());
+    PublishStats stats = queue->stats();
+    TEST_ASSERT_EQUAL(3, stats.dropped);
+    TEST_ASSERT_EQUAL(0, stats.drained);
+    TEST_ASSERT_EQUAL(0, stats.batches);
+}
+
+void test_full_queue_and_oversized_payloads() {
+    char payload[MQTT_QUEUED_PAYLOAD_SIZE + 1];
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[sizeof(payload) - 1] = '\0';
+    TEST_ASSERT_FALSE(queue->push(PUBLISH_RECEIPT, payload));
+    TEST_ASSERT_FALSE(queue->push(PUBLISH_RECEIPT, (const uint8_t*)payload, 0));
+
+    char text[16];
+    for (int i = 0; i < MQTT_QUEUE_SIZE + 2; i++) {
+        snprintf(text, sizeof(text), "%d", i);
+        TEST_ASSERT_EQUAL(i < MQTT_QUEUE_SIZE, queue->push(PUBLISH_RECEIPT, text));
+    }
+    // The oldest are kept
+    TEST_ASSERT_EQUAL_STRING("0", queue->at(0)->payload);
+    TEST_ASSERT_EQUAL(4, queue->stats().dropped);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pop_counts_delivery);
+    RUN_TEST(test_discard_counts_as_dropped);
+    RUN_TEST(test_full_queue_and_oversized_payloads);
+    return UNITY_END();
+}
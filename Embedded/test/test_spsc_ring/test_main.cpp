@@ -0,0 +1,170 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "SpscRing.h"
+
+// Big enough that a torn copy shows up as a checksum mismatch
+struct Record {
+    uint32_t sequence;
+    uint32_t words[7];
+    uint32_t checksum;
+};
+
+static Record makeRecord(uint32_t sequence) {
+    Record record;
+    record.sequence = sequence;
+    record.checksum = sequence;
+    for (uint32_t i = 0; i < 7; i++) {
+        record.words[i] = sequence * 2654435761u + i;
+        record.checksum ^= record.words[i];
+    }
+    return record;
+}
+
+static bool intact(const Record& record) {
+    uint32_t checksum = record.sequence;
+    for (uint32_t i = 0; i < 7; i++) {
+        checksum ^= record.words[i];
+    }
+    return checksum == record.checksum;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_fifo_order() {
+    SpscRing<int, 8> ring;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_NULL(ring.front());
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_EQUAL(5, ring.size());
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_NOT_NULL(ring.front());
+        TEST_ASSERT_EQUAL(i, *ring.front());
+        ring.pop();
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+    // pop() on an empty ring is a no-op
+    ring.pop();
+    TEST_ASSERT_EQUAL(0, ring.size());
+}
+
+void test_full_ring_drops_and_counts() {
+    SpscRing<int, 4> ring;
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_FALSE(ring.push(4));
+    TEST_ASSERT_FALSE(ring.push(5));
+    TEST_ASSERT_EQUAL(4, ring.size());
+    TEST_ASSERT_EQUAL(2, ring.dropped());
+    // The oldest entries survive, the new ones were dropped
+    TEST_ASSERT_EQUAL(0, *ring.front());
+    ring.pop();
+    TEST_ASSERT_TRUE(ring.push(6));
+    int expected[] = {1, 2, 3, 6};
+    for (int value : expected) {
+        TEST_ASSERT_EQUAL(value, *ring.front());
+        ring.pop();
+    }
+}
+
+void test_clear_and_wraparound() {
+    SpscRing<int, 4> ring;
+    for (int round = 0; round < 1000; round++) {
+        TEST_ASSERT_TRUE(ring.push(round));
+        TEST_ASSERT_TRUE(ring.push(round + 1));
+        TEST_ASSERT_EQUAL(round, *ring.front());
+        ring.pop();
+        ring.clear();
+        TEST_ASSERT_TRUE(ring.empty());
+    }
+    TEST_ASSERT_EQUAL(0, ring.dropped());
+}
+
+// The NimBLE task never waits: everything it pushes arrives intact and in order, or is counted as
+// dropped. The consumer yields when the ring is empty so this also runs on a single core.
+void test_two_threads_lossy_producer() {
+    static SpscRing<Record, 32> ring;
+    const uint32_t total = 2000000;
+    std::atomic<bool> done{false};
+    uint32_t received = 0;
+    uint32_t torn = 0;
+    uint32_t reordered = 0;
+
+    std::thread producer([&] {
+        for (uint32_t i = 1; i <= total; i++) {
+            ring.push(makeRecord(i));
+        }
+        done = true;
+    });
+
+    uint32_t last = 0;
+    while (!done || !ring.empty()) {
+        const Record* record = ring.front();
+        if (record == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!intact(*record)) {
+            torn++;
+        }
+        if (record->sequence <= last) {
+            reordered++;
+        }
+        last = record->sequence;
+        received++;
+        ring.pop();
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_EQUAL(0, reordered);
+    TEST_ASSERT_EQUAL(total, received + ring.dropped());
+}
+
+// With a producer that retries, nothing may be lost or duplicated
+void test_two_threads_every_item_once() {
+    static SpscRing<Record, 8> ring;
+    const uint32_t total = 1000000;
+
+    std::thread producer([&] {
+        for (uint32_t i = 1; i <= total; i++) {
+            Record record = makeRecord(i);
+            while (!ring.push(record)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 1;
+    uint32_t mismatches = 0;
+    while (expected <= total) {
+        const Record* record = ring.front();
+        if (record == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (record->sequence != expected || !intact(*record)) {
+            mismatches++;
+        }
+        expected++;
+        ring.pop();
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL(0, mismatches);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_order);
+    RUN_TEST(test_full_ring_drops_and_counts);
+    RUN_TEST(test_clear_and_wraparound);
+    RUN_TEST(test_two_threads_lossy_producer);
+    RUN_TEST(test_two_threads_every_item_once);
+    return UNITY_END();
+}
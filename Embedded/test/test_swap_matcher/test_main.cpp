@@ -0,0 +1,211 @@
+#include <unity.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "BadgeMessage.h"
+#include "SwapConfirmer.h"
+#include "SwapMatcher.h"
+
+static const uint32_t WINDOW_MS = 1000;
+
+void setUp() {}
+void tearDown() {}
+
+void test_mutual_claims_match_once() {
+    SwapMatcher matcher(64, WINDOW_MS);
+    SwapMatch match = {};
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(1, 2, 100, &match));
+    TEST_ASSERT_EQUAL(SWAP_MATCHED, matcher.offer(2, 1, 350, &match));
+    TEST_ASSERT_EQUAL(2, match.ticketId);
+    TEST_ASSERT_EQUAL(1, match.partnerTicketId);
+    TEST_ASSERT_EQUAL(250, match.waitedMs);
+
+    // Live resends, outbox replays and the partner's copy within the window all confirm once
+    TEST_ASSERT_EQUAL(SWAP_DUPLICATE, matcher.offer(1, 2, 400, &match));
+    TEST_ASSERT_EQUAL(SWAP_DUPLICATE, matcher.offer(2, 1, 1300, &match));
+    // The window restarts at the match, so the pair is remembered until 350 + WINDOW_MS
+    TEST_ASSERT_EQUAL(SWAP_DUPLICATE, matcher.offer(1, 2, 350 + WINDOW_MS - 1, &match));
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(1, 2, 350 + WINDOW_MS, &match));
+
+    SwapMatcherStats stats = matcher.stats();
+    TEST_ASSERT_EQUAL(1, stats.matched);
+    TEST_ASSERT_EQUAL(3, stats.duplicates);
+    TEST_ASSERT_EQUAL(0, stats.expired);
+}
+
+void test_orphans_expire_and_invalid_claims() {
+    SwapMatcher matcher(64, WINDOW_MS);
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(5, 6, 0, nullptr));
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(7, 8, 10, nullptr));
+    TEST_ASSERT_EQUAL(2, matcher.size());
+    matcher.expire(WINDOW_MS + 10);
+    TEST_ASSERT_EQUAL(0, matcher.size());
+    TEST_ASSERT_EQUAL(2, matcher.stats().expired);
+    // Too late: the partner's claim starts a new pending claim instead of matching
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(6, 5, WINDOW_MS + 20, nullptr));
+
+    TEST_ASSERT_EQUAL(SWAP_INVALID, matcher.offer(0, 5, 0, nullptr));
+    TEST_ASSERT_EQUAL(SWAP_INVALID, matcher.offer(5, 0, 0, nullptr));
+    TEST_ASSERT_EQUAL(SWAP_INVALID, matcher.offer(9, 9, 0, nullptr));
+    TEST_ASSERT_EQUAL(3, matcher.stats().invalid);
+}
+
+void test_full_table_drops_and_recovers() {
+    SwapMatcher matcher(8, WINDOW_MS);
+    for (uint32_t i = 1; i <= 8; i++) {
+        TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(i, 100 + i, 0, nullptr));
+    }
+    TEST_ASSERT_EQUAL(SWAP_FULL, matcher.offer(9, 109, 0, nullptr));
+    TEST_ASSERT_EQUAL(1, matcher.stats().full);
+    matcher.expire(WINDOW_MS);
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(9, 109, WINDOW_MS, nullptr));
+}
+
+// Arrival times are millis(), which wraps every 49.7 days
+void test_window_across_clock_wrap() {
+    SwapMatcher matcher(64, WINDOW_MS);
+    SwapMatch match = {};
+    TEST_ASSERT_EQUAL(SWAP_PENDING, matcher.offer(1, 2, 0xFFFFFF00u, &match));
+    TEST_ASSERT_EQUAL(SWAP_MATCHED, matcher.offer(2, 1, 0x100, &match));
+    TEST_ASSERT_EQUAL(0x200, match.waitedMs);
+    TEST_ASSERT_EQUAL(SWAP_DUPLICATE, matcher.offer(1, 2, 0x100 + WINDOW_MS - 1, &match));
+}
+
+// The same rules on a std::map: a claim lives for a window from its arrival or its match, a
+// repeat of a live claim or of a matched pair is a duplicate, and the table holds capacity claims
+static SwapOffer modelOffer(std::map<uint64_t, std::pair<uint32_t, bool>>& model, size_t capacity, uint32_t a, uint32_t b, uint32_t now) {
+    for (auto it = model.begin(); it != model.end();) {
+        it = now - it->second.first >= WINDOW_MS ? model.erase(it) : std::next(it);
+    }
+    uint64_t key = (uint64_t)a << 32 | b;
+    uint64_t mirror = (uint64_t)b << 32 | a;
+    if (a == b) {
+        return SWAP_INVALID;
+    }
+    if (model.count(key)) {
+        return SWAP_DUPLICATE;
+    }
+    if (model.size() >= capacity) {
+        return SWAP_FULL;
+    }
+    if (!model.count(mirror)) {
+        model[key] = {now, false};
+        return SWAP_PENDING;
+    }
+    if (model[mirror].second) {
+        return SWAP_DUPLICATE;
+    }
+    model[mirror] = {now, true};
+    model[key] = {now, true};
+    return SWAP_MATCHED;
+}
+
+void test_agrees_with_map_model() {
+    // A roomy table and one small enough to fill, each over a random clock
+    const size_t capacities[] = {4096, 48};
+    std::mt19937 rng(49);
+    uint32_t results[SWAP_INVALID + 1] = {};
+    for (size_t capacity : capacities) {
+        SwapMatcher matcher(capacity, WINDOW_MS);
+        std::map<uint64_t, std::pair<uint32_t, bool>> model;
+        uint32_t now = 0;
+        for (int i = 0; i < 500000; i++) {
+            now += rng() % 3;
+            uint32_t a = 1 + rng() % 30;
+            uint32_t b = 1 + rng() % 30;
+            SwapOffer expected = modelOffer(model, capacity, a, b, now);
+            SwapOffer actual = matcher.offer(a, b, now, nullptr);
+            if (actual != expected || matcher.size() != model.size()) {
+                char message[96];
+                snprintf(message, sizeof(message), "offer %d: %u->%u at %u ms gave %d, model %d", i, a, b, now, actual, expected);
+                TEST_FAIL_MESSAGE(message);
+            }
+            results[actual]++;
+        }
+    }
+    // Every outcome was exercised
+    for (uint32_t count : results) {
+        TEST_ASSERT_GREATER_THAN(0, count);
+    }
+}
+
+static bool offerJson(SwapConfirmer& confirmer, const char* ticket, const char* partner, uint32_t nowMs,
+                      std::vector<SwapConfirmation>& out) {
+    char json[128];
+    snprintf(json, sizeof(json), "{\"event_id\": \"E_01\", \"ticket_id\": \"%s\", \"ticket_id_to_swap\": \"%s\"}", ticket, partner);
+    return confirmer.offer((const uint8_t*)json, strlen(json), nowMs, out);
+}
+
+// Badges match their swap topic byte for byte, so each is confirmed on the ticket it claimed with
+void test_confirmations_echo_each_badges_spelling() {
+    SwapConfirmer confirmer(64, WINDOW_MS);
+    std::vector<SwapConfirmation> out;
+    TEST_ASSERT_TRUE(offerJson(confirmer, "T_0001", "T_000002", 0, out));
+    TEST_ASSERT_EQUAL(0, out.size());
+    // The partner spells the first badge's ticket its own way; the numbers still pair
+    TEST_ASSERT_TRUE(offerJson(confirmer, "T_000002", "T_000001", 10, out));
+    TEST_ASSERT_EQUAL(2, out.size());
+    TEST_ASSERT_EQUAL_STRING("T_000002", out[0].ticket.c_str());
+    TEST_ASSERT_EQUAL_STRING("T_0001", out[0].partnerTicket.c_str());
+    TEST_ASSERT_EQUAL_STRING("T_0001", out[1].ticket.c_str());
+    TEST_ASSERT_EQUAL_STRING("T_000002", out[1].partnerTicket.c_str());
+
+    // BadgeMessage claims carry only numbers, so they are confirmed in formatTicketId's form
+    out.clear();
+    uint8_t binary[64];
+    size_t length = encodeProfileSwap(binary, sizeof(binary), "E_01", 7, 8);
+    TEST_ASSERT_TRUE(confirmer.offer(binary, length, 20, out));
+    length = encodeProfileSwap(binary, sizeof(binary), "E_01", 8, 7);
+    TEST_ASSERT_TRUE(confirmer.offer(binary, length, 20, out));
+    TEST_ASSERT_EQUAL(2, out.size());
+    TEST_ASSERT_EQUAL_STRING("T_000007", out[1].ticket.c_str());
+
+    // A spelling is forgotten a window after its ticket's last claim
+    out.clear();
+    confirmer.expire(2 * WINDOW_MS);
+    TEST_ASSERT_TRUE(offerJson(confirmer, "T_000002", "T_000001", 2 * WINDOW_MS, out));
+    TEST_ASSERT_TRUE(offerJson(confirmer, "T_000001", "T_000002", 2 * WINDOW_MS, out));
+    TEST_ASSERT_EQUAL_STRING("T_000001", out[0].ticket.c_str());
+    TEST_ASSERT_FALSE(confirmer.offer((const uint8_t*)"{}", 2, 0, out));
+}
+
+void test_offer_cost() {
+    const uint32_t tickets = 200000;
+    const int claims = 2000000;
+    SwapMatcher matcher(100000, 10000);
+    std::mt19937 rng(7);
+    SwapMatch match;
+    uint32_t matched = 0;
+    uint32_t now = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // Each handshake is claimed by both badges within a few ms of each other
+    for (int i = 0; i < claims / 2; i++) {
+        uint32_t a = 1 + rng() % tickets;
+        uint32_t b = 1 + rng() % tickets;
+        now += rng() % 2;
+        matcher.offer(a, b, now, &match);
+        matched += matcher.offer(b, a, now + rng() % 5, &match) == SWAP_MATCHED;
+    }
+    double perOfferNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / claims;
+
+    char message[96];
+    snprintf(message, sizeof(message), "%d claims: %.0f ns per offer, %.2f M claims/s, %u matched", claims, perOfferNs,
+             1000.0 / perOfferNs, matched);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(claims / 2 * 0.95, matched);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_mutual_claims_match_once);
+    RUN_TEST(test_orphans_expire_and_invalid_claims);
+    RUN_TEST(test_full_table_drops_and_recovers);
+    RUN_TEST(test_window_across_clock_wrap);
+    RUN_TEST(test_agrees_with_map_model);
+    RUN_TEST(test_confirmations_echo_each_badges_spelling);
+    RUN_TEST(test_offer_cost);
+    return UNITY_END();
+}
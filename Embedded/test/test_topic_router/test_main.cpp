@@ -0,0 +1,209 @@
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "TopicRouter.h"
+
+static const char* DEVICE_ID = "AA:BB:CC:DD:EE:FF";
+static const char* EVENT_ID = "E_01";
+
+static TopicRouter router;
+
+void setUp() {
+    router.begin(DEVICE_ID, EVENT_ID);
+}
+
+void tearDown() {}
+
+static TopicRoute route(const char* topic, std::string* tail = nullptr) {
+    const char* tailStart = nullptr;
+    size_t tailLength = 0;
+    TopicRoute result = router.route(topic, &tailStart, &tailLength);
+    if (tail != nullptr) {
+        *tail = tailStart ? std::string(tailStart, tailLength) : std::string();
+    }
+    return result;
+}
+
+// What handleMessage did before the router: build every candidate topic and compare in turn
+static TopicRoute chainRoute(const std::string& topic, const std::string& clientId, const std::string& eventId, std::string* tail) {
+    std::string device = "device/" + clientId + "/";
+    std::string event = "event/" + eventId + "/";
+    if (topic == device + "assignment") return ROUTE_ASSIGNMENT;
+    if (topic == device + "reassignment") return ROUTE_REASSIGNMENT;
+    if (topic == device + "resetNFC") return ROUTE_RESET_NFC;
+    if (topic == device + "encoding") return ROUTE_ENCODING;
+    if (topic == device + "receipt_batch") return ROUTE_RECEIPT_BATCH;
+    if (topic == device + "reboot") return ROUTE_DEVICE_REBOOT;
+    if (topic == event + "reboot") return ROUTE_EVENT_REBOOT;
+    std::string swap = event + "profile_swap/";
+    if (topic.size() > swap.size() && topic.compare(0, swap.size(), swap) == 0) {
+        *tail = topic.substr(swap.size());
+        return ROUTE_PROFILE_SWAP;
+    }
+    return ROUTE_NONE;
+}
+
+void test_device_routes() {
+    TEST_ASSERT_EQUAL(ROUTE_ASSIGNMENT, route("device/AA:BB:CC:DD:EE:FF/assignment"));
+    TEST_ASSERT_EQUAL(ROUTE_REASSIGNMENT, route("device/AA:BB:CC:DD:EE:FF/reassignment"));
+    TEST_ASSERT_EQUAL(ROUTE_RESET_NFC, route("device/AA:BB:CC:DD:EE:FF/resetNFC"));
+    TEST_ASSERT_EQUAL(ROUTE_ENCODING, route("device/AA:BB:CC:DD:EE:FF/encoding"));
+    TEST_ASSERT_EQUAL(ROUTE_RECEIPT_BATCH, route("device/AA:BB:CC:DD:EE:FF/receipt_batch"));
+    TEST_ASSERT_EQUAL(ROUTE_DEVICE_REBOOT, route("device/AA:BB:CC:DD:EE:FF/reboot"));
+}
+
+void test_event_routes() {
+    std::string tail;
+    TEST_ASSERT_EQUAL(ROUTE_EVENT_REBOOT, route("event/E_01/reboot"));
+    TEST_ASSERT_EQUAL(ROUTE_PROFILE_SWAP, route("event/E_01/profile_swap/T_000123", &tail));
+    TEST_ASSERT_EQUAL_STRING("T_000123", tail.c_str());
+    // Claims on the bare topic and other badges' announcements are not for us
+    TEST_ASSERT_EQUAL(ROUTE_NONE, route("event/E_01/profile_swap", &tail));
+    TEST_ASSERT_EQUAL(ROUTE_NONE, route("event/E_01/profile_swap/", &tail));
+    TEST_ASSERT_EQUAL(0, tail.size());
+    TEST_ASSERT_EQUAL(ROUTE_NONE, route("event/E_01/available_devices/11:22:33:44:55:66"));
+}
+
+void test_near_misses() {
+    const char* topics[] = {
+        "device/AA:BB:CC:DD:EE:FF/",
+        "device/AA:BB:CC:DD:EE:FF",
+        "device/AA:BB:CC:DD:EE:FF/receipt",
+        "device/AA:BB:CC:DD:EE:FF/resetNFX",
+        "device/AA:BB:CC:DD:EE:FF/encodinG",
+        "device/AA:BB:CC:DD:EE:FF/assignments",
+        "device/AA:BB:CC:DD:EE:FF/health",
+        "device/11:22:33:44:55:66/assignment",
+        "event/E_02/reboot",
+        "event/E_01/rebooT",
+        "event/E_01/profile_swaP/T_000123",
+        "device/E_01/reboot",
+        "",
+    };
+    for (const char* topic : topics) {
+        TEST_ASSERT_EQUAL_MESSAGE(ROUTE_NONE, route(topic), topic);
+    }
+}
+
+// The old substring offsets assumed a four-character event id
+void test_event_ids_of_any_length() {
+    std::string tail;
+    router.begin(DEVICE_ID, "E_2024_SPRING");
+    TEST_ASSERT_EQUAL(ROUTE_PROFILE_SWAP, route("event/E_2024_SPRING/profile_swap/T_000007", &tail));
+    TEST_ASSERT_EQUAL_STRING("T_000007", tail.c_str());
+    TEST_ASSERT_EQUAL(ROUTE_NONE, route("event/E_01/profile_swap/T_000007"));
+
+    router.begin(DEVICE_ID, "E");
+    TEST_ASSERT_EQUAL(ROUTE_EVENT_REBOOT, route("event/E/reboot"));
+}
+
+void test_prefixes_and_overlong_ids() {
+    TEST_ASSERT_EQUAL_STRING("device/AA:BB:CC:DD:EE:FF/", router.devicePrefix());
+    TEST_ASSERT_EQUAL_STRING("event/E_01/", router.eventPrefix());
+
+    std::string longId(TopicRouter::PREFIX_SIZE, 'x');
+    TEST_ASSERT_FALSE(router.begin(longId.c_str(), EVENT_ID));
+    // Nothing routes rather than a truncated prefix matching the wrong topics
+    TEST_ASSERT_EQUAL(ROUTE_NONE, route("event/E_01/reboot"));
+    TEST_ASSERT_EQUAL(ROUTE_NONE, route(("device/" + longId + "/reboot").c_str()));
+}
+
+// The mix handleMessage saw under the old event-wide subscription: 60% availability,
+// 30% profile swap, 10% our own device topics, plus mutated topics
+static std::vector<std::string> mixedTopics(size_t count, bool mutate) {
+    std::mt19937 rng(40);
+    const char* device[] = {"assignment", "reassignment", "resetNFC", "encoding", "receipt_batch", "reboot", "receipt"};
+    std::vector<std::string> topics;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t kind = rng() % 10;
+        char ticket[16];
+        snprintf(ticket, sizeof(ticket), "T_%06u", (unsigned)(rng() % 1000000));
+        std::string topic;
+        if (kind < 6) {
+            topic = std::string("event/E_01/available_devices/") + ticket;
+        } else if (kind < 9) {
+            topic = std::string("event/E_01/profile_swap") + (rng() % 2 ? "/" : "") + (rng() % 2 ? ticket : "");
+        } else {
+            topic = std::string("device/") + DEVICE_ID + "/" + device[rng() % 7];
+        }
+        if (mutate && !topic.empty()) {
+            for (uint32_t edits = rng() % 3; edits > 0; edits--) {
+                size_t at = rng() % topic.size();
+                switch (rng() % 3) {
+                    case 0: topic[at] = (char)(' ' + rng() % 95); break;
+                    case 1: topic.erase(at, 1); break;
+                    default: topic.insert(at, 1, (char)(' ' + rng() % 95)); break;
+                }
+                if (topic.empty()) {
+                    break;
+                }
+            }
+        }
+        topics.push_back(topic);
+    }
+    return topics;
+}
+
+void test_matches_the_string_chain() {
+    std::vector<std::string> topics = mixedTopics(20000, false);
+    std::vector<std::string> mutated = mixedTopics(20000, true);
+    topics.insert(topics.end(), mutated.begin(), mutated.end());
+
+    size_t routed = 0;
+    for (const std::string& topic : topics) {
+        std::string expectedTail;
+        std::string tail;
+        TopicRoute expected = chainRoute(topic, DEVICE_ID, EVENT_ID, &expectedTail);
+        TEST_ASSERT_EQUAL_MESSAGE(expected, route(topic.c_str(), &tail), topic.c_str());
+        TEST_ASSERT_EQUAL_STRING(expectedTail.c_str(), tail.c_str());
+        routed += expected != ROUTE_NONE;
+    }
+    TEST_ASSERT_GREATER_THAN(1000, routed);
+}
+
+void test_cost_against_the_string_chain() {
+    std::vector<std::string> topics = mixedTopics(10000, false);
+    const int rounds = 20;
+    size_t chainRouted = 0;
+    size_t routerRouted = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (const std::string& topic : topics) {
+            std::string tail;
+            chainRouted += chainRoute(topic, DEVICE_ID, EVENT_ID, &tail) != ROUTE_NONE;
+        }
+    }
+    double chainNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * topics.size());
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (const std::string& topic : topics) {
+            const char* tail;
+            size_t tailLength;
+            routerRouted += router.route(topic.c_str(), &tail, &tailLength) != ROUTE_NONE;
+        }
+    }
+    double routerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * topics.size());
+
+    char message[128];
+    snprintf(message, sizeof(message), "per message: string chain %.0f ns, router %.0f ns", chainNs, routerNs);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(chainRouted, routerRouted);
+    TEST_ASSERT_LESS_THAN(chainNs, routerNs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_device_routes);
+    RUN_TEST(test_event_routes);
+    RUN_TEST(test_near_misses);
+    RUN_TEST(test_event_ids_of_any_length);
+    RUN_TEST(test_prefixes_and_overlong_ids);
+    RUN_TEST(test_matches_the_string_chain);
+    RUN_TEST(test_cost_against_the_string_chain);
+    return UNITY_END();
+}
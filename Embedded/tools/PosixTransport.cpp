@@ -0,0 +1,92 @@
+#include "PosixTransport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+PosixTransport::~PosixTransport() {
+    close();
+}
+
+bool PosixTransport::connect(const char* host, uint16_t port) {
+    close();
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host, service, &hints, &results) != 0) {
+        return false;
+    }
+
+    for (addrinfo* ai = results; ai != nullptr && _fd < 0; ai = ai->ai_next) {
+        _fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (_fd >= 0 && ::connect(_fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    if (_fd < 0) {
+        return false;
+    }
+
+    // Small MQTT packets should not wait for Nagle
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+int PosixTransport::read(uint8_t* buffer, size_t length) {
+    if (_fd < 0) {
+        return -1;
+    }
+    ssize_t received = ::recv(_fd, buffer, length, 0);
+    if (received > 0) {
+        return (int)received;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    return -1;
+}
+
+int PosixTransport::write(const uint8_t* data, size_t length) {
+    if (_fd < 0) {
+        return -1;
+    }
+    ssize_t sent = ::send(_fd, data, length, MSG_NOSIGNAL);
+    if (sent >= 0) {
+        return (int)sent;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+}
+
+void PosixTransport::close() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+int PosixTransport::fd() const {
+    return _fd;
+}
+
+uint64_t hostMicros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t hostMillis() {
+    return (uint32_t)(hostMicros() / 1000);
+}
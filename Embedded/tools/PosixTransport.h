@@ -0,0 +1,35 @@
+#ifndef POSIX_TRANSPORT_H
+#define POSIX_TRANSPORT_H
+
+#include "Mqtt5Client.h"
+
+/**
+ * @brief Plain TCP MqttTransport for host tools, e.g. against a local mosquitto.
+ *
+ * connect() blocks like the badge's TLS connect; after that the socket is
+ * non-blocking, so read() and write() return 0 instead of waiting.
+ */
+class PosixTransport : public MqttTransport {
+private:
+    int _fd = -1;
+
+public:
+    ~PosixTransport();
+    bool connect(const char* host, uint16_t port);
+    int read(uint8_t* buffer, size_t length) override;
+    int write(const uint8_t* data, size_t length) override;
+    void close() override;
+    int fd() const;
+};
+
+/**
+ * @brief Milliseconds on a monotonic clock, the host's millis()
+ */
+uint32_t hostMillis();
+
+/**
+ * @brief Microseconds on a monotonic clock, the host's micros()
+ */
+uint64_t hostMicros();
+
+#endif
@@ -0,0 +1,94 @@
+#include "SwapClaim.h"
+#include "BadgeAdvertisement.h"
+#include "BadgeMessage.h"
+#include <string.h>
+
+namespace {
+
+// Start of the value after "key": at the top level, or nullptr
+const char* findValue(const char* json, size_t length, const char* key) {
+    size_t keyLength = strlen(key);
+    const char* end = json + length;
+    for (const char* p = json; p + keyLength + 2 < end; p++) {
+        if (*p != '"' || memcmp(p + 1, key, keyLength) != 0 || p[keyLength + 1] != '"') {
+            continue;
+        }
+        const char* value = p + keyLength + 2;
+        while (value < end && (*value == ' ' || *value == ':')) {
+            value++;
+        }
+        return value < end ? value : nullptr;
+    }
+    return nullptr;
+}
+
+bool jsonNumberField(const char* json, size_t length, const char* key, uint32_t* out) {
+    const char* value = findValue(json, length, key);
+    const char* end = json + length;
+    if (value == nullptr || *value < '0' || *value > '9') {
+        return false;
+    }
+    uint32_t number = 0;
+    for (; value < end && *value >= '0' && *value <= '9'; value++) {
+        number = number * 10 + (uint32_t)(*value - '0');
+    }
+    *out = number;
+    return true;
+}
+
+}  // namespace
+
+int jsonStringField(const char* json, size_t length, const char* key, char* out, size_t outSize) {
+    const char* value = findValue(json, length, key);
+    const char* end = json + length;
+    if (value == nullptr || *value != '"') {
+        return -1;
+    }
+    value++;
+    size_t used = 0;
+    for (; value < end && *value != '"'; value++) {
+        // Ticket ids never need escapes; keep the escaped character as is
+        if (*value == '\\' && value + 1 < end) {
+            value++;
+        }
+        if (used + 1 >= outSize) {
+            return -1;
+        }
+        out[used++] = *value;
+    }
+    if (value == end) {
+        return -1;
+    }
+    out[used] = '\0';
+    return (int)used;
+}
+
+bool parseSwapClaim(const uint8_t* payload, size_t length, SwapClaim& claim) {
+    if (length > 0 && payload[0] == BADGE_MESSAGE_VERSION) {
+        BadgeMessage message;
+        if (!decodeBadgeMessage(payload, length, message) || message.type != BADGE_MSG_PROFILE_SWAP) {
+            return false;
+        }
+        claim.ticketId = message.ticketId;
+        claim.partnerTicketId = message.partnerTicketId;
+        formatTicketId(claim.ticketId, claim.ticket, sizeof(claim.ticket));
+        formatTicketId(claim.partnerTicketId, claim.partnerTicket, sizeof(claim.partnerTicket));
+        claim.replayed = (message.flags & BADGE_SWAP_HAS_CLAIM) != 0;
+        claim.timestamp = message.timestamp;
+        claim.nonce = message.nonce;
+        return true;
+    }
+
+    const char* json = (const char*)payload;
+    if (jsonStringField(json, length, "ticket_id", claim.ticket, sizeof(claim.ticket)) <= 0 ||
+        jsonStringField(json, length, "ticket_id_to_swap", claim.partnerTicket, sizeof(claim.partnerTicket)) <= 0) {
+        return false;
+    }
+    claim.ticketId = parseBadgeNumber(claim.ticket);
+    claim.partnerTicketId = parseBadgeNumber(claim.partnerTicket);
+    claim.timestamp = 0;
+    claim.nonce = 0;
+    claim.replayed = jsonNumberField(json, length, "timestamp", &claim.timestamp) &&
+                     jsonNumberField(json, length, "nonce", &claim.nonce);
+    return true;
+}
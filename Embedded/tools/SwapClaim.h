@@ -0,0 +1,39 @@
+#ifndef SWAP_CLAIM_H
+#define SWAP_CLAIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief One badge's report of a handshake, as published to event/<eventId>/profile_swap
+ *
+ * Ticket ids are the number after "T_", as in the BLE advertisement and BadgeMessage. The
+ * strings are the ids as the badge wrote them: verbatim from JSON, formatTicketId() for
+ * BadgeMessage, which only carries the number.
+ */
+struct SwapClaim {
+    uint32_t ticketId;
+    uint32_t partnerTicketId;
+    char ticket[24];
+    char partnerTicket[24];
+    bool replayed;          // published late from the offline outbox, timestamp and nonce are set
+    uint32_t timestamp;
+    uint32_t nonce;
+};
+
+/**
+ * @brief Read a claim in either encoding the badge publishes: the JsonWriter object from
+ *        publishHandshake()/publishHandshakeClaim(), or a BadgeMessage profile swap
+ *
+ * @return false if the payload is neither or a ticket id is missing
+ */
+bool parseSwapClaim(const uint8_t* payload, size_t length, SwapClaim& claim);
+
+/**
+ * @brief Copy the string value of a top-level key out of a flat JSON object such as JsonWriter writes
+ *
+ * @return The value length, or -1 if the key is missing or the value does not fit
+ */
+int jsonStringField(const char* json, size_t length, const char* key, char* out, size_t outSize);
+
+#endif
@@ -0,0 +1,58 @@
+#include "SwapConfirmer.h"
+#include "BadgeAdvertisement.h"
+#include "SwapClaim.h"
+#include <string.h>
+
+SwapConfirmer::SwapConfirmer(size_t capacity, uint32_t windowMs) : _matcher(capacity, windowMs), _windowMs(windowMs) {}
+
+void SwapConfirmer::_remember(uint32_t ticketId, const char* text, uint32_t nowMs) {
+    char canonical[16];
+    formatTicketId(ticketId, canonical, sizeof(canonical));
+    if (strcmp(text, canonical) != 0) {
+        _spellings[ticketId] = Spelling{text, nowMs};
+    } else if (!_spellings.empty()) {
+        _spellings.erase(ticketId);
+    }
+}
+
+std::string SwapConfirmer::_spelling(uint32_t ticketId) const {
+    auto found = _spellings.find(ticketId);
+    if (found != _spellings.end()) {
+        return found->second.text;
+    }
+    char canonical[16];
+    formatTicketId(ticketId, canonical, sizeof(canonical));
+    return canonical;
+}
+
+bool SwapConfirmer::offer(const uint8_t* payload, size_t length, uint32_t nowMs, std::vector<SwapConfirmation>& out) {
+    SwapClaim claim;
+    if (!parseSwapClaim(payload, length, claim)) {
+        return false;
+    }
+    // Only a badge's own claim says how it spells its ticket
+    _remember(claim.ticketId, claim.ticket, nowMs);
+    SwapMatch match;
+    if (_matcher.offer(claim.ticketId, claim.partnerTicketId, nowMs, &match) == SWAP_MATCHED) {
+        std::string ticket = _spelling(match.ticketId);
+        std::string partner = _spelling(match.partnerTicketId);
+        out.push_back(SwapConfirmation{ticket, partner});
+        out.push_back(SwapConfirmation{partner, ticket});
+    }
+    return true;
+}
+
+void SwapConfirmer::expire(uint32_t nowMs) {
+    _matcher.expire(nowMs);
+    if (_spellings.empty() || nowMs - _sweptMs < _windowMs) {
+        return;
+    }
+    _sweptMs = nowMs;
+    for (auto it = _spellings.begin(); it != _spellings.end();) {
+        it = nowMs - it->second.seenMs >= _windowMs ? _spellings.erase(it) : std::next(it);
+    }
+}
+
+const SwapMatcher& SwapConfirmer::matcher() const {
+    return _matcher;
+}
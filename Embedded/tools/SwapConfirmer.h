@@ -0,0 +1,59 @@
+#ifndef SWAP_CONFIRMER_H
+#define SWAP_CONFIRMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SwapMatcher.h"
+
+// Publish partnerTicket to event/<eventId>/profile_swap/<ticket>
+struct SwapConfirmation {
+    std::string ticket;
+    std::string partnerTicket;
+};
+
+/**
+ * @brief The backend's side of a profile swap: claim payloads in, confirmations out.
+ *
+ * SwapMatcher pairs the claims by ticket number. Each confirmation goes to the ticket as that
+ * badge wrote it in its own claim, because the badge matches its swap topic byte for byte: a
+ * badge that was assigned "T_0001" listens on profile_swap/T_0001, never on T_000001.
+ * Spellings other than formatTicketId()'s are remembered for a window after the ticket's
+ * last claim; every other ticket costs nothing beyond the matcher.
+ */
+class SwapConfirmer {
+private:
+    struct Spelling {
+        std::string text;
+        uint32_t seenMs;
+    };
+
+    SwapMatcher _matcher;
+    std::unordered_map<uint32_t, Spelling> _spellings;
+    uint32_t _windowMs;
+    uint32_t _sweptMs = 0;
+
+    void _remember(uint32_t ticketId, const char* text, uint32_t nowMs);
+    std::string _spelling(uint32_t ticketId) const;
+
+public:
+    SwapConfirmer(size_t capacity, uint32_t windowMs);
+
+    /**
+     * @brief Offer one claim payload, JSON or BadgeMessage, live or replayed from the outbox
+     *
+     * @param out Gets both confirmations when the claim completes a pair
+     * @return false if the payload is not a claim
+     */
+    bool offer(const uint8_t* payload, size_t length, uint32_t nowMs, std::vector<SwapConfirmation>& out);
+
+    /**
+     * @brief Drop claims and spellings older than the window; call it when idle
+     */
+    void expire(uint32_t nowMs);
+    const SwapMatcher& matcher() const;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "SwapMatcher.h"
+
+namespace {
+
+inline uint64_t claimKey(uint32_t ticketId, uint32_t partnerTicketId) {
+    return ((uint64_t)ticketId << 32) | partnerTicketId;
+}
+
+inline size_t slotHash(uint64_t key) {
+    // Fibonacci hashing; the high bits are the well mixed ones
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+}  // namespace
+
+SwapMatcher::SwapMatcher(size_t capacity, uint32_t windowMs) : _capacity(capacity), _windowMs(windowMs) {
+    size_t tableSize = 16;
+    while (tableSize < capacity * 2) {
+        tableSize <<= 1;
+    }
+    _slots.assign(tableSize, Slot{0, 0, false});
+    _mask = tableSize - 1;
+    // A match re-arms the partner's entry, so it can briefly have two expiry records
+    _expiry.resize(capacity * 2);
+}
+
+size_t SwapMatcher::_find(uint64_t key) const {
+    for (size_t i = slotHash(key) & _mask;; i = (i + 1) & _mask) {
+        if (_slots[i].key == key) {
+            return i;
+        }
+        if (_slots[i].key == 0) {
+            return SIZE_MAX;
+        }
+    }
+}
+
+bool SwapMatcher::_remember(uint64_t key, uint32_t nowMs) {
+    if (_expiryCount == _expiry.size()) {
+        return false;
+    }
+    _expiry[(_expiryHead + _expiryCount) % _expiry.size()] = Expiry{key, nowMs};
+    _expiryCount++;
+    return true;
+}
+
+void SwapMatcher::_insert(uint64_t key, uint32_t nowMs, bool matched) {
+    size_t i = slotHash(key) & _mask;
+    while (_slots[i].key != 0) {
+        i = (i + 1) & _mask;
+    }
+    _slots[i] = Slot{key, nowMs, matched};
+    _live++;
+    _remember(key, nowMs);
+}
+
+void SwapMatcher::_erase(size_t index) {
+    // Backward-shift deletion: pull later entries of the probe run into the hole so lookups
+    // never need tombstones
+    size_t hole = index;
+    for (size_t i = (hole + 1) & _mask; _slots[i].key != 0; i = (i + 1) & _mask) {
+        size_t home = slotHash(_slots[i].key) & _mask;
+        if (((i - home) & _mask) >= ((i - hole) & _mask)) {
+            _slots[hole] = _slots[i];
+            hole = i;
+        }
+    }
+    _slots[hole].key = 0;
+    _live--;
+}
+
+void SwapMatcher::expire(uint32_t nowMs) {
+    while (_expiryCount > 0) {
+        const Expiry& oldest = _expiry[_expiryHead];
+        if (nowMs - oldest.arrivedMs < _windowMs) {
+            break;
+        }
+        size_t index = _find(oldest.key);
+        // A stale record: the entry was re-armed by a match after this was written
+        if (index != SIZE_MAX && _slots[index].arrivedMs == oldest.arrivedMs) {
+            if (!_slots[index].matched) {
+                _stats.expired++;
+            }
+            _erase(index);
+        }
+        _expiryHead = (_expiryHead + 1) % _expiry.size();
+        _expiryCount--;
+    }
+}
+
+SwapOffer SwapMatcher::offer(uint32_t ticketId, uint32_t partnerTicketId, uint32_t nowMs, SwapMatch* match) {
+    _stats.offered++;
+    expire(nowMs);
+    if (ticketId == 0 || partnerTicketId == 0 || ticketId == partnerTicketId) {
+        _stats.invalid++;
+        return SWAP_INVALID;
+    }
+
+    uint64_t key = claimKey(ticketId, partnerTicketId);
+    // Pending or matched, this pair already has a claim in the window
+    if (_find(key) != SIZE_MAX) {
+        _stats.duplicates++;
+        return SWAP_DUPLICATE;
+    }
+    // Worst case below is one new entry and two expiry records
+    if (_live >= _capacity || _expiryCount + 2 > _expiry.size()) {
+        _stats.full++;
+        return SWAP_FULL;
+    }
+
+    size_t partner = _find(claimKey(partnerTicketId, ticketId));
+    if (partner == SIZE_MAX) {
+        _insert(key, nowMs, false);
+        return SWAP_PENDING;
+    }
+    // Both halves of a match expire together, so this should not happen; never match a pair twice
+    if (_slots[partner].matched) {
+        _stats.duplicates++;
+        return SWAP_DUPLICATE;
+    }
+
+    Slot& other = _slots[partner];
+    if (match != nullptr) {
+        match->ticketId = ticketId;
+        match->partnerTicketId = partnerTicketId;
+        match->waitedMs = nowMs - other.arrivedMs;
+    }
+    // Keep both halves for another window so replays of either are recognised
+    other.matched = true;
+    other.arrivedMs = nowMs;
+    _remember(other.key, nowMs);
+    _insert(key, nowMs, true);
+    _stats.matched++;
+    return SWAP_MATCHED;
+}
+
+size_t SwapMatcher::size() const {
+    return _live;
+}
+
+SwapMatcherStats SwapMatcher::stats() const {
+    return _stats;
+}
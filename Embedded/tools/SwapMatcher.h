@@ -0,0 +1,93 @@
+#ifndef SWAP_MATCHER_H
+#define SWAP_MATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum SwapOffer : uint8_t {
+    SWAP_PENDING,       // first side of a handshake, waiting for the partner's claim
+    SWAP_MATCHED,       // the partner had already claimed; confirm both
+    SWAP_DUPLICATE,     // same pair again within the window (outbox replay, both badges' copies), ignored
+    SWAP_FULL,          // no room for another pending claim, dropped
+    SWAP_INVALID        // ticket 0 or a badge claiming itself
+};
+
+struct SwapMatch {
+    uint32_t ticketId;
+    uint32_t partnerTicketId;
+    uint32_t waitedMs;          // between the two claims
+};
+
+struct SwapMatcherStats {
+    uint32_t offered;
+    uint32_t matched;
+    uint32_t duplicates;
+    uint32_t expired;           // claims whose partner never claimed within the window
+    uint32_t full;
+    uint32_t invalid;
+};
+
+/**
+ * @brief Pairs mutual profile swap claims (A claims B, B claims A) arriving within a time window.
+ *
+ * Claims live in an open-addressing hash table keyed by (ticket, partner), with linear probing
+ * and backward-shift deletion, sized once at construction. Arrivals are monotonic, so expiry is
+ * a FIFO of insertions checked from the front: each offer() costs O(1) expected and nothing is
+ * ever scanned. A matched pair stays in the table for another window, and any claim for it in
+ * that time is a duplicate: a live resend, an outbox replay or the partner's copy all confirm
+ * once. Nonces are not consulted; two badges can only swap again once the window has passed.
+ */
+class SwapMatcher {
+private:
+    struct Slot {
+        uint64_t key;           // ticket << 32 | partner, 0 for an empty slot
+        uint32_t arrivedMs;
+        bool matched;
+    };
+
+    struct Expiry {
+        uint64_t key;
+        uint32_t arrivedMs;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _mask;
+    size_t _live = 0;
+    size_t _capacity;
+
+    std::vector<Expiry> _expiry;
+    size_t _expiryHead = 0;
+    size_t _expiryCount = 0;
+
+    uint32_t _windowMs;
+    SwapMatcherStats _stats = {};
+
+    size_t _find(uint64_t key) const;
+    void _insert(uint64_t key, uint32_t nowMs, bool matched);
+    void _erase(size_t index);
+    bool _remember(uint64_t key, uint32_t nowMs);
+
+public:
+    /**
+     * @param capacity Claims held at once, pending or recently matched; the table is twice that
+     */
+    SwapMatcher(size_t capacity, uint32_t windowMs);
+
+    /**
+     * @brief Offer one claim, live or replayed from the outbox
+     *
+     * @param match Filled in when the result is SWAP_MATCHED
+     */
+    SwapOffer offer(uint32_t ticketId, uint32_t partnerTicketId, uint32_t nowMs, SwapMatch* match);
+
+    /**
+     * @brief Drop claims older than the window; offer() does this itself, call it when idle
+     */
+    void expire(uint32_t nowMs);
+
+    size_t size() const;
+    SwapMatcherStats stats() const;
+};
+
+#endif
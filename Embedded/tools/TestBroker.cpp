@@ -0,0 +1,789 @@
+#include "TestBroker.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+enum PacketType : uint8_t {
+    CONNECT = 1,
+    CONNACK = 2,
+    PUBLISH = 3,
+    PUBACK = 4,
+    SUBSCRIBE = 8,
+    SUBACK = 9,
+    UNSUBSCRIBE = 10,
+    UNSUBACK = 11,
+    PINGREQ = 12,
+    PINGRESP = 13,
+    DISCONNECT = 14
+};
+
+// Property ids this broker reads; everything else is skipped by its type
+const uint8_t PROPERTY_SESSION_EXPIRY = 0x11;
+const uint8_t PROPERTY_RECEIVE_MAXIMUM = 0x21;
+const uint8_t PROPERTY_TOPIC_ALIAS_MAXIMUM = 0x22;
+const uint8_t PROPERTY_TOPIC_ALIAS = 0x23;
+
+const size_t MAX_PACKET_SIZE = 1 << 20;
+const size_t MAX_SESSION_QUEUE = 10000;
+const size_t MAX_TX_BACKLOG = 8 << 20;
+
+uint64_t nowMs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+uint16_t getU16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+void putU16(std::string& out, uint16_t value) {
+    out.push_back((char)(value >> 8));
+    out.push_back((char)value);
+}
+
+void putVarint(std::string& out, uint32_t value) {
+    do {
+        uint8_t digit = value & 0x7F;
+        value >>= 7;
+        out.push_back((char)(value ? digit | 0x80 : digit));
+    } while (value);
+}
+
+// Decode a variable byte integer; returns its length, or 0 if malformed or cut short
+size_t getVarint(const uint8_t* p, size_t length, uint32_t* value) {
+    *value = 0;
+    for (size_t i = 0; i < 4 && i < length; i++) {
+        *value |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+        if ((p[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// A length-prefixed UTF-8 string at p; false if it runs past end
+bool getString(const uint8_t*& p, const uint8_t* end, std::string* out) {
+    if (end - p < 2 || (size_t)(end - p) < 2u + getU16(p)) {
+        return false;
+    }
+    if (out != nullptr) {
+        out->assign((const char*)p + 2, getU16(p));
+    }
+    p += 2 + getU16(p);
+    return true;
+}
+
+struct Properties {
+    uint32_t sessionExpiry = 0;
+    uint16_t receiveMaximum = 0;
+    uint16_t topicAlias = 0;
+};
+
+// Walk a property block; returns the bytes it takes, or 0 if malformed
+size_t readProperties(const uint8_t* p, size_t length, Properties* properties) {
+    uint32_t size = 0;
+    size_t used = getVarint(p, length, &size);
+    if (used == 0 || size > length - used) {
+        return 0;
+    }
+    const uint8_t* q = p + used;
+    const uint8_t* end = q + size;
+    while (q < end) {
+        uint8_t id = *q++;
+        size_t need = 0;
+        switch (id) {
+            case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+                need = 1;
+                break;
+            case 0x13: case PROPERTY_RECEIVE_MAXIMUM: case PROPERTY_TOPIC_ALIAS_MAXIMUM: case PROPERTY_TOPIC_ALIAS:
+                need = 2;
+                if (end - q >= 2 && id == PROPERTY_RECEIVE_MAXIMUM) {
+                    properties->receiveMaximum = getU16(q);
+                } else if (end - q >= 2 && id == PROPERTY_TOPIC_ALIAS) {
+                    properties->topicAlias = getU16(q);
+                }
+                break;
+            case 0x02: case PROPERTY_SESSION_EXPIRY: case 0x18: case 0x27:
+                need = 4;
+                if (end - q >= 4 && id == PROPERTY_SESSION_EXPIRY) {
+                    properties->sessionExpiry = (uint32_t)getU16(q) << 16 | getU16(q + 2);
+                }
+                break;
+            case 0x0B: {
+                uint32_t ignored;
+                need = getVarint(q, end - q, &ignored);
+                if (need == 0) {
+                    return 0;
+                }
+                break;
+            }
+            case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+                if (!getString(q, end, nullptr)) {
+                    return 0;
+                }
+                break;
+            case 0x26:
+                if (!getString(q, end, nullptr) || !getString(q, end, nullptr)) {
+                    return 0;
+                }
+                break;
+            default:
+                return 0;
+        }
+        if ((size_t)(end - q) < need) {
+            return 0;
+        }
+        q += need;
+    }
+    return used + size;
+}
+
+void splitTopic(const std::string& topic, std::vector<std::string>& levels) {
+    levels.clear();
+    size_t start = 0;
+    for (;;) {
+        size_t slash = topic.find('/', start);
+        levels.push_back(topic.substr(start, slash == std::string::npos ? std::string::npos : slash - start));
+        if (slash == std::string::npos) {
+            return;
+        }
+        start = slash + 1;
+    }
+}
+
+}  // namespace
+
+TestBroker::~TestBroker() {
+    end();
+}
+
+bool TestBroker::begin(uint16_t port) {
+    end();
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (_listenFd < 0 || bind(_listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(_listenFd, 4096) != 0 ||
+        getsockname(_listenFd, (sockaddr*)&address, &addressLength) != 0) {
+        end();
+        return false;
+    }
+    _port = ntohs(address.sin_port);
+    fcntl(_listenFd, F_SETFL, O_NONBLOCK);
+
+    _epollFd = epoll_create1(0);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = _listenFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &event);
+    return true;
+}
+
+void TestBroker::end() {
+    while (!_connections.empty()) {
+        Connection* connection = _connections.begin()->second.get();
+        if (connection->session != nullptr) {
+            connection->session->expiryS = 0;
+        }
+        _close(connection);
+    }
+    while (!_sessions.empty()) {
+        _dropSession(_sessions.begin()->second.get());
+    }
+    if (_listenFd >= 0) {
+        close(_listenFd);
+        _listenFd = -1;
+    }
+    if (_epollFd >= 0) {
+        close(_epollFd);
+        _epollFd = -1;
+    }
+    _dirty.clear();
+}
+
+void TestBroker::poll(int timeoutMs) {
+    if (_epollFd < 0) {
+        return;
+    }
+    epoll_event events[256];
+    int ready = epoll_wait(_epollFd, events, 256, timeoutMs);
+    for (int i = 0; i < ready; i++) {
+        int fd = events[i].data.fd;
+        if (fd == _listenFd) {
+            _accept();
+            continue;
+        }
+        auto it = _connections.find(fd);
+        if (it == _connections.end()) {
+            continue;
+        }
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            _read(it->second.get());
+        } else if (events[i].events & EPOLLOUT) {
+            _markDirty(it->second.get());
+        }
+    }
+
+    // Replies and fan-out are written once per pass, so a burst goes out in few send() calls
+    std::vector<int> dirty;
+    dirty.swap(_dirty);
+    for (int fd : dirty) {
+        auto it = _connections.find(fd);
+        if (it != _connections.end()) {
+            it->second->dirty = false;
+            _flush(it->second.get());
+        }
+    }
+
+    if (nowMs() - _lastExpiryMs >= 1000) {
+        _lastExpiryMs = nowMs();
+        _expireSessions();
+    }
+}
+
+uint16_t TestBroker::port() const {
+    return _port;
+}
+
+size_t TestBroker::connections() const {
+    return _connections.size();
+}
+
+TestBrokerStats TestBroker::stats() const {
+    return _stats;
+}
+
+void TestBroker::_accept() {
+    for (;;) {
+        int fd = accept(_listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        int one = 1;
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event);
+        _connections[fd] = std::move(connection);
+    }
+}
+
+void TestBroker::_read(Connection* connection) {
+    char buffer[65536];
+    for (;;) {
+        ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            connection->rx.append(buffer, received);
+            continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            _close(connection);
+            return;
+        }
+        break;
+    }
+
+    size_t offset = 0;
+    while (connection->rx.size() - offset >= 2) {
+        const uint8_t* p = (const uint8_t*)connection->rx.data() + offset;
+        size_t available = connection->rx.size() - offset;
+        uint32_t remaining = 0;
+        size_t used = getVarint(p + 1, available - 1, &remaining);
+        if (used == 0) {
+            if (available >= 5 || remaining > MAX_PACKET_SIZE) {
+                _close(connection);
+                return;
+            }
+            break;
+        }
+        if (remaining > MAX_PACKET_SIZE) {
+            _close(connection);
+            return;
+        }
+        if (available < 1 + used + remaining) {
+            break;
+        }
+        if (!_handle(connection, p[0], p + 1 + used, remaining)) {
+            _close(connection);
+            return;
+        }
+        offset += 1 + used + remaining;
+    }
+    connection->rx.erase(0, offset);
+    _markDirty(connection);
+}
+
+void TestBroker::_markDirty(Connection* connection) {
+    if (!connection->dirty) {
+        connection->dirty = true;
+        _dirty.push_back(connection->fd);
+    }
+}
+
+// Write what the socket takes, and ask for EPOLLOUT only while something is left
+void TestBroker::_flush(Connection* connection) {
+    while (!connection->tx.empty()) {
+        ssize_t sent = send(connection->fd, connection->tx.data(), connection->tx.size(), MSG_NOSIGNAL);
+        if (sent <= 0) {
+            break;
+        }
+        connection->tx.erase(0, sent);
+    }
+    epoll_event event = {};
+    event.events = connection->tx.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+    event.data.fd = connection->fd;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+// A session with an expiry outlives the connection; its unacknowledged messages go back in line
+void TestBroker::_close(Connection* connection) {
+    Session* session = connection->session;
+    if (session != nullptr) {
+        session->connection = nullptr;
+        if (session->expiryS == 0) {
+            _dropSession(session);
+        } else {
+            session->disconnectedMs = nowMs();
+            for (auto it = session->inflight.rbegin(); it != session->inflight.rend(); ++it) {
+                it->second.duplicate = true;
+                session->pending.push_front(it->second);
+            }
+            session->inflight.clear();
+        }
+    }
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    _connections.erase(connection->fd);
+}
+
+void TestBroker::_dropSession(Session* session) {
+    for (const std::string& filter : session->filters) {
+        _unsubscribe(filter, session);
+    }
+    _sessions.erase(session->clientId);
+}
+
+void TestBroker::_expireSessions() {
+    uint64_t now = nowMs();
+    std::vector<Session*> expired;
+    for (auto& entry : _sessions) {
+        Session* session = entry.second.get();
+        if (session->connection == nullptr && session->expiryS != UINT32_MAX &&
+            now - session->disconnectedMs >= (uint64_t)session->expiryS * 1000) {
+            expired.push_back(session);
+        }
+    }
+    for (Session* session : expired) {
+        _dropSession(session);
+    }
+}
+
+bool TestBroker::_handle(Connection* connection, uint8_t header, const uint8_t* body, size_t length) {
+    uint8_t type = header >> 4;
+    if (connection->session == nullptr && type != CONNECT) {
+        return false;
+    }
+    switch (type) {
+        case CONNECT:
+            return connection->session == nullptr && _handleConnect(connection, body, length);
+        case PUBLISH:
+            return _handlePublish(connection, header, body, length);
+        case PUBACK: {
+            if (length < 2) {
+                return false;
+            }
+            connection->session->inflight.erase(getU16(body));
+            _pump(connection->session);
+            return true;
+        }
+        case SUBSCRIBE:
+            return _handleSubscribe(connection, body, length);
+        case UNSUBSCRIBE:
+            return _handleUnsubscribe(connection, body, length);
+        case PINGREQ:
+            connection->tx.push_back((char)(PINGRESP << 4));
+            connection->tx.push_back(0);
+            return true;
+        default:
+            // DISCONNECT, or anything this broker does not speak: close the connection
+            return false;
+    }
+}
+
+bool TestBroker::_handleConnect(Connection* connection, const uint8_t* body, size_t length) {
+    // Protocol name, level 5, flags, keepalive
+    if (length < 10 || getU16(body) != 4 || memcmp(body + 2, "MQTT", 4) != 0 || body[6] != 5) {
+        return false;
+    }
+    uint8_t flags = body[7];
+    const uint8_t* p = body + 10;
+    const uint8_t* end = body + length;
+
+    Properties properties;
+    size_t used = readProperties(p, end - p, &properties);
+    if (used == 0) {
+        return false;
+    }
+    p += used;
+    std::string clientId;
+    if (!getString(p, end, &clientId) || clientId.empty()) {
+        return false;
+    }
+    if (flags & 0x04) {
+        // A will is accepted but never published
+        Properties ignored;
+        used = readProperties(p, end - p, &ignored);
+        if (used == 0) {
+            return false;
+        }
+        p += used;
+        if (!getString(p, end, nullptr) || !getString(p, end, nullptr)) {
+            return false;
+        }
+    }
+
+    // A second connection with the same client id takes the session over
+    auto it = _sessions.find(clientId);
+    if (it != _sessions.end() && it->second->connection != nullptr) {
+        _close(it->second->connection);
+        it = _sessions.find(clientId);
+    }
+    bool cleanStart = (flags & 0x02) != 0;
+    if (it != _sessions.end() && cleanStart) {
+        _dropSession(it->second.get());
+        it = _sessions.end();
+    }
+    bool present = it != _sessions.end();
+    if (!present) {
+        std::unique_ptr<Session> session(new Session());
+        session->clientId = clientId;
+        it = _sessions.emplace(clientId, std::move(session)).first;
+    }
+
+    Session* session = it->second.get();
+    session->expiryS = properties.sessionExpiry;
+    session->connection = connection;
+    connection->session = session;
+    connection->receiveMaximum = properties.receiveMaximum ? properties.receiveMaximum : 65535;
+    _stats.connects++;
+
+    std::string ack;
+    ack.push_back(present ? 1 : 0);
+    ack.push_back(0);
+    std::string advertised;
+    advertised.push_back((char)PROPERTY_RECEIVE_MAXIMUM);
+    putU16(advertised, RECEIVE_MAXIMUM);
+    advertised.push_back((char)PROPERTY_TOPIC_ALIAS_MAXIMUM);
+    putU16(advertised, TOPIC_ALIAS_MAXIMUM);
+    putVarint(ack, (uint32_t)advertised.size());
+    ack += advertised;
+    connection->tx.push_back((char)(CONNACK << 4));
+    putVarint(connection->tx, (uint32_t)ack.size());
+    connection->tx += ack;
+
+    _pump(session);
+    return true;
+}
+
+bool TestBroker::_handlePublish(Connection* connection, uint8_t header, const uint8_t* body, size_t length) {
+    uint8_t qos = (header >> 1) & 0x03;
+    if (qos > 1) {
+        return false;
+    }
+    const uint8_t* p = body;
+    const uint8_t* end = body + length;
+    Message message;
+    message.qos = qos;
+    message.duplicate = false;
+    if (!getString(p, end, &message.topic)) {
+        return false;
+    }
+    uint16_t packetId = 0;
+    if (qos > 0) {
+        if (end - p < 2) {
+            return false;
+        }
+        packetId = getU16(p);
+        p += 2;
+    }
+    Properties properties;
+    size_t used = readProperties(p, end - p, &properties);
+    if (used == 0) {
+        return false;
+    }
+    p += used;
+
+    // Topic aliases from the client: a topic plus alias sets it, an empty topic uses it
+    if (properties.topicAlias != 0) {
+        if (properties.topicAlias > TOPIC_ALIAS_MAXIMUM) {
+            return false;
+        }
+        if (!message.topic.empty()) {
+            connection->aliases[properties.topicAlias] = message.topic;
+        } else {
+            auto alias = connection->aliases.find(properties.topicAlias);
+            if (alias == connection->aliases.end()) {
+                return false;
+            }
+            message.topic = alias->second;
+        }
+    } else if (message.topic.empty()) {
+        return false;
+    }
+    message.payload.assign((const char*)p, end - p);
+    _stats.messagesIn++;
+
+    if (qos == 1) {
+        connection->tx.push_back((char)(PUBACK << 4));
+        connection->tx.push_back(2);
+        putU16(connection->tx, packetId);
+    }
+    _route(connection->session, message);
+    return true;
+}
+
+bool TestBroker::_handleSubscribe(Connection* connection, const uint8_t* body, size_t length) {
+    if (length < 2) {
+        return false;
+    }
+    uint16_t packetId = getU16(body);
+    const uint8_t* p = body + 2;
+    const uint8_t* end = body + length;
+    Properties ignored;
+    size_t used = readProperties(p, end - p, &ignored);
+    if (used == 0) {
+        return false;
+    }
+    p += used;
+
+    std::string codes;
+    while (p < end) {
+        std::string filter;
+        if (!getString(p, end, &filter) || p >= end || filter.empty()) {
+            return false;
+        }
+        uint8_t options = *p++;
+        uint8_t qos = std::min<uint8_t>(options & 0x03, 1);
+        _subscribe(filter, Subscription{connection->session, qos, (options & 0x04) != 0});
+        std::vector<std::string>& filters = connection->session->filters;
+        if (std::find(filters.begin(), filters.end(), filter) == filters.end()) {
+            filters.push_back(filter);
+        }
+        codes.push_back((char)qos);
+    }
+    if (codes.empty()) {
+        return false;
+    }
+
+    std::string ack;
+    putU16(ack, packetId);
+    ack.push_back(0);
+    ack += codes;
+    connection->tx.push_back((char)(SUBACK << 4));
+    putVarint(connection->tx, (uint32_t)ack.size());
+    connection->tx += ack;
+    return true;
+}
+
+bool TestBroker::_handleUnsubscribe(Connection* connection, const uint8_t* body, size_t length) {
+    if (length < 2) {
+        return false;
+    }
+    uint16_t packetId = getU16(body);
+    const uint8_t* p = body + 2;
+    const uint8_t* end = body + length;
+    Properties ignored;
+    size_t used = readProperties(p, end - p, &ignored);
+    if (used == 0) {
+        return false;
+    }
+    p += used;
+
+    std::string codes;
+    while (p < end) {
+        std::string filter;
+        if (!getString(p, end, &filter)) {
+            return false;
+        }
+        std::vector<std::string>& filters = connection->session->filters;
+        auto it = std::find(filters.begin(), filters.end(), filter);
+        // 0x11: no subscription existed
+        codes.push_back(it == filters.end() ? 0x11 : 0);
+        if (it != filters.end()) {
+            filters.erase(it);
+            _unsubscribe(filter, connection->session);
+        }
+    }
+
+    std::string ack;
+    putU16(ack, packetId);
+    ack.push_back(0);
+    ack += codes;
+    connection->tx.push_back((char)(UNSUBACK << 4));
+    putVarint(connection->tx, (uint32_t)ack.size());
+    connection->tx += ack;
+    return true;
+}
+
+void TestBroker::_subscribe(const std::string& filter, const Subscription& subscription) {
+    std::vector<std::string> levels;
+    splitTopic(filter, levels);
+    FilterNode* node = &_filters;
+    for (const std::string& level : levels) {
+        std::unique_ptr<FilterNode>& child = node->children[level];
+        if (!child) {
+            child.reset(new FilterNode());
+        }
+        node = child.get();
+    }
+    for (Subscription& existing : node->subscriptions) {
+        if (existing.session == subscription.session) {
+            existing = subscription;
+            return;
+        }
+    }
+    node->subscriptions.push_back(subscription);
+}
+
+void TestBroker::_unsubscribe(const std::string& filter, Session* session) {
+    std::vector<std::string> levels;
+    splitTopic(filter, levels);
+    FilterNode* node = &_filters;
+    for (const std::string& level : levels) {
+        auto it = node->children.find(level);
+        if (it == node->children.end()) {
+            return;
+        }
+        node = it->second.get();
+    }
+    std::vector<Subscription>& subscriptions = node->subscriptions;
+    for (size_t i = 0; i < subscriptions.size(); i++) {
+        if (subscriptions[i].session == session) {
+            subscriptions.erase(subscriptions.begin() + i);
+            return;
+        }
+    }
+}
+
+// Filters matching levels[index..]; # also matches its parent level, neither wildcard matches $ topics
+void TestBroker::_match(FilterNode* node, const std::vector<std::string>& levels, size_t index,
+                        std::vector<Subscription*>& out) const {
+    bool system = index == 0 && !levels[0].empty() && levels[0][0] == '$';
+    auto hash = node->children.find("#");
+    if (hash != node->children.end() && !system) {
+        for (Subscription& subscription : hash->second->subscriptions) {
+            out.push_back(&subscription);
+        }
+    }
+    if (index == levels.size()) {
+        for (Subscription& subscription : node->subscriptions) {
+            out.push_back(&subscription);
+        }
+        return;
+    }
+    auto exact = node->children.find(levels[index]);
+    if (exact != node->children.end()) {
+        _match(exact->second.get(), levels, index + 1, out);
+    }
+    auto plus = node->children.find("+");
+    if (plus != node->children.end() && !system) {
+        _match(plus->second.get(), levels, index + 1, out);
+    }
+}
+
+// One copy per session, at the highest QoS any of its matching subscriptions grants
+void TestBroker::_route(Session* from, const Message& message) {
+    std::vector<std::string> levels;
+    splitTopic(message.topic, levels);
+    std::vector<Subscription*> matches;
+    _match(&_filters, levels, 0, matches);
+
+    std::unordered_map<Session*, uint8_t> targets;
+    for (Subscription* subscription : matches) {
+        if (subscription->noLocal && subscription->session == from) {
+            continue;
+        }
+        uint8_t qos = std::min(subscription->qos, message.qos);
+        auto it = targets.find(subscription->session);
+        if (it == targets.end() || it->second < qos) {
+            targets[subscription->session] = qos;
+        }
+    }
+    for (auto& target : targets) {
+        Message copy = message;
+        copy.qos = target.second;
+        _deliver(target.first, copy);
+    }
+}
+
+void TestBroker::_deliver(Session* session, const Message& message) {
+    Connection* connection = session->connection;
+    if (message.qos == 0) {
+        if (connection == nullptr || connection->tx.size() > MAX_TX_BACKLOG) {
+            _stats.dropped++;
+            return;
+        }
+        _sendPublish(connection, message, 0);
+        _markDirty(connection);
+        return;
+    }
+    if (session->pending.size() >= MAX_SESSION_QUEUE) {
+        _stats.dropped++;
+        return;
+    }
+    session->pending.push_back(message);
+    _pump(session);
+}
+
+// Send queued QoS 1 messages within the client's Receive Maximum
+void TestBroker::_pump(Session* session) {
+    Connection* connection = session->connection;
+    if (connection == nullptr) {
+        return;
+    }
+    while (!session->pending.empty() && session->inflight.size() < connection->receiveMaximum) {
+        uint16_t packetId;
+        do {
+            packetId = session->nextPacketId++;
+        } while (packetId == 0 || session->inflight.count(packetId) != 0);
+        Message& message = session->pending.front();
+        _sendPublish(connection, message, packetId);
+        session->inflight[packetId] = message;
+        session->pending.pop_front();
+    }
+    _markDirty(connection);
+}
+
+void TestBroker::_sendPublish(Connection* connection, const Message& message, uint16_t packetId) {
+    std::string body;
+    putU16(body, (uint16_t)message.topic.size());
+    body += message.topic;
+    if (message.qos > 0) {
+        putU16(body, packetId);
+    }
+    body.push_back(0);
+    body += message.payload;
+    connection->tx.push_back((char)(PUBLISH << 4 | (message.duplicate ? 0x08 : 0) | message.qos << 1));
+    putVarint(connection->tx, (uint32_t)body.size());
+    connection->tx += body;
+    _stats.messagesOut++;
+}
@@ -0,0 +1,134 @@
+#ifndef TEST_BROKER_H
+#define TEST_BROKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TestBrokerStats {
+    uint64_t connects;
+    uint64_t messagesIn;
+    uint64_t messagesOut;
+    uint64_t dropped;           // QoS 0 to an offline or backed-up subscriber, or a full session queue
+};
+
+/**
+ * @brief Single-threaded MQTT 5 broker on one epoll loop, for host tools and tests where
+ *        mosquitto is not installed.
+ *
+ * Covers what the badge and the tools use: CONNECT with session expiry and Receive
+ * Maximum, QoS 0 and 1, inbound topic aliases, + and # filters, No Local, persistent
+ * sessions with QoS 1 redelivery, PINGREQ and DISCONNECT. Not covered: QoS 2, retained
+ * messages, wills, AUTH and outbound topic aliases.
+ *
+ * Every call must come from the same thread; run poll() on a thread of its own when the
+ * clients block, e.g. ECE140_MQTT's connect task waiting for CONNACK.
+ */
+class TestBroker {
+public:
+    static const uint16_t RECEIVE_MAXIMUM = 100;
+    static const uint16_t TOPIC_ALIAS_MAXIMUM = 10;
+
+private:
+    struct Message {
+        std::string topic;
+        std::string payload;
+        uint8_t qos;
+        bool duplicate;         // resent after the subscriber reconnected
+    };
+
+    struct Connection;
+
+    struct Session {
+        std::string clientId;
+        Connection* connection = nullptr;
+        std::vector<std::string> filters;
+        std::deque<Message> pending;
+        std::map<uint16_t, Message> inflight;
+        uint16_t nextPacketId = 1;
+        uint32_t expiryS = 0;
+        uint64_t disconnectedMs = 0;
+    };
+
+    struct Subscription {
+        Session* session;
+        uint8_t qos;
+        bool noLocal;
+    };
+
+    struct FilterNode {
+        std::unordered_map<std::string, std::unique_ptr<FilterNode>> children;
+        std::vector<Subscription> subscriptions;
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string rx;
+        std::string tx;
+        Session* session = nullptr;
+        uint16_t receiveMaximum = 65535;
+        std::unordered_map<uint16_t, std::string> aliases;
+        bool dirty = false;
+    };
+
+    int _listenFd = -1;
+    int _epollFd = -1;
+    uint16_t _port = 0;
+    FilterNode _filters;
+    std::unordered_map<std::string, std::unique_ptr<Session>> _sessions;
+    std::unordered_map<int, std::unique_ptr<Connection>> _connections;
+    std::vector<int> _dirty;        // connections with bytes to send after this pass
+    uint64_t _lastExpiryMs = 0;
+    TestBrokerStats _stats = {};
+
+    void _accept();
+    void _read(Connection* connection);
+    void _flush(Connection* connection);
+    void _close(Connection* connection);
+    void _markDirty(Connection* connection);
+    bool _handle(Connection* connection, uint8_t header, const uint8_t* body, size_t length);
+    bool _handleConnect(Connection* connection, const uint8_t* body, size_t length);
+    bool _handlePublish(Connection* connection, uint8_t header, const uint8_t* body, size_t length);
+    bool _handleSubscribe(Connection* connection, const uint8_t* body, size_t length);
+    bool _handleUnsubscribe(Connection* connection, const uint8_t* body, size_t length);
+    void _route(Session* from, const Message& message);
+    void _deliver(Session* session, const Message& message);
+    void _pump(Session* session);
+    void _sendPublish(Connection* connection, const Message& message, uint16_t packetId);
+    void _subscribe(const std::string& filter, const Subscription& subscription);
+    void _unsubscribe(const std::string& filter, Session* session);
+    void _match(FilterNode* node, const std::vector<std::string>& levels, size_t index,
+                std::vector<Subscription*>& out) const;
+    void _dropSession(Session* session);
+    void _expireSessions();
+
+public:
+    ~TestBroker();
+
+    /**
+     * @brief Listen on 127.0.0.1:port; port 0 picks a free one, see port()
+     */
+    bool begin(uint16_t port);
+
+    /**
+     * @brief Serve every ready socket, waiting at most timeoutMs for one
+     */
+    void poll(int timeoutMs);
+
+    /**
+     * @brief Close every connection and forget every session, like a broker restart
+     *        without persistence; begin() again to accept clients
+     */
+    void end();
+
+    uint16_t port() const;
+    size_t connections() const;
+    TestBrokerStats stats() const;
+};
+
+#endif
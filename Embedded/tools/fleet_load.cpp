@@ -0,0 +1,597 @@
+/**
+ * Fleet load generator: thousands of virtual badges against a local broker.
+ *
+ * Every badge is an Mqtt5Client on its own socket, speaking ECE140_MQTT's topics and
+ * payloads through the firmware's BadgePublisher, so payloads, receipt batching and the
+ * drain pacing (MQTT_DRAIN_BURST per MQTT_DRAIN_INTERVAL_MS) are the badge's own. It
+ * connects with a persistent session, subscribes to device/<mac>/# and
+ * event/<id>/reboot, announces itself on event/<id>/available_devices/<mac>, moves to
+ * event/<id>/profile_swap/<ticket> once assigned, and then shakes hands with random other
+ * badges. Both sides of a handshake publish their claim to event/<id>/profile_swap, a
+ * skew apart, with the receipts main.cpp sends around it.
+ *
+ * A built-in backend stand-in assigns tickets from availability, turns on JSON receipt
+ * batching as a current backend would, and, unless --external-matcher is given (see
+ * tools/swap_matcher.cpp), confirms mutual claims.
+ *
+ * Reported: broker throughput as seen by the clients, inbound messages per badge, and
+ * the latency from a badge's claim to its confirmation, when the real badge buzzes.
+ *
+ *   mosquitto -p 1883 &      (or .pio/build/native_test_broker/program --port 1883 &)
+ *   pio run -e native_fleet_load && .pio/build/native_fleet_load/program --badges 2000 --duration 60
+ *
+ * Options:
+ *   --host H --port P         broker (default 127.0.0.1:1883)
+ *   --event E                 event id (default E_01)
+ *   --badges N                virtual badges (default 1000)
+ *   --connect-rate R          new connections per second while ramping up (default 500)
+ *   --handshake-interval S    mean seconds between handshakes per badge (default 30)
+ *   --skew-ms M               largest gap between the two claims of one handshake (default 200)
+ *   --duration S              measured seconds after every badge is assigned (default 30)
+ *   --binary                  BadgeMessage payloads instead of JSON
+ *   --no-receipt-batch        leave JSON receipt batching off, as before the backend negotiates it
+ *   --external-matcher        leave swap confirmations to a separate matching service
+ *   --event-wide              subscribe to event/<id>/# as the firmware used to, to compare fan-out
+ *   --seed N                  random seed (default 1)
+ */
+#include "BadgeAdvertisement.h"
+#include "BadgeMessage.h"
+#include "BadgePublisher.h"
+#include "JsonWriter.h"
+#include "Mqtt5Client.h"
+#include "PosixTransport.h"
+#include "SwapClaim.h"
+#include "TopicRouter.h"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+// The firmware's defaults, see ECE140_MQTT.h
+static const uint16_t KEEPALIVE_S = 15;
+static const uint32_t SESSION_EXPIRY_S = 3600;
+static const uint8_t BADGE_QOS = 1;
+static const uint64_t CONFIRM_TIMEOUT_US = 10000000;
+static const uint32_t BACKEND_ID = 0xFFFFFFFF;
+
+struct Options {
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    const char* eventId = "E_01";
+    uint32_t badges = 1000;
+    uint32_t connectRate = 500;
+    double handshakeIntervalS = 30;
+    uint32_t skewMs = 200;
+    uint32_t durationS = 30;
+    bool binary = false;
+    bool receiptBatch = true;
+    bool externalMatcher = false;
+    bool eventWide = false;
+    uint32_t seed = 1;
+};
+
+struct Outgoing {
+    std::string topic;
+    std::string payload;
+};
+
+struct Badge {
+    Mqtt5Client client;
+    PosixTransport transport;
+    TopicRouter router;
+    BadgePublisher outbox;
+    uint32_t index = 0;
+    char mac[18] = {0};
+    char ticket[16] = {0};
+    Mqtt5State state = MQTT5_DISCONNECTED;
+    bool assigned = false;
+    bool busy = false;              // in a handshake, waiting to claim or for the confirmation
+    bool dirty = false;             // queued on the service list
+    uint64_t connectStartUs = 0;
+    uint64_t availableUs = 0;
+    uint64_t claimUs = 0;           // our claim, waiting for its confirmation
+    uint64_t pairedUs = 0;          // the later claim of our current handshake
+    uint32_t inbound = 0;
+    uint32_t lastDrainMs = 0;
+};
+
+// One side of a handshake, due at a given time
+struct Claim {
+    uint64_t dueUs;
+    uint32_t badge;
+    uint32_t partner;
+    bool operator>(const Claim& other) const { return dueUs > other.dueUs; }
+};
+
+struct Counters {
+    uint64_t published = 0;
+    uint64_t delivered = 0;
+    uint64_t queueFull = 0;         // badge publishes its outbound queue refused
+    uint64_t badgePublished = 0;
+    uint64_t badgeDelivered = 0;
+    uint64_t unexpected = 0;
+    uint64_t claims = 0;
+    uint64_t confirmed = 0;
+    uint64_t missed = 0;
+    uint64_t disconnects = 0;
+};
+
+static Options opt;
+static std::vector<std::unique_ptr<Badge>> badges;
+static Badge* current = nullptr;
+static Counters counters;
+static std::vector<uint32_t> connectUs;
+static std::vector<uint32_t> assignUs;
+static std::vector<uint32_t> swapUs;
+static std::vector<uint32_t> matchUs;
+static std::vector<uint32_t> serviceList;
+static volatile bool stopping = false;
+
+static Mqtt5Client backend;
+static PosixTransport backendSocket;
+static std::deque<Outgoing> backendBacklog;
+static std::unordered_map<uint64_t, uint64_t> openClaims;  // (ticket << 32 | partner) -> arrival
+static uint32_t nextTicket = 1;
+static char eventPrefix[TopicRouter::PREFIX_SIZE];
+
+static void markDirty(Badge& badge) {
+    if (!badge.dirty) {
+        badge.dirty = true;
+        serviceList.push_back(badge.index);
+    }
+}
+
+static void queued(Badge& badge, bool accepted) {
+    if (!accepted) {
+        counters.queueFull++;
+    }
+    markDirty(badge);
+}
+
+static void publishReceipt(Badge& badge, const char* command, const char* status) {
+    queued(badge, badge.outbox.receipt(command, status));
+}
+
+static void subscribe(Badge& badge, const char* a, const char* b) {
+    char filter[MQTT5_TOPIC_SIZE];
+    if (joinTopic(filter, sizeof(filter), {a, b})) {
+        badge.client.subscribe(filter, BADGE_QOS);
+    }
+}
+
+// What ECE140_MQTT::_onConnected() and setup() do once the broker accepts us
+static void onBadgeConnected(Badge& badge, uint64_t nowUs) {
+    connectUs.push_back((uint32_t)(nowUs - badge.connectStartUs));
+    subscribe(badge, badge.router.devicePrefix(), "#");
+    subscribe(badge, badge.router.eventPrefix(), opt.eventWide ? "#" : "reboot");
+    queued(badge, badge.outbox.availability(opt.eventId, badge.mac));
+    publishReceipt(badge, "connect", "success");
+    badge.availableUs = nowUs;
+}
+
+// The badge side of ECE140_MQTT::handleMessage() plus what main.cpp does with each command
+static void onBadgeMessage(char* topic, uint8_t* payload, unsigned int length) {
+    Badge& badge = *current;
+    uint64_t nowUs = hostMicros();
+    counters.delivered++;
+    counters.badgeDelivered++;
+    badge.inbound++;
+
+    const char* tail = nullptr;
+    size_t tailLength = 0;
+    TopicRoute route = badge.router.route(topic, &tail, &tailLength);
+    switch (route) {
+        case ROUTE_ASSIGNMENT:
+        case ROUTE_REASSIGNMENT: {
+            size_t copy = std::min<size_t>(length, sizeof(badge.ticket) - 1);
+            memcpy(badge.ticket, payload, copy);
+            badge.ticket[copy] = '\0';
+            if (!badge.assigned) {
+                assignUs.push_back((uint32_t)(nowUs - badge.availableUs));
+            }
+            badge.assigned = true;
+            char filter[MQTT5_TOPIC_SIZE];
+            if (!opt.eventWide && joinTopic(filter, sizeof(filter), {badge.router.eventPrefix(), "profile_swap/", badge.ticket})) {
+                badge.client.subscribe(filter, BADGE_QOS);
+            }
+            publishReceipt(badge, "assign device", "success");
+            publishReceipt(badge, "write NFC", "success");
+            break;
+        }
+        case ROUTE_PROFILE_SWAP:
+            if (tailLength != strlen(badge.ticket) || memcmp(tail, badge.ticket, tailLength) != 0) {
+                counters.unexpected++;
+                break;
+            }
+            if (badge.claimUs != 0) {
+                swapUs.push_back((uint32_t)(nowUs - badge.claimUs));
+                matchUs.push_back((uint32_t)(nowUs - badge.pairedUs));
+                counters.confirmed++;
+                badge.claimUs = 0;
+                badge.busy = false;
+            }
+            publishReceipt(badge, "Haptic feedback", "success");
+            break;
+        case ROUTE_ENCODING:
+        case ROUTE_RECEIPT_BATCH:
+            queued(badge, badge.outbox.negotiate(route, payload, length));
+            break;
+        case ROUTE_NONE:
+            counters.unexpected++;
+            break;
+        default:
+            break;
+    }
+}
+
+// Write backlog, read and dispatch; reconnects are out of scope, a dropped badge is counted and left
+static void service(Badge& badge) {
+    badge.dirty = false;
+    if (badge.state == MQTT5_DISCONNECTED) {
+        return;
+    }
+    current = &badge;
+    uint64_t nowUs = hostMicros();
+    bool alive = badge.client.poll((uint32_t)(nowUs / 1000));
+    Mqtt5State state = badge.client.state();
+    if (badge.state == MQTT5_CONNECTING && state == MQTT5_CONNECTED) {
+        badge.state = state;
+        onBadgeConnected(badge, nowUs);
+    }
+    badge.state = state;
+    if (!alive) {
+        counters.disconnects++;
+        fprintf(stderr, "%s: disconnected, reason 0x%02X\n", badge.mac, badge.client.reason());
+        return;
+    }
+    // Paced like ECE140_MQTT::loop(): one drain of burst() publishes per intervalMs()
+    uint32_t nowMs = (uint32_t)(nowUs / 1000);
+    if (badge.outbox.size() > 0 && badge.state == MQTT5_CONNECTED && nowMs - badge.lastDrainMs >= badge.outbox.intervalMs()) {
+        badge.lastDrainMs = nowMs;
+        uint32_t before = badge.client.stats().publishesOut;
+        badge.outbox.drain(badge.client, badge.router, badge.mac, badge.outbox.burst(), BADGE_QOS);
+        uint32_t sent = badge.client.stats().publishesOut - before;
+        counters.published += sent;
+        counters.badgePublished += sent;
+    }
+    if (badge.client.pendingBytes() > 0) {
+        badge.client.poll(hostMillis());
+    }
+    if (badge.outbox.size() > 0 || badge.client.pendingBytes() > 0 || badge.client.bufferedBytes() > 0) {
+        markDirty(badge);
+    }
+}
+
+static void backendPublish(const char* topic, const char* payload) {
+    backendBacklog.push_back(Outgoing{topic, payload});
+}
+
+// Stand-in for the real backend: tickets in order of availability, confirmations for mutual claims
+static void onBackendMessage(char* topic, uint8_t* payload, unsigned int length) {
+    counters.delivered++;
+    char fullTopic[MQTT5_TOPIC_SIZE];
+    size_t prefixLength = strlen(eventPrefix);
+
+    if (strncmp(topic, eventPrefix, prefixLength) == 0 && strncmp(topic + prefixLength, "available_devices/", 18) == 0) {
+        const char* mac = topic + prefixLength + 18;
+        char ticket[16];
+        formatTicketId(nextTicket++, ticket, sizeof(ticket));
+        if (joinTopic(fullTopic, sizeof(fullTopic), {"device/", mac, "/assignment"})) {
+            backendPublish(fullTopic, ticket);
+        }
+        if (opt.receiptBatch && joinTopic(fullTopic, sizeof(fullTopic), {"device/", mac, "/receipt_batch"})) {
+            backendPublish(fullTopic, "on");
+        }
+        return;
+    }
+
+    SwapClaim claim;
+    if (!parseSwapClaim(payload, length, claim)) {
+        return;
+    }
+    uint64_t key = (uint64_t)claim.ticketId << 32 | claim.partnerTicketId;
+    uint64_t mirror = (uint64_t)claim.partnerTicketId << 32 | claim.ticketId;
+    auto match = openClaims.find(mirror);
+    if (match == openClaims.end()) {
+        openClaims[key] = hostMicros();
+        return;
+    }
+    openClaims.erase(match);
+    // Tickets as the badges wrote them; fleet_load assigns them, so both spell them alike
+    if (joinTopic(fullTopic, sizeof(fullTopic), {eventPrefix, "profile_swap/", claim.ticket})) {
+        backendPublish(fullTopic, claim.partnerTicket);
+    }
+    if (joinTopic(fullTopic, sizeof(fullTopic), {eventPrefix, "profile_swap/", claim.partnerTicket})) {
+        backendPublish(fullTopic, claim.ticket);
+    }
+}
+
+// QoS 0 out, so the stand-in's own small in-flight window is not what gets measured.
+// Polls until nothing is left, since each poll() only handles a few packets.
+static bool serviceBackend() {
+    for (int round = 0; round < 256; round++) {
+        if (!backend.poll(hostMillis())) {
+            fprintf(stderr, "backend: disconnected, reason 0x%02X\n", backend.reason());
+            return false;
+        }
+        while (!backendBacklog.empty()) {
+            const Outgoing& next = backendBacklog.front();
+            if (!backend.publish(next.topic.c_str(), (const uint8_t*)next.payload.data(), next.payload.size(), 0)) {
+                break;
+            }
+            counters.published++;
+            backendBacklog.pop_front();
+        }
+        if (backendBacklog.empty() && backend.pendingBytes() == 0 && backend.bufferedBytes() == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+static bool startBackend(int epollFd) {
+    if (!backendSocket.connect(opt.host, opt.port)) {
+        fprintf(stderr, "backend: cannot reach %s:%u\n", opt.host, opt.port);
+        return false;
+    }
+    backend.setTransport(&backendSocket);
+    backend.setCallback(onBackendMessage);
+    Mqtt5ConnectOptions options = {"fleet-backend", nullptr, nullptr, KEEPALIVE_S, 0, true};
+    backend.begin(options, hostMillis());
+    while (backend.state() == MQTT5_CONNECTING && backend.poll(hostMillis())) {
+    }
+    if (!backend.connected()) {
+        fprintf(stderr, "backend: connect failed, reason 0x%02X\n", backend.reason());
+        return false;
+    }
+    char filter[MQTT5_TOPIC_SIZE];
+    joinTopic(filter, sizeof(filter), {eventPrefix, "available_devices/+"});
+    backend.subscribe(filter, 1);
+    if (!opt.externalMatcher) {
+        joinTopic(filter, sizeof(filter), {eventPrefix, "profile_swap"});
+        backend.subscribe(filter, 1);
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = BACKEND_ID;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, backendSocket.fd(), &event);
+    return true;
+}
+
+static bool startBadge(Badge& badge, int epollFd) {
+    badge.connectStartUs = hostMicros();
+    if (!badge.transport.connect(opt.host, opt.port)) {
+        return false;
+    }
+    badge.client.setTransport(&badge.transport);
+    badge.client.setCallback(onBadgeMessage);
+    Mqtt5ConnectOptions options = {badge.mac, "badge", "badge", KEEPALIVE_S, SESSION_EXPIRY_S, true};
+    if (!badge.client.begin(options, hostMillis())) {
+        return false;
+    }
+    badge.state = MQTT5_CONNECTING;
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = badge.index;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, badge.transport.fd(), &event);
+    markDirty(badge);
+    return true;
+}
+
+static uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+static void printPercentiles(const char* label, std::vector<uint32_t>& values, double scale, const char* unit) {
+    std::sort(values.begin(), values.end());
+    printf("%-13s n %zu  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f %s\n", label, values.size(), percentile(values, 0.50) / scale,
+           percentile(values, 0.90) / scale, percentile(values, 0.99) / scale, values.empty() ? 0.0 : values.back() / scale, unit);
+}
+
+static void onSignal(int) {
+    stopping = true;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--binary")) opt.binary = true;
+        else if (!strcmp(argv[i], "--no-receipt-batch")) opt.receiptBatch = false;
+        else if (!strcmp(argv[i], "--external-matcher")) opt.externalMatcher = true;
+        else if (!strcmp(argv[i], "--event-wide")) opt.eventWide = true;
+        else if (!hasValue) break;
+        else if (!strcmp(argv[i], "--host")) opt.host = argv[++i];
+        else if (!strcmp(argv[i], "--port")) opt.port = (uint16_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--event")) opt.eventId = argv[++i];
+        else if (!strcmp(argv[i], "--badges")) opt.badges = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--connect-rate")) opt.connectRate = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--handshake-interval")) opt.handshakeIntervalS = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--skew-ms")) opt.skewMs = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--duration")) opt.durationS = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed")) opt.seed = (uint32_t)atoi(argv[++i]);
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    snprintf(eventPrefix, sizeof(eventPrefix), "event/%s/", opt.eventId);
+
+    int epollFd = epoll_create1(0);
+    if (!startBackend(epollFd)) {
+        return 1;
+    }
+
+    badges.reserve(opt.badges);
+    for (uint32_t i = 0; i < opt.badges; i++) {
+        std::unique_ptr<Badge> badge(new Badge());
+        badge->index = i;
+        snprintf(badge->mac, sizeof(badge->mac), "F0:00:%02X:%02X:%02X:%02X", (i >> 24) & 0xFF, (i >> 16) & 0xFF,
+                 (i >> 8) & 0xFF, i & 0xFF);
+        badge->router.begin(badge->mac, opt.eventId);
+        badge->outbox.setBinary(opt.binary);
+        badges.push_back(std::move(badge));
+    }
+
+    std::mt19937 random(opt.seed);
+    std::priority_queue<Claim, std::vector<Claim>, std::greater<Claim>> claims;
+    std::vector<epoll_event> events(1024);
+
+    uint64_t startUs = hostMicros();
+    uint64_t measureStartUs = 0;
+    uint64_t measureEndUs = 0;
+    uint64_t nextHandshakeUs = 0;
+    uint64_t lastSweepUs = startUs;
+    uint32_t started = 0;
+    uint32_t failedConnects = 0;
+    Counters atMeasureStart;
+    Mqtt5Stats bytesAtStart = {};
+    std::exponential_distribution<double> handshakeGap(opt.badges / std::max(0.001, opt.handshakeIntervalS));
+    std::uniform_int_distribution<uint32_t> pick(0, opt.badges ? opt.badges - 1 : 0);
+
+    while (!stopping) {
+        uint64_t nowUs = hostMicros();
+
+        // Ramp up at the connect rate
+        while (started < opt.badges && (nowUs - startUs) * opt.connectRate >= (uint64_t)started * 1000000) {
+            if (!startBadge(*badges[started], epollFd)) {
+                failedConnects++;
+            }
+            started++;
+        }
+
+        int ready = epoll_wait(epollFd, events.data(), (int)events.size(), serviceList.empty() ? 1 : 0);
+        for (int i = 0; i < ready; i++) {
+            uint32_t id = events[i].data.u32;
+            if (id == BACKEND_ID) {
+                continue;
+            }
+            markDirty(*badges[id]);
+        }
+        if (!serviceBackend()) {
+            break;
+        }
+        std::vector<uint32_t> pending;
+        pending.swap(serviceList);
+        for (uint32_t id : pending) {
+            service(*badges[id]);
+        }
+        serviceBackend();
+        nowUs = hostMicros();
+
+        if (measureStartUs == 0) {
+            uint32_t assigned = 0;
+            for (auto& badge : badges) {
+                assigned += badge->assigned ? 1 : 0;
+            }
+            bool rampDone = started == opt.badges && assigned + failedConnects + counters.disconnects >= opt.badges;
+            if (rampDone || nowUs - startUs > 120000000ull) {
+                measureStartUs = nowUs;
+                measureEndUs = nowUs + (uint64_t)opt.durationS * 1000000;
+                nextHandshakeUs = nowUs;
+                atMeasureStart = counters;
+                for (auto& badge : badges) {
+                    badge->inbound = 0;
+                    Mqtt5Stats stats = badge->client.stats();
+                    bytesAtStart.bytesIn += stats.bytesIn;
+                    bytesAtStart.bytesOut += stats.bytesOut;
+                }
+                printf("ramp         %u of %u badges assigned in %.1f s, %u failed to connect, %llu dropped\n", assigned, opt.badges,
+                       (nowUs - startUs) / 1e6, failedConnects, (unsigned long long)counters.disconnects);
+                fflush(stdout);
+            }
+        } else if (nowUs < measureEndUs) {
+            // Start handshakes between random idle assigned badges at the fleet-wide rate
+            while (nextHandshakeUs <= nowUs) {
+                nextHandshakeUs += (uint64_t)(handshakeGap(random) * 1e6) + 1;
+                for (int attempt = 0; attempt < 8; attempt++) {
+                    Badge& a = *badges[pick(random)];
+                    Badge& b = *badges[pick(random)];
+                    if (&a == &b || a.busy || b.busy || !a.assigned || !b.assigned || a.state != MQTT5_CONNECTED ||
+                        b.state != MQTT5_CONNECTED) {
+                        continue;
+                    }
+                    a.busy = true;
+                    b.busy = true;
+                    uint64_t skewUs = opt.skewMs ? (uint64_t)(random() % (opt.skewMs * 1000)) : 0;
+                    bool aFirst = random() & 1;
+                    claims.push(Claim{nowUs + (aFirst ? 0 : skewUs), a.index, b.index});
+                    claims.push(Claim{nowUs + (aFirst ? skewUs : 0), b.index, a.index});
+                    break;
+                }
+            }
+        } else if (claims.empty() && (nowUs > measureEndUs + CONFIRM_TIMEOUT_US || counters.confirmed == counters.claims)) {
+            break;
+        }
+
+        // Claims that are due: handshake receipt, the claim itself, then the exchange receipt, as main.cpp sends them
+        while (!claims.empty() && claims.top().dueUs <= nowUs) {
+            Claim claim = claims.top();
+            claims.pop();
+            Badge& badge = *badges[claim.badge];
+            if (badge.state != MQTT5_CONNECTED) {
+                badge.busy = false;
+                continue;
+            }
+            publishReceipt(badge, "handshake", "success");
+            queued(badge, badge.outbox.profileSwap(opt.eventId, badge.ticket, badges[claim.partner]->ticket));
+            publishReceipt(badge, "profile exchange", "success");
+            badge.claimUs = nowUs;
+            badge.pairedUs = nowUs;
+            badges[claim.partner]->pairedUs = nowUs;
+            counters.claims++;
+        }
+
+        // Keepalives, stuck writes and lost confirmations once a second
+        if (nowUs - lastSweepUs >= 1000000) {
+            lastSweepUs = nowUs;
+            for (auto& badge : badges) {
+                if (badge->claimUs != 0 && nowUs - badge->claimUs > CONFIRM_TIMEOUT_US) {
+                    badge->claimUs = 0;
+                    badge->busy = false;
+                    counters.missed++;
+                }
+                markDirty(*badge);
+            }
+        }
+    }
+
+    double seconds = (hostMicros() - measureStartUs) / 1e6;
+    Mqtt5Stats bytes = {};
+    std::vector<uint32_t> inboundRate;
+    for (auto& badge : badges) {
+        Mqtt5Stats stats = badge->client.stats();
+        bytes.bytesIn += stats.bytesIn;
+        bytes.bytesOut += stats.bytesOut;
+        inboundRate.push_back((uint32_t)(badge->inbound * 1000 / seconds));   // milli-messages per second
+        badge->client.disconnect();
+    }
+    backend.disconnect();
+
+    uint64_t published = counters.published - atMeasureStart.published;
+    uint64_t delivered = counters.delivered - atMeasureStart.delivered;
+    printf("measured     %.1f s, %u badges, %s payloads, matcher %s\n", seconds, opt.badges, opt.binary ? "binary" : "JSON",
+           opt.externalMatcher ? "external" : "built-in");
+    printf("broker       %.0f msg/s published, %.0f msg/s delivered (badges %.0f out, %.0f in)\n", published / seconds,
+           delivered / seconds, (counters.badgePublished - atMeasureStart.badgePublished) / seconds,
+           (counters.badgeDelivered - atMeasureStart.badgeDelivered) / seconds);
+    printf("badge bytes  %.1f KB/s out, %.1f KB/s in across the fleet\n", (bytes.bytesOut - bytesAtStart.bytesOut) / 1024.0 / seconds,
+           (bytes.bytesIn - bytesAtStart.bytesIn) / 1024.0 / seconds);
+    printPercentiles("inbound/badge", inboundRate, 1000.0, "msg/s");
+    printf("unexpected   %llu messages delivered to a badge that does not act on them\n", (unsigned long long)counters.unexpected);
+    printf("queue full   %llu badge publishes refused by the outbound queue\n",
+           (unsigned long long)(counters.queueFull - atMeasureStart.queueFull));
+    printf("handshakes   %llu claims, %llu confirmed, %llu missed, %llu disconnects\n", (unsigned long long)counters.claims,
+           (unsigned long long)counters.confirmed, (unsigned long long)counters.missed, (unsigned long long)counters.disconnects);
+    printPercentiles("connect", connectUs, 1000.0, "ms");
+    printPercentiles("assignment", assignUs, 1000.0, "ms");
+    printPercentiles("swap->haptic", swapUs, 1000.0, "ms");
+    printPercentiles(" after pair", matchUs, 1000.0, "ms");
+    return counters.missed == 0 && counters.disconnects == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/**
+ * Throughput and latency of Mqtt5Client against a local broker.
+ *
+ * Two clients share one loop like the badge's: a publisher sending on the
+ * badge's availability topic and a subscriber receiving it. Each payload
+ * carries its send time, so the subscriber measures publish-to-delivery latency.
+ *
+ *   mosquitto -p 1883 &      (or .pio/build/native_test_broker/program --port 1883 &)
+ *   pio run -e native_mqtt_bench && .pio/build/native_mqtt_bench/program --count 20000 --qos 1
+ *
+ * Options:
+ *   --host H --port P   broker (default 127.0.0.1:1883)
+ *   --count N           messages to publish (default 10000)
+ *   --qos Q             0 or 1 (default 1)
+ *   --size B            payload bytes, at least 8 (default 48, a JSON receipt)
+ *   --rate R            messages per second, 0 for as fast as flow control allows (default 0)
+ */
+#include "Mqtt5Client.h"
+#include "PosixTransport.h"
+#include <algorithm>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const char* TOPIC = "event/E_01/available_devices/AA:BB:CC:DD:EE:FF";
+
+static std::vector<uint32_t> latenciesUs;
+static uint32_t received = 0;
+
+static void onMessage(char*, uint8_t* payload, unsigned int length) {
+    if (length >= 8) {
+        uint64_t sentUs;
+        memcpy(&sentUs, payload, sizeof(sentUs));
+        latenciesUs.push_back((uint32_t)(hostMicros() - sentUs));
+    }
+    received++;
+}
+
+static bool open(Mqtt5Client& client, PosixTransport& transport, const char* host, uint16_t port, const char* clientId,
+                 uint32_t* connectUs) {
+    uint64_t startUs = hostMicros();
+    if (!transport.connect(host, port)) {
+        fprintf(stderr, "%s: cannot reach %s:%u\n", clientId, host, port);
+        return false;
+    }
+    client.setTransport(&transport);
+    Mqtt5ConnectOptions options = {clientId, nullptr, nullptr, 30, 0, true};
+    client.begin(options, hostMillis());
+    while (client.state() == MQTT5_CONNECTING && client.poll(hostMillis())) {
+    }
+    if (!client.connected()) {
+        fprintf(stderr, "%s: connect failed, reason 0x%02X\n", clientId, client.reason());
+        return false;
+    }
+    *connectUs = (uint32_t)(hostMicros() - startUs);
+    return true;
+}
+
+static uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+int main(int argc, char** argv) {
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    uint32_t count = 10000;
+    uint8_t qos = 1;
+    size_t size = 48;
+    uint32_t rate = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--host")) host = argv[i + 1];
+        else if (!strcmp(argv[i], "--port")) port = (uint16_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--count")) count = (uint32_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--qos")) qos = (uint8_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--size")) size = (size_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--rate")) rate = (uint32_t)atoi(argv[i + 1]);
+    }
+    size = std::max<size_t>(8, std::min<size_t>(size, MQTT5_INFLIGHT_PAYLOAD));
+
+    static Mqtt5Client publisher;
+    static Mqtt5Client subscriber;
+    PosixTransport publisherSocket;
+    PosixTransport subscriberSocket;
+    uint32_t publisherConnectUs = 0;
+    uint32_t subscriberConnectUs = 0;
+
+    subscriber.setCallback(onMessage);
+    if (!open(subscriber, subscriberSocket, host, port, "bench-sub", &subscriberConnectUs) ||
+        !open(publisher, publisherSocket, host, port, "bench-pub", &publisherConnectUs)) {
+        return 1;
+    }
+    subscriber.subscribe(TOPIC, qos);
+    // Let the SUBACK land before publishing
+    for (uint32_t untilMs = hostMillis() + 200; hostMillis() < untilMs;) {
+        subscriber.poll(hostMillis());
+        publisher.poll(hostMillis());
+    }
+
+    latenciesUs.reserve(count);
+    std::vector<uint8_t> payload(size, 'x');
+    uint32_t sent = 0;
+    uint32_t refused = 0;
+    uint64_t longestPollUs = 0;
+    uint64_t startUs = hostMicros();
+    uint64_t deadlineUs = startUs + 30000000ull + (rate ? (uint64_t)count * 1000000 / rate : 0);
+
+    while ((sent < count || received < sent) && hostMicros() < deadlineUs) {
+        bool due = rate == 0 || (hostMicros() - startUs) * rate >= (uint64_t)sent * 1000000;
+        if (sent < count && due) {
+            uint64_t nowUs = hostMicros();
+            memcpy(payload.data(), &nowUs, sizeof(nowUs));
+            if (publisher.publish(TOPIC, payload.data(), payload.size(), qos)) {
+                sent++;
+            } else {
+                refused++;
+            }
+        }
+        uint64_t pollStartUs = hostMicros();
+        if (!publisher.poll(hostMillis()) || !subscriber.poll(hostMillis())) {
+            fprintf(stderr, "connection lost, reasons 0x%02X / 0x%02X\n", publisher.reason(), subscriber.reason());
+            break;
+        }
+        longestPollUs = std::max(longestPollUs, hostMicros() - pollStartUs);
+        // Give a broker on the same core a chance to run
+        sched_yield();
+    }
+    double seconds = (hostMicros() - startUs) / 1e6;
+
+    Mqtt5Stats stats = publisher.stats();
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    printf("connect      %u us (pub), %u us (sub)\n", publisherConnectUs, subscriberConnectUs);
+    printf("published    %u at QoS %u, %zu B payload, received %u (%.1f%%), %u refused by flow control\n",
+           sent, qos, size, received, sent ? 100.0 * received / sent : 0.0, refused);
+    printf("throughput   %.0f msg/s, %.1f KB/s on the wire out\n", received / seconds, stats.bytesOut / 1024.0 / seconds);
+    printf("latency us   p50 %u  p90 %u  p99 %u  max %u\n", percentile(latenciesUs, 0.50), percentile(latenciesUs, 0.90),
+           percentile(latenciesUs, 0.99), latenciesUs.empty() ? 0 : latenciesUs.back());
+    printf("topic alias  %u of %u publishes aliased, %u B saved (%.1f B/msg on a %zu B topic)\n", stats.aliasedPublishes,
+           stats.publishesOut, stats.aliasBytesSaved, stats.publishesOut ? (double)stats.aliasBytesSaved / stats.publishesOut : 0.0,
+           strlen(TOPIC));
+    printf("loop         longest poll() %llu us\n", (unsigned long long)longestPollUs);
+
+    publisher.disconnect();
+    subscriber.disconnect();
+    return received == sent && sent == count ? 0 : 1;
+}
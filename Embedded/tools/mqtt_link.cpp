@@ -0,0 +1,386 @@
+/**
+ * ECE140_MQTT on the host, through the stubs in tools/stubs, against an in-process
+ * TestBroker and a scripted backend. Walks the link through the cases the badge meets
+ * in a hall and checks each one:
+ *
+ *   assign    availability -> assignment, its latency in the health report; tickets that are not
+ *             T_xxxxxx refused with a receipt; receipt batching negotiated, 10 receipts batched
+ *   swap      the badge's claim and its partner's are matched by SwapConfirmer, as in
+ *             tools/swap_matcher.cpp, and the confirmation arrives as a command; after a
+ *             reassignment the swap topic follows the ticket and other badges' announcements
+ *             and claims never reach the badge
+ *   outage    WiFi drops, 12 handshakes queue offline, the session resumes with a message
+ *             the backend sent meanwhile and everything queued is delivered
+ *   restart   the broker restarts without persistence; the badge reconnects with backoff
+ *             and replays its subscriptions
+ *   backoff   the broker is down for 7.5 s; each retry waits within its jittered doubling
+ *             window (0.5-1 s, 1-2 s, 2-4 s, ...) and the badge is back soon after
+ *
+ *   pio run -e native_mqtt_link && .pio/build/native_mqtt_link/program
+ *
+ * Options:
+ *   --verbose           keep ECE140_MQTT's Serial log
+ *   --connect-times N   instead of the cases, reconnect N times into a resumed persistent
+ *                       session (WiFi blip) and N times into a lost one (broker restart), and
+ *                       report getLastConnectTime() and the time until the badge is subscribed
+ *                       again, as percentiles; no TLS here, so this is TCP plus CONNACK
+ *
+ * Exits 1 if any case fails.
+ */
+#include "ECE140_MQTT.h"
+#include "PosixTransport.h"
+#include "SwapConfirmer.h"
+#include "TestBroker.h"
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* DEVICE_ID = "AA:BB:CC:DD:EE:FF";
+static const char* EVENT_ID = "E_01";
+
+struct Received {
+    std::string topic;
+    std::string payload;
+};
+
+static ECE140_MQTT badge;
+static Mqtt5Client backend;
+static PosixTransport backendSocket;
+static std::vector<Received> backendInbox;
+static uint32_t commandsHandled[COMMAND_TYPE_COUNT] = {};
+static uint32_t badgeInbound = 0;
+// The backend's matcher; confirmations are published from runUntil(), outside the client's callback
+static SwapConfirmer swapBackend(1024, 10000);
+static std::vector<SwapConfirmation> confirmations;
+
+static TestBroker broker;
+static std::atomic<bool> brokerRunning{true};
+static std::atomic<bool> brokerRestart{false};
+static std::atomic<uint32_t> brokerDownMs{0};
+
+static void onBadgeMessage(char* topic, uint8_t* payload, unsigned int length) {
+    badgeInbound++;
+    badge.handleMessage(topic, payload, length);
+}
+
+static void onBackendMessage(char* topic, uint8_t* payload, unsigned int length) {
+    backendInbox.push_back(Received{topic, std::string((const char*)payload, length)});
+    if (std::string(topic) == std::string("event/") + EVENT_ID + "/profile_swap") {
+        swapBackend.offer(payload, length, hostMillis(), confirmations);
+    }
+}
+
+// The broker must answer CONNECT while ECE140_MQTT blocks in connectToBroker(), so it gets a thread
+static void brokerThread() {
+    while (brokerRunning) {
+        if (brokerRestart.exchange(false)) {
+            uint16_t port = broker.port();
+            broker.end();
+            usleep(brokerDownMs.exchange(0) * 1000);
+            broker.begin(port);
+        }
+        broker.poll(5);
+    }
+}
+
+static bool openBackend() {
+    backendSocket.close();
+    if (!backendSocket.connect("127.0.0.1", broker.port())) {
+        return false;
+    }
+    backend.setTransport(&backendSocket);
+    backend.setCallback(onBackendMessage);
+    Mqtt5ConnectOptions options = {"backend", nullptr, nullptr, 30, 0, true};
+    backend.begin(options, hostMillis());
+    while (backend.state() == MQTT5_CONNECTING && backend.poll(hostMillis())) {
+    }
+    return backend.connected() && backend.subscribe("event/#", 1) && backend.subscribe("device/+/receipt", 1);
+}
+
+static void backendPublish(const char* suffix, const char* payload) {
+    std::string topic = std::string("device/") + DEVICE_ID + "/" + suffix;
+    backend.publish(topic.c_str(), (const uint8_t*)payload, strlen(payload), 1);
+}
+
+// Run the badge's and the backend's loops until done() or the timeout; the backend reconnects when dropped
+template <typename Done>
+static bool runUntil(uint32_t timeoutMs, Done done) {
+    uint32_t untilMs = hostMillis() + timeoutMs;
+    while (hostMillis() < untilMs) {
+        badge.loop();
+        InboundCommand command;
+        while (badge.nextCommand(command)) {
+            commandsHandled[command.type]++;
+            badge.commandHandled(command);
+        }
+        if (!backend.poll(hostMillis())) {
+            openBackend();
+        }
+        for (const SwapConfirmation& confirmation : confirmations) {
+            std::string topic = std::string("event/") + EVENT_ID + "/profile_swap/" + confirmation.ticket;
+            backend.publish(topic.c_str(), (const uint8_t*)confirmation.partnerTicket.data(), confirmation.partnerTicket.size(), 1);
+        }
+        confirmations.clear();
+        if (done()) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+static size_t countTopic(const char* suffix) {
+    size_t count = 0;
+    size_t suffixLength = strlen(suffix);
+    for (const Received& message : backendInbox) {
+        if (message.topic.size() >= suffixLength &&
+            message.topic.compare(message.topic.size() - suffixLength, suffixLength, suffix) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static size_t countPayload(const char* text) {
+    size_t count = 0;
+    for (const Received& message : backendInbox) {
+        count += message.payload.find(text) != std::string::npos;
+    }
+    return count;
+}
+
+static bool report(const char* name, bool passed, const std::string& detail) {
+    printf("%-8s %s  %s\n", name, passed ? "ok  " : "FAIL", detail.c_str());
+    return passed;
+}
+
+static bool assignCase() {
+    badge.publishAvailability();
+    bool announced = runUntil(2000, [] { return countTopic(std::string("available_devices/").append(DEVICE_ID).c_str()) > 0; });
+    // Spellings that would advertise another ticket, or ticket 0, never replace the ticket
+    backendPublish("assignment", "T_0001");
+    backendPublish("assignment", "T_ABC");
+    bool refused = runUntil(2000, [] { return countPayload("invalid ticket") >= 2; }) && !badge.isAssigned();
+    backendPublish("assignment", "T_000001");
+    bool assigned = runUntil(2000, [] { return badge.isAssigned() && commandsHandled[COMMAND_ASSIGNMENT] > 0; });
+
+    backendPublish("receipt_batch", "on");
+    runUntil(2000, [] { return countTopic("/receipt") > 0; });
+    size_t before = countTopic("/receipt");
+    for (int i = 0; i < 10; i++) {
+        badge.publishReceipt("resetNFC", "ok");
+    }
+    runUntil(3000, [] { return badge.getPublishStats().queued == 0; });
+    runUntil(200, [] { return false; });
+    size_t receipts = countTopic("/receipt") - before;
+    // The next health report carries the assignment's command-to-action latency
+    CommandLatency latency = badge.getLinkHealth().command(COMMAND_ASSIGNMENT);
+    return report("assign", announced && refused && assigned && receipts > 0 && receipts <= 3 && latency.handled > 0,
+                  std::string(refused ? "T_0001 and T_ABC refused" : "non-canonical ticket accepted") + ", ticket " +
+                      std::string(badge.getTicketID().c_str()) + ", 10 receipts in " + std::to_string(receipts) +
+                      " publishes, assignment handled in " + std::to_string(latency.maxUs) + " us");
+}
+
+static bool swapCase() {
+    badge.subscribeProfileSwap();
+    runUntil(300, [] { return false; });
+    // The partner badge's claim, as its publishHandshake() sends it, is already waiting in the matcher
+    char partnerClaim[96];
+    JsonWriter json(partnerClaim, sizeof(partnerClaim));
+    json.field("event_id", EVENT_ID).field("ticket_id", "T_000002").field("ticket_id_to_swap", "T_000001");
+    json.finish();
+    swapBackend.offer((const uint8_t*)partnerClaim, json.length(), hostMillis(), confirmations);
+    badge.publishHandshake("T_000002");
+    bool claimed = runUntil(2000, [] { return countTopic("/profile_swap") > 0; });
+    bool swapped = runUntil(2000, [] { return commandsHandled[COMMAND_PROFILE_SWAP] > 0; });
+
+    backendPublish("reassignment", "T_000005");
+    bool reassigned = runUntil(2000, [] { return badge.getTicketID() == "T_000005"; });
+    runUntil(500, [] { return false; });
+    // Traffic for the old ticket, another badge's ticket and another badge's availability
+    uint32_t inbound = badgeInbound;
+    const char* others[] = {"profile_swap/T_000001", "profile_swap/T_000009", "available_devices/11:22:33:44:55:66"};
+    for (const char* suffix : others) {
+        std::string other = std::string("event/") + EVENT_ID + "/" + suffix;
+        backend.publish(other.c_str(), (const uint8_t*)"T_000002", 8, 1);
+    }
+    runUntil(500, [] { return false; });
+    uint32_t stray = badgeInbound - inbound;
+    uint32_t swaps = commandsHandled[COMMAND_PROFILE_SWAP];
+    std::string topic = std::string("event/") + EVENT_ID + "/profile_swap/T_000005";
+    backend.publish(topic.c_str(), (const uint8_t*)"T_000002", 8, 1);
+    bool followed = runUntil(2000, [swaps] { return commandsHandled[COMMAND_PROFILE_SWAP] > swaps; });
+    return report("swap", claimed && swapped && reassigned && stray == 0 && followed,
+                  std::string(swapped ? "claims matched, swap delivered" : "no swap command") + ", " +
+                      (followed ? "topic followed the reassignment" : "no swap on the new ticket") + ", " +
+                      std::to_string(stray) + " of 3 messages for other tickets/badges received");
+}
+
+static bool outageCase() {
+    hostWiFiUp = false;
+    bool lost = runUntil(2000, [] { return !badge.isConnected(); });
+    size_t before = countTopic("/profile_swap");
+    for (int i = 0; i < 12; i++) {
+        badge.publishHandshake("T_000003");
+    }
+    // Held in the badge's persistent session until it is back
+    uint32_t resets = commandsHandled[COMMAND_RESET_NFC];
+    backendPublish("resetNFC", "1");
+    runUntil(1500, [] { return false; });
+    hostWiFiUp = true;
+
+    bool back = runUntil(10000, [] { return badge.isConnected(); });
+    bool resumed = runUntil(3000, [resets] { return commandsHandled[COMMAND_RESET_NFC] > resets; });
+    size_t before12 = before + 12;
+    bool delivered = runUntil(5000, [before12] { return countTopic("/profile_swap") >= before12; });
+    const LinkHealth& health = badge.getLinkHealth();
+    return report("outage", lost && back && resumed && delivered,
+                  std::to_string(countTopic("/profile_swap") - before) + " of 12 queued handshakes delivered, " +
+                      (resumed ? "session resumed" : "session lost") + ", " +
+                      std::to_string(health.counter(LINK_FAILED_WIFI)) + " attempt(s) while WiFi was down");
+}
+
+static bool restartCase() {
+    uint32_t attempts = badge.getReconnectAttempts();
+    brokerRestart = true;
+    bool lost = runUntil(2000, [] { return !badge.isConnected(); });
+    bool back = runUntil(10000, [] { return badge.isConnected(); });
+    // Nothing survived the restart, so this only arrives if the badge subscribed again
+    runUntil(300, [] { return false; });
+    uint32_t reassigned = commandsHandled[COMMAND_REASSIGNMENT];
+    backendPublish("reassignment", "T_000004");
+    bool resubscribed = runUntil(3000, [reassigned] { return commandsHandled[COMMAND_REASSIGNMENT] > reassigned; });
+    return report("restart", lost && back && resubscribed,
+                  std::to_string(badge.getReconnectAttempts() - attempts) + " reconnect attempt(s), " +
+                      (resubscribed ? "subscriptions replayed" : "reassignment not delivered"));
+}
+
+static bool backoffCase() {
+    // The restart case left the backoff at its first step
+    std::vector<uint32_t> attemptsAtMs;
+    uint32_t attempts = badge.getReconnectAttempts();
+    uint32_t lostMs = 0;
+    brokerDownMs = 7500;
+    brokerRestart = true;
+    bool lost = runUntil(2000, [] { return !badge.isConnected(); });
+    lostMs = hostMillis();
+    bool back = runUntil(20000, [&] {
+        if (badge.getReconnectAttempts() != attempts) {
+            attempts = badge.getReconnectAttempts();
+            attemptsAtMs.push_back(hostMillis());
+        }
+        return badge.isConnected();
+    });
+
+    // Retry k waits between half and all of MQTT_BACKOFF_MIN_MS << k after the previous one
+    // failed; connection refused fails within a few ms, the rest is loop granularity
+    bool paced = !attemptsAtMs.empty();
+    std::string gaps;
+    uint32_t previousMs = lostMs;
+    for (size_t k = 0; k < attemptsAtMs.size(); k++) {
+        uint32_t ceiling = std::min<uint32_t>((uint32_t)MQTT_BACKOFF_MIN_MS << k, MQTT_BACKOFF_MAX_MS);
+        uint32_t gap = attemptsAtMs[k] - previousMs;
+        paced &= gap + 20 >= ceiling / 2 && gap <= ceiling + 100;
+        gaps += (k ? ", " : "") + std::to_string(gap);
+        previousMs = attemptsAtMs[k];
+    }
+    return report("backoff", lost && back && paced,
+                  std::to_string(attemptsAtMs.size()) + " attempt(s) " + std::to_string(hostMillis() - lostMs) +
+                      " ms after the loss, waits " + gaps + " ms");
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(fraction * values.size()))];
+}
+
+// A resumed session keeps its subscriptions; a lost one (restart without persistence, or
+// expiry) costs the badge a SUBSCRIBE and SUBACK per topic before commands reach it again
+static bool connectTimes(int rounds) {
+    badge.subscribeProfileSwap();
+    backendPublish("assignment", "T_000001");
+    bool assigned = runUntil(2000, [] { return badge.isAssigned() && badge.getClientStats().subscribeAcks >= 3; });
+    bool passed = assigned;
+    const char* modes[] = {"resumed", "lost"};
+    for (const char* mode : modes) {
+        bool resumed = mode == modes[0];
+        std::vector<double> connectMs;
+        std::vector<double> readyMs;
+        uint32_t resubscribes = 0;
+        for (int round = 0; round < rounds; round++) {
+            if (resumed) {
+                hostWiFiUp = false;
+                passed &= runUntil(2000, [] { return !badge.isConnected(); });
+                hostWiFiUp = true;
+            } else {
+                brokerRestart = true;
+                passed &= runUntil(2000, [] { return !badge.isConnected(); });
+            }
+            uint32_t acks = badge.getClientStats().subscribeAcks;
+            passed &= runUntil(10000, [] { return badge.isConnected(); });
+
+            // Subscriptions go out from loop() as soon as it sees the connection; wait without sleeping
+            unsigned long startUs = micros();
+            uint32_t expected = resumed ? 0 : 3;
+            while (badge.getClientStats().subscribeAcks - acks < expected && micros() - startUs < 2000000) {
+                badge.loop();
+            }
+            resubscribes += badge.getClientStats().subscribeAcks - acks;
+            connectMs.push_back(badge.getLastConnectTime());
+            readyMs.push_back(badge.getLastConnectTime() + (micros() - startUs) / 1000.0);
+        }
+        char line[160];
+        snprintf(line, sizeof(line), "connect p50 %.0f p90 %.0f max %.0f ms, subscribed p50 %.1f p90 %.1f max %.1f ms, %.1f resubscribes",
+                 percentile(connectMs, 0.5), percentile(connectMs, 0.9), percentile(connectMs, 1.0), percentile(readyMs, 0.5),
+                 percentile(readyMs, 0.9), percentile(readyMs, 1.0), (double)resubscribes / rounds);
+        passed &= report(mode, assigned && resubscribes == (resumed ? 0u : 3u * rounds), line);
+    }
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    Serial.enabled = false;
+    int connectRounds = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--verbose")) Serial.enabled = true;
+        if (!strcmp(argv[i], "--connect-times") && i + 1 < argc) connectRounds = atoi(argv[++i]);
+    }
+
+    // ECE140_MQTT dials MQTT_SERVER:MQTT_PORT, fixed at build time
+    if (!broker.begin((uint16_t)atoi(MQTT_PORT))) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%s\n", MQTT_PORT);
+        return 1;
+    }
+    std::thread brokerLoop(brokerThread);
+    if (!openBackend()) {
+        fprintf(stderr, "backend cannot connect to 127.0.0.1:%u\n", broker.port());
+        brokerRunning = false;
+        brokerLoop.join();
+        return 1;
+    }
+
+    badge.setCallback(onBadgeMessage);
+    bool passed = badge.connectToBroker(DEVICE_ID, EVENT_ID);
+    badge.subscribeDevice();
+    badge.subscribeEvent();
+    report("connect", passed, std::to_string(badge.getLastConnectTime()) + " ms");
+
+    if (connectRounds > 0) {
+        passed &= connectTimes(connectRounds);
+    } else {
+        passed &= assignCase();
+        passed &= swapCase();
+        passed &= outageCase();
+        passed &= restartCase();
+        passed &= backoffCase();
+    }
+
+    brokerRunning = false;
+    brokerLoop.join();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Minimal Arduino surface for building ECE140_MQTT on the host. Unlike sim/stubs, time is
+// the wall clock: the client talks to a real socket.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+#define HEX 16
+
+inline unsigned long millis() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+inline unsigned long micros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)(now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+inline void delay(unsigned long ms) { usleep(ms * 1000); }
+inline uint32_t esp_random() { return (uint32_t)rand(); }
+
+class String {
+private:
+    std::string _value;
+
+public:
+    String() {}
+    String(const char* value) : _value(value ? value : "") {}
+    String(const char* value, unsigned int length) : _value(value, length) {}
+    String(const std::string& value) : _value(value) {}
+    String(int value) : _value(std::to_string(value)) {}
+    String(unsigned int value) : _value(std::to_string(value)) {}
+    String(long value) : _value(std::to_string(value)) {}
+    String(unsigned long value) : _value(std::to_string(value)) {}
+    String(unsigned char value, int base) {
+        char digits[4];
+        snprintf(digits, sizeof(digits), base == HEX ? "%X" : "%u", value);
+        _value = digits;
+    }
+
+    const char* c_str() const { return _value.c_str(); }
+    unsigned int length() const { return _value.length(); }
+    bool isEmpty() const { return _value.empty(); }
+
+    String& operator+=(const String& other) { _value += other._value; return *this; }
+    bool operator==(const String& other) const { return _value == other._value; }
+    bool operator!=(const String& other) const { return _value != other._value; }
+    friend String operator+(String lhs, const String& rhs) { lhs += rhs; return lhs; }
+};
+
+// Serial output is on by default; a tool that prints its own report turns it off
+class HostSerial {
+public:
+    bool enabled = true;
+    void println(const String& line) { if (enabled) puts(line.c_str()); }
+    void print(const String& text) { if (enabled) fputs(text.c_str(), stdout); }
+};
+
+inline HostSerial Serial;
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef CERTIFICATES_H
+#define CERTIFICATES_H
+
+// The host build talks plain TCP to a local broker; there is no certificate to check
+static const char* CA_CERT = "";
+
+#endif
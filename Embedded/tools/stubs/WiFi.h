@@ -0,0 +1,21 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <atomic>
+
+enum {
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+};
+
+// Tools take the network down and up with this; WiFiClient sockets follow it
+inline std::atomic<bool> hostWiFiUp{true};
+
+class HostWiFi {
+public:
+    int status() { return hostWiFiUp ? WL_CONNECTED : WL_DISCONNECTED; }
+};
+
+inline HostWiFi WiFi;
+
+#endif
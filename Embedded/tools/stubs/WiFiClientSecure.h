@@ -0,0 +1,137 @@
+#ifndef HOST_WIFI_CLIENT_SECURE_H
+#define HOST_WIFI_CLIENT_SECURE_H
+
+// WiFiClient over a plain non-blocking POSIX socket, and the FreeRTOS and ESP calls
+// ECE140_MQTT makes, so the shipped client runs on the host against a local broker.
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+
+class WiFiClient {
+private:
+    int _fd = -1;
+    bool _closed = false;
+
+public:
+    virtual ~WiFiClient() { stop(); }
+
+    // Host name is an IPv4 literal; the connect blocks like the badge's TLS handshake
+    virtual int connect(const char* host, uint16_t port) {
+        stop();
+        if (!hostWiFiUp) {
+            return 0;
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (_fd < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+            ::connect(_fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            stop();
+            return 0;
+        }
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(_fd, F_SETFL, O_NONBLOCK);
+        return 1;
+    }
+
+    virtual int available() {
+        if (!connected()) {
+            return 0;
+        }
+        char peek[4096];
+        ssize_t pending = recv(_fd, peek, sizeof(peek), MSG_PEEK);
+        if (pending == 0 || (pending < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            _closed = true;
+            return 0;
+        }
+        return pending < 0 ? 0 : (int)pending;
+    }
+
+    virtual int read(uint8_t* buffer, size_t length) {
+        return connected() ? (int)recv(_fd, buffer, length, 0) : -1;
+    }
+
+    virtual size_t write(const uint8_t* data, size_t length) {
+        if (!connected()) {
+            return 0;
+        }
+        ssize_t written = send(_fd, data, length, MSG_NOSIGNAL);
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            _closed = true;
+        }
+        return written < 0 ? 0 : (size_t)written;
+    }
+
+    // Losing WiFi drops the socket, as the badge's would time out
+    virtual uint8_t connected() {
+        return _fd >= 0 && !_closed && hostWiFiUp;
+    }
+
+    virtual void stop() {
+        if (_fd >= 0) {
+            close(_fd);
+        }
+        _fd = -1;
+        _closed = false;
+    }
+};
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setCACert(const char*) {}
+};
+
+// FreeRTOS tasks as detached threads, with one notification counter each
+struct HostTask {
+    std::atomic<uint32_t> notifications{0};
+};
+
+typedef HostTask* TaskHandle_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define portMAX_DELAY 0xFFFFFFFFu
+
+inline thread_local HostTask* hostCurrentTask = nullptr;
+
+inline int xTaskCreate(void (*task)(void*), const char*, uint32_t, void* arg, unsigned, TaskHandle_t* handle) {
+    HostTask* created = new HostTask();
+    *handle = created;
+    std::thread([task, arg, created] {
+        hostCurrentTask = created;
+        task(arg);
+    }).detach();
+    return pdPASS;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+    task->notifications++;
+}
+
+// Clear-on-exit take; the timeout is ignored, every caller waits forever
+inline uint32_t ulTaskNotifyTake(int, uint32_t) {
+    while (hostCurrentTask->notifications == 0) {
+        usleep(1000);
+    }
+    return hostCurrentTask->notifications.exchange(0);
+}
+
+class EspClass {
+public:
+    void restart() { exit(0); }
+};
+
+inline EspClass ESP;
+
+#endif
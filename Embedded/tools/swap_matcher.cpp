@@ -0,0 +1,477 @@
+/**
+ * Reference profile swap matcher: the backend side of the badge's handshake contract.
+ *
+ * Both badges of a handshake publish {event_id, ticket_id, ticket_id_to_swap} to
+ * event/<id>/profile_swap (JSON or BadgeMessage, live or replayed from the outbox).
+ * When the second claim of a mutual pair arrives within the window, each badge gets
+ * its partner's ticket on event/<id>/profile_swap/<its ticket>, spelled as in its own claim
+ * (see SwapConfirmer). Claims wait in
+ * SwapMatcher's hash index and expire if the partner never claims; any further claim for a
+ * pair that is pending or matched within the window is dropped, so a badge buzzes once per
+ * handshake.
+ *
+ *   mosquitto -p 1883 &
+ *   pio run -e native_swap_matcher
+ *   .pio/build/native_swap_matcher/program &
+ *   .pio/build/native_swap_matcher/program --drive 10000 --duration 30
+ *
+ * With --drive the same program is the load generator instead: it publishes claims for
+ * handshakes at the given rate, listens on event/<id>/profile_swap/+ and reports the
+ * latency from the second claim of a pair to each confirmation. --core runs the matcher
+ * alone, in process, to show what the index costs without the broker.
+ *
+ * Options:
+ *   --host H --port P       broker (default 127.0.0.1:1883)
+ *   --event E               event id (default E_01)
+ *   --window-ms M           longest gap between the two claims of a handshake (default 10000)
+ *   --capacity N            claims held at once, pending or recently matched (default 262144)
+ *   --qos Q                 confirmation QoS, 1 so badges that are offline get it later (default 1)
+ *   --stats-interval S      seconds between status lines, 0 for none (default 10)
+ *   --drive R               generate R claims per second against a running matcher
+ *   --duration S            seconds to drive (default 30)
+ *   --skew-ms M             largest gap between the two claims of a driven handshake (default 200)
+ *   --replays P             share of driven handshakes published from the outbox: with nonces, and
+ *                           each badge sending the partner's claim too (default 0.05)
+ *   --orphans P             share of driven handshakes with only one claim, left to expire (default 0.01)
+ *   --binary                drive with BadgeMessage payloads instead of JSON
+ *   --core N                offer N synthetic claims to SwapMatcher in process and exit
+ */
+#include "BadgeAdvertisement.h"
+#include "BadgeMessage.h"
+#include "JsonWriter.h"
+#include "Mqtt5Client.h"
+#include "PosixTransport.h"
+#include "SwapConfirmer.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <poll.h>
+#include <queue>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const uint16_t KEEPALIVE_S = 30;
+static const uint64_t CONFIRM_TIMEOUT_US = 5000000;
+
+struct Options {
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    const char* eventId = "E_01";
+    uint32_t windowMs = 10000;
+    uint32_t capacity = 262144;
+    uint8_t qos = 1;
+    uint32_t statsIntervalS = 10;
+    uint32_t driveRate = 0;
+    uint32_t durationS = 30;
+    uint32_t skewMs = 200;
+    double replays = 0.05;
+    double orphans = 0.01;
+    bool binary = false;
+    uint32_t core = 0;
+};
+
+struct Outgoing {
+    std::string topic;
+    std::string payload;
+};
+
+static Options opt;
+static Mqtt5Client client;
+static PosixTransport transport;
+static std::deque<Outgoing> backlog;
+static char eventPrefix[64];
+static char claimTopic[MQTT5_TOPIC_SIZE];
+static volatile bool stopping = false;
+
+// hostMicros() is too coarse for one offer()
+static uint64_t nowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+static void printPercentiles(const char* label, std::vector<uint32_t>& values, double scale, const char* unit) {
+    std::sort(values.begin(), values.end());
+    printf("%-13s n %zu  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f %s\n", label, values.size(),
+           percentile(values, 0.50) / scale, percentile(values, 0.90) / scale, percentile(values, 0.99) / scale,
+           percentile(values, 0.999) / scale, values.empty() ? 0.0 : values.back() / scale, unit);
+}
+
+static bool open(const char* clientId, void (*callback)(char*, uint8_t*, unsigned int)) {
+    if (!transport.connect(opt.host, opt.port)) {
+        fprintf(stderr, "%s: cannot reach %s:%u\n", clientId, opt.host, opt.port);
+        return false;
+    }
+    client.setTransport(&transport);
+    client.setCallback(callback);
+    Mqtt5ConnectOptions options = {clientId, nullptr, nullptr, KEEPALIVE_S, 0, true};
+    client.begin(options, hostMillis());
+    while (client.state() == MQTT5_CONNECTING && client.poll(hostMillis())) {
+    }
+    if (!client.connected()) {
+        fprintf(stderr, "%s: connect failed, reason 0x%02X\n", clientId, client.reason());
+        return false;
+    }
+    return true;
+}
+
+// Hand the backlog to the client and keep polling while it has bytes to move or packets to
+// dispatch; false once the connection is gone
+static bool pump(uint8_t qos) {
+    for (int round = 0; round < 64; round++) {
+        if (!client.poll(hostMillis())) {
+            fprintf(stderr, "disconnected, reason 0x%02X\n", client.reason());
+            return false;
+        }
+        while (!backlog.empty()) {
+            const Outgoing& next = backlog.front();
+            if (!client.publish(next.topic.c_str(), (const uint8_t*)next.payload.data(), next.payload.size(), qos)) {
+                break;
+            }
+            backlog.pop_front();
+        }
+        if (client.pendingBytes() == 0 && client.bufferedBytes() == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+// Sleep until the socket has data or the timeout passes, unless the client still has work
+static void waitForSocket(int timeoutMs) {
+    if (client.pendingBytes() > 0 || client.bufferedBytes() > 0) {
+        return;
+    }
+    pollfd socket = {transport.fd(), POLLIN, 0};
+    ::poll(&socket, 1, timeoutMs);
+}
+
+// ---- Matcher service ----
+
+static SwapConfirmer* confirmer = nullptr;
+static uint64_t parseErrors = 0;
+static uint64_t confirmations = 0;
+static std::vector<uint32_t> handleNs;
+static std::vector<SwapConfirmation> matched;
+
+static void onClaim(char* topic, uint8_t* payload, unsigned int length) {
+    uint64_t startNs = nowNs();
+    matched.clear();
+    if (strcmp(topic, claimTopic) != 0 || !confirmer->offer(payload, length, hostMillis(), matched)) {
+        parseErrors++;
+        return;
+    }
+    char confirmTopic[MQTT5_TOPIC_SIZE];
+    for (const SwapConfirmation& confirmation : matched) {
+        if (joinTopic(confirmTopic, sizeof(confirmTopic), {eventPrefix, "profile_swap/", confirmation.ticket.c_str()})) {
+            backlog.push_back(Outgoing{confirmTopic, confirmation.partnerTicket});
+            confirmations++;
+        }
+    }
+    if (handleNs.size() < 4000000) {
+        handleNs.push_back((uint32_t)(nowNs() - startNs));
+    }
+}
+
+static int runMatcher() {
+    SwapConfirmer service(opt.capacity, opt.windowMs);
+    const SwapMatcher& index = service.matcher();
+    confirmer = &service;
+    if (!open("swap-matcher", onClaim)) {
+        return 1;
+    }
+    client.subscribe(claimTopic, 1);
+    printf("matching     %s, window %u ms, capacity %u claims, confirmations at QoS %u\n", claimTopic, opt.windowMs,
+           opt.capacity, opt.qos);
+    fflush(stdout);
+
+    uint64_t lastStatsUs = hostMicros();
+    SwapMatcherStats last = {};
+    while (!stopping) {
+        if (!pump(opt.qos)) {
+            return 1;
+        }
+        service.expire(hostMillis());
+        waitForSocket(backlog.empty() ? 100 : 1);
+
+        uint64_t nowUs = hostMicros();
+        if (opt.statsIntervalS > 0 && nowUs - lastStatsUs >= opt.statsIntervalS * 1000000ull) {
+            SwapMatcherStats stats = index.stats();
+            double seconds = (nowUs - lastStatsUs) / 1e6;
+            printf("claims       %.0f/s, %.0f matched/s, %u duplicate, %u expired, %u full, %zu held, %zu queued\n",
+                   (stats.offered - last.offered) / seconds, (stats.matched - last.matched) / seconds,
+                   stats.duplicates - last.duplicates, stats.expired - last.expired, stats.full - last.full,
+                   index.size(), backlog.size());
+            fflush(stdout);
+            last = stats;
+            lastStatsUs = nowUs;
+        }
+    }
+
+    SwapMatcherStats stats = index.stats();
+    printf("total        %u claims, %u matched, %u duplicate, %u expired, %u full, %u invalid, %llu unreadable\n",
+           stats.offered, stats.matched, stats.duplicates, stats.expired, stats.full, stats.invalid,
+           (unsigned long long)parseErrors);
+    printf("confirmed    %llu published\n", (unsigned long long)confirmations);
+    printPercentiles("claim cost", handleNs, 1000.0, "us");
+    client.disconnect();
+    return 0;
+}
+
+// ---- Load driver ----
+
+struct Handshake {
+    uint64_t pairedUs;      // the later claim went out, 0 before that
+    uint32_t ticketA;
+    uint32_t ticketB;
+    uint32_t nonceA;        // both 0 unless replayed from the outbox
+    uint32_t nonceB;
+    uint8_t confirmed;
+    bool orphan;
+};
+
+// One claim, due at a given time
+struct DueClaim {
+    uint64_t dueUs;
+    uint32_t handshake;
+    bool fromA;
+    bool last;              // the later of the two claims
+    bool operator>(const DueClaim& other) const { return dueUs > other.dueUs; }
+};
+
+static std::vector<Handshake> handshakes;
+static std::unordered_map<uint32_t, uint32_t> handshakeByTicket;
+static std::vector<uint32_t> confirmUs;
+static uint64_t confirmed = 0;
+static uint64_t unexpected = 0;
+
+static void onConfirmation(char* topic, uint8_t*, unsigned int) {
+    uint64_t nowUs = hostMicros();
+    const char* ticket = strrchr(topic, '/');
+    auto found = ticket ? handshakeByTicket.find(parseBadgeNumber(ticket + 1)) : handshakeByTicket.end();
+    if (found == handshakeByTicket.end()) {
+        unexpected++;
+        return;
+    }
+    Handshake& handshake = handshakes[found->second];
+    handshakeByTicket.erase(found);
+    if (handshake.orphan || handshake.pairedUs == 0) {
+        unexpected++;
+        return;
+    }
+    handshake.confirmed++;
+    confirmed++;
+    confirmUs.push_back((uint32_t)(nowUs - handshake.pairedUs));
+}
+
+// nonce 0 for a live claim, as publishHandshake() sends it
+static void publishClaim(uint32_t ticketId, uint32_t partnerTicketId, uint32_t nonce) {
+    bool replayed = nonce != 0;
+    uint8_t payload[160];
+    size_t length;
+    char ticket[16];
+    char partner[16];
+    formatTicketId(ticketId, ticket, sizeof(ticket));
+    formatTicketId(partnerTicketId, partner, sizeof(partner));
+    if (opt.binary) {
+        length = replayed ? encodeProfileSwapClaim(payload, sizeof(payload), opt.eventId, ticketId, partnerTicketId,
+                                                   (uint32_t)(hostMillis() / 1000), nonce)
+                          : encodeProfileSwap(payload, sizeof(payload), opt.eventId, ticketId, partnerTicketId);
+    } else {
+        JsonWriter json((char*)payload, sizeof(payload));
+        json.field("event_id", opt.eventId).field("ticket_id", ticket).field("ticket_id_to_swap", partner);
+        if (replayed) {
+            json.field("timestamp", (uint32_t)(hostMillis() / 1000)).field("nonce", nonce);
+        }
+        length = json.finish() ? json.length() : 0;
+    }
+    if (length > 0) {
+        backlog.push_back(Outgoing{claimTopic, std::string((const char*)payload, length)});
+    }
+}
+
+static int runDriver() {
+    if (!open("swap-driver", onConfirmation)) {
+        return 1;
+    }
+    char filter[MQTT5_TOPIC_SIZE];
+    joinTopic(filter, sizeof(filter), {eventPrefix, "profile_swap/+"});
+    client.subscribe(filter, 1);
+    pump(1);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::priority_queue<DueClaim, std::vector<DueClaim>, std::greater<DueClaim>> due;
+    uint64_t intervalUs = std::max<uint64_t>(1, 2000000 / opt.driveRate);    // two claims per handshake
+    uint64_t startUs = hostMicros();
+    uint64_t endUs = startUs + opt.durationS * 1000000ull;
+    uint64_t nextHandshakeUs = startUs;
+    uint64_t claims = 0;
+    uint64_t replays = 0;
+    uint64_t expected = 0;
+    uint32_t nextTicket = 1;
+
+    while (!stopping) {
+        uint64_t nowUs = hostMicros();
+        while (nowUs < endUs && nextHandshakeUs <= nowUs) {
+            nextHandshakeUs += intervalUs;
+            // Fresh tickets for every handshake; wrap well after the matcher's window
+            if (nextTicket > 999998) {
+                nextTicket = 1;
+            }
+            Handshake handshake = {0, nextTicket, nextTicket + 1, 0, 0, 0, chance(random) < opt.orphans};
+            nextTicket += 2;
+            if (chance(random) < opt.replays) {
+                handshake.nonceA = (uint32_t)random() | 1;
+                handshake.nonceB = (uint32_t)random() | 1;
+                replays++;
+            }
+            uint32_t id = (uint32_t)handshakes.size();
+            handshakes.push_back(handshake);
+            handshakeByTicket[handshake.ticketA] = id;
+            handshakeByTicket[handshake.ticketB] = id;
+            uint64_t skewUs = opt.skewMs ? (uint64_t)(random() % (opt.skewMs * 1000)) : 0;
+            due.push(DueClaim{nowUs, id, true, handshake.orphan});
+            if (!handshake.orphan) {
+                due.push(DueClaim{nowUs + skewUs, id, false, true});
+                expected += 2;
+            }
+        }
+
+        while (!due.empty() && due.top().dueUs <= nowUs) {
+            DueClaim claim = due.top();
+            due.pop();
+            Handshake& handshake = handshakes[claim.handshake];
+            uint32_t ticket = claim.fromA ? handshake.ticketA : handshake.ticketB;
+            uint32_t partner = claim.fromA ? handshake.ticketB : handshake.ticketA;
+            uint32_t nonce = claim.fromA ? handshake.nonceA : handshake.nonceB;
+            publishClaim(ticket, partner, nonce);
+            claims++;
+            if (nonce != 0 && !handshake.orphan) {
+                // The partner's claim, received over GATT, goes out from this badge's outbox too
+                publishClaim(partner, ticket, claim.fromA ? handshake.nonceB : handshake.nonceA);
+                claims++;
+            }
+            // A replayed handshake is complete once the first badge's outbox has both claims out
+            if ((claim.last || nonce != 0) && !handshake.orphan && handshake.pairedUs == 0) {
+                handshake.pairedUs = hostMicros();
+            }
+        }
+
+        if (!pump(1)) {
+            return 1;
+        }
+        if (nowUs >= endUs && due.empty() && backlog.empty() &&
+            (confirmed >= expected || nowUs > endUs + CONFIRM_TIMEOUT_US)) {
+            break;
+        }
+        if (backlog.empty()) {
+            uint64_t nextUs = std::min(nextHandshakeUs, due.empty() ? nextHandshakeUs : due.top().dueUs);
+            waitForSocket(nextUs > nowUs + 1000 ? 1 : 0);
+        }
+    }
+
+    double seconds = opt.durationS;
+    uint64_t missed = 0;
+    uint64_t orphans = 0;
+    for (const Handshake& handshake : handshakes) {
+        if (handshake.orphan) {
+            orphans++;
+            continue;
+        }
+        missed += 2 - std::min<uint8_t>(handshake.confirmed, 2);
+    }
+    Mqtt5Stats stats = client.stats();
+    printf("driven       %.0f claims/s for %u s, %s payloads, %llu replayed, %llu orphan handshakes\n", claims / seconds,
+           opt.durationS, opt.binary ? "binary" : "JSON", (unsigned long long)replays, (unsigned long long)orphans);
+    printf("confirmed    %llu of %llu, %llu missed, %llu unexpected\n", (unsigned long long)confirmed,
+           (unsigned long long)expected, (unsigned long long)missed, (unsigned long long)unexpected);
+    printf("driver bytes %.1f KB/s out, %.1f KB/s in\n", stats.bytesOut / 1024.0 / seconds, stats.bytesIn / 1024.0 / seconds);
+    printPercentiles("pair->confirm", confirmUs, 1000.0, "ms");
+    client.disconnect();
+    return missed == 0 && unexpected == 0 ? 0 : 1;
+}
+
+// ---- In-process index benchmark ----
+
+static int runCore() {
+    SwapMatcher index(opt.capacity, opt.windowMs);
+    std::mt19937 random(1);
+    std::vector<uint32_t> offerNs;
+    offerNs.reserve(opt.core);
+    uint32_t pending[64] = {0};     // recent first claims, answered in random order
+    uint32_t nextTicket = 1;
+    uint64_t startUs = hostMicros();
+    for (uint32_t i = 0; i < opt.core; i++) {
+        uint32_t slot = random() % 64;
+        uint32_t ticket;
+        uint32_t partner;
+        if (pending[slot] != 0) {
+            ticket = pending[slot] + 1;
+            partner = pending[slot];
+            pending[slot] = 0;
+        } else {
+            ticket = nextTicket;
+            partner = nextTicket + 1;
+            pending[slot] = ticket;
+            nextTicket = nextTicket > 999996 ? 1 : nextTicket + 2;
+        }
+        // One claim per 100 us of simulated time: 10k claims/s against the real window
+        uint32_t nowMs = i / 10;
+        uint64_t beforeNs = nowNs();
+        index.offer(ticket, partner, nowMs, nullptr);
+        offerNs.push_back((uint32_t)(nowNs() - beforeNs));
+    }
+    double seconds = (hostMicros() - startUs) / 1e6;
+    SwapMatcherStats stats = index.stats();
+    printf("core         %u claims in %.2f s, %.2f M claims/s with timing, %zu held at the end\n", opt.core, seconds,
+           opt.core / seconds / 1e6, index.size());
+    printf("outcome      %u matched, %u duplicate, %u expired, %u full\n", stats.matched, stats.duplicates, stats.expired,
+           stats.full);
+    printPercentiles("offer", offerNs, 1000.0, "us");
+    return 0;
+}
+
+static void onSignal(int) {
+    stopping = true;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--binary")) opt.binary = true;
+        else if (!hasValue) break;
+        else if (!strcmp(argv[i], "--host")) opt.host = argv[++i];
+        else if (!strcmp(argv[i], "--port")) opt.port = (uint16_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--event")) opt.eventId = argv[++i];
+        else if (!strcmp(argv[i], "--window-ms")) opt.windowMs = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--capacity")) opt.capacity = (uint32_t)std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--qos")) opt.qos = (uint8_t)std::min(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--stats-interval")) opt.statsIntervalS = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--drive")) opt.driveRate = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--duration")) opt.durationS = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--skew-ms")) opt.skewMs = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--replays")) opt.replays = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--orphans")) opt.orphans = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--core")) opt.core = (uint32_t)atoi(argv[++i]);
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    snprintf(eventPrefix, sizeof(eventPrefix), "event/%s/", opt.eventId);
+    joinTopic(claimTopic, sizeof(claimTopic), {eventPrefix, "profile_swap"});
+
+    if (opt.core > 0) {
+        return runCore();
+    }
+    return opt.driveRate > 0 ? runDriver() : runMatcher();
+}
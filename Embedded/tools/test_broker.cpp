@@ -0,0 +1,59 @@
+/**
+ * Local MQTT 5 broker for the host tools and tests, for machines without mosquitto.
+ *
+ *   pio run -e native_test_broker && .pio/build/native_test_broker/program --port 1883 &
+ *   .pio/build/native_mqtt_bench/program --port 1883
+ *
+ * Covers the subset in tools/TestBroker.h. Prints its counters every --stats seconds.
+ *
+ * Options:
+ *   --port P            listen on 127.0.0.1:P (default 1883)
+ *   --stats S           seconds between counter lines, 0 for none (default 0)
+ */
+#include "TestBroker.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int) {
+    stopping = 1;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = 1883;
+    uint32_t statsS = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--port")) port = (uint16_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--stats")) statsS = (uint32_t)atoi(argv[i + 1]);
+    }
+
+    TestBroker broker;
+    if (!broker.begin(port)) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%u\n", port);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("listening on 127.0.0.1:%u\n", broker.port());
+    fflush(stdout);
+
+    time_t lastStats = time(nullptr);
+    while (!stopping) {
+        broker.poll(100);
+        if (statsS && time(nullptr) - lastStats >= (time_t)statsS) {
+            lastStats = time(nullptr);
+            TestBrokerStats stats = broker.stats();
+            printf("connections %zu  connects %llu  in %llu  out %llu  dropped %llu\n", broker.connections(),
+                   (unsigned long long)stats.connects, (unsigned long long)stats.messagesIn,
+                   (unsigned long long)stats.messagesOut, (unsigned long long)stats.dropped);
+            fflush(stdout);
+        }
+    }
+    broker.end();
+    return 0;
+}
@@ -0,0 +1,187 @@
+"""
+Receive field IMU captures published by badges built with IMU_CAPTURE=1 and
+write them as CSVs in the TensorFlow/Data layout (one folder per label).
+
+Captures are labelled by the badge's own prediction, so they are written to
+a separate tree (default ./TensorFlow/FieldData) to be reviewed and moved into
+./TensorFlow/Data by hand. The chunk format is documented in
+Embedded/include/ImuCapture.h.
+
+    python TensorFlow/captureReceiver.py --host <cluster>.hivemq.cloud --username u --password p --event E_01
+"""
+import argparse
+import csv
+import os
+import ssl
+import struct
+import time
+from datetime import datetime
+
+VERSION = 0xC1
+HEADER = struct.Struct('<BIHBBBBBHHBB')
+CHANNEL_HEADER = struct.Struct('<hB')
+# Sensor LSBs used by the badge: linear acceleration 0.01 m/s^2, gyro 1/16 dps
+SCALES = [100.0, 100.0, 100.0, 16.0, 16.0, 16.0]
+COLUMNS = ['lin_acc_x', 'lin_acc_y', 'lin_acc_z', 'gyro_x', 'gyro_y', 'gyro_z']
+CLASSES = ['dancing', 'dapup', 'fistbump', 'flapping', 'handshake', 'highfive',
+           'scratch', 'speedwalking', 'still', 'stretch', 'walking', 'waving']
+TRIGGERS = {1: 'positive', 2: 'near_miss'}
+# Incomplete captures are abandoned after this long without a new chunk
+STALE_SECONDS = 60
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decodeChunk(payload):
+    """Return (header dict, samples as a list of rows of raw ints) or raise ValueError."""
+    if len(payload) < HEADER.size:
+        raise ValueError("chunk too short")
+    (version, sequence, captureId, chunkIndex, chunkCount, trigger, predictedClass, score,
+     triggerSample, firstSample, count, channels) = HEADER.unpack_from(payload)
+    if version != VERSION or channels != len(COLUMNS) or count == 0 or chunkIndex >= chunkCount:
+        raise ValueError("unsupported chunk")
+
+    offset = HEADER.size
+    columns = []
+    for _ in range(channels):
+        if offset + CHANNEL_HEADER.size > len(payload):
+            raise ValueError("truncated channel header")
+        value, bits = CHANNEL_HEADER.unpack_from(payload, offset)
+        offset += CHANNEL_HEADER.size
+        packedLength = (bits * (count - 1) + 7) // 8
+        if bits > 17 or offset + packedLength > len(payload):
+            raise ValueError("truncated channel data")
+        packed = int.from_bytes(payload[offset:offset + packedLength], 'little')
+        offset += packedLength
+
+        column = [value]
+        mask = (1 << bits) - 1
+        for i in range(count - 1):
+            value += unzigzag((packed >> (i * bits)) & mask) if bits else 0
+            column.append(value)
+        columns.append(column)
+    if offset != len(payload):
+        raise ValueError("trailing bytes")
+
+    header = {
+        'sequence': sequence, 'captureId': captureId, 'chunkIndex': chunkIndex, 'chunkCount': chunkCount,
+        'trigger': trigger, 'predictedClass': predictedClass, 'score': score,
+        'triggerSample': triggerSample, 'firstSample': firstSample, 'count': count,
+    }
+    return header, [list(row) for row in zip(*columns)]
+
+
+def labelFor(header):
+    predicted = CLASSES[header['predictedClass']] if header['predictedClass'] < len(CLASSES) else 'unknown'
+    trigger = TRIGGERS.get(header['trigger'], 'unknown')
+    return predicted if trigger == 'positive' else f"{predicted}_{trigger}"
+
+
+def writeCapture(folder, device, header, samples):
+    label = labelFor(header)
+    path = os.path.join(folder, label)
+    os.makedirs(path, exist_ok=True)
+
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    device = device.replace(':', '')
+    filename = os.path.join(path, f"{label}_{timestamp}_{device}_{header['captureId']}_{len(samples)}.csv")
+    with open(filename, mode='w', newline='') as file:
+        writer = csv.writer(file)
+        writer.writerow(COLUMNS)
+        for row in samples:
+            writer.writerow([round(value / scale, 4) for value, scale in zip(row, SCALES)])
+    return filename
+
+
+class CaptureAssembler:
+    """Reassembles chunks per badge and capture, and tracks sequence gaps."""
+
+    def __init__(self, folder):
+        self.folder = folder
+        self.pending = {}
+        self.lastSequence = {}
+        self.lostChunks = 0
+        self.written = 0
+
+    def add(self, device, payload):
+        try:
+            header, samples = decodeChunk(payload)
+        except ValueError as e:
+            print(f"[{device}] Dropped chunk: {e}")
+            return None
+
+        last = self.lastSequence.get(device)
+        if last is not None and header['sequence'] > last + 1:
+            self.lostChunks += header['sequence'] - last - 1
+            print(f"[{device}] {header['sequence'] - last - 1} chunk(s) lost before #{header['sequence']}")
+        if last is None or header['sequence'] > last:
+            self.lastSequence[device] = header['sequence']
+
+        key = (device, header['captureId'])
+        capture = self.pending.setdefault(key, {'header': header, 'chunks': {}, 'updated': time.time()})
+        capture['chunks'][header['chunkIndex']] = (header['firstSample'], samples)
+        capture['updated'] = time.time()
+
+        filename = None
+        if len(capture['chunks']) == header['chunkCount']:
+            rows = []
+            for _, (_, chunk) in sorted(capture['chunks'].items(), key=lambda item: item[1][0]):
+                rows.extend(chunk)
+            filename = writeCapture(self.folder, device, capture['header'], rows)
+            self.written += 1
+            del self.pending[key]
+            print(f"[{device}] Saved {filename}")
+
+        self.expire()
+        return filename
+
+    def expire(self):
+        now = time.time()
+        for key in [key for key, capture in self.pending.items() if now - capture['updated'] > STALE_SECONDS]:
+            capture = self.pending.pop(key)
+            print(f"[{key[0]}] Capture {key[1]} incomplete ({len(capture['chunks'])}/{capture['header']['chunkCount']} chunks), dropped")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write badge IMU captures into the TensorFlow/Data CSV format")
+    parser.add_argument('--host', required=True)
+    parser.add_argument('--port', type=int, default=8883)
+    parser.add_argument('--username')
+    parser.add_argument('--password')
+    parser.add_argument('--event', default='+', help="event id to listen to, default all")
+    parser.add_argument('--out', default='./TensorFlow/FieldData')
+    parser.add_argument('--insecure', action='store_true', help="plain TCP instead of TLS")
+    args = parser.parse_args()
+
+    import paho.mqtt.client as mqtt
+
+    assembler = CaptureAssembler(args.out)
+    topic = f"event/{args.event}/capture/+"
+
+    def onConnect(client, userdata, flags, reasonCode, properties=None):
+        print(f"Connected ({reasonCode}), subscribing to {topic}")
+        client.subscribe(topic, qos=0)
+
+    def onMessage(client, userdata, message):
+        assembler.add(message.topic.rsplit('/', 1)[-1], message.payload)
+
+    client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2) if hasattr(mqtt, 'CallbackAPIVersion') else mqtt.Client()
+    if args.username:
+        client.username_pw_set(args.username, args.password)
+    if not args.insecure:
+        client.tls_set(cert_reqs=ssl.CERT_REQUIRED)
+    client.on_connect = onConnect
+    client.on_message = onMessage
+    client.connect(args.host, args.port)
+
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        print(f"Saved {assembler.written} capture(s), {assembler.lostChunks} chunk(s) lost, "
+              f"{len(assembler.pending)} incomplete")
+
+
+if __name__ == "__main__":
+    main()